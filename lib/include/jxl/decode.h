@@ -105,12 +105,51 @@ JXL_EXPORT JxlDecoder* JxlDecoderCreate(const JxlMemoryManager* memory_manager);
 /**
  * Re-initializes a JxlDecoder instance, so it can be re-used for decoding
  * another image. All state and settings are reset as if the object was
- * newly created with JxlDecoderCreate, but the memory manager is kept.
+ * newly created with JxlDecoderCreate, but the memory manager is kept, and so
+ * is the setting of JxlDecoderSetReuseAllocations.
  *
  * @param dec instance to be re-initialized.
  */
 JXL_EXPORT void JxlDecoderReset(JxlDecoder* dec);
 
+/**
+ * Rewinds decoder to the beginning. The same input must be given again from
+ * the beginning of the file and the decoder will emit events from the
+ * beginning again. Unlike JxlDecoderReset, the settings, such as the parallel
+ * runner and the subscribed events, are kept, and so is an index of the frames
+ * that were seen so far. This index lets JxlDecoderSkipFrames skip to a frame
+ * without parsing all the frames before it again.
+ *
+ * After rewinding, JxlDecoderSubscribeEvents can be used again, for example
+ * to leave out events that were already handled, such as JXL_DEC_BASIC_INFO.
+ *
+ * @param dec decoder object
+ */
+JXL_EXPORT void JxlDecoderRewind(JxlDecoder* dec);
+
+/**
+ * Makes the decoder skip the next @p amount displayed frames: no events are
+ * returned for them, and only the frames that the frame after them depends on
+ * through reference frames (blending sources, patches and DC frames), and the
+ * last frame saved to each reference slot, which later frames may use, are
+ * decoded to pixels. For an animation where frames rarely reference earlier
+ * ones, this makes getting frame N much faster than decoding all frames
+ * before it.
+ *
+ * The frames still need to be passed as input, and their headers are read to
+ * find the dependencies, which requires the input up to the frame that is
+ * skipped to. If the decoder already started processing a frame, that is,
+ * returned JXL_DEC_FRAME but not yet JXL_DEC_FULL_IMAGE for it, skipping
+ * starts from the next frame. Calling this again adds to the amount of frames
+ * to skip. Skipping past the last frame ends decoding.
+ *
+ * To seek to a frame before the current one, use JxlDecoderRewind first.
+ *
+ * @param dec decoder object
+ * @param amount the amount of displayed frames to skip
+ */
+JXL_EXPORT void JxlDecoderSkipFrames(JxlDecoder* dec, size_t amount);
+
 /**
  * Deinitializes and frees JxlDecoder instance.
  *
@@ -160,10 +199,20 @@ typedef enum {
 
   /** The decoder requests and output buffer to store the full resolution image,
    * which can be set with JxlDecoderSetImageOutBuffer. This event re-occurs for
-   * new frames if there are multiple animation frames.
+   * new frames if there are multiple animation frames. It occurs before the
+   * frame is decoded, so that the decoder can write the pixels to the buffer
+   * while decoding.
    */
   JXL_DEC_NEED_IMAGE_OUT_BUFFER = 5,
 
+  /** The JPEG reconstruction buffer is too small for the reconstructed JPEG
+   * codestream. Use JxlDecoderReleaseJPEGBuffer to get the amount of bytes
+   * that were not used, consume the bytes written so far, and set a new buffer
+   * with JxlDecoderSetJPEGBuffer to continue. This only happens if a JPEG
+   * reconstruction buffer was set with JxlDecoderSetJPEGBuffer.
+   */
+  JXL_DEC_JPEG_NEED_MORE_OUTPUT = 6,
+
   /** Informative event by JxlDecoderProcessInput: basic information such as
    * image dimensions and extra channels. This event occurs max once per image.
    */
@@ -222,6 +271,32 @@ typedef enum {
    * max once per frame and always later than JXL_DEC_DC_IMAGE.
    */
   JXL_DEC_FULL_IMAGE = 0x1000,
+
+  /** Informative event by JxlDecoderProcessInput: JPEG reconstruction data
+   * decoded. This event occurs max once per image, only if the image is a
+   * losslessly recompressed JPEG, and always later than
+   * JXL_DEC_COLOR_ENCODING and earlier than any pixel data.
+   * JxlDecoderSetJPEGBuffer may be used at this point: if it is, the
+   * original JPEG codestream is written to the JPEG reconstruction buffer
+   * instead of pixels to the image out buffer, during the
+   * JxlDecoderProcessInput call that returns JXL_DEC_FULL_IMAGE.
+   */
+  JXL_DEC_JPEG_RECONSTRUCTION = 0x2000,
+
+  /** Informative event by JxlDecoderProcessInput: a progressive pass of the
+   * frame is decoded, and the frame as decoded so far is written to the image
+   * out buffer. The image out buffer then contains a lower quality version of
+   * the frame, which is refined at the next passes. The AC of the frame is
+   * decoded one pass at a time to give this event after each of its passes but
+   * the last one, for which JXL_DEC_FULL_IMAGE occurs instead. This event
+   * occurs only for frames with several passes that form the still on their
+   * own, without crop or downsampling, and that can be rendered more than
+   * once, and only when JXL_DEC_FULL_IMAGE is subscribed to as well. When the
+   * pixels are output with JxlDecoderSetImageOutCallback, no pixels are
+   * output at this event. This event always occurs later than
+   * JXL_DEC_DC_IMAGE and earlier than JXL_DEC_FULL_IMAGE for the same frame.
+   */
+  JXL_DEC_FRAME_PROGRESSION = 0x4000,
 } JxlDecoderStatus;
 
 /**
@@ -317,6 +392,126 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderSubscribeEvents(JxlDecoder* dec,
 JXL_EXPORT JxlDecoderStatus
 JxlDecoderSetKeepOrientation(JxlDecoder* dec, JXL_BOOL keep_orientation);
 
+/**
+ * Enables or disables keeping the internal buffers of the decoder for the next
+ * image. By default, the buffers used to decode the frames to pixels are freed
+ * once the last frame is decoded, and by JxlDecoderReset and
+ * JxlDecoderRewind. When this option is enabled, they are kept instead, and
+ * decoding a next image with the same dimensions, after JxlDecoderReset or
+ * JxlDecoderRewind, uses them without allocating them again. This avoids the
+ * allocation overhead when decoding many images of the same size, at the cost
+ * of keeping the memory in use between images. Buffers that do not match the
+ * size of the next image are allocated again as usual.
+ *
+ * Unlike other settings, this one is kept by JxlDecoderReset. It may be
+ * changed at any time; disabling it frees the buffers at the next reset.
+ *
+ * @param dec decoder object
+ * @param reuse_allocations JXL_TRUE to enable, JXL_FALSE to disable.
+ * @return JXL_DEC_SUCCESS if no error, JXL_DEC_ERROR otherwise.
+ */
+JXL_EXPORT JxlDecoderStatus
+JxlDecoderSetReuseAllocations(JxlDecoder* dec, JXL_BOOL reuse_allocations);
+
+/**
+ * Enables or disables decoding of only a rectangular region of the image.
+ * When a crop is set, the full image output (see
+ * JxlDecoderSetImageOutBuffer) only contains the pixels of the region
+ * starting at (x0, y0) with size xsize * ysize, and the decoder skips the
+ * groups of the codestream that do not contribute to this region when the
+ * codestream allows it, so that decoding a small region of a large image
+ * is much faster than decoding all of it.
+ *
+ * The coordinates are those of the image as stored in the codestream, before
+ * orientation (see JxlDecoderSetKeepOrientation) is applied. The JxlBasicInfo
+ * keeps reporting the dimensions of the whole image.
+ *
+ * This may be called before starting, or at any time between frames, such as
+ * after the JXL_DEC_BASIC_INFO event, but not while a frame is being decoded
+ * or once the image out buffer for it is set. Setting a crop with xsize and
+ * ysize 0 disables cropping again.
+ *
+ * @param dec decoder object
+ * @param x0 left coordinate of the region
+ * @param y0 top coordinate of the region
+ * @param xsize width of the region
+ * @param ysize height of the region
+ * @return JXL_DEC_SUCCESS if no error, JXL_DEC_ERROR if the region is not
+ * inside the image, or when called while a frame is being decoded.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetCrop(JxlDecoder* dec, size_t x0,
+                                              size_t y0, size_t xsize,
+                                              size_t ysize);
+
+/**
+ * Sets the factor by which the full image output is downsampled in each
+ * dimension: the output image has dimensions ceil(xsize / downsampling) by
+ * ceil(ysize / downsampling), where xsize and ysize are those of the image, or
+ * of the crop if one is set with JxlDecoderSetCrop.
+ *
+ * The decoder only decodes the progressive passes of the codestream that are
+ * needed for this resolution. For downsampling 8, when possible, only the DC
+ * of the image is decoded and it is output directly, without rendering the
+ * image or allocating it at full resolution. The pixels are approximately, but
+ * not exactly, those obtained by downsampling the fully decoded image.
+ * Otherwise, and for downsampling 2 and 4, the image is still rendered at full
+ * resolution, then averaged over blocks of downsampling x downsampling pixels,
+ * but its loop filters, whose effect the averaging mostly removes, are skipped.
+ *
+ * This may be called before starting, or at any time between frames, such as
+ * after the JXL_DEC_BASIC_INFO event, but not while a frame is being decoded
+ * or once the image out buffer for it is set. The JxlBasicInfo keeps reporting
+ * the dimensions of the whole image.
+ *
+ * @param dec decoder object
+ * @param downsampling downsampling factor: 1 (the default), 2, 4 or 8.
+ * @return JXL_DEC_SUCCESS if no error, JXL_DEC_ERROR for an unsupported
+ * factor, or when called while a frame is being decoded.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetDownsampling(JxlDecoder* dec,
+                                                      uint32_t downsampling);
+
+/**
+ * Sets an upper limit on the memory that the decoder uses for the pixels of a
+ * frame. Before decoding the pixels of each frame, the decoder estimates the
+ * size of the buffers it needs to hold them, and fails with JXL_DEC_ERROR
+ * instead of allocating them if it exceeds max_bytes. The image out buffer,
+ * which is owned by the caller, is not counted.
+ *
+ * Most frames are held whole while they are decoded, as 3 floating point
+ * planes padded for the loop filters, so the memory they need grows with the
+ * width times the height of the frame.
+ *
+ * The frames that are written directly to an 8-bit RGB or RGBA image out
+ * buffer need less memory than others: the rows coming out of the loop filters
+ * are converted right away, so the decoder does not keep a second, filtered
+ * floating point copy of the frame. This is the case when the buffer is set
+ * with JxlDecoderSetImageOutBuffer or JxlDecoderSetImageOutLayout, or the
+ * rows are passed to JxlDecoderSetImageOutCallback, with JXL_TYPE_UINT8
+ * samples, for an XYB encoded image without extra channels that has a single
+ * frame and is neither cropped, downsampled nor reoriented.
+ *
+ * If such a frame exceeds max_bytes, and is VarDCT encoded without chroma
+ * subsampling, as lossy images usually are, it is decoded in a band instead:
+ * its groups of 256x256 pixels are decoded and rendered one row of groups at a
+ * time, from top to bottom, and the decoder only holds the pixels of the row
+ * of groups being decoded and the last 16 rows of the one above it. The memory
+ * needed then grows with the width of the frame only. Such a frame is only
+ * decoded once all of its bytes are available, and is not flushed by
+ * JxlDecoderFlushImage.
+ *
+ * This may be called before starting, or at any time between frames, but not
+ * while a frame is being decoded. The limit is kept by JxlDecoderRewind.
+ *
+ * @param dec decoder object
+ * @param max_bytes maximum size in bytes of the buffers of a frame, or 0 for
+ * no limit (the default).
+ * @return JXL_DEC_SUCCESS if no error, JXL_DEC_ERROR when called while a frame
+ * is being decoded.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetMemoryLimit(JxlDecoder* dec,
+                                                     size_t max_bytes);
+
 /**
  * Decodes JPEG XL file using the available bytes. Requires input has been
  * set with JxlDecoderSetInput. After JxlDecoderProcessInput, input can
@@ -334,6 +529,10 @@ JxlDecoderSetKeepOrientation(JxlDecoder* dec, JXL_BOOL keep_orientation);
  * the return value is not JXL_DEC_ERROR or JXL_DEC_SUCCESS, the decoding
  * requires more JxlDecoderProcessInput calls to continue.
  *
+ * The decoder does not wait for a frame to be complete before decoding it:
+ * the groups of the frame are decoded as soon as their bytes are available,
+ * so that most of the decoding work is done while the input is being received.
+ *
  * @param dec decoder object
  * @return JXL_DEC_SUCCESS when decoding finished and all events handled.
  * @return JXL_DEC_ERROR when decoding failed, e.g. invalid codestream.
@@ -636,7 +835,9 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderSetDCOutBuffer(
 /**
  * Returns the minimum size in bytes of the image output pixel buffer for the
  * given format. This is the buffer for JxlDecoderSetImageOutBuffer. Requires
- * the basic image information is available in the decoder.
+ * the basic image information is available in the decoder. If a crop is set
+ * with JxlDecoderSetCrop, this is the size for the cropped region, and it
+ * takes the downsampling set with JxlDecoderSetDownsampling into account.
  *
  * @param dec decoder object
  * @param format format of pixelsformat of pixels.
@@ -664,6 +865,223 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderImageOutBufferSize(
 JXL_EXPORT JxlDecoderStatus JxlDecoderSetImageOutBuffer(
     JxlDecoder* dec, const JxlPixelFormat* format, void* buffer, size_t size);
 
+/**
+ * Function type for JxlDecoderSetImageOutCallback.
+ *
+ * The callback may be called simultaneously by different threads when using a
+ * threaded parallel runner, on different pixels.
+ *
+ * @param opaque optional user data, as given to JxlDecoderSetImageOutCallback.
+ * @param x horizontal position of leftmost pixel of the pixel data.
+ * @param y vertical position of the pixel data.
+ * @param num_pixels amount of pixels included in the pixel data, horizontally.
+ * This is not the same as xsize of the full image, it may be smaller.
+ * @param pixels pixel data as a horizontal stripe, in the format passed to
+ * JxlDecoderSetImageOutCallback. The memory is not owned by the user, and is
+ * only valid during the time the callback is running.
+ */
+typedef void (*JxlImageOutCallback)(void* opaque, size_t x, size_t y,
+                                    size_t num_pixels, const void* pixels);
+
+/**
+ * Sets pixel output callback. This is an alternative to
+ * JxlDecoderSetImageOutBuffer. It must be set when the
+ * JXL_DEC_NEED_IMAGE_OUT_BUFFER event occurs, and applies only for the current
+ * frame. Only one of
+ * JxlDecoderSetImageOutBuffer or JxlDecoderSetImageOutCallback may be used
+ * for the same frame, not both at the same time.
+ *
+ * The callback will be called multiple times, to receive the image
+ * data in small chunks. The callback receives a pointer to a horizontal
+ * stripe of pixel data, 1 pixel high, xsize pixels wide, called a scanline.
+ * The xsize here is not the same as the full image width, the scanline may be
+ * a partial section, and xsize may differ between calls. The user can then
+ * process and/or copy the partial scanline to an image buffer. The callback
+ * may be called simultaneously by different threads when using a threaded
+ * parallel runner, on different pixels.
+ *
+ * Each pixel will be visited exactly once by the different callback calls,
+ * at the latest during the JxlDecoderProcessInput call that returns
+ * JXL_DEC_FULL_IMAGE. These pixels are decoded to full detail, they are not
+ * part of a lower resolution or lower quality progressive pass, but the final
+ * pass. The frame cannot be flushed with JxlDecoderFlushImage.
+ *
+ * Since no image buffer of the size of the image is needed, this reduces the
+ * peak memory of decoding compared to JxlDecoderSetImageOutBuffer. For
+ * JXL_TYPE_UINT8 RGB or RGBA output of the same frames that
+ * JxlDecoderSetMemoryLimit describes as written directly, the decoder does not
+ * hold the rendered frame in floating point either: the rows are passed to the
+ * callback as soon as they are rendered, which may be during earlier
+ * JxlDecoderProcessInput calls, while the rest of the frame is still being
+ * decoded. Other frames are passed to the callback once fully rendered.
+ *
+ * @param dec decoder object
+ * @param format format of the pixels. Object owned by user and its contents
+ * are copied internally.
+ * @param callback the callback function receiving partial scanlines of pixel
+ * data.
+ * @param opaque optional user data, which will be passed on to the callback,
+ * may be NULL.
+ * @return JXL_DEC_SUCCESS on success, JXL_DEC_ERROR on error, such as
+ * JxlDecoderSetImageOutBuffer already set.
+ */
+JXL_EXPORT JxlDecoderStatus
+JxlDecoderSetImageOutCallback(JxlDecoder* dec, const JxlPixelFormat* format,
+                              JxlImageOutCallback callback, void* opaque);
+
+/**
+ * Memory layout of the output image for JxlDecoderSetImageOutLayout. Each
+ * channel of the pixels, in the order of JxlPixelFormat (gray or red, green
+ * and blue, then alpha), is described by the entry of the arrays with the same
+ * index. Entries beyond the num_channels of the format are ignored.
+ */
+typedef struct {
+  /** Location of the sample of the channel of the top-left pixel.
+   */
+  void* data[4];
+
+  /** Distance in bytes between the samples of the channel of two horizontally
+   * adjacent pixels. Must be at least the size of one sample.
+   */
+  size_t pixel_stride[4];
+
+  /** Distance in bytes between the samples of the channel of two vertically
+   * adjacent pixels.
+   */
+  size_t row_stride[4];
+} JxlImageOutLayout;
+
+/**
+ * Sets the memory to write the full resolution image to, as an alternative to
+ * JxlDecoderSetImageOutBuffer for when the pixels are not in a single tightly
+ * packed interleaved buffer. This allows, for example, rows with padding,
+ * channels in a different order, or the channels, or only the alpha channel,
+ * in separate planes. The image is written directly to the given memory, which
+ * is owned by the caller. It must be large enough to hold the pixels of the
+ * image with the dimensions used for JxlDecoderImageOutBufferSize. The
+ * endianness and data type of the samples are taken from format, the align
+ * field is ignored. It must be set when the JXL_DEC_NEED_IMAGE_OUT_BUFFER event
+ * occurs, and applies only for the current frame. Only one of
+ * JxlDecoderSetImageOutBuffer, JxlDecoderSetImageOutCallback or
+ * JxlDecoderSetImageOutLayout may be used for the same frame.
+ *
+ * @param dec decoder object
+ * @param format format of the pixels. Object owned by user and its contents
+ * are copied internally.
+ * @param layout location of each channel of the pixels. Object owned by user
+ * and its contents are copied internally.
+ * @return JXL_DEC_SUCCESS on success, JXL_DEC_ERROR on error, such as a
+ * missing channel.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetImageOutLayout(
+    JxlDecoder* dec, const JxlPixelFormat* format,
+    const JxlImageOutLayout* layout);
+
+/**
+ * Size of the planes of the image output with JxlDecoderSetYCbCrOutLayout, in
+ * the order Y, Cb, Cr. The chroma planes are smaller than the image if the
+ * image uses chroma subsampling, for example half the width and half the
+ * height of it, rounded up, for 4:2:0.
+ */
+typedef struct {
+  /** Width of each plane, in samples.
+   */
+  uint32_t xsize[3];
+
+  /** Height of each plane, in samples.
+   */
+  uint32_t ysize[3];
+} JxlYCbCrInfo;
+
+/**
+ * Outputs the size of the planes of the current image, if it can be output as
+ * planar YCbCr with JxlDecoderSetYCbCrOutLayout. This is the case for a
+ * losslessly recompressed JPEG, or another image whose frame is coded as
+ * YCbCr, when the frame is the only one of the image and no filters, features
+ * or extra channels are applied to it, and no crop or downsampling is
+ * requested. Can be used once the JXL_DEC_FRAME event occured, or when the
+ * JXL_DEC_NEED_IMAGE_OUT_BUFFER event occurs.
+ *
+ * @param dec decoder object
+ * @param info struct to copy the information into, or NULL to only check
+ * whether the image can be output as YCbCr.
+ * @return JXL_DEC_SUCCESS if the image can be output as YCbCr, JXL_DEC_ERROR
+ * otherwise.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderGetYCbCrInfo(const JxlDecoder* dec,
+                                                   JxlYCbCrInfo* info);
+
+/**
+ * Sets the memory to write the image to as planar 8-bit YCbCr, instead of
+ * converting it to RGB: the Y, Cb and Cr samples, as full-range JFIF values,
+ * are written to the planes of layout with index 0, 1 and 2 respectively, at
+ * the sizes given by JxlDecoderGetYCbCrInfo. The chroma planes are not
+ * upsampled, and the decoder only holds them at their subsampled size while
+ * decoding, in floating point, next to the full size Y plane. The orientation
+ * of the image is not applied, as if JxlDecoderSetKeepOrientation was used.
+ * This is only possible if JxlDecoderGetYCbCrInfo succeeds, and is used like
+ * JxlDecoderSetImageOutLayout, at the JXL_DEC_NEED_IMAGE_OUT_BUFFER event.
+ *
+ * @param dec decoder object
+ * @param layout location of each plane. Object owned by user and its contents
+ * are copied internally.
+ * @return JXL_DEC_SUCCESS on success, JXL_DEC_ERROR on error, such as an
+ * image that cannot be output as YCbCr.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetYCbCrOutLayout(
+    JxlDecoder* dec, const JxlImageOutLayout* layout);
+
+/**
+ * Writes the frame as decoded so far to the image out buffer, for example
+ * after JXL_DEC_NEED_MORE_INPUT when the rest of the input is not available
+ * yet. The parts of the frame whose data is missing are rendered from the data
+ * that is available, or upsampled from the DC. This is possible for the same
+ * frames as JXL_DEC_FRAME_PROGRESSION, once their DC and the global data of
+ * their AC are decoded, and when the image out buffer was set with
+ * JxlDecoderSetImageOutBuffer or JxlDecoderSetImageOutLayout. The decoding of
+ * the frame then continues as usual.
+ *
+ * @param dec decoder object
+ * @return JXL_DEC_SUCCESS if the image out buffer was written, JXL_DEC_ERROR
+ * if the current frame cannot be written, for example because not enough of
+ * it is decoded yet.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderFlushImage(JxlDecoder* dec);
+
+/**
+ * Sets the buffer to write the reconstructed JPEG codestream to, for a
+ * losslessly recompressed JPEG. This can be done after the
+ * JXL_DEC_JPEG_RECONSTRUCTION event occured, or after
+ * JXL_DEC_JPEG_NEED_MORE_OUTPUT to continue writing after the previous buffer
+ * was released with JxlDecoderReleaseJPEGBuffer.
+ *
+ * When a JPEG buffer is set, the frame is not decoded to pixels: its DCT
+ * coefficients are written out as the original JPEG instead, in the
+ * JxlDecoderProcessInput call that returns JXL_DEC_FULL_IMAGE. No image out
+ * buffer is needed then, and cropping and downsampling do not apply. The JPEG
+ * is written incrementally: if the buffer fills up, JxlDecoderProcessInput
+ * returns JXL_DEC_JPEG_NEED_MORE_OUTPUT, and only a small part of the JPEG
+ * is buffered internally until a next buffer is set.
+ *
+ * @param dec decoder object
+ * @param data pointer to next bytes to write to, owned by the caller.
+ * @param size amount of bytes that can be written to @p data.
+ * @return JXL_DEC_SUCCESS on success, JXL_DEC_ERROR if a JPEG buffer was
+ * already set and not released, or if there is no JPEG reconstruction data.
+ */
+JXL_EXPORT JxlDecoderStatus JxlDecoderSetJPEGBuffer(JxlDecoder* dec,
+                                                    uint8_t* data, size_t size);
+
+/**
+ * Releases the buffer set with JxlDecoderSetJPEGBuffer. The bytes of the
+ * buffer that were written to are the next part of the reconstructed JPEG.
+ *
+ * @param dec decoder object
+ * @return the amount of bytes at the end of the buffer that were not written
+ * to, or 0 if no buffer was set.
+ */
+JXL_EXPORT size_t JxlDecoderReleaseJPEGBuffer(JxlDecoder* dec);
+
 /* TODO(lode): add way to output extra channels */
 
 #if defined(__cplusplus) || defined(c_plusplus)
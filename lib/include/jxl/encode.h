@@ -184,6 +184,61 @@ JXL_EXPORT JxlEncoderStatus JxlEncoderAddImageFrame(
     const JxlEncoderOptions* options, const JxlPixelFormat* pixel_format,
     const void* buffer, size_t size);
 
+/**
+ * Planar YCbCr image for JxlEncoderAddYCbCrFrame, such as a frame output by a
+ * video decoder. The samples are full-range, as in JFIF, and the planes are in
+ * the order Y, Cb, Cr.
+ */
+typedef struct {
+  /** Horizontal and vertical sampling factors of each plane, 1 or 2, as in a
+   * JPEG. For example, 2, 1, 1 horizontally and vertically for 4:2:0, and
+   * 2, 1, 1 horizontally and 1, 1, 1 vertically for 4:2:2. A plane has the
+   * width of the image times its horizontal sampling factor divided by the
+   * largest one, rounded up, and likewise for its height.
+   */
+  uint32_t h_samp_factor[3];
+  uint32_t v_samp_factor[3];
+
+  /** Number of significant bits of the samples, from 8 to 16. The samples are
+   * uint8_t if this is 8, and native-endian uint16_t otherwise.
+   */
+  uint32_t bits_per_sample;
+
+  /** First sample of each plane.
+   */
+  const void* data[3];
+
+  /** Distance in bytes between the first samples of two consecutive rows of
+   * each plane.
+   */
+  size_t row_stride[3];
+} JxlYCbCrImage;
+
+/**
+ * Sets the planes to read the next image to encode from, as an alternative to
+ * JxlEncoderAddImageFrame for YCbCr input. The planes are encoded as they are,
+ * like the planes of a recompressed JPEG: the chroma planes keep their
+ * subsampling and nothing is converted to RGB. Samples with more than 8 bits
+ * are reduced to 8 bits. The image must use its original color profile, see
+ * JxlBasicInfo::uses_original_profile, must have no alpha channel, and cannot
+ * be encoded losslessly.
+ *
+ * The planes are quantized like a baseline JPEG, which then is recompressed
+ * losslessly, so the distance set with JxlEncoderOptionsSetDistance does not
+ * have its usual butteraugli meaning here: it scales the example quantization
+ * tables of Annex K of ITU-T T.81 linearly, where a distance of 1 uses the
+ * tables of libjpeg quality 90 (the Annex K tables times 0.2), 5 uses the
+ * Annex K tables as they are (libjpeg quality 50) and larger distances give
+ * coarser tables, with entries limited to 255.
+ *
+ * @param options set of encoder options to use when encoding the frame.
+ * @param image planes of the image. Object owned by the caller and the
+ * samples are copied internally.
+ * @return JXL_ENC_SUCCESS on success, JXL_ENC_ERROR on error
+ */
+JXL_EXPORT JxlEncoderStatus JxlEncoderAddYCbCrFrame(
+    const JxlEncoderOptions* options, const JxlYCbCrImage* image);
+
 /**
  * Declares that this encoder will not encode anything further.
  *
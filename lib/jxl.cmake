@@ -263,6 +263,8 @@ set(JPEGXL_INTERNAL_SOURCES_ENC
   jxl/enc_transforms.h
   jxl/enc_xyb.cc
   jxl/enc_xyb.h
+  jxl/enc_ycbcr.cc
+  jxl/enc_ycbcr.h
   jxl/encode.cc
   jxl/encode_internal.h
 )
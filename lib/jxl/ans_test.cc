@@ -15,23 +15,30 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <stdio.h>
+
 #include <random>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "lib/jxl/ans_params.h"
 #include "lib/jxl/aux_out_fwd.h"
+#include "lib/jxl/base/os_specific.h"
+#include "lib/jxl/base/padded_bytes.h"
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/dec_ans.h"
 #include "lib/jxl/dec_bit_reader.h"
+#include "lib/jxl/dec_huffman.h"
 #include "lib/jxl/enc_ans.h"
 #include "lib/jxl/enc_bit_writer.h"
+#include "lib/jxl/huffman_table.h"
 
 namespace jxl {
 namespace {
 
 void RoundtripTestcase(int n_histograms, int alphabet_size,
-                       const std::vector<Token>& input_values) {
+                       const std::vector<Token>& input_values,
+                       const HistogramParams& params = HistogramParams()) {
   constexpr uint16_t kMagic1 = 0x9e33;
   constexpr uint16_t kMagic2 = 0x8b04;
 
@@ -46,8 +53,8 @@ void RoundtripTestcase(int n_histograms, int alphabet_size,
   std::vector<std::vector<Token>> input_values_vec;
   input_values_vec.push_back(input_values);
 
-  BuildAndEncodeHistograms(HistogramParams(), n_histograms, input_values_vec,
-                           &codes, &context_map, &writer, 0, nullptr);
+  BuildAndEncodeHistograms(params, n_histograms, input_values_vec, &codes,
+                           &context_map, &writer, 0, nullptr);
   WriteTokens(input_values_vec[0], codes, context_map, &writer, 0, nullptr);
 
   // Magic bytes + padding
@@ -167,6 +174,62 @@ TEST(ANSTest, RandomUnbalancedStreamRoundtripBig) {
   RoundtripRandomUnbalancedStream(ANS_MAX_ALPHABET_SIZE);
 }
 
+TEST(ANSTest, PrefixCodeMultiSymbolRoundtrip) {
+  // Runs of the same context, some of which mostly contain short codes, mixed
+  // with values that need extra bits.
+  constexpr int kNumHistograms = 3;
+  std::mt19937_64 rng;
+  std::vector<Token> symbols;
+  while (symbols.size() < (1 << 16)) {
+    const int context =
+        std::uniform_int_distribution<>(0, kNumHistograms - 1)(rng);
+    const int run = std::uniform_int_distribution<>(1, 8)(rng);
+    for (int i = 0; i < run; i++) {
+      uint32_t value;
+      if (context == 0) {
+        value = std::bernoulli_distribution(0.8)(rng) ? 0 : 1;
+      } else if (context == 1) {
+        value = std::geometric_distribution<uint32_t>(0.1)(rng);
+      } else {
+        value = std::uniform_int_distribution<uint32_t>(0, 15)(rng);
+      }
+      symbols.emplace_back(context, value);
+    }
+  }
+  HistogramParams params;
+  params.force_huffman = true;
+  RoundtripTestcase(kNumHistograms, ANS_MAX_ALPHABET_SIZE, symbols, params);
+}
+
+TEST(ANSTest, HuffmanMultiTable) {
+  // Codes 0, 10, 110 and 111, read from the lowest bit.
+  const uint8_t code_lengths[4] = {1, 2, 3, 3};
+  uint16_t counts[16] = {0, 1, 1, 2};
+  std::vector<HuffmanCode> table(4 + 376);
+  ASSERT_NE(0u, BuildHuffmanTable(table.data(), kHuffmanTableBits,
+                                  code_lengths, 4, counts));
+  std::vector<HuffmanMultiCode> multi_table(1 << kHuffmanTableBits);
+  BuildHuffmanMultiTable(table.data(), kHuffmanTableBits, multi_table.data());
+  const HuffmanMultiCode& zeros = multi_table[0];
+  ASSERT_EQ(kHuffmanMaxMultiSymbols, zeros.num_symbols);
+  for (size_t i = 0; i < kHuffmanMaxMultiSymbols; i++) {
+    EXPECT_EQ(0, zeros.value[i]);
+    EXPECT_EQ(1, zeros.bits[i]);
+  }
+  // Two codes 111, then only 2 bits are left.
+  const HuffmanMultiCode& ones = multi_table[0xFF];
+  ASSERT_EQ(2, ones.num_symbols);
+  EXPECT_EQ(3, ones.value[0]);
+  EXPECT_EQ(3, ones.value[1]);
+  // 10, then 0, 0 and 110.
+  const HuffmanMultiCode& mixed = multi_table[0x31];
+  ASSERT_EQ(4, mixed.num_symbols);
+  EXPECT_EQ(1, mixed.value[0]);
+  EXPECT_EQ(0, mixed.value[1]);
+  EXPECT_EQ(0, mixed.value[2]);
+  EXPECT_EQ(2, mixed.value[3]);
+}
+
 TEST(ANSTest, UintConfigRoundtrip) {
   for (size_t log_alpha_size = 5; log_alpha_size <= 8; log_alpha_size++) {
     std::vector<HybridUintConfig> uint_config, uint_config_dec;
@@ -195,5 +258,112 @@ TEST(ANSTest, UintConfigRoundtrip) {
   }
 }
 
+TEST(ANSTest, UintLutMatchesConfig) {
+  std::mt19937_64 rng;
+  // Enough for all the extra bits of an alphabet.
+  PaddedBytes random_bits(1 << 12);
+  for (size_t i = 0; i < random_bits.size(); i++) {
+    random_bits[i] = std::uniform_int_distribution<>(0, 255)(rng);
+  }
+  size_t num_with_lut = 0;
+  size_t num_configs = 0;
+  for (size_t log_alpha_size = 5; log_alpha_size <= 8; log_alpha_size++) {
+    for (size_t i = 0; i <= log_alpha_size; i++) {
+      for (size_t j = 0; j <= i; j++) {
+        for (size_t k = 0; k <= i - j; k++) {
+          ANSCode code;
+          code.use_prefix_code = false;
+          code.log_alpha_size = log_alpha_size;
+          code.uint_config.emplace_back(i, j, k);
+          code.InitUintLut();
+          num_configs++;
+          if (code.uint_lut.empty()) continue;
+          num_with_lut++;
+          ASSERT_EQ(1u << log_alpha_size, code.uint_lut.size());
+          const Span<const uint8_t> span(random_bits);
+          BitReader br_lut(span);
+          BitReader br_config(span);
+          for (size_t token = 0; token < code.uint_lut.size(); token++) {
+            br_lut.Refill();
+            br_config.Refill();
+            const HybridUintLutEntry entry = code.uint_lut[token];
+            const size_t extra_bits = br_lut.ReadBits(entry.nbits);
+            EXPECT_EQ(ANSSymbolReader::ReadHybridUintConfig(
+                          code.uint_config[0], token, &br_config),
+                      entry.base | (extra_bits << entry.shift));
+            EXPECT_EQ(br_config.TotalBitsConsumed(),
+                      br_lut.TotalBitsConsumed());
+          }
+          EXPECT_TRUE(br_lut.Close());
+          EXPECT_TRUE(br_config.Close());
+        }
+      }
+    }
+  }
+  // Only configs with many extra bits for large tokens do without.
+  EXPECT_GT(num_with_lut, num_configs / 2);
+  ANSCode ac_code;
+  ac_code.use_prefix_code = false;
+  ac_code.log_alpha_size = 8;
+  ac_code.uint_config.emplace_back(4, 2, 0);
+  ac_code.InitUintLut();
+  EXPECT_FALSE(ac_code.uint_lut.empty());
+}
+
+// Decoding speed of the hybrid uints of a stream with the statistics of
+// VarDCT AC coefficients, with and without ReadHybridUintClusteredFast.
+TEST(ANSTest, DISABLED_HybridUintDecodeBenchmark) {
+  constexpr size_t kNumContexts = 64;
+  constexpr size_t kNumTokens = 1 << 22;
+  std::mt19937_64 rng;
+  std::vector<Token> tokens;
+  tokens.reserve(kNumTokens);
+  for (size_t i = 0; i < kNumTokens; i++) {
+    const size_t ctx =
+        std::uniform_int_distribution<size_t>(0, kNumContexts - 1)(rng);
+    // Mostly zeros and small magnitudes, more of them in the higher contexts.
+    std::geometric_distribution<uint32_t> magnitude(0.3 + 0.6 * ctx /
+                                                    kNumContexts);
+    const uint32_t m = magnitude(rng);
+    const uint32_t packed =
+        m == 0 ? 0 : 2 * m - (std::bernoulli_distribution(0.5)(rng) ? 1 : 0);
+    tokens.emplace_back(ctx, packed);
+  }
+  HistogramParams params(SpeedTier::kSquirrel, kNumContexts);
+  params.lz77_method = HistogramParams::LZ77Method::kNone;
+  BitWriter writer;
+  std::vector<uint8_t> context_map;
+  EntropyEncodingData codes;
+  std::vector<std::vector<Token>> tokens_vec = {tokens};
+  BuildAndEncodeHistograms(params, kNumContexts, tokens_vec, &codes,
+                           &context_map, &writer, 0, nullptr);
+  WriteTokens(tokens_vec[0], codes, context_map, &writer, 0, nullptr);
+  writer.ZeroPadToByte();
+
+  for (int fast = 0; fast < 2; fast++) {
+    BitReader br(writer.GetSpan());
+    std::vector<uint8_t> dec_context_map;
+    ANSCode decoded_codes;
+    ASSERT_TRUE(
+        DecodeHistograms(&br, kNumContexts, &decoded_codes, &dec_context_map));
+    ANSSymbolReader reader(&decoded_codes, &br);
+    ASSERT_TRUE(reader.HasFastPath());
+    size_t checksum = 0;
+    const double t0 = Now();
+    for (const Token& token : tokens) {
+      checksum += fast ? reader.ReadHybridUintClusteredFast(
+                             dec_context_map[token.context], &br)
+                       : reader.ReadHybridUint(token.context, &br,
+                                               dec_context_map);
+    }
+    const double elapsed = Now() - t0;
+    EXPECT_TRUE(reader.CheckANSFinalState());
+    EXPECT_TRUE(br.Close());
+    printf("%s: %.1f M tokens/s (checksum %zu)\n",
+           fast ? "fast path" : "generic", kNumTokens * 1e-6 / elapsed,
+           checksum);
+  }
+}
+
 }  // namespace
 }  // namespace jxl
@@ -60,6 +60,10 @@ void CacheAligned::PrintStats() {
          double(max_bytes_in_use.load(std::memory_order_relaxed)));
 }
 
+size_t CacheAligned::NumAllocations() {
+  return size_t(num_allocations.load(std::memory_order_relaxed));
+}
+
 size_t CacheAligned::NextOffset() {
   static std::atomic<uint32_t> next{0};
   constexpr uint32_t kGroups = CacheAligned::kAlias / CacheAligned::kAlignment;
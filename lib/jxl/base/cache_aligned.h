@@ -32,6 +32,9 @@ class CacheAligned {
  public:
   static void PrintStats();
 
+  // Returns the number of calls to Allocate so far, in all threads.
+  static size_t NumAllocations();
+
   static constexpr size_t kPointerSize = sizeof(void*);
   static constexpr size_t kCacheLineSize = 64;
   // To avoid RFOs, match L2 fill size (pairs of lines).
@@ -14,12 +14,15 @@
 
 #include "lib/jxl/blending.h"
 
+#include <utility>
+
 #include "lib/jxl/alpha.h"
 #include "lib/jxl/image_ops.h"
 
 namespace jxl {
 
-Status DoBlending(PassesDecoderState* dec_state, ImageBundle* foreground) {
+Status DoBlending(PassesDecoderState* dec_state, ImageBundle* foreground,
+                  bool reuse_background) {
   const PassesSharedState& state = *dec_state->shared;
   // No need to blend anything in this case.
   if (!(state.frame_header.frame_type == FrameType::kRegularFrame ||
@@ -114,8 +117,9 @@ Status DoBlending(PassesDecoderState* dec_state, ImageBundle* foreground) {
     return true;
   }
 
-  ImageBundle& bg = *state.reference_frames[info.source].frame;
-  if (bg.xsize() == 0 && bg.ysize() == 0) {
+  const ReferenceFrame& bg_frame = state.reference_frames[info.source];
+  ImageBundle& bg = *bg_frame.frame;
+  if (bg_frame.xsize() == 0 && bg_frame.ysize() == 0) {
     // there is no background, assume it to be all zeroes
     ImageBundle empty(foreground->metadata());
     Image3F color(image_xsize, image_ysize);
@@ -131,16 +135,16 @@ Status DoBlending(PassesDecoderState* dec_state, ImageBundle* foreground) {
       empty.SetExtraChannels(std::move(ec));
     }
     bg = std::move(empty);
-  } else if (state.reference_frames[info.source].ib_is_in_xyb == true) {
+  } else if (bg_frame.ib_is_in_xyb == true) {
     return JXL_FAILURE(
         "Trying to blend XYB reference frame %i and non-XYB frame",
         info.source);
   }
 
-  if (bg.xsize() != image_xsize || bg.ysize() != image_ysize ||
+  if (bg_frame.xsize() != image_xsize || bg_frame.ysize() != image_ysize ||
       bg.origin.x0 != 0 || bg.origin.y0 != 0) {
     return JXL_FAILURE("Trying to use a %zux%zu crop as a background",
-                       bg.xsize(), bg.ysize());
+                       bg_frame.xsize(), bg_frame.ysize());
   }
   if (state.metadata->m.xyb_encoded) {
     if (!state.metadata->m.color_encoding.IsSRGB() &&
@@ -171,9 +175,11 @@ Status DoBlending(PassesDecoderState* dec_state, ImageBundle* foreground) {
     }
   }
 
-  // TODO(veluca): optimize memory copies here if we end up saving on the same
-  // frame that we are reading from.
-  ImageBundle dest = bg.Copy();
+  // The background is only copied if it is still needed as is afterwards, or
+  // if it has to be expanded from its compact form anyway.
+  ImageBundle dest = reuse_background && !bg_frame.IsCompact()
+                         ? std::move(bg)
+                         : bg_frame.Copy();
   if (info.mode == BlendMode::kAdd) {
     for (int p = 0; p < 3; p++) {
       AddTo(overlap, foreground->color()->Plane(p), cropbox,
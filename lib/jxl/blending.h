@@ -19,7 +19,13 @@
 
 namespace jxl {
 
-Status DoBlending(PassesDecoderState* dec_state, ImageBundle* foreground);
+// Blends the decoded frame `foreground` onto its background reference frame
+// and replaces it with the resulting canvas; only the area that the frame
+// covers is written. If `reuse_background` is true, the background is moved
+// into the result instead of copied, and the caller must overwrite its
+// reference slot afterwards.
+Status DoBlending(PassesDecoderState* dec_state, ImageBundle* foreground,
+                  bool reuse_background);
 
 }
 
@@ -28,6 +28,9 @@
 #include <algorithm>
 #include <array>
 #include <atomic>
+#include <functional>
+#include <iterator>
+#include <list>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -59,13 +62,31 @@
 #define LIB_JXL_COLOR_MANAGEMENT_CC_
 
 namespace jxl {
+struct ColorSpaceTransform::Shared {
+  ~Shared();
+
 #if JPEGXL_ENABLE_SKCMS
-struct ColorSpaceTransform::SkcmsICC {
   // Parsed skcms_ICCProfiles retain pointers to the original data.
   PaddedBytes icc_src_, icc_dst_;
   skcms_ICCProfile profile_src_, profile_dst_;
+#else
+  // Created without the one-pixel cache, so that all threads can use it.
+  void* transform_ = nullptr;
+#endif
+
+  float intensity_target_;
+  bool skip_lcms_ = false;
+  ExtraTF preprocess_ = ExtraTF::kNone;
+  ExtraTF postprocess_ = ExtraTF::kNone;
+
+  // Set if both encodings are fully described by their fields. The CMS is
+  // then not used at all; instead, DoColorSpaceTransform applies preprocess_,
+  // matrix_ and postprocess_.
+  bool fast_path_ = false;
+  // Row-major; linear destination RGB from linear source RGB, including the
+  // PQ intensity scaling.
+  float matrix_[9];
 };
-#endif  // JPEGXL_ENABLE_SKCMS
 }  // namespace jxl
 
 #endif  // LIB_JXL_COLOR_MANAGEMENT_CC_
@@ -81,7 +102,7 @@ const size_t kX = 0;  // pixel index, multiplied by 3 for RGB
 // xform_src = UndoGammaCompression(buf_src).
 void BeforeTransform(ColorSpaceTransform* t, const float* buf_src,
                      float* xform_src) {
-  switch (t->preprocess_) {
+  switch (t->shared_->preprocess_) {
     case ExtraTF::kNone:
       JXL_DASSERT(false);  // unreachable
       break;
@@ -89,7 +110,7 @@ void BeforeTransform(ColorSpaceTransform* t, const float* buf_src,
     case ExtraTF::kPQ:
       // By default, PQ content has an intensity target of 10000, stored
       // exactly.
-      if (t->intensity_target_ == 10000.f) {
+      if (t->shared_->intensity_target_ == 10000.f) {
         for (size_t i = 0; i < t->buf_src_.xsize(); ++i) {
           xform_src[i] = static_cast<float>(
               TF_PQ().DisplayFromEncoded(static_cast<double>(buf_src[i])));
@@ -97,7 +118,7 @@ void BeforeTransform(ColorSpaceTransform* t, const float* buf_src,
       } else {
         // After the transform, 1 represents 10000 cd/m², but we want
         // `intensity_target` cd/m² to be 1 instead.
-        const double multiplier = 10000. / t->intensity_target_;
+        const double multiplier = 10000. / t->shared_->intensity_target_;
         for (size_t i = 0; i < t->buf_src_.xsize(); ++i) {
           xform_src[i] = static_cast<float>(
               multiplier *
@@ -141,12 +162,12 @@ void BeforeTransform(ColorSpaceTransform* t, const float* buf_src,
 
 // Applies gamma compression in-place.
 void AfterTransform(ColorSpaceTransform* t, float* JXL_RESTRICT buf_dst) {
-  switch (t->postprocess_) {
+  switch (t->shared_->postprocess_) {
     case ExtraTF::kNone:
       JXL_DASSERT(false);  // unreachable
       break;
     case ExtraTF::kPQ:
-      if (t->intensity_target_ == 10000.f) {
+      if (t->shared_->intensity_target_ == 10000.f) {
         for (size_t i = 0; i < t->buf_dst_.xsize(); ++i) {
           buf_dst[i] = static_cast<float>(
               TF_PQ().EncodedFromDisplay(static_cast<double>(buf_dst[i])));
@@ -154,7 +175,7 @@ void AfterTransform(ColorSpaceTransform* t, float* JXL_RESTRICT buf_dst) {
       } else {
         // Our PQ transform expects 1 to represent 10000 cd/m², but at this
         // point, it represents `intensity_target` cd/m² instead.
-        const double multiplier = t->intensity_target_ / 10000.;
+        const double multiplier = t->shared_->intensity_target_ / 10000.;
         for (size_t i = 0; i < t->buf_dst_.xsize(); ++i) {
           buf_dst[i] = static_cast<float>(TF_PQ().EncodedFromDisplay(
               static_cast<double>(multiplier * buf_dst[i])));
@@ -190,12 +211,117 @@ void AfterTransform(ColorSpaceTransform* t, float* JXL_RESTRICT buf_dst) {
   }
 }
 
+// PQ and HLG for FastColorSpaceTransform, one lane at a time. sRGB is
+// vectorized instead and linear needs no conversion.
+void ScalarDisplayFromEncoded(const ExtraTF tf, float* JXL_RESTRICT values,
+                              size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    const double e = static_cast<double>(values[i]);
+    values[i] = static_cast<float>(tf == ExtraTF::kPQ
+                                       ? TF_PQ().DisplayFromEncoded(e)
+                                       : TF_HLG().DisplayFromEncoded(e));
+  }
+}
+
+void ScalarEncodedFromDisplay(const ExtraTF tf, float* JXL_RESTRICT values,
+                              size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    const double d = static_cast<double>(values[i]);
+    values[i] = static_cast<float>(tf == ExtraTF::kPQ
+                                       ? TF_PQ().EncodedFromDisplay(d)
+                                       : TF_HLG().EncodedFromDisplay(d));
+  }
+}
+
+// Converts interleaved RGB between two encodings that are fully described by
+// their fields: undoes the source transfer function, applies the 3x3 matrix
+// and re-applies the destination transfer function. Pixels are deinterleaved
+// into one vector per channel so that all three steps are SIMD. In-place
+// conversion (buf_src == buf_dst) is allowed.
+void FastColorSpaceTransform(const ColorSpaceTransform::Shared& s,
+                             const float* buf_src, float* buf_dst,
+                             const size_t xsize) {
+  const HWY_FULL(float) df;
+  const size_t N = Lanes(df);
+  HWY_ALIGN float block[3 * hwy::kMaxVectorSize / sizeof(float)];
+  float* planes[3] = {block, block + N, block + 2 * N};
+  const bool scalar_pre =
+      s.preprocess_ == ExtraTF::kPQ || s.preprocess_ == ExtraTF::kHLG;
+  const bool scalar_post =
+      s.postprocess_ == ExtraTF::kPQ || s.postprocess_ == ExtraTF::kHLG;
+
+  const auto m00 = Set(df, s.matrix_[0]);
+  const auto m01 = Set(df, s.matrix_[1]);
+  const auto m02 = Set(df, s.matrix_[2]);
+  const auto m10 = Set(df, s.matrix_[3]);
+  const auto m11 = Set(df, s.matrix_[4]);
+  const auto m12 = Set(df, s.matrix_[5]);
+  const auto m20 = Set(df, s.matrix_[6]);
+  const auto m21 = Set(df, s.matrix_[7]);
+  const auto m22 = Set(df, s.matrix_[8]);
+
+  for (size_t x = 0; x < xsize; x += N) {
+    const size_t n = std::min(N, xsize - x);
+    const float* in = buf_src + 3 * x;
+    for (size_t i = 0; i < n; ++i) {
+      planes[0][i] = in[3 * i + 0];
+      planes[1][i] = in[3 * i + 1];
+      planes[2][i] = in[3 * i + 2];
+    }
+    for (size_t i = n; i < N; ++i) {
+      planes[0][i] = planes[1][i] = planes[2][i] = 0.0f;
+    }
+    if (scalar_pre) {
+      for (size_t c = 0; c < 3; ++c) {
+        ScalarDisplayFromEncoded(s.preprocess_, planes[c], n);
+      }
+    }
+
+    auto r = Load(df, planes[0]);
+    auto g = Load(df, planes[1]);
+    auto b = Load(df, planes[2]);
+    if (s.preprocess_ == ExtraTF::kSRGB) {
+      r = TF_SRGB().DisplayFromEncoded(r);
+      g = TF_SRGB().DisplayFromEncoded(g);
+      b = TF_SRGB().DisplayFromEncoded(b);
+    }
+    auto r2 = MulAdd(m02, b, MulAdd(m01, g, m00 * r));
+    auto g2 = MulAdd(m12, b, MulAdd(m11, g, m10 * r));
+    auto b2 = MulAdd(m22, b, MulAdd(m21, g, m20 * r));
+    if (s.postprocess_ == ExtraTF::kSRGB) {
+      r2 = TF_SRGB().EncodedFromDisplay(r2);
+      g2 = TF_SRGB().EncodedFromDisplay(g2);
+      b2 = TF_SRGB().EncodedFromDisplay(b2);
+    }
+    Store(r2, df, planes[0]);
+    Store(g2, df, planes[1]);
+    Store(b2, df, planes[2]);
+
+    if (scalar_post) {
+      for (size_t c = 0; c < 3; ++c) {
+        ScalarEncodedFromDisplay(s.postprocess_, planes[c], n);
+      }
+    }
+    float* out = buf_dst + 3 * x;
+    for (size_t i = 0; i < n; ++i) {
+      out[3 * i + 0] = planes[0][i];
+      out[3 * i + 1] = planes[1][i];
+      out[3 * i + 2] = planes[2][i];
+    }
+  }
+}
+
 void DoColorSpaceTransform(ColorSpaceTransform* t, const size_t thread,
                            const float* buf_src, float* buf_dst) {
   // No lock needed.
 
+  if (t->shared_->fast_path_) {
+    FastColorSpaceTransform(*t->shared_, buf_src, buf_dst, t->xsize_);
+    return;
+  }
+
   float* xform_src = const_cast<float*>(buf_src);  // Read-only.
-  if (t->preprocess_ != ExtraTF::kNone) {
+  if (t->shared_->preprocess_ != ExtraTF::kNone) {
     xform_src = t->buf_src_.Row(thread);  // Writable buffer.
     BeforeTransform(t, buf_src, xform_src);
   }
@@ -207,7 +333,7 @@ void DoColorSpaceTransform(ColorSpaceTransform* t, const size_t thread,
   const float in2 = xform_src[3 * kX + 2];
 #endif
 
-  if (t->skip_lcms_) {
+  if (t->shared_->skip_lcms_) {
     if (buf_dst != xform_src) {
       memcpy(buf_dst, xform_src, t->buf_dst_.xsize() * sizeof(*buf_dst));
     }  // else: in-place, no need to copy
@@ -215,22 +341,21 @@ void DoColorSpaceTransform(ColorSpaceTransform* t, const size_t thread,
 #if JPEGXL_ENABLE_SKCMS
     JXL_CHECK(skcms_Transform(
         xform_src, skcms_PixelFormat_RGB_fff, skcms_AlphaFormat_Opaque,
-        &t->skcms_icc_->profile_src_, buf_dst, skcms_PixelFormat_RGB_fff,
-        skcms_AlphaFormat_Opaque, &t->skcms_icc_->profile_dst_, t->xsize_));
+        &t->shared_->profile_src_, buf_dst, skcms_PixelFormat_RGB_fff,
+        skcms_AlphaFormat_Opaque, &t->shared_->profile_dst_, t->xsize_));
 #else  // JPEGXL_ENABLE_SKCMS
-    JXL_DASSERT(thread < t->transforms_.size());
-    cmsHTRANSFORM xform = t->transforms_[thread];
+    cmsHTRANSFORM xform = t->shared_->transform_;
     cmsDoTransform(xform, xform_src, buf_dst,
                    static_cast<cmsUInt32Number>(t->xsize_));
 #endif  // JPEGXL_ENABLE_SKCMS
   }
 #if JXL_CMS_VERBOSE >= 2
   printf("xform skip%d: %.4f %.4f %.4f (%p) -> (%p) %.4f %.4f %.4f\n",
-         t->skip_lcms_, in0, in1, in2, xform_src, buf_dst, buf_dst[3 * kX],
-         buf_dst[3 * kX + 1], buf_dst[3 * kX + 2]);
+         t->shared_->skip_lcms_, in0, in1, in2, xform_src, buf_dst,
+         buf_dst[3 * kX], buf_dst[3 * kX + 1], buf_dst[3 * kX + 2]);
 #endif
 
-  if (t->postprocess_ != ExtraTF::kNone) {
+  if (t->shared_->postprocess_ != ExtraTF::kNone) {
     AfterTransform(t, buf_dst);
   }
 }
@@ -1442,38 +1567,213 @@ void ColorEncoding::DecideIfWantICC() {
   want_icc_ = false;
 }
 
-ColorSpaceTransform::~ColorSpaceTransform() {
+ColorSpaceTransform::Shared::~Shared() {
 #if !JPEGXL_ENABLE_SKCMS
+  if (transform_ == nullptr) return;
   std::lock_guard<std::mutex> guard(lcms_mutex);
-  for (void* p : transforms_) {
-    TransformDeleter()(p);
-  }
+  TransformDeleter()(transform_);
 #endif
 }
 
-ColorSpaceTransform::ColorSpaceTransform()
-#if JPEGXL_ENABLE_SKCMS
-    : skcms_icc_(new SkcmsICC())
-#endif  // JPEGXL_ENABLE_SKCMS
-{
+namespace {
+
+// Maximum number of conversions kept in the cache. Each entry holds two parsed
+// profiles (or one lcms transform), i.e. at most a few hundred KiB.
+constexpr size_t kMaxCachedTransforms = 16;
+
+// Bounded, thread-safe cache of the shared state of the most recently used
+// conversions.
+class TransformCache {
+ public:
+  using SharedPtr = std::shared_ptr<const ColorSpaceTransform::Shared>;
+
+  SharedPtr Get(const std::string& key) {
+    const size_t hash = std::hash<std::string>()(key);
+    std::lock_guard<std::mutex> guard(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->hash == hash && it->key == key) {
+        // Move to the front, which holds the most recently used entry.
+        entries_.splice(entries_.begin(), entries_, it);
+        return it->shared;
+      }
+    }
+    return nullptr;
+  }
+
+  void Put(std::string key, SharedPtr shared) {
+    const size_t hash = std::hash<std::string>()(key);
+    // Destroyed after unlocking, because destroying an lcms transform takes
+    // lcms_mutex.
+    std::list<Entry> evicted;
+    std::lock_guard<std::mutex> guard(mutex_);
+    entries_.push_front(Entry{hash, std::move(key), std::move(shared)});
+    if (entries_.size() > kMaxCachedTransforms) {
+      evicted.splice(evicted.begin(), entries_, std::prev(entries_.end()));
+    }
+  }
+
+  void Clear() {
+    std::list<Entry> evicted;
+    std::lock_guard<std::mutex> guard(mutex_);
+    evicted.swap(entries_);
+  }
+
+ private:
+  struct Entry {
+    size_t hash;
+    std::string key;
+    SharedPtr shared;
+  };
+  std::mutex mutex_;
+  std::list<Entry> entries_;
+};
+
+TransformCache* GetTransformCache() {
+  // Never destroyed, so it can still be used while other statics are.
+  static TransformCache* cache = new TransformCache();
+  return cache;
 }
 
-Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
-                                 const ColorEncoding& c_dst,
-                                 float intensity_target, size_t xsize,
-                                 const size_t num_threads) {
+// Everything the shared state depends on. The ICC profiles alone could be
+// ambiguous if they were generated from encodings they cannot represent.
+std::string TransformCacheKey(const ColorEncoding& c_src,
+                              const ColorEncoding& c_dst,
+                              float intensity_target) {
+  std::string key = Description(c_src) + "|" + Description(c_dst) + "|" +
+                    std::to_string(intensity_target);
+  for (const ColorEncoding* c : {&c_src, &c_dst}) {
+    const PaddedBytes& icc = c->ICC();
+    key += "|" + std::to_string(icc.size()) + ":";
+    key.append(reinterpret_cast<const char*>(icc.data()), icc.size());
+  }
+  return key;
+}
+
+// Computes the matrix from linear RGB to XYZ, adapted to D50 with the Bradford
+// transform, as in the profiles created from the fields by MaybeCreateProfile.
+Status LinearRGBToXYZD50(const ColorEncoding& c, double m[9]) {
+  const CIExy w = c.GetWhitePoint();
+  if (w.y <= 0) return JXL_FAILURE("Invalid white point");
+  const PrimariesCIExy p = c.GetPrimaries();
+  if (p.r.y <= 0 || p.g.y <= 0 || p.b.y <= 0) {
+    return JXL_FAILURE("Invalid primaries");
+  }
+
+  // Columns are the XYZ of the primaries with Y = 1; scale them such that
+  // their sum is the white point.
+  const double primaries_XYZ[9] = {p.r.x / p.r.y,
+                                   p.g.x / p.g.y,
+                                   p.b.x / p.b.y,
+                                   1.0,
+                                   1.0,
+                                   1.0,
+                                   (1.0 - p.r.x - p.r.y) / p.r.y,
+                                   (1.0 - p.g.x - p.g.y) / p.g.y,
+                                   (1.0 - p.b.x - p.b.y) / p.b.y};
+  double inverse[9];
+  memcpy(inverse, primaries_XYZ, sizeof(inverse));
+  Inv3x3Matrix(inverse);
+  const double white_XYZ[3] = {w.x / w.y, 1.0, (1.0 - w.x - w.y) / w.y};
+  double scale[3];
+  MatMul(inverse, white_XYZ, 3, 3, 1, scale);
+  double XYZ_from_RGB[9];
+  for (size_t i = 0; i < 9; ++i) {
+    XYZ_from_RGB[i] = primaries_XYZ[i] * scale[i % 3];
+  }
+
+  static constexpr double kLMSFromXYZ[9] = {0.8951,  0.2664, -0.1614,
+                                            -0.7502, 1.7135, 0.0367,
+                                            0.0389,  -0.0685, 1.0296};
+  static constexpr double kWpD50XYZ[3] = {0.96420288, 1.0, 0.82490540};
+  double XYZ_from_LMS[9];
+  memcpy(XYZ_from_LMS, kLMSFromXYZ, sizeof(XYZ_from_LMS));
+  Inv3x3Matrix(XYZ_from_LMS);
+  double white_LMS[3], d50_LMS[3];
+  MatMul(kLMSFromXYZ, white_XYZ, 3, 3, 1, white_LMS);
+  MatMul(kLMSFromXYZ, kWpD50XYZ, 3, 3, 1, d50_LMS);
+  double adapted_LMS_from_XYZ[9];
+  for (size_t i = 0; i < 9; ++i) {
+    adapted_LMS_from_XYZ[i] =
+        kLMSFromXYZ[i] * d50_LMS[i / 3] / white_LMS[i / 3];
+  }
+  double adapt[9];
+  MatMul(XYZ_from_LMS, adapted_LMS_from_XYZ, 3, 3, 3, adapt);
+  MatMul(adapt, XYZ_from_RGB, 3, 3, 3, m);
+  for (size_t i = 0; i < 9; ++i) {
+    if (!std::isfinite(m[i])) return JXL_FAILURE("Degenerate primaries");
+  }
+  return true;
+}
+
+// Returns whether c can be converted by FastColorSpaceTransform.
+bool FastPathSupports(const ColorEncoding& c) {
+  if (c.GetColorSpace() != ColorSpace::kRGB || c.WantICC()) return false;
+  return c.tf.IsLinear() || c.tf.IsSRGB() || c.tf.IsPQ() || c.tf.IsHLG();
+}
+
+ExtraTF ExtraTFFor(const CustomTransferFunction& tf) {
+  if (tf.IsSRGB()) return ExtraTF::kSRGB;
+  if (tf.IsPQ()) return ExtraTF::kPQ;
+  if (tf.IsHLG()) return ExtraTF::kHLG;
+  return ExtraTF::kNone;
+}
+
+// Sets up the conversion without the CMS. Returns false (not an error) if the
+// CMS has to be used instead.
+bool InitFastPath(const ColorEncoding& c_src, const ColorEncoding& c_dst,
+                  float intensity_target, ColorSpaceTransform::Shared* t) {
+  if (!FastPathSupports(c_src) || !FastPathSupports(c_dst)) return false;
+  // Unlike the other intents, absolute colorimetric does not adapt the white
+  // point.
+  if (c_dst.rendering_intent == RenderingIntent::kAbsolute) return false;
+
+  double src_to_XYZ[9], dst_to_XYZ[9];
+  if (!LinearRGBToXYZD50(c_src, src_to_XYZ) ||
+      !LinearRGBToXYZD50(c_dst, dst_to_XYZ)) {
+    return false;
+  }
+  Inv3x3Matrix(dst_to_XYZ);
+  double matrix[9];
+  MatMul(dst_to_XYZ, src_to_XYZ, 3, 3, 3, matrix);
+
+  // As in BeforeTransform/AfterTransform: 1 represents 10000 cd/m² in PQ, but
+  // `intensity_target` cd/m² in linear light.
+  double scale = 1.0;
+  if (c_src.tf.IsPQ()) scale *= 10000. / intensity_target;
+  if (c_dst.tf.IsPQ()) scale *= intensity_target / 10000.;
+  for (size_t i = 0; i < 9; ++i) {
+    if (!std::isfinite(matrix[i] * scale)) return false;
+    t->matrix_[i] = static_cast<float>(matrix[i] * scale);
+  }
+
+  t->preprocess_ = ExtraTFFor(c_src.tf);
+  t->postprocess_ = ExtraTFFor(c_dst.tf);
+  t->fast_path_ = true;
+#if JXL_CMS_VERBOSE
+  printf("Fast path %s -> %s\n", Description(c_src).c_str(),
+         Description(c_dst).c_str());
+#endif
+  return true;
+}
+
+Status InitShared(const ColorEncoding& c_src, const ColorEncoding& c_dst,
+                  float intensity_target, ColorSpaceTransform::Shared* t) {
+  t->intensity_target_ = intensity_target;
+  if (!c_src.SameColorEncoding(c_dst) &&
+      InitFastPath(c_src, c_dst, intensity_target, t)) {
+    return true;
+  }
+
   std::lock_guard<std::mutex> guard(lcms_mutex);
 #if JXL_CMS_VERBOSE
   printf("%s -> %s\n", Description(c_src).c_str(), Description(c_dst).c_str());
 #endif
 
 #if JPEGXL_ENABLE_SKCMS
-  skcms_icc_->icc_src_ = c_src.ICC();
-  skcms_icc_->icc_dst_ = c_dst.ICC();
-  JXL_RETURN_IF_ERROR(
-      DecodeProfile(skcms_icc_->icc_src_, &skcms_icc_->profile_src_));
-  JXL_RETURN_IF_ERROR(
-      DecodeProfile(skcms_icc_->icc_dst_, &skcms_icc_->profile_dst_));
+  t->icc_src_ = c_src.ICC();
+  t->icc_dst_ = c_dst.ICC();
+  JXL_RETURN_IF_ERROR(DecodeProfile(t->icc_src_, &t->profile_src_));
+  JXL_RETURN_IF_ERROR(DecodeProfile(t->icc_dst_, &t->profile_dst_));
 #else  // JPEGXL_ENABLE_SKCMS
   const cmsContext context = GetContext();
   Profile profile_src, profile_dst;
@@ -1481,9 +1781,9 @@ Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
   JXL_RETURN_IF_ERROR(DecodeProfile(context, c_dst.ICC(), &profile_dst));
 #endif  // JPEGXL_ENABLE_SKCMS
 
-  skip_lcms_ = false;
+  t->skip_lcms_ = false;
   if (c_src.SameColorEncoding(c_dst)) {
-    skip_lcms_ = true;
+    t->skip_lcms_ = true;
 #if JXL_CMS_VERBOSE
     printf("Skip CMS\n");
 #endif
@@ -1494,7 +1794,7 @@ Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
   const bool dst_linear = c_dst.tf.IsLinear();
   if (((c_src.tf.IsPQ() || c_src.tf.IsHLG()) && dst_linear) ||
       ((c_dst.tf.IsPQ() || c_dst.tf.IsHLG()) && src_linear) ||
-      ((c_src.tf.IsPQ() != c_dst.tf.IsPQ()) && intensity_target_ != 10000) ||
+      ((c_src.tf.IsPQ() != c_dst.tf.IsPQ()) && intensity_target != 10000) ||
       (c_src.tf.IsSRGB() && dst_linear) || (c_dst.tf.IsSRGB() && src_linear)) {
     // Construct new profiles as if the data were already/still linear.
     ColorEncoding c_linear_src = c_src;
@@ -1518,29 +1818,30 @@ Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
         DecodeProfile(context, icc_dst, &new_dst)) {
 #endif  // JPEGXL_ENABLE_SKCMS
       if (c_src.SameColorSpace(c_dst)) {
-        skip_lcms_ = true;
+        t->skip_lcms_ = true;
       }
 #if JXL_CMS_VERBOSE
-      printf("Special linear <-> HLG/PQ/sRGB; skip=%d\n", skip_lcms_);
+      printf("Special linear <-> HLG/PQ/sRGB; skip=%d\n", t->skip_lcms_);
 #endif
 #if JPEGXL_ENABLE_SKCMS
-      skcms_icc_->icc_src_ = PaddedBytes();
-      skcms_icc_->profile_src_ = new_src;
-      skcms_icc_->icc_dst_ = PaddedBytes();
-      skcms_icc_->profile_dst_ = new_dst;
+      t->icc_src_ = PaddedBytes();
+      t->profile_src_ = new_src;
+      t->icc_dst_ = PaddedBytes();
+      t->profile_dst_ = new_dst;
 #else  // JPEGXL_ENABLE_SKCMS
       profile_src.swap(new_src);
       profile_dst.swap(new_dst);
 #endif  // JPEGXL_ENABLE_SKCMS
       if (!c_src.tf.IsLinear()) {
-        preprocess_ = c_src.tf.IsSRGB()
-                          ? ExtraTF::kSRGB
-                          : (c_src.tf.IsPQ() ? ExtraTF::kPQ : ExtraTF::kHLG);
+        t->preprocess_ = c_src.tf.IsSRGB()
+                             ? ExtraTF::kSRGB
+                             : (c_src.tf.IsPQ() ? ExtraTF::kPQ : ExtraTF::kHLG);
       }
       if (!c_dst.tf.IsLinear()) {
-        postprocess_ = c_dst.tf.IsSRGB()
-                           ? ExtraTF::kSRGB
-                           : (c_dst.tf.IsPQ() ? ExtraTF::kPQ : ExtraTF::kHLG);
+        t->postprocess_ =
+            c_dst.tf.IsSRGB()
+                ? ExtraTF::kSRGB
+                : (c_dst.tf.IsPQ() ? ExtraTF::kPQ : ExtraTF::kHLG);
       }
     } else {
       JXL_WARNING("Failed to create extra linear profiles");
@@ -1548,13 +1849,46 @@ Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
   }
 
 #if JPEGXL_ENABLE_SKCMS
-  if (!skcms_MakeUsableAsDestination(&skcms_icc_->profile_dst_)) {
+  if (!skcms_MakeUsableAsDestination(&t->profile_dst_)) {
     return JXL_FAILURE(
         "Failed to make %s usable as a color transform destination",
         Description(c_dst).c_str());
   }
 #endif  // JPEGXL_ENABLE_SKCMS
 
+#if !JPEGXL_ENABLE_SKCMS
+  // Type includes color space (XYZ vs RGB), so can be different.
+  const uint32_t type_src = Type32(c_src);
+  const uint32_t type_dst = Type32(c_dst);
+  const uint32_t intent = static_cast<uint32_t>(c_dst.rendering_intent);
+  // Float transforms do not use the one-pixel cache anyway; without it, the
+  // transform can be used by several threads at the same time.
+  const uint32_t flags = cmsFLAGS_BLACKPOINTCOMPENSATION |
+                         cmsFLAGS_HIGHRESPRECALC | cmsFLAGS_NOCACHE;
+  // NOTE: we're using the current thread's context and assuming all state
+  // modified by cmsDoTransform resides in the transform, not the context.
+  t->transform_ =
+      cmsCreateTransformTHR(context, profile_src.get(), type_src,
+                            profile_dst.get(), type_dst, intent, flags);
+  if (t->transform_ == nullptr) {
+    return JXL_FAILURE("Failed to create transform");
+  }
+#endif  // !JPEGXL_ENABLE_SKCMS
+  return true;
+}
+
+}  // namespace
+
+void ClearColorSpaceTransformCache() { GetTransformCache()->Clear(); }
+
+ColorSpaceTransform::~ColorSpaceTransform() = default;
+
+ColorSpaceTransform::ColorSpaceTransform() = default;
+
+Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
+                                 const ColorEncoding& c_dst,
+                                 float intensity_target, size_t xsize,
+                                 const size_t num_threads) {
   // Not including alpha channel (copied separately).
   const size_t channels_src = c_src.Channels();
   const size_t channels_dst = c_dst.Channels();
@@ -1563,25 +1897,15 @@ Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
   printf("Channels: %zu; Threads: %zu\n", channels_src, num_threads);
 #endif
 
-#if !JPEGXL_ENABLE_SKCMS
-  // Type includes color space (XYZ vs RGB), so can be different.
-  const uint32_t type_src = Type32(c_src);
-  const uint32_t type_dst = Type32(c_dst);
-  transforms_.clear();
-  for (size_t i = 0; i < num_threads; ++i) {
-    const uint32_t intent = static_cast<uint32_t>(c_dst.rendering_intent);
-    const uint32_t flags =
-        cmsFLAGS_BLACKPOINTCOMPENSATION | cmsFLAGS_HIGHRESPRECALC;
-    // NOTE: we're using the current thread's context and assuming all state
-    // modified by cmsDoTransform resides in the transform, not the context.
-    transforms_.emplace_back(cmsCreateTransformTHR(context, profile_src.get(),
-                                                   type_src, profile_dst.get(),
-                                                   type_dst, intent, flags));
-    if (transforms_.back() == nullptr) {
-      return JXL_FAILURE("Failed to create transform");
-    }
+  std::string key = TransformCacheKey(c_src, c_dst, intensity_target);
+  shared_ = GetTransformCache()->Get(key);
+  if (shared_ == nullptr) {
+    std::shared_ptr<Shared> shared = std::make_shared<Shared>();
+    JXL_RETURN_IF_ERROR(
+        InitShared(c_src, c_dst, intensity_target, shared.get()));
+    shared_ = shared;
+    GetTransformCache()->Put(std::move(key), shared_);
   }
-#endif  // !JPEGXL_ENABLE_SKCMS
 
   // Ideally LCMS would convert directly from External to Image3. However,
   // cmsDoTransformLineStride only accepts 32-bit BytesPerPlaneIn, whereas our
@@ -1600,7 +1924,6 @@ Status ColorSpaceTransform::Init(const ColorEncoding& c_src,
   buf_src_ = ImageF(xsize * channels_src, num_threads);
   buf_dst_ = ImageF(xsize * channels_dst, num_threads);
 #endif
-  intensity_target_ = intensity_target;
   xsize_ = xsize;
   return true;
 }
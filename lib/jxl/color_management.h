@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <memory>
 #include <vector>
 
 #include "lib/jxl/base/padded_bytes.h"
@@ -43,7 +44,7 @@ class ColorSpaceTransform {
   ColorSpaceTransform();
   ~ColorSpaceTransform();
 
-  // Cannot copy (transforms_ holds pointers).
+  // Cannot copy (the per-thread buffers are not meant to be shared).
   ColorSpaceTransform(const ColorSpaceTransform&) = delete;
   ColorSpaceTransform& operator=(const ColorSpaceTransform&) = delete;
 
@@ -51,6 +52,12 @@ class ColorSpaceTransform {
   // `intensity_target` is used for conversion to and from PQ, which is absolute
   // (1 always represents 10000 cd/m²) and thus needs scaling in linear space if
   // 1 is to represent another luminance level instead.
+  // The parsed profiles and CMS transform only depend on the two encodings and
+  // the intensity target; they are taken from a process-wide cache of recently
+  // used conversions if possible, so that only the buffers are allocated here.
+  // RGB encodings that are fully described by their fields (i.e. !WantICC())
+  // and use a linear, sRGB, PQ or HLG transfer function are converted without
+  // the CMS, using only a 3x3 matrix and the transfer functions.
   Status Init(const ColorEncoding& c_src, const ColorEncoding& c_dst,
               float intensity_target, size_t xsize, size_t num_threads);
 
@@ -58,23 +65,20 @@ class ColorSpaceTransform {
 
   float* BufDst(const size_t thread) { return buf_dst_.Row(thread); }
 
-#if JPEGXL_ENABLE_SKCMS
-  struct SkcmsICC;
-  std::unique_ptr<SkcmsICC> skcms_icc_;
-#else
-  // One per thread - cannot share because of caching.
-  std::vector<void*> transforms_;
-#endif
+  // Immutable once initialized, and shared by all the transforms between the
+  // same encodings.
+  struct Shared;
+  std::shared_ptr<const Shared> shared_;
 
   ImageF buf_src_;
   ImageF buf_dst_;
-  float intensity_target_;
   size_t xsize_;
-  bool skip_lcms_ = false;
-  ExtraTF preprocess_ = ExtraTF::kNone;
-  ExtraTF postprocess_ = ExtraTF::kNone;
 };
 
+// Drops the cached state of all the conversions that are not currently in use,
+// e.g. to measure the cost of initializing a ColorSpaceTransform.
+void ClearColorSpaceTransformCache();
+
 // buf_X can either be from BufX() or caller-allocated, interleaved storage.
 // `thread` must be less than the `num_threads` passed to Init.
 // `t` is non-const because buf_* may be modified.
@@ -27,7 +27,10 @@
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/file_io.h"
+#include "lib/jxl/base/os_specific.h"
 #include "lib/jxl/base/thread_pool_internal.h"
+#include "lib/jxl/image_bundle.h"
+#include "lib/jxl/image_ops.h"
 #include "lib/jxl/image_test_utils.h"
 #include "lib/jxl/test_utils.h"
 #include "lib/jxl/testdata.h"
@@ -241,5 +244,164 @@ TEST_F(ColorManagementTest, D2700ToSRGB) {
                           FloatNear(0.601, 1e-3)));
 }
 
+TEST_F(ColorManagementTest, TransformCacheSharesState) {
+  ColorEncoding c_p3 = ColorEncoding::SRGB();
+  c_p3.primaries = Primaries::kP3;
+  ASSERT_TRUE(c_p3.CreateICC());
+
+  ColorSpaceTransform a, b, c;
+  ASSERT_TRUE(a.Init(ColorEncoding::SRGB(), c_p3, kDefaultIntensityTarget,
+                     kWidth, 1));
+  ASSERT_TRUE(b.Init(ColorEncoding::SRGB(), c_p3, kDefaultIntensityTarget,
+                     2 * kWidth, 2));
+  ASSERT_TRUE(c.Init(c_p3, ColorEncoding::SRGB(), kDefaultIntensityTarget,
+                     kWidth, 1));
+  // Same conversion, any width and number of threads.
+  EXPECT_EQ(a.shared_, b.shared_);
+  EXPECT_NE(a.shared_, c.shared_);
+
+  ClearColorSpaceTransformCache();
+  ColorSpaceTransform d;
+  ASSERT_TRUE(d.Init(ColorEncoding::SRGB(), c_p3, kDefaultIntensityTarget,
+                     kWidth, 1));
+  EXPECT_NE(a.shared_, d.shared_);
+
+  // Cached and fresh state give the same results.
+  const float in[3 * kWidth] = {0.1f, 0.5f, 0.9f, 1.0f, 0.0f, 0.25f};
+  DoColorSpaceTransform(&a, 0, in, a.BufDst(0));
+  DoColorSpaceTransform(&d, 0, in, d.BufDst(0));
+  for (size_t i = 0; i < 3 * kWidth; i++) {
+    EXPECT_EQ(a.BufDst(0)[i], d.BufDst(0)[i]);
+  }
+}
+
+// Conversions between encodings described by their fields do not use the CMS;
+// an encoding that only has an ICC profile forces the CMS path.
+TEST_F(ColorManagementTest, FastPathMatchesCMS) {
+  const Globals& g = *Globals::GetInstance();
+  auto make = [](Primaries primaries, WhitePoint white_point,
+                 TransferFunction tf) {
+    ColorEncoding c;
+    c.SetColorSpace(ColorSpace::kRGB);
+    c.white_point = white_point;
+    c.primaries = primaries;
+    c.tf.SetTransferFunction(tf);
+    JXL_CHECK(c.CreateICC());
+    return c;
+  };
+  const ColorEncoding srgb = ColorEncoding::SRGB();
+  const ColorEncoding linear_srgb = ColorEncoding::LinearSRGB();
+  const ColorEncoding p3 =
+      make(Primaries::kP3, WhitePoint::kD65, TransferFunction::kSRGB);
+  const ColorEncoding dci_p3 =
+      make(Primaries::kP3, WhitePoint::kDCI, TransferFunction::kSRGB);
+  const ColorEncoding linear_2100 =
+      make(Primaries::k2100, WhitePoint::kD65, TransferFunction::kLinear);
+  const ColorEncoding pq_2100 =
+      make(Primaries::k2100, WhitePoint::kD65, TransferFunction::kPQ);
+  const ColorEncoding hlg_2100 =
+      make(Primaries::k2100, WhitePoint::kD65, TransferFunction::kHLG);
+  const std::pair<const ColorEncoding*, const ColorEncoding*> pairs[] = {
+      {&srgb, &p3},
+      {&p3, &srgb},
+      {&srgb, &dci_p3},
+      {&linear_srgb, &srgb},
+      {&srgb, &linear_srgb},
+      {&linear_2100, &pq_2100},
+      {&pq_2100, &srgb},
+      {&hlg_2100, &linear_2100},
+  };
+
+  for (const auto& pair : pairs) {
+    const ColorEncoding& c_src = *pair.first;
+    const ColorEncoding& c_dst = *pair.second;
+    ColorEncoding icc_src, icc_dst;
+    ASSERT_TRUE(icc_src.SetICC(PaddedBytes(c_src.ICC())));
+    ASSERT_TRUE(icc_dst.SetICC(PaddedBytes(c_dst.ICC())));
+
+    ColorSpaceTransform fast, cms;
+    ASSERT_TRUE(
+        fast.Init(c_src, c_dst, kDefaultIntensityTarget, kWidth, 1));
+    ASSERT_TRUE(
+        cms.Init(icc_src, icc_dst, kDefaultIntensityTarget, kWidth, 1));
+    const float* in = g.in_color.Row(0);
+    DoColorSpaceTransform(&fast, 0, in, fast.BufDst(0));
+    DoColorSpaceTransform(&cms, 0, in, cms.BufDst(0));
+    for (size_t i = 0; i < 3 * kWidth; ++i) {
+      EXPECT_NEAR(fast.BufDst(0)[i], cms.BufDst(0)[i], 2E-3)
+          << Description(c_src) << " -> " << Description(c_dst) << " at "
+          << i;
+    }
+  }
+}
+
+TEST_F(ColorManagementTest, DISABLED_FastPathBenchmark) {
+  ColorEncoding p3 = ColorEncoding::SRGB();
+  p3.primaries = Primaries::kP3;
+  ASSERT_TRUE(p3.CreateICC());
+  ColorEncoding pq_2100;
+  pq_2100.SetColorSpace(ColorSpace::kRGB);
+  pq_2100.white_point = WhitePoint::kD65;
+  pq_2100.primaries = Primaries::k2100;
+  pq_2100.tf.SetTransferFunction(TransferFunction::kPQ);
+  ASSERT_TRUE(pq_2100.CreateICC());
+  const ColorEncoding srgb = ColorEncoding::SRGB();
+
+  constexpr size_t kXsize = 1024;
+  constexpr size_t kRows = 2000;
+  ImageF in(3 * kXsize, 1);
+  for (size_t x = 0; x < 3 * kXsize; ++x) {
+    in.Row(0)[x] = (x % 256) / 255.0f;
+  }
+  const std::pair<const ColorEncoding*, const ColorEncoding*> pairs[] = {
+      {&srgb, &p3}, {&p3, &srgb}, {&srgb, &pq_2100}};
+  for (const auto& pair : pairs) {
+    for (int use_cms = 0; use_cms < 2; ++use_cms) {
+      ColorEncoding c_src = *pair.first;
+      ColorEncoding c_dst = *pair.second;
+      if (use_cms) {
+        ASSERT_TRUE(c_src.SetICC(PaddedBytes(pair.first->ICC())));
+        ASSERT_TRUE(c_dst.SetICC(PaddedBytes(pair.second->ICC())));
+      }
+      ColorSpaceTransform t;
+      ASSERT_TRUE(t.Init(c_src, c_dst, kDefaultIntensityTarget, kXsize, 1));
+      const double t0 = Now();
+      for (size_t y = 0; y < kRows; ++y) {
+        DoColorSpaceTransform(&t, 0, in.Row(0), t.BufDst(0));
+      }
+      const double elapsed = Now() - t0;
+      printf("%s -> %s %-4s %7.2f MP/s\n", Description(*pair.first).c_str(),
+             Description(*pair.second).c_str(), use_cms ? "CMS" : "fast",
+             kXsize * kRows * 1E-6 / elapsed);
+    }
+  }
+}
+
+TEST_F(ColorManagementTest, DISABLED_TransformSetupBenchmark) {
+  ColorEncoding c_p3 = ColorEncoding::SRGB();
+  c_p3.primaries = Primaries::kP3;
+  ASSERT_TRUE(c_p3.CreateICC());
+  ImageMetadata metadata;
+  metadata.color_encoding = ColorEncoding::SRGB();
+  constexpr size_t kReps = 1000;
+  for (size_t size : {16, 64, 256}) {
+    ImageBundle ib(&metadata);
+    Image3F image(size, size);
+    FillImage(0.5f, &image);
+    ib.SetFromImage(std::move(image), ColorEncoding::SRGB());
+    for (int cached = 0; cached < 2; cached++) {
+      Image3F out;
+      const double t0 = Now();
+      for (size_t i = 0; i < kReps; i++) {
+        if (!cached) ClearColorSpaceTransformCache();
+        ASSERT_TRUE(ib.CopyTo(Rect(ib), c_p3, &out));
+      }
+      const double elapsed = Now() - t0;
+      printf("%3zux%-3zu %-8s %8.2f us/image\n", size, size,
+             cached ? "cached" : "uncached", elapsed * 1e6 / kReps);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace jxl
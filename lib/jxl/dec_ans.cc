@@ -225,6 +225,7 @@ Status DecodeANSCodes(const size_t num_histograms,
           result->UpdateMaxNumBits(c, h.value);
         }
       }
+      result->huffman_data[c].InitMultiTable();
     }
   } else {
     JXL_ASSERT(max_alphabet_size <= ANS_MAX_ALPHABET_SIZE);
@@ -310,6 +311,39 @@ Status LZ77Params::VisitFields(Visitor* JXL_RESTRICT visitor) {
   return true;
 }
 
+void ANSCode::InitUintLut() {
+  uint_lut.clear();
+  if (use_prefix_code) return;
+  const size_t alphabet_size = 1 << log_alpha_size;
+  std::vector<HybridUintLutEntry> lut(uint_config.size() * alphabet_size);
+  for (size_t c = 0; c < uint_config.size(); c++) {
+    const HybridUintConfig& cfg = uint_config[c];
+    const size_t in_token = cfg.msb_in_token + cfg.lsb_in_token;
+    for (size_t token = 0; token < alphabet_size; token++) {
+      HybridUintLutEntry& entry = lut[c * alphabet_size + token];
+      if (token < cfg.split_token) {
+        entry = {static_cast<uint32_t>(token), 0, 0};
+        continue;
+      }
+      // Same as ANSSymbolReader::ReadHybridUintConfig.
+      const uint32_t nbits = (cfg.split_exponent - in_token +
+                              ((token - cfg.split_token) >> in_token)) &
+                             31u;
+      const uint64_t low = token & ((1 << cfg.lsb_in_token) - 1);
+      const uint64_t high = (1 << cfg.msb_in_token) |
+                            ((token >> cfg.lsb_in_token) &
+                             ((1 << cfg.msb_in_token) - 1));
+      const uint64_t base = (high << (nbits + cfg.lsb_in_token)) | low;
+      // Codes with tokens whose values do not fit in 32 bits are left to
+      // ReadHybridUintConfig.
+      if (base > UINT32_MAX) return;
+      entry = {static_cast<uint32_t>(base), static_cast<uint8_t>(nbits),
+               static_cast<uint8_t>(cfg.lsb_in_token)};
+    }
+  }
+  uint_lut = std::move(lut);
+}
+
 void ANSCode::UpdateMaxNumBits(size_t ctx, size_t symbol) {
   HybridUintConfig* cfg = &uint_config[ctx];
   // LZ77 symbols use a different uint config.
@@ -364,6 +398,7 @@ Status DecodeHistograms(BitReader* br, size_t num_contexts, ANSCode* code,
   if (!DecodeANSCodes(num_histograms, max_alphabet_size, br, code)) {
     return JXL_FAILURE("Histo DecodeANSCodes");
   }
+  code->InitUintLut();
   // When using LZ77, flat codes might result in valid codestreams with
   // histograms that potentially allow very large bit counts.
   // TODO(veluca): in principle, a valid codestream might contain a histogram
@@ -141,8 +141,20 @@ static constexpr int8_t kSpecialDistances[kNumSpecialDistances][2] = {
     {-6, 6}, {8, 3},  {5, 7},  {-5, 7}, {7, 5},  {-7, 5}, {8, 4},  {6, 7},
     {-6, 7}, {7, 6},  {-7, 6}, {8, 5},  {7, 7},  {-7, 7}, {8, 6},  {8, 7}};
 
+// Precomputed decoding of one hybrid uint token: its value is
+// `base | (extra_bits << shift)`, where `extra_bits` are the next `nbits` bits.
+struct HybridUintLutEntry {
+  uint32_t base;
+  uint8_t nbits;
+  uint8_t shift;
+};
+
 struct ANSCode {
   CacheAlignedUniquePtr alias_tables;
+  // For ANS codes, the entry of each token of each histogram, at index
+  // (histogram << log_alpha_size) + token. Empty for prefix codes, whose
+  // alphabets are too large, and if some token does not fit in an entry.
+  std::vector<HybridUintLutEntry> uint_lut;
   std::vector<HuffmanDecodingData> huffman_data;
   std::vector<HybridUintConfig> uint_config;
   std::vector<int> degenerate_symbols;
@@ -153,6 +165,8 @@ struct ANSCode {
   // ReadHybridUint call done with this ANSCode.
   size_t max_num_bits = 0;
   void UpdateMaxNumBits(size_t ctx, size_t symbol);
+  // Fills uint_lut from uint_config.
+  void InitUintLut();
 };
 
 class ANSSymbolReader {
@@ -165,7 +179,8 @@ class ANSSymbolReader {
             reinterpret_cast<AliasTable::Entry*>(code->alias_tables.get())),
         huffman_data_(code->huffman_data.data()),
         use_prefix_code_(code->use_prefix_code),
-        configs(code->uint_config.data()) {
+        configs(code->uint_config.data()),
+        uint_lut_(code->uint_lut.empty() ? nullptr : code->uint_lut.data()) {
     if (!use_prefix_code_) {
       state_ = static_cast<uint32_t>(br->ReadFixedBits<32>());
       log_alpha_size_ = code->log_alpha_size;
@@ -178,6 +193,7 @@ class ANSSymbolReader {
     // initialization.
     lz77_window_storage_ = AllocateArray(kWindowSize * sizeof(uint32_t));
     lz77_window_ = reinterpret_cast<uint32_t*>(lz77_window_storage_.get());
+    has_fast_path_ = uint_lut_ != nullptr && !code->lz77.enabled;
     if (!code->lz77.enabled) return;
     lz77_ctx_ = code->lz77.nonserialized_distance_context;
     lz77_length_uint_ = code->lz77.length_uint_config;
@@ -224,7 +240,32 @@ class ANSSymbolReader {
 
   JXL_INLINE size_t ReadSymbolHuffWithoutRefill(const size_t histo_idx,
                                                 BitReader* JXL_RESTRICT br) {
-    return huffman_data_[histo_idx].ReadSymbol(br);
+    // The symbols that the last multi-symbol lookup decoded after the one it
+    // returned are still valid if nothing else was read since.
+    if (multi_code_ != nullptr && histo_idx == multi_histo_ &&
+        br == multi_br_ && br->TotalBitsConsumed() == multi_position_) {
+      const size_t i = multi_next_++;
+      const size_t symbol = multi_code_->value[i];
+      br->Consume(multi_code_->bits[i]);
+      multi_position_ += multi_code_->bits[i];
+      if (multi_next_ == multi_code_->num_symbols) multi_code_ = nullptr;
+      return symbol;
+    }
+    const HuffmanDecodingData& data = huffman_data_[histo_idx];
+    if (!data.multi_table_.empty()) {
+      const HuffmanMultiCode* code =
+          &data.multi_table_[br->PeekBits(kHuffmanTableBits)];
+      if (code->num_symbols != 0) {
+        br->Consume(code->bits[0]);
+        multi_code_ = code->num_symbols > 1 ? code : nullptr;
+        multi_next_ = 1;
+        multi_histo_ = histo_idx;
+        multi_br_ = br;
+        multi_position_ = br->TotalBitsConsumed();
+        return code->value[0];
+      }
+    }
+    return data.ReadSymbol(br);
   }
 
   JXL_INLINE size_t ReadSymbolWithoutRefill(const size_t histo_idx,
@@ -276,6 +317,37 @@ class ANSSymbolReader {
     return ret;
   }
 
+  // Decodes `token`, read with the *clustered* context `ctx`.
+  JXL_INLINE size_t ReadHybridUintToken(size_t ctx, size_t token,
+                                        BitReader* JXL_RESTRICT br) {
+    if (JXL_UNLIKELY(uint_lut_ == nullptr)) {
+      return ReadHybridUintConfig(configs[ctx], token, br);
+    }
+    const HybridUintLutEntry entry =
+        uint_lut_[(ctx << log_alpha_size_) + token];
+    const size_t bits = br->PeekBits(entry.nbits);
+    br->Consume(entry.nbits);
+    return entry.base | (bits << entry.shift);
+  }
+
+  // Whether ReadHybridUintClusteredFast can be used: the code is an ANS code
+  // without LZ77, whose tokens are all decoded from uint_lut.
+  bool HasFastPath() const { return has_fast_path_; }
+
+  // Same as ReadHybridUintClustered, without the checks for prefix codes and
+  // LZ77. Requires HasFastPath().
+  JXL_INLINE size_t ReadHybridUintClusteredFast(size_t ctx,
+                                                BitReader* JXL_RESTRICT br) {
+    JXL_DASSERT(has_fast_path_);
+    br->Refill();  // covers ReadSymbolANSWithoutRefill + PeekBits
+    const size_t token = ReadSymbolANSWithoutRefill(ctx, br);
+    const HybridUintLutEntry entry =
+        uint_lut_[(ctx << log_alpha_size_) + token];
+    const size_t bits = br->PeekBits(entry.nbits);
+    br->Consume(entry.nbits);
+    return entry.base | (bits << entry.shift);
+  }
+
   // Takes a *clustered* idx.
   size_t ReadHybridUintClustered(size_t ctx, BitReader* JXL_RESTRICT br) {
     if (JXL_UNLIKELY(num_to_copy_ > 0)) {
@@ -313,7 +385,7 @@ class ANSSymbolReader {
       }
       return ReadHybridUintClustered(ctx, br);  // will trigger a copy.
     }
-    size_t ret = ReadHybridUintConfig(configs[ctx], token, br);
+    size_t ret = ReadHybridUintToken(ctx, token, br);
     lz77_window_[(num_decoded_++) & kWindowMask] = ret;
     return ret;
   }
@@ -348,6 +420,16 @@ class ANSSymbolReader {
   bool use_prefix_code_;
   uint32_t state_ = ANS_SIGNATURE << 16u;
   const HybridUintConfig* JXL_RESTRICT configs;
+  const HybridUintLutEntry* JXL_RESTRICT uint_lut_ = nullptr;  // not owned
+  // Pending symbols of the last multi-symbol lookup of a prefix code: those
+  // after multi_next_ in *multi_code_, decoded with histogram multi_histo_
+  // from the bits of multi_br_ at multi_position_.
+  const HuffmanMultiCode* multi_code_ = nullptr;
+  size_t multi_next_ = 0;
+  size_t multi_histo_ = 0;
+  const BitReader* multi_br_ = nullptr;
+  size_t multi_position_ = 0;
+  bool has_fast_path_ = false;
   uint32_t log_alpha_size_;
   uint32_t log_entry_size_;
   uint32_t entry_size_minus_1_;
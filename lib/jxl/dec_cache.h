@@ -16,7 +16,12 @@
 #define LIB_JXL_DEC_CACHE_H_
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
+
+#include <hwy/aligned_allocator.h>
 #include <hwy/base.h>  // HWY_ALIGN_MAX
 
 #include "lib/jxl/ac_strategy.h"
@@ -26,6 +31,7 @@
 #include "lib/jxl/convolve.h"
 #include "lib/jxl/dec_noise.h"
 #include "lib/jxl/dec_upsample.h"
+#include "lib/jxl/external_image.h"
 #include "lib/jxl/filters.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/passes_state.h"
@@ -33,6 +39,86 @@
 
 namespace jxl {
 
+// Rows above a row of groups that a banded frame keeps in `decoded` while the
+// groups are decoded: the loop filters across the border between two rows of
+// groups read up to 2 * LoopFilter::PaddingRows() rows above it.
+constexpr size_t kBandOverlapRows = 2 * kBlockDim;
+
+// Temp images required for decoding a single group. Reduces memory allocations
+// for large images because we only initialize min(#threads, #groups) instances.
+struct GroupDecCache {
+  GroupDecCache() = default;
+  GroupDecCache(const GroupDecCache&) = delete;
+  GroupDecCache& operator=(const GroupDecCache&) = delete;
+  ~GroupDecCache() { FreeQRows(); }
+
+  void InitOnce(size_t num_passes, size_t xsize_blocks, ACType type) {
+    PROFILER_FUNC;
+
+    for (size_t i = 0; i < num_passes; i++) {
+      if (num_nzeroes[i].xsize() == 0) {
+        // Allocate enough for a whole group - partial groups on the
+        // right/bottom border just use a subset. The valid size is passed via
+        // Rect.
+
+        num_nzeroes[i] = Image3I(kGroupDimInBlocks, kGroupDimInBlocks);
+      }
+    }
+
+    // The rows are kept for all following groups (and frames) that fit in
+    // them, instead of being allocated again for each group.
+    if (qrow_xsize_blocks_ >= xsize_blocks && qrow_type_ == type) return;
+    FreeQRows();
+    const size_t num_coeffs = 3 * AcStrategy::kMaxCoeffArea * xsize_blocks;
+    if (type == ACType::k16) {
+      dec_group_qrow16 = AllocateQRow<int16_t>(num_coeffs);
+      prev_dec_group_qrow16 = AllocateQRow<int16_t>(num_coeffs);
+    } else {
+      dec_group_qrow = AllocateQRow<int32_t>(num_coeffs);
+      prev_dec_group_qrow = AllocateQRow<int32_t>(num_coeffs);
+    }
+    qrow_xsize_blocks_ = xsize_blocks;
+    qrow_type_ = type;
+  }
+
+  // Scratch space used by DecGroupImpl().
+  // TODO(veluca): figure out if we can use unions here.
+  HWY_ALIGN_MAX float dec_group_block[3 * AcStrategy::kMaxCoeffArea];
+  HWY_ALIGN_MAX int32_t* dec_group_qrow = nullptr;
+  HWY_ALIGN_MAX int32_t* prev_dec_group_qrow = nullptr;
+  HWY_ALIGN_MAX int16_t* dec_group_qrow16 = nullptr;
+  HWY_ALIGN_MAX int16_t* prev_dec_group_qrow16 = nullptr;
+  // For TransformToPixels.
+  HWY_ALIGN_MAX float scratch_space[2 * AcStrategy::kMaxCoeffArea];
+
+  // AC decoding
+  Image3I num_nzeroes[kMaxNumPasses];
+
+ private:
+  template <typename T>
+  static T* AllocateQRow(size_t num_coeffs) {
+    return static_cast<T*>(
+        aligned_alloc(hwy::kMaxVectorSize, sizeof(T) * num_coeffs));
+  }
+
+  void FreeQRows() {
+    free(dec_group_qrow);
+    free(prev_dec_group_qrow);
+    free(dec_group_qrow16);
+    free(prev_dec_group_qrow16);
+    dec_group_qrow = prev_dec_group_qrow = nullptr;
+    dec_group_qrow16 = prev_dec_group_qrow16 = nullptr;
+    qrow_xsize_blocks_ = 0;
+  }
+
+  // Size in blocks of the currently allocated rows, 0 if there are none.
+  size_t qrow_xsize_blocks_ = 0;
+  ACType qrow_type_ = ACType::k32;
+};
+
+static_assert(sizeof(GroupDecCache) % hwy::kMaxVectorSize == 0,
+              "GroupDecCache must be aligned to vector size.");
+
 // Per-frame decoder state. All the images here should be accessed through a
 // group rect (either with block units or pixel units).
 struct PassesDecoderState {
@@ -46,9 +132,6 @@ struct PassesDecoderState {
   // DC upsampler
   Upsampler dc_upsampler;
 
-  // Storage for RNG output for noise synthesis.
-  Image3F noise;
-
   // Storage for pre-color-transform output for displayed
   // save_before_color_transform frames.
   Image3F pre_color_transform_frame;
@@ -63,12 +146,78 @@ struct PassesDecoderState {
 
   // Padded decoded image. This image has two blocks of padding on each left and
   // and right sides and xsize() rounded up to a block size, but it has no
-  // vertical padding.
+  // vertical padding. The chroma planes of a frame output as YCbCr only have
+  // the size of the subsampled planes, so rows of different planes must be
+  // accessed through Plane(c).
   Image3F decoded;
   size_t decoded_padding = kMaxFilterPadding;
 
+  // If true, which requires rgb_output_only and a VarDCT frame without chroma
+  // subsampling, the groups are decoded and rendered one row of groups at a
+  // time, from top to bottom, and `decoded` only holds a band of rows of the
+  // frame: the row of groups being decoded, and the last kBandOverlapRows rows
+  // of the one above it.
+  bool banded = false;
+  // Row of the frame held by the first row of `decoded`. Always 0 if the frame
+  // is not banded.
+  size_t decoded_y0 = 0;
+
+  // Region of the frame, in pixels, outside of which the pixels are not needed
+  // and may be left undecoded. Empty if the whole frame is rendered.
+  Rect render_rect;
+
+  // If num_rgb_output_channels is not 0, the color transform of an XYB frame
+  // writes its pixels as 8-bit sRGB to the first num_rgb_output_channels
+  // entries of rgb_output, instead of to the decoded image, which is left in
+  // XYB. A fourth channel is filled as opaque alpha.
+  ChannelOut rgb_output[4];
+  size_t num_rgb_output_channels = 0;
+
+  // If not null, the rows converted for rgb_output are interleaved into the
+  // callback_rows entry of the thread that renders them, and passed to this
+  // callback with rgb_output_opaque as soon as they are rendered, instead of
+  // being written to the data of rgb_output. Only the pixel_stride of the
+  // entries of rgb_output is used, and must be num_rgb_output_channels.
+  JxlImageOutCallback rgb_output_callback = nullptr;
+  void* rgb_output_opaque = nullptr;
+
+  // If true, which requires num_rgb_output_channels to be non-zero and the
+  // frame to have no extra channels, rgb_output is the only output of the
+  // frame: each row is rendered to the output_rows entry of the thread that
+  // renders it and written to rgb_output right away, and the decoded image of
+  // the frame is not allocated.
+  bool rgb_output_only = false;
+
+  // If true, the planes of a YCbCr frame are written as 8-bit samples to
+  // ycbcr_output, in the order Y, Cb, Cr, at the resolution at which they are
+  // coded: they are neither upsampled nor converted to RGB. The frame is not
+  // rendered otherwise: the decoded ImageBundle is not allocated, and the
+  // planes of `decoded` are only allocated at their subsampled size.
+  ChannelOut ycbcr_output[3];
+  bool ycbcr_output_only = false;
+
+  // If true, only the DC of the frame is decoded, and it is the whole output:
+  // neither the decoded image nor the filter state is allocated.
+  bool dc_only = false;
+
+  // One row of kApplyImageFeaturesTileDim pixels, with kMaxFilterPadding
+  // pixels of padding on each side, per thread. Only used if rgb_output_only.
+  std::vector<Image3F> output_rows;
+
+  // One interleaved row of kApplyImageFeaturesTileDim pixels of up to 4
+  // channels per thread. Only used if rgb_output_callback is set.
+  std::vector<ImageB> callback_rows;
+
+  // Per-thread storage for noise synthesis: the random noise of the rect that
+  // the thread renders, with a border of kNoiseBorder pixels, and one row of
+  // it after high-pass filtering. Allocated on first use.
+  std::vector<Image3F> raw_noise;
+  std::vector<Image3F> noise_rows;
+
   // Seed for noise, to have different noise per-frame.
   size_t noise_seed = 0;
+  // Seed of the first group of the current frame.
+  size_t frame_noise_seed = 0;
 
   // Storage for coefficients if in "accumulate" mode.
   std::unique_ptr<ACImage> coefficients = make_unique<ACImageT<int32_t>>(0, 0);
@@ -89,13 +238,84 @@ struct PassesDecoderState {
     if (filter_pipelines.size() < num_threads) {
       filter_pipelines.resize(num_threads);
     }
+    if (raw_noise.size() < num_threads) {
+      raw_noise.resize(num_threads);
+      noise_rows.resize(num_threads);
+    }
+    if (rgb_output_only) {
+      while (output_rows.size() < num_threads) {
+        output_rows.emplace_back(
+            kApplyImageFeaturesTileDim + 2 * kMaxFilterPadding, 1);
+      }
+    }
+    if (rgb_output_callback != nullptr) {
+      while (callback_rows.size() < num_threads) {
+        callback_rows.emplace_back(4 * kApplyImageFeaturesTileDim, 1);
+      }
+    }
+  }
+
+  // Scratch space for group decoding, one entry per thread. Kept across
+  // frames, and across images if the state is reused.
+  size_t group_dec_caches_size = 0;
+  hwy::AlignedUniquePtr<GroupDecCache[]> group_dec_caches;
+
+  // Ensures that there are at least num_threads entries in group_dec_caches.
+  void EnsureGroupDecCaches(size_t num_threads) {
+    if (num_threads > group_dec_caches_size) {
+      group_dec_caches_size = num_threads;
+      group_dec_caches =
+          hwy::MakeUniqueAlignedArray<GroupDecCache>(num_threads);
+    }
   }
 
   // Color encoding that will be used for output.
   ColorEncoding output_encoding;
 
+  // Drops the state that only applies to the frames of the current image, such
+  // as the reference frames, but keeps the allocated buffers, so that another
+  // image can be decoded with this state without allocating them again.
+  void ResetForNextImage() {
+    noise_seed = 0;
+    num_rgb_output_channels = 0;
+    rgb_output_callback = nullptr;
+    rgb_output_opaque = nullptr;
+    rgb_output_only = false;
+    ycbcr_output_only = false;
+    dc_only = false;
+    banded = false;
+    for (Image3F& dc_frame : shared_storage.dc_frames) {
+      dc_frame = Image3F();
+    }
+    for (ReferenceFrame& reference_frame : shared_storage.reference_frames) {
+      reference_frame.Reset();
+    }
+  }
+
+  // Number of rows of `decoded` for a frame of the given dimensions.
+  static size_t DecodedYSize(const FrameDimensions& frame_dim, bool banded) {
+    return banded ? std::min(frame_dim.ysize_padded,
+                             kGroupDim + kBandOverlapRows)
+                  : frame_dim.ysize_padded;
+  }
+
+  // Moves the band of a banded frame down, so that it starts at row y0 of the
+  // frame. The rows from y0 on that the band already holds are kept.
+  void MoveBand(size_t y0) {
+    JXL_DASSERT(banded && y0 > decoded_y0);
+    const size_t shift = y0 - decoded_y0;
+    for (size_t c = 0; c < 3; c++) {
+      ImageF& plane = decoded.Plane(c);
+      for (size_t y = shift; y < plane.ysize(); y++) {
+        memcpy(plane.Row(y - shift), plane.Row(y),
+               plane.xsize() * sizeof(float));
+      }
+    }
+    decoded_y0 = y0;
+  }
+
   // Initializes decoder-specific structures using information from *shared.
-  void Init(ThreadPool* pool) {
+  void Init() {
     x_dm_multiplier =
         std::pow(1 / (1.25f), shared->frame_header.x_qm_scale - 2.0f);
     b_dm_multiplier =
@@ -114,41 +334,42 @@ struct PassesDecoderState {
     }
 
     if (shared->frame_header.flags & FrameHeader::kNoise) {
-      noise = Image3F(shared->frame_dim.xsize_padded,
-                      shared->frame_dim.ysize_padded);
-      PROFILER_ZONE("GenerateNoise");
-      auto generate_noise = [&](int group_index, int _) {
-        RandomImage3(noise_seed + group_index,
-                     shared->PaddedGroupRect(group_index), &noise);
-      };
-      RunOnPool(pool, 0, shared->frame_dim.num_groups, ThreadPool::SkipInit(),
-                generate_noise, "Generate noise");
-      {
-        PROFILER_ZONE("High pass noise");
-        // 4 * (1 - box kernel)
-        WeightsSymmetric5 weights{{HWY_REP4(-3.84)}, {HWY_REP4(0.16)},
-                                  {HWY_REP4(0.16)},  {HWY_REP4(0.16)},
-                                  {HWY_REP4(0.16)},  {HWY_REP4(0.16)}};
-        // TODO(veluca): avoid copy.
-        // TODO(veluca): avoid having a full copy of the image in main memory.
-        ImageF noise_tmp(noise.xsize(), noise.ysize());
-        for (size_t c = 0; c < 3; c++) {
-          Symmetric5(noise.Plane(c), Rect(noise), weights, pool, &noise_tmp);
-          std::swap(noise.Plane(c), noise_tmp);
-        }
-        noise_seed += shared->frame_dim.num_groups;
-      }
+      // The noise itself is generated for each rect when it is rendered.
+      frame_noise_seed = noise_seed;
+      noise_seed += shared->frame_dim.num_groups;
+    }
+
+    if (dc_only) {
+      // Also drops the buffers kept from a previous image.
+      decoded = Image3F();
+      filter_weights.sigma = ImageF();
+      return;
     }
 
     // decoded must be padded to a multiple of kBlockDim rows since the last
     // rows may be used by the filters even if they are outside the frame
     // dimension.
-    decoded = Image3F(shared->frame_dim.xsize_padded + 2 * decoded_padding,
-                      shared->frame_dim.ysize_padded);
+    // It is only allocated again if the frame size changed.
+    // The planes output as YCbCr are never upsampled, so they only need the
+    // size of the subsampled planes.
+    const YCbCrChromaSubsampling& cs = shared->frame_header.chroma_subsampling;
+    decoded_y0 = 0;
+    for (size_t c = 0; c < 3; c++) {
+      const size_t hshift = ycbcr_output_only ? cs.HShift(c) : 0;
+      const size_t vshift = ycbcr_output_only ? cs.VShift(c) : 0;
+      const size_t decoded_xsize =
+          (shared->frame_dim.xsize_padded >> hshift) + 2 * decoded_padding;
+      const size_t decoded_ysize =
+          DecodedYSize(shared->frame_dim, banded) >> vshift;
+      ImageF& plane = decoded.Plane(c);
+      if (plane.xsize() != decoded_xsize || plane.ysize() != decoded_ysize) {
+        plane = ImageF(decoded_xsize, decoded_ysize);
+      }
 #if MEMORY_SANITIZER
-    // Avoid errors due to loading vectors on the outermost padding.
-    ZeroFillImage(&decoded);
+      // Avoid errors due to loading vectors on the outermost padding.
+      ZeroFillImage(&plane);
 #endif
+    }
     const LoopFilter& lf = shared->frame_header.loop_filter;
     filter_weights.Init(lf, shared->frame_dim);
     for (auto& fp : filter_pipelines) {
@@ -158,67 +379,6 @@ struct PassesDecoderState {
   }
 };
 
-// Temp images required for decoding a single group. Reduces memory allocations
-// for large images because we only initialize min(#threads, #groups) instances.
-struct GroupDecCache {
-  void InitOnce(size_t num_passes, size_t xsize_blocks,
-                ACType type) { // todo (@mkondratek): remove unused param
-    PROFILER_FUNC;
-
-    for (size_t i = 0; i < num_passes; i++) {
-      if (num_nzeroes[i].xsize() == 0) {
-        // Allocate enough for a whole group - partial groups on the
-        // right/bottom border just use a subset. The valid size is passed via
-        // Rect.
-
-        num_nzeroes[i] = Image3I(kGroupDimInBlocks, kGroupDimInBlocks);
-      }
-    }
-
-    if (type == ACType::k16) {
-      dec_group_qrow16 =
-          (int16_t*)aligned_alloc(hwy::kMaxVectorSize,
-              sizeof(int16_t) * 3 * AcStrategy::kMaxCoeffArea * xsize_blocks);
-      prev_dec_group_qrow16 =
-          (int16_t*)aligned_alloc(hwy::kMaxVectorSize,
-              sizeof(int16_t) * 3 * AcStrategy::kMaxCoeffArea * xsize_blocks);
-    } else {
-      dec_group_qrow =
-          (int32_t*)aligned_alloc(hwy::kMaxVectorSize,
-              sizeof(int32_t) * 3 * AcStrategy::kMaxCoeffArea * xsize_blocks);
-      prev_dec_group_qrow =
-          (int32_t*)aligned_alloc(hwy::kMaxVectorSize,
-              sizeof(int32_t) * 3 * AcStrategy::kMaxCoeffArea * xsize_blocks);
-    }
-  }
-
-  void DeInit( ACType type) {
-    if (type == ACType::k16) {
-	    free(dec_group_qrow16);
-	    free(prev_dec_group_qrow16);
-    } else {
-	    free(dec_group_qrow);
-	    free(prev_dec_group_qrow);
-    }
-  }
-
-  // Scratch space used by DecGroupImpl().
-  // TODO(veluca): figure out if we can use unions here.
-  HWY_ALIGN_MAX float dec_group_block[3 * AcStrategy::kMaxCoeffArea];
-  HWY_ALIGN_MAX int32_t* dec_group_qrow;
-  HWY_ALIGN_MAX int32_t* prev_dec_group_qrow;
-  HWY_ALIGN_MAX int16_t* dec_group_qrow16;
-  HWY_ALIGN_MAX int16_t* prev_dec_group_qrow16;
-  // For TransformToPixels.
-  HWY_ALIGN_MAX float scratch_space[2 * AcStrategy::kMaxCoeffArea];
-
-  // AC decoding
-  Image3I num_nzeroes[kMaxNumPasses];
-};
-
-static_assert(sizeof(GroupDecCache) % hwy::kMaxVectorSize == 0,
-              "GroupDecCache must be aligned to vector size.");
-
 }  // namespace jxl
 
 #endif  // LIB_JXL_DEC_CACHE_H_
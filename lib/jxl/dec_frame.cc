@@ -33,6 +33,7 @@
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/profiler.h"
 #include "lib/jxl/base/status.h"
+#include "lib/jxl/blending.h"
 #include "lib/jxl/chroma_from_luma.h"
 #include "lib/jxl/coeff_order.h"
 #include "lib/jxl/coeff_order_fwd.h"
@@ -70,7 +71,7 @@ namespace jxl {
 
 namespace {
 Status DecodeGlobalDCInfo(BitReader* reader, bool is_jpeg,
-                          PassesDecoderState* state, ThreadPool* pool) {
+                          PassesDecoderState* state) {
   PROFILER_FUNC;
   JXL_RETURN_IF_ERROR(state->shared_storage.quantizer.Decode(reader));
 
@@ -85,7 +86,7 @@ Status DecodeGlobalDCInfo(BitReader* reader, bool is_jpeg,
   }
 
   state->shared_storage.ac_strategy.FillInvalid();
-  state->Init(pool);
+  state->Init();
   return true;
 }
 }  // namespace
@@ -154,6 +155,33 @@ static BitReader* GetReaderForSection(
   return store;
 }
 
+size_t PassesForDownsampling(const FrameHeader& frame_header,
+                             size_t max_downsampling, size_t max_passes,
+                             size_t* JXL_RESTRICT downsampling) {
+  max_downsampling = std::max(
+      max_downsampling >> (frame_header.dc_level * 3), size_t(1));
+  // TODO(veluca): deal with downsamplings >= 8.
+  if (max_downsampling >= 8) {
+    *downsampling = 8;
+    max_passes = 0;
+  } else {
+    *downsampling = 1;
+    for (uint32_t i = 0; i < frame_header.passes.num_downsample; ++i) {
+      if (max_downsampling >= frame_header.passes.downsample[i] &&
+          max_passes > frame_header.passes.last_pass[i]) {
+        *downsampling = frame_header.passes.downsample[i];
+        max_passes = frame_header.passes.last_pass[i] + 1;
+      }
+    }
+  }
+  // Do not use downsampling for kReferenceOnly frames.
+  if (frame_header.frame_type == FrameType::kReferenceOnly) {
+    *downsampling = 1;
+    max_passes = frame_header.passes.num_passes;
+  }
+  return std::min<size_t>(max_passes, frame_header.passes.num_passes);
+}
+
 Status DecodeFrame(const DecompressParams& dparams,
                    PassesDecoderState* dec_state, ThreadPool* JXL_RESTRICT pool,
                    BitReader* JXL_RESTRICT reader, AuxOut* JXL_RESTRICT aux_out,
@@ -171,34 +199,14 @@ Status DecodeFrame(const DecompressParams& dparams,
 
   // Handling of progressive decoding.
   {
-    const FrameHeader& frame_header = frame_decoder.GetFrameHeader();
     size_t downsampling;
-    size_t max_passes = dparams.max_passes;
-    size_t max_downsampling = std::max(
-        dparams.max_downsampling >> (frame_header.dc_level * 3), size_t(1));
-    // TODO(veluca): deal with downsamplings >= 8.
-    if (max_downsampling >= 8) {
-      downsampling = 8;
-      max_passes = 0;
-    } else {
-      downsampling = 1;
-      for (uint32_t i = 0; i < frame_header.passes.num_downsample; ++i) {
-        if (max_downsampling >= frame_header.passes.downsample[i] &&
-            max_passes > frame_header.passes.last_pass[i]) {
-          downsampling = frame_header.passes.downsample[i];
-          max_passes = frame_header.passes.last_pass[i] + 1;
-        }
-      }
-    }
-    // Do not use downsampling for kReferenceOnly frames.
-    if (frame_header.frame_type == FrameType::kReferenceOnly) {
-      downsampling = 1;
-      max_passes = frame_header.passes.num_passes;
-    }
+    const size_t max_passes =
+        PassesForDownsampling(frame_decoder.GetFrameHeader(),
+                              dparams.max_downsampling, dparams.max_passes,
+                              &downsampling);
     if (aux_out != nullptr) {
       aux_out->downsampling = downsampling;
     }
-    max_passes = std::min<size_t>(max_passes, frame_header.passes.num_passes);
     frame_decoder.SetMaxPasses(max_passes);
   }
 
@@ -269,6 +277,7 @@ Status FrameDecoder::InitFrame(BitReader* JXL_RESTRICT br, ImageBundle* decoded,
                                bool allow_partial_dc_global) {
   PROFILER_FUNC;
   decoded_ = decoded;
+  saved_output_ = nullptr;
   JXL_ASSERT(is_finalized_);
 
   allow_partial_frames_ = allow_partial_frames;
@@ -372,6 +381,9 @@ Status FrameDecoder::InitFrame(BitReader* JXL_RESTRICT br, ImageBundle* decoded,
   decoded_dc_groups_.resize(frame_dim_.num_dc_groups);
   decoded_passes_per_ac_group_.clear();
   decoded_passes_per_ac_group_.resize(frame_dim_.num_groups, 0);
+  skipped_dc_groups_.clear();
+  skipped_ac_groups_.clear();
+  dec_state_->render_rect = Rect();
   processed_section_.clear();
   processed_section_.resize(section_offsets_.size());
   max_passes_ = frame_header_.passes.num_passes;
@@ -398,19 +410,98 @@ Status FrameDecoder::ProcessDCGlobal(BitReader* br) {
   JXL_RETURN_IF_ERROR(dec_state_->shared_storage.matrices.DecodeDC(br));
   if (frame_header_.encoding == FrameEncoding::kVarDCT) {
     JXL_RETURN_IF_ERROR(
-        jxl::DecodeGlobalDCInfo(br, decoded_->IsJPEG(), dec_state_, pool_));
+        jxl::DecodeGlobalDCInfo(br, decoded_->IsJPEG(), dec_state_));
   } else if (frame_header_.encoding == FrameEncoding::kModular) {
-    dec_state_->Init(pool_);
+    dec_state_->Init();
+  }
+  if ((shared.frame_header.flags & FrameHeader::kSplines) &&
+      !dec_state_->dc_only) {
+    // Needs the color correlation map, decoded with the DC info above.
+    JXL_RETURN_IF_ERROR(shared.image_features.splines.InitializeDrawCache(
+        frame_dim_.xsize_padded, frame_dim_.ysize_padded, shared.cmap));
   }
   Status dec_status = modular_frame_decoder_.DecodeGlobalInfo(
       br, frame_header_, allow_partial_dc_global_);
   if (dec_status.IsFatalError()) return dec_status;
   if (dec_status) {
     decoded_dc_global_ = true;
+    SkipGroupsOutsideCrop();
   }
   return dec_status;
 }
 
+namespace {
+// Whether the ranges [a0, a1) and [b0, b1) intersect.
+bool RangesOverlap(size_t a0, size_t a1, size_t b0, size_t b1) {
+  return a0 < b1 && b0 < a1;
+}
+}  // namespace
+
+void FrameDecoder::SkipGroupsOutsideCrop() {
+  if (crop_rect_.xsize() == 0 || crop_rect_.ysize() == 0) return;
+  if (NumSections() == 1) return;
+  // Groups can only be skipped if they are reconstructed independently of
+  // each other, and if the pixels outside of the crop are not used later on,
+  // e.g. as a reference frame.
+  if (frame_header_.encoding != FrameEncoding::kVarDCT ||
+      !frame_header_.chroma_subsampling.Is444() ||
+      frame_header_.upsampling != 1 || frame_header_.dc_level != 0 ||
+      frame_header_.CanBeReferenced() ||
+      frame_header_.nonserialized_is_preview || decoded_->IsJPEG() ||
+      modular_frame_decoder_.HasGlobalTransforms()) {
+    return;
+  }
+
+  // Crop rect in frame coordinates, extended by the border that adaptive DC
+  // smoothing and the loop filters read from.
+  const LoopFilter& lf = frame_header_.loop_filter;
+  const int64_t border =
+      kBlockDim + std::max(lf.PaddingCols(), lf.PaddingRows());
+  const int64_t xsize = frame_dim_.xsize_padded;
+  const int64_t ysize = frame_dim_.ysize_padded;
+  const int64_t x0 = std::max<int64_t>(
+      0, static_cast<int64_t>(crop_rect_.x0()) -
+             frame_header_.frame_origin.x0 - border);
+  const int64_t y0 = std::max<int64_t>(
+      0, static_cast<int64_t>(crop_rect_.y0()) -
+             frame_header_.frame_origin.y0 - border);
+  const int64_t x1 = std::min<int64_t>(
+      xsize, static_cast<int64_t>(crop_rect_.x0() + crop_rect_.xsize()) -
+                 frame_header_.frame_origin.x0 + border);
+  const int64_t y1 = std::min<int64_t>(
+      ysize, static_cast<int64_t>(crop_rect_.y0() + crop_rect_.ysize()) -
+                 frame_header_.frame_origin.y0 + border);
+  // The crop does not intersect this frame; this is rare enough that it is
+  // not worth special handling.
+  if (x0 >= x1 || y0 >= y1) return;
+
+  const size_t group_dim = frame_dim_.group_dim;
+  skipped_ac_groups_.resize(frame_dim_.num_groups);
+  for (size_t g = 0; g < frame_dim_.num_groups; g++) {
+    const size_t gx = g % frame_dim_.xsize_groups;
+    const size_t gy = g / frame_dim_.xsize_groups;
+    if (RangesOverlap(gx * group_dim, (gx + 1) * group_dim, x0, x1) &&
+        RangesOverlap(gy * group_dim, (gy + 1) * group_dim, y0, y1)) {
+      continue;
+    }
+    skipped_ac_groups_[g] = true;
+    decoded_passes_per_ac_group_[g] = frame_header_.passes.num_passes;
+  }
+  const size_t dc_group_dim = group_dim * kBlockDim;
+  skipped_dc_groups_.resize(frame_dim_.num_dc_groups);
+  for (size_t g = 0; g < frame_dim_.num_dc_groups; g++) {
+    const size_t gx = g % frame_dim_.xsize_dc_groups;
+    const size_t gy = g / frame_dim_.xsize_dc_groups;
+    if (RangesOverlap(gx * dc_group_dim, (gx + 1) * dc_group_dim, x0, x1) &&
+        RangesOverlap(gy * dc_group_dim, (gy + 1) * dc_group_dim, y0, y1)) {
+      continue;
+    }
+    skipped_dc_groups_[g] = true;
+    decoded_dc_groups_[g] = true;
+  }
+  dec_state_->render_rect = Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
 Status FrameDecoder::ProcessDCGroup(size_t dc_group_id, BitReader* br) {
   PROFILER_FUNC;
   const size_t gx = dc_group_id % frame_dim_.xsize_dc_groups;
@@ -449,11 +540,13 @@ void FrameDecoder::FinalizeDC() {
 Status FrameDecoder::ProcessACGlobal(BitReader* br) {
   JXL_CHECK(finalized_dc_);
 
-  // Allocate output image.
+  // Allocate output image, unless the frame is rendered row by row.
   const CodecMetadata& metadata = *frame_header_.nonserialized_metadata;
-  decoded_->SetFromImage(
-      Image3F(frame_dim_.xsize_padded, frame_dim_.ysize_padded),
-      dec_state_->output_encoding);
+  if (!dec_state_->rgb_output_only && !dec_state_->ycbcr_output_only) {
+    decoded_->SetFromImage(
+        Image3F(frame_dim_.xsize_padded, frame_dim_.ysize_padded),
+        dec_state_->output_encoding);
+  }
   if (metadata.m.num_extra_channels > 0) {
     std::vector<ImageF> ecv;
     for (size_t i = 0; i < metadata.m.num_extra_channels; i++) {
@@ -502,13 +595,21 @@ Status FrameDecoder::ProcessACGlobal(BitReader* br) {
     // TODO(veluca): figure out the exact limit - 16 should still work with
     // 16-bit buffers, but we are excluding it for safety.
     bool use_16_bit = max_num_bits_ac < 16 && !decoded_->IsJPEG();
-    bool store = frame_header_.passes.num_passes > 1;
+    // All passes of the groups of a banded frame are decoded at once, so their
+    // coefficients need not be kept between passes.
+    bool store = frame_header_.passes.num_passes > 1 && !dec_state_->banded;
     size_t xs = store ? kGroupDim * kGroupDim : 0;
     size_t ys = store ? frame_dim_.num_groups : 0;
-    if (use_16_bit) {
-      dec_state_->coefficients = make_unique<ACImageT<int16_t>>(xs, ys);
-    } else {
-      dec_state_->coefficients = make_unique<ACImageT<int32_t>>(xs, ys);
+    const ACType type = use_16_bit ? ACType::k16 : ACType::k32;
+    // Keep the coefficients of the previous frame, if they fit.
+    if (dec_state_->coefficients->Type() != type ||
+        dec_state_->coefficients->xsize() != xs ||
+        dec_state_->coefficients->ysize() != ys) {
+      if (use_16_bit) {
+        dec_state_->coefficients = make_unique<ACImageT<int16_t>>(xs, ys);
+      } else {
+        dec_state_->coefficients = make_unique<ACImageT<int32_t>>(xs, ys);
+      }
     }
     if (store) {
       dec_state_->coefficients->ZeroFill();
@@ -570,13 +671,13 @@ Status FrameDecoder::ProcessACGroup(size_t ac_group_id,
   if (frame_header_.encoding == FrameEncoding::kVarDCT) {
     const Rect& rect = dec_state_->shared->BlockGroupRect(ac_group_id);
 
-    ACType ac_type = dec_state_->coefficients->Type();
-    group_dec_caches_[thread].InitOnce(num_passes, rect.xsize(), ac_type);
+    GroupDecCache* group_dec_cache = &dec_state_->group_dec_caches[thread];
+    group_dec_cache->InitOnce(num_passes, rect.xsize(),
+                              dec_state_->coefficients->Type());
     JXL_RETURN_IF_ERROR(
-        DecodeGroup(br, num_passes, ac_group_id, dec_state_,
-                    &group_dec_caches_[thread], thread, decoded_,
+        DecodeGroup(br, num_passes, ac_group_id, dec_state_, group_dec_cache,
+                    thread, decoded_,
                     decoded_passes_per_ac_group_[ac_group_id], force_draw));
-    group_dec_caches_[thread].DeInit(ac_type);
   }
 
   // don't limit to image dimensions here (is done in DecodeGroup)
@@ -611,9 +712,45 @@ Status FrameDecoder::ProcessACGroup(size_t ac_group_id,
   return true;
 }
 
+bool FrameDecoder::SectionIsBeyondMaxPasses(size_t id) const {
+  if (NumSections() == 1) return false;
+  const size_t ac_global_index = frame_dim_.num_dc_groups + 1;
+  if (id <= ac_global_index) return false;
+  return (id - ac_global_index - 1) / frame_dim_.num_groups >= max_passes_;
+}
+
+bool FrameDecoder::SupportsPartialFlush() const {
+  // The global modular transforms of extra channels are undone in place, and
+  // chroma upsampling and upsampling replace the decoded image, so those can
+  // only be rendered once.
+  return frame_header_.encoding == FrameEncoding::kVarDCT &&
+         frame_header_.chroma_subsampling.Is444() &&
+         frame_header_.upsampling == 1 &&
+         frame_header_.nonserialized_metadata->m.num_extra_channels == 0 &&
+         !decoded_->IsJPEG();
+}
+
+size_t FrameDecoder::NumCompletePasses() const {
+  return *std::min_element(decoded_passes_per_ac_group_.begin(),
+                           decoded_passes_per_ac_group_.end());
+}
+
+size_t FrameDecoder::SectionPass(size_t id) const {
+  if (NumSections() == 1) return 0;
+  const size_t ac_global_index = frame_dim_.num_dc_groups + 1;
+  if (id <= ac_global_index) return 0;
+  return (id - ac_global_index - 1) / frame_dim_.num_groups;
+}
+
 Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
                                      SectionStatus* section_status) {
   JXL_ASSERT(num > 0);
+  if (num_renders_ != 0 && decoded_ac_global_ && decoded_->HasColor()) {
+    // The frame was flushed before it was fully decoded, which shrank the
+    // output to the frame size: the groups are drawn to all of it again.
+    decoded_->color()->ShrinkTo(frame_dim_.xsize_padded,
+                                frame_dim_.ysize_padded);
+  }
   std::fill(section_status, section_status + num, SectionStatus::kSkipped);
   size_t dc_global_sec = num;
   size_t ac_global_sec = num;
@@ -682,6 +819,27 @@ Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
     }
   }
 
+  // Sections of the groups outside of the crop rect are dropped without being
+  // decoded.
+  if (!skipped_ac_groups_.empty()) {
+    for (size_t i = 0; i < dc_group_sec.size(); i++) {
+      if (skipped_dc_groups_[i] && dc_group_sec[i] != num) {
+        section_status[dc_group_sec[i]] = SectionStatus::kDone;
+        dc_group_sec[i] = num;
+      }
+    }
+    for (size_t g = 0; g < ac_group_sec.size(); g++) {
+      if (!skipped_ac_groups_[g]) continue;
+      for (size_t& sec : ac_group_sec[g]) {
+        if (sec != num) {
+          section_status[sec] = SectionStatus::kDone;
+          sec = num;
+        }
+      }
+      num_ac_passes[g] = 0;
+    }
+  }
+
   std::atomic<bool> has_error{false};
   if (decoded_dc_global_) {
     RunOnPool(
@@ -716,35 +874,54 @@ Status FrameDecoder::ProcessSections(const SectionInfo* sections, size_t num,
   }
 
   if (decoded_ac_global_) {
-    RunOnPool(
-        pool_, 0, ac_group_sec.size(),
-        [this](size_t num_threads) {
-          SetNumThreads(num_threads);
-          return true;
-        },
-        [this, &ac_group_sec, &num_ac_passes, &num, &sections, &section_status,
-         &has_error](size_t g, size_t thread) {
-          if (num_ac_passes[g] == 0) {  // no new AC pass, nothing to do.
-            return;
-          }
-          (void)num;
-          size_t first_pass = decoded_passes_per_ac_group_[g];
-          BitReader* JXL_RESTRICT readers[kMaxNumPasses];
-          for (size_t i = 0; i < num_ac_passes[g]; i++) {
-            JXL_ASSERT(ac_group_sec[g][first_pass + i] != num);
-            readers[i] = sections[ac_group_sec[g][first_pass + i]].br;
-          }
-          if (!ProcessACGroup(g, readers, num_ac_passes[g], thread,
-                              /*force_draw=*/false)) {
-            has_error = true;
-          } else {
-            for (size_t i = 0; i < num_ac_passes[g]; i++) {
-              section_status[ac_group_sec[g][first_pass + i]] =
-                  SectionStatus::kDone;
-            }
-          }
-        },
-        "DecodeGroup");
+    const auto init_threads = [this](size_t num_threads) {
+      SetNumThreads(num_threads);
+      return true;
+    };
+    const auto process_group = [this, &ac_group_sec, &num_ac_passes, &num,
+                                &sections, &section_status,
+                                &has_error](size_t g, size_t thread) {
+      if (num_ac_passes[g] == 0) {  // no new AC pass, nothing to do.
+        return;
+      }
+      (void)num;
+      size_t first_pass = decoded_passes_per_ac_group_[g];
+      BitReader* JXL_RESTRICT readers[kMaxNumPasses];
+      for (size_t i = 0; i < num_ac_passes[g]; i++) {
+        JXL_ASSERT(ac_group_sec[g][first_pass + i] != num);
+        readers[i] = sections[ac_group_sec[g][first_pass + i]].br;
+      }
+      if (!ProcessACGroup(g, readers, num_ac_passes[g], thread,
+                          /*force_draw=*/false)) {
+        has_error = true;
+      } else {
+        for (size_t i = 0; i < num_ac_passes[g]; i++) {
+          section_status[ac_group_sec[g][first_pass + i]] =
+              SectionStatus::kDone;
+        }
+      }
+    };
+    if (dec_state_->banded) {
+      // The groups are decoded one row of groups at a time, and the band of
+      // rows of the frame that `decoded` holds moves down between them.
+      for (size_t g = 0; g < num_ac_passes.size(); g++) {
+        if (decoded_passes_per_ac_group_[g] + num_ac_passes[g] < max_passes_) {
+          return JXL_FAILURE("Banded frames must be decoded at once");
+        }
+      }
+      const size_t xsize_groups = frame_dim_.xsize_groups;
+      for (size_t gy = 0; gy < frame_dim_.ysize_groups; gy++) {
+        if (gy != 0) dec_state_->MoveBand(gy * kGroupDim - kBandOverlapRows);
+        RunOnPool(pool_, gy * xsize_groups, (gy + 1) * xsize_groups,
+                  init_threads, process_group, "DecodeGroup");
+        if (has_error) break;
+        JXL_RETURN_IF_ERROR(
+            FinalizeGroupRowBorders(decoded_, gy, dec_state_, pool_));
+      }
+    } else {
+      RunOnPool(pool_, 0, ac_group_sec.size(), init_threads, process_group,
+                "DecodeGroup");
+    }
   }
   if (has_error) return JXL_FAILURE("Error in AC group");
 
@@ -805,8 +982,17 @@ Status FrameDecoder::Flush() {
       modular_frame_decoder_.FinalizeDecoding(dec_state_, pool_, decoded_));
 
   JXL_RETURN_IF_ERROR(FinalizeFrameDecoding(decoded_, dec_state_, pool_,
-                                            /*rerender=*/num_renders_ != 0,
-                                            /*skip_blending=*/false));
+                                            /*rerender=*/num_renders_ != 0));
+
+  // The last render of a frame that is saved in place of its own background
+  // can blend onto that background directly: FinalizeFrame overwrites it
+  // right after, and earlier renders still blended onto a copy of it.
+  const FrameHeader& frame_header = dec_state_->shared->frame_header;
+  bool reuse_background =
+      is_finalized_ && frame_header.CanBeReferenced() &&
+      !frame_header.save_before_color_transform &&
+      frame_header.save_as_reference == frame_header.blending_info.source;
+  JXL_RETURN_IF_ERROR(DoBlending(dec_state_, decoded_, reuse_background));
 
   num_renders_++;
   return true;
@@ -840,27 +1026,38 @@ Status FrameDecoder::FinalizeFrame() {
 
   if (dec_state_->shared->frame_header.CanBeReferenced()) {
     size_t id = dec_state_->shared->frame_header.save_as_reference;
+    ReferenceFrame& reference_frame =
+        dec_state_->shared_storage.reference_frames[id];
+    reference_frame.Reset();
+    // Frames that are never displayed only matter as references, so their
+    // pixels are handed over instead of copied; decoded_ is left empty. So are
+    // those of displayed frames if the caller reads them from the reference.
+    bool displayed = frame_header_.frame_type != FrameType::kReferenceOnly;
     if (dec_state_->pre_color_transform_frame.xsize() == 0) {
-      dec_state_->shared_storage.reference_frames[id].storage =
-          decoded_->Copy();
+      // Lossless frames are kept as integers, at half the memory.
+      if (!reference_frame.SetCompact(*decoded_)) {
+        if (displayed && !move_saved_output_) {
+          reference_frame.storage = decoded_->Copy();
+        } else {
+          reference_frame.storage = std::move(*decoded_);
+          if (displayed) saved_output_ = &reference_frame.storage;
+        }
+      }
     } else {
-      dec_state_->shared_storage.reference_frames[id].storage =
-          ImageBundle(decoded_->metadata());
-      dec_state_->shared_storage.reference_frames[id].storage.SetFromImage(
+      reference_frame.storage = ImageBundle(decoded_->metadata());
+      reference_frame.storage.SetFromImage(
           std::move(dec_state_->pre_color_transform_frame),
           decoded_->c_current());
       if (decoded_->HasExtraChannels()) {
         std::vector<ImageF> extra_channels;
-        for (const auto& ec : decoded_->extra_channels()) {
-          extra_channels.push_back(CopyImage(ec));
+        for (auto& ec : decoded_->extra_channels()) {
+          extra_channels.push_back(displayed ? CopyImage(ec) : std::move(ec));
         }
-        dec_state_->shared_storage.reference_frames[id]
-            .storage.SetExtraChannels(std::move(extra_channels));
+        if (!displayed) decoded_->ClearExtraChannels();
+        reference_frame.storage.SetExtraChannels(std::move(extra_channels));
       }
     }
-    dec_state_->shared_storage.reference_frames[id].frame =
-        &dec_state_->shared_storage.reference_frames[id].storage;
-    dec_state_->shared_storage.reference_frames[id].ib_is_in_xyb =
+    reference_frame.ib_is_in_xyb =
         dec_state_->shared->frame_header.save_before_color_transform;
   }
   if (dec_state_->shared->frame_header.dc_level != 0) {
@@ -869,10 +1066,12 @@ Status FrameDecoder::FinalizeFrame() {
         std::move(*decoded_->color());
     decoded_->RemoveColor();
   }
+  // The bundle that holds the pixels of the frame from now on.
+  ImageBundle* output = saved_output_ != nullptr ? saved_output_ : decoded_;
   if (frame_header_.nonserialized_is_preview) {
     // Fix possible larger image size (multiple of kBlockDim)
     // TODO(lode): verify if and when that happens.
-    decoded_->ShrinkTo(frame_dim_.xsize, frame_dim_.ysize);
+    output->ShrinkTo(frame_dim_.xsize, frame_dim_.ysize);
   } else if (!decoded_->IsJPEG()) {
     // A kRegularFrame is blended with the other frames, and thus results in a
     // coalesced frame of size equal to image dimensions. Other frames are not
@@ -880,14 +1079,13 @@ Status FrameDecoder::FinalizeFrame() {
     // frame_header.
     if (frame_header_.frame_type == kRegularFrame ||
         frame_header_.frame_type == kSkipProgressive) {
-      decoded_->ShrinkTo(
+      output->ShrinkTo(
           dec_state_->shared->frame_header.nonserialized_metadata->xsize(),
           dec_state_->shared->frame_header.nonserialized_metadata->ysize());
     } else {
       // xsize_upsampled is the actual frame size, after any upsampling has been
       // applied.
-      decoded_->ShrinkTo(frame_dim_.xsize_upsampled,
-                         frame_dim_.ysize_upsampled);
+      output->ShrinkTo(frame_dim_.xsize_upsampled, frame_dim_.ysize_upsampled);
     }
   }
 
@@ -54,6 +54,13 @@ Status DecodeFrame(const DecompressParams& dparams,
                    ImageBundle* decoded, const CodecMetadata& metadata,
                    const SizeConstraints* constraints, bool is_preview = false);
 
+// Returns how many passes of the frame must be decoded, at most `max_passes`,
+// for an image that may be downsampled by up to `max_downsampling`. Stores the
+// downsampling factor of the resulting image in `downsampling`.
+size_t PassesForDownsampling(const FrameHeader& frame_header,
+                             size_t max_downsampling, size_t max_passes,
+                             size_t* JXL_RESTRICT downsampling);
+
 // Leaves reader in the same state as DecodeFrame would. Used to skip preview.
 // Also updates `dec_state` with the new frame header.
 Status SkipFrame(const CodecMetadata& metadata, BitReader* JXL_RESTRICT reader,
@@ -73,6 +80,22 @@ class FrameDecoder {
     constraints_ = constraints;
   }
 
+  // Restricts decoding to the groups that are needed to render `rect`, given
+  // in image coordinates. This is only done for frames whose pixels outside
+  // of `rect` are not used afterwards; the rest of the output is then left
+  // undefined. An empty `rect` (the default) decodes the whole frame.
+  // Must be called before InitFrame.
+  void SetCropRect(const Rect& rect) { crop_rect_ = rect; }
+
+  // Lets FinalizeFrame move the pixels of a frame that is saved as a reference
+  // to the reference slot, instead of copying them, also if the frame is shown.
+  // They are then no longer in `decoded`, and must be read from SavedOutput(),
+  // without modifying them, before the next frame is decoded.
+  void SetMoveSavedOutput() { move_saved_output_ = true; }
+  // The frame that FinalizeFrame moved to a reference slot instead of leaving
+  // it in `decoded`, or nullptr if `decoded` holds it.
+  const ImageBundle* SavedOutput() const { return saved_output_; }
+
   // Read FrameHeader and table of contents from the given BitReader.
   // Also checks frame dimensions for their limits, and sets the output
   // image buffer.
@@ -109,6 +132,18 @@ class FrameDecoder {
   // Flushes all the data decoded so far to pixels.
   Status Flush();
 
+  // Whether Flush can render the frame before all of its sections are
+  // decoded, and then again once more sections are, without changing the
+  // final result. Requires the frame header.
+  bool SupportsPartialFlush() const;
+  // Whether enough of the frame is decoded for such a partial Flush.
+  bool HasDecodedACGlobal() const { return decoded_ac_global_; }
+  // Number of passes that are decoded for all of the AC groups.
+  size_t NumCompletePasses() const;
+  // Index of the pass of the section with index `id` if it is the section of
+  // an AC group, or 0 otherwise.
+  size_t SectionPass(size_t id) const;
+
   // Runs final operations once a frame data is decoded.
   // Must be called exactly once per frame, after all calls to ProcessSections.
   Status FinalizeFrame();
@@ -121,11 +156,27 @@ class FrameDecoder {
 
   // TODO(veluca): remove once we remove --downsampling flag.
   void SetMaxPasses(size_t max_passes) { max_passes_ = max_passes; }
+  // Disables gaborish and the edge preserving filter, whose effect is mostly
+  // averaged out when the output is downsampled. Must be called before any
+  // section of the frame is processed.
+  void DisableLoopFilters() {
+    frame_header_.loop_filter.gab = false;
+    frame_header_.loop_filter.epf_iters = 0;
+    LoopFilter& shared_lf = dec_state_->shared_storage.frame_header.loop_filter;
+    shared_lf.gab = false;
+    shared_lf.epf_iters = 0;
+  }
+  // Whether the section with index `id` only contains passes that are not
+  // decoded because of SetMaxPasses.
+  bool SectionIsBeyondMaxPasses(size_t id) const;
   const FrameHeader& GetFrameHeader() const { return frame_header_; }
 
  private:
   Status ProcessDCGlobal(BitReader* br);
   Status ProcessDCGroup(size_t dc_group_id, BitReader* br);
+  // Marks the groups that do not contribute to the crop rect as decoded, and
+  // sets the render rect accordingly. Must be called after ProcessDCGlobal.
+  void SkipGroupsOutsideCrop();
   void FinalizeDC();
   Status ProcessACGlobal(BitReader* br);
   Status ProcessACGroup(size_t ac_group_id, BitReader* JXL_RESTRICT* br,
@@ -135,11 +186,7 @@ class FrameDecoder {
   // parameter passed to DecodeDCGroup and DecodeACGroup must be smaller than
   // the "num_threads" passed here.
   void SetNumThreads(size_t num_threads) {
-    if (num_threads > group_dec_caches_size_) {
-      group_dec_caches_size_ = num_threads;
-      group_dec_caches_ =
-          hwy::MakeUniqueAlignedArray<GroupDecCache>(num_threads);
-    }
+    dec_state_->EnsureGroupDecCaches(num_threads);
     dec_state_->EnsureStorage(num_threads);
   }
 
@@ -159,20 +206,24 @@ class FrameDecoder {
   std::vector<uint8_t> processed_section_;
   std::vector<uint8_t> decoded_passes_per_ac_group_;
   std::vector<uint8_t> decoded_dc_groups_;
+  // Groups that are not decoded because they are outside of the crop rect.
+  // Empty if all groups are decoded.
+  std::vector<uint8_t> skipped_dc_groups_;
+  std::vector<uint8_t> skipped_ac_groups_;
   bool decoded_dc_global_;
   bool decoded_ac_global_;
   bool finalized_dc_ = true;
   bool is_finalized_ = true;
   size_t num_renders_ = 0;
 
-  // Number of allocated GroupDecCache entries in the group_dec_caches_ smart
-  // pointer. This is only needed to tell whether we need to reallocate the
-  // cache.
-  size_t group_dec_caches_size_ = 0;
-  hwy::AlignedUniquePtr<GroupDecCache[]> group_dec_caches_;
-
   // Frame size limits.
   const SizeConstraints* constraints_ = nullptr;
+
+  // Region of the image that must be decoded, or empty for all of it.
+  Rect crop_rect_;
+
+  bool move_saved_output_ = false;
+  ImageBundle* saved_output_ = nullptr;
 };
 
 }  // namespace jxl
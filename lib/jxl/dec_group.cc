@@ -200,7 +200,10 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
   const YCbCrChromaSubsampling& cs =
       dec_state->shared->frame_header.chroma_subsampling;
 
-  const size_t idct_stride = dec_state->decoded.PixelsPerRow();
+  // The planes of the decoded image may have different sizes.
+  const size_t idct_stride[3] = {dec_state->decoded.Plane(0).PixelsPerRow(),
+                                 dec_state->decoded.Plane(1).PixelsPerRow(),
+                                 dec_state->decoded.Plane(2).PixelsPerRow()};
 
   HWY_ALIGN int32_t scaled_qtable[64 * 3];
 
@@ -283,9 +286,10 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
     float* JXL_RESTRICT idct_row[3];
     int16_t* JXL_RESTRICT jpeg_row[3];
     for (size_t c = 0; c < 3; c++) {
-      idct_row[c] =
-          dec_state->decoded.PlaneRow(c, (r[c].y0() + sby[c]) * kBlockDim) +
-          r[c].x0() * kBlockDim;
+      idct_row[c] = dec_state->decoded.Plane(c).Row(
+                        (r[c].y0() + sby[c]) * kBlockDim -
+                        dec_state->decoded_y0) +
+                    r[c].x0() * kBlockDim;
       if (decoded->IsJPEG()) {
         auto& component = decoded->jpeg_data->components[jpeg_c_map[c]];
         jpeg_row[c] =
@@ -465,7 +469,7 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
             float* JXL_RESTRICT idct_pos =
                 idct_row[c] + dec_state->decoded_padding + sbx[c] * kBlockDim;
             TransformToPixels(acs.Strategy(), block + c * size, idct_pos,
-                              idct_stride, group_dec_cache->scratch_space);
+                              idct_stride[c], group_dec_cache->scratch_space);
           }
         }
         bx += llf_x;
@@ -500,9 +504,10 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
 
   // No ApplyImageFeatures in JPEG mode, or if using chroma subsampling. It will
   // be done after decoding the whole image (this allows it to work on the
-  // chroma channels too).
-  bool run_apply_image_features =
-      xstart < xend && ystart < yend && !decoded->IsJPEG() && cs.Is444();
+  // chroma channels too). Planes that are output as YCbCr are not rendered.
+  bool run_apply_image_features = xstart < xend && ystart < yend &&
+                                  !decoded->IsJPEG() && cs.Is444() &&
+                                  !dec_state->ycbcr_output_only;
 
   static_assert(kApplyImageFeaturesTileDim >= kGroupDim,
                 "Groups are too large");
@@ -512,7 +517,8 @@ Status DecodeGroupImpl(GetBlock* JXL_RESTRICT get_block,
   if (lf.PaddingCols() != 0) {
     PadRectMirrorInPlace(
         &dec_state->decoded,
-        Rect(block_rect.x0() * kBlockDim, block_rect.y0() * kBlockDim,
+        Rect(block_rect.x0() * kBlockDim,
+             block_rect.y0() * kBlockDim - dec_state->decoded_y0,
              block_rect.xsize() * kBlockDim, block_rect.ysize() * kBlockDim),
         dec_state->shared->frame_dim.xsize_padded, lf.PaddingCols(),
         dec_state->decoded_padding);
@@ -534,7 +540,8 @@ namespace jxl {
 namespace {
 // Decode quantized AC coefficients of DCT blocks.
 // LLF components in the output block will not be modified.
-template <ACType ac_type>
+// `fast_path` must be decoder->HasFastPath().
+template <ACType ac_type, bool fast_path>
 Status DecodeACVarBlock(size_t ctx_offset, size_t log2_covered_blocks,
                         int32_t* JXL_RESTRICT row_nzeros,
                         const int32_t* JXL_RESTRICT row_nzeros_top,
@@ -584,7 +591,10 @@ Status DecodeACVarBlock(size_t ctx_offset, size_t log2_covered_blocks,
       const size_t ctx =
           histo_offset + ZeroDensityContext(nzeros, k, covered_blocks,
                                             log2_covered_blocks, prev);
-      const size_t u_coeff = decoder->ReadHybridUint(ctx, br, context_map);
+      const size_t u_coeff =
+          fast_path
+              ? decoder->ReadHybridUintClusteredFast(context_map[ctx], br)
+              : decoder->ReadHybridUint(ctx, br, context_map);
       // Hand-rolled version of UnpackSigned, shifting before the conversion to
       // signed integer to avoid undefined behavior of shifting negative
       // numbers.
@@ -632,9 +642,6 @@ struct GetBlockFromBitstream : public GetBlock {
   Status LoadBlock(size_t bx, size_t by, const AcStrategy& acs, size_t size,
                    size_t log2_covered_blocks, ACPtr block[3],
                    ACType ac_type) override {
-    auto decode_ac_varblock = ac_type == ACType::k16
-                                  ? DecodeACVarBlock<ACType::k16>
-                                  : DecodeACVarBlock<ACType::k32>;
     for (size_t c : {1, 0, 2}) {
       size_t sbx = bx >> hshift[c];
       size_t sby = by >> vshift[c];
@@ -643,6 +650,13 @@ struct GetBlockFromBitstream : public GetBlock {
       }
 
       for (size_t pass = 0; JXL_UNLIKELY(pass < num_passes); pass++) {
+        auto decode_ac_varblock =
+            decoders[pass].HasFastPath()
+                ? (ac_type == ACType::k16 ? DecodeACVarBlock<ACType::k16, true>
+                                          : DecodeACVarBlock<ACType::k32, true>)
+                : (ac_type == ACType::k16
+                       ? DecodeACVarBlock<ACType::k16, false>
+                       : DecodeACVarBlock<ACType::k32, false>);
         JXL_RETURN_IF_ERROR(decode_ac_varblock(
             ctx_offset[pass], log2_covered_blocks, row_nzeros[pass][c],
             row_nzeros_top[pass][c], nzeros_stride, c, sbx, sby, bx, acs,
@@ -779,8 +793,8 @@ Status DecodeGroup(BitReader* JXL_RESTRICT* JXL_RESTRICT readers,
   if (draw == kDraw && num_passes == 0 && first_pass == 0) {
     Rect src_rect = dec_state->shared->BlockGroupRect(group_idx);
     Rect dst_rect(src_rect.x0() * 8 + dec_state->decoded_padding,
-                  src_rect.y0() * 8, src_rect.xsize() * 8,
-                  src_rect.ysize() * 8);
+                  src_rect.y0() * 8 - dec_state->decoded_y0,
+                  src_rect.xsize() * 8, src_rect.ysize() * 8);
     dec_state->dc_upsampler.UpsampleRect(*dec_state->shared->dc, src_rect,
                                          &dec_state->decoded, dst_rect);
     draw = kOnlyImageFeatures;
@@ -245,6 +245,17 @@ bool HuffmanDecodingData::ReadFromBitStream(size_t alphabet_size,
   return (table_size > 0);
 }
 
+void HuffmanDecodingData::InitMultiTable() {
+  const uint32_t table_size = 1u << kHuffmanTableBits;
+  multi_table_.resize(table_size);
+  const uint32_t total_symbols = BuildHuffmanMultiTable(
+      table_.data(), kHuffmanTableBits, multi_table_.data());
+  if (total_symbols < 2 * table_size) {
+    multi_table_.clear();
+    multi_table_.shrink_to_fit();
+  }
+}
+
 // Decodes the next Huffman coded symbol from the bit-stream.
 uint16_t HuffmanDecodingData::ReadSymbol(BitReader* br) const {
   size_t n_bits;
@@ -33,7 +33,14 @@ struct HuffmanDecodingData {
 
   uint16_t ReadSymbol(BitReader* br) const;
 
+  // Fills multi_table_ from the root of table_ if its entries decode at least
+  // two symbols on average, and clears it otherwise.
+  void InitMultiTable();
+
   std::vector<HuffmanCode> table_;
+  // Symbols decoded by the next kHuffmanTableBits bits, see
+  // BuildHuffmanMultiTable. Empty if the codes are too long for it to pay off.
+  std::vector<HuffmanMultiCode> multi_table_;
 };
 
 }  // namespace jxl
@@ -33,6 +33,7 @@
 #include "lib/jxl/epf.h"
 #include "lib/jxl/modular/encoding/encoding.h"
 #include "lib/jxl/modular/modular_image.h"
+#include "lib/jxl/modular/transform/transform.h"
 HWY_BEFORE_NAMESPACE();
 namespace jxl {
 namespace HWY_NAMESPACE {
@@ -409,7 +410,8 @@ Status ModularFrameDecoder::DecodeAcMetadata(size_t group_id, BitReader* reader,
       num++;
     }
   }
-  if (dec_state->shared->frame_header.loop_filter.epf_iters > 0) {
+  if (dec_state->shared->frame_header.loop_filter.epf_iters > 0 &&
+      !dec_state->dc_only) {
     ComputeSigma(r, dec_state);
   }
   return true;
@@ -428,18 +430,66 @@ Status ModularFrameDecoder::FinalizeDecoding(PassesDecoderState* dec_state,
   // Don't use threads if total image size is smaller than a group
   if (xsize * ysize < frame_dim.group_dim * frame_dim.group_dim) pool = nullptr;
 
+  const bool rgb_from_gray =
+      metadata->m.color_encoding.IsGray() &&
+      frame_header.color_transform == ColorTransform::kNone;
+  // If the last transform to undo is an RCT on the color channels (typical for
+  // lossless images), it is fused with the conversion to float below instead of
+  // making another pass over the whole image.
+  const bool fuse_rct = do_color && !rgb_from_gray &&
+                        frame_header.color_transform != ColorTransform::kXYB &&
+                        !gi.transform.empty() &&
+                        gi.transform[0].id == TransformId::kRCT &&
+                        gi.transform[0].begin_c == 0;
+
   // Undo the global transforms
-  gi.undo_transforms(global_header.wp_header, -1, pool);
+  gi.undo_transforms(global_header.wp_header, fuse_rct ? 1 : -1, pool);
   if (gi.error) return JXL_FAILURE("Undoing transforms failed");
 
   auto& decoded = dec_state->decoded;
   size_t decoded_padding = dec_state->decoded_padding;
 
   int c = 0;
-  if (do_color) {
-    const bool rgb_from_gray =
-        metadata->m.color_encoding.IsGray() &&
-        frame_header.color_transform == ColorTransform::kNone;
+  if (do_color && fuse_rct) {
+    if (gi.channel.size() < 3) {
+      return JXL_FAILURE("Invalid number of channels for RCT");
+    }
+    for (; c < 3; c++) {
+      if (gi.channel[c].w != xsize || gi.channel[c].h != ysize) {
+        return JXL_FAILURE("Invalid channel dimensions for RCT");
+      }
+    }
+    const bool fp = metadata->m.bit_depth.floating_point_sample;
+    const int bits = metadata->m.bit_depth.bits_per_sample;
+    const int exp_bits = metadata->m.bit_depth.exponent_bits_per_sample;
+    const uint32_t rct_type = gi.transform[0].rct_type;
+    const float factor = 1.f / (float)full_image.maxval;
+    ImageI rct_rows;
+    RunOnPool(
+        pool, 0, ysize,
+        [&](const size_t num_threads) {
+          rct_rows = ImageI(xsize, 3 * num_threads);
+          return true;
+        },
+        [&](const int task, const int thread) {
+          const size_t y = task;
+          pixel_type* const rows[3] = {rct_rows.Row(3 * thread),
+                                       rct_rows.Row(3 * thread + 1),
+                                       rct_rows.Row(3 * thread + 2)};
+          InvRCTRow(rct_type, gi.channel[0].Row(y), gi.channel[1].Row(y),
+                    gi.channel[2].Row(y), rows, xsize);
+          for (size_t ch = 0; ch < 3; ch++) {
+            if (fp) {
+              int_to_float(rows[ch], decoded.PlaneRow(ch, y) + decoded_padding,
+                           xsize, bits, exp_bits);
+            } else {
+              HWY_DYNAMIC_DISPATCH(SingleFromSingle)
+              (xsize, rows[ch], factor, &decoded, decoded_padding, ch, y);
+            }
+          }
+        },
+        "ModularInvRCTToFloat");
+  } else if (do_color) {
     const bool fp = metadata->m.bit_depth.floating_point_sample;
 
     for (; c < 3; c++) {
@@ -522,17 +572,22 @@ Status ModularFrameDecoder::FinalizeDecoding(PassesDecoderState* dec_state,
       const float mul = fp ? 0 : (1.0f / ((1u << bits) - 1));
       const size_t ec_xsize = eci.Size(xsize);  // includes shift
       const size_t ec_ysize = eci.Size(ysize);
-      for (size_t y = 0; y < ec_ysize; ++y) {
-        float* const JXL_RESTRICT row_out = output->extra_channels()[ec].Row(y);
-        const pixel_type* const JXL_RESTRICT row_in = gi.channel[c].Row(y);
-        if (fp) {
-          int_to_float(row_in, row_out, ec_xsize, bits, exp_bits);
-        } else {
-          for (size_t x = 0; x < ec_xsize; ++x) {
-            row_out[x] = row_in[x] * mul;
-          }
-        }
-      }
+      RunOnPool(
+          pool, 0, ec_ysize, jxl::ThreadPool::SkipInit(),
+          [&](const int task, const int thread) {
+            const size_t y = task;
+            float* const JXL_RESTRICT row_out =
+                output->extra_channels()[ec].Row(y);
+            const pixel_type* const JXL_RESTRICT row_in = gi.channel[c].Row(y);
+            if (fp) {
+              int_to_float(row_in, row_out, ec_xsize, bits, exp_bits);
+            } else {
+              for (size_t x = 0; x < ec_xsize; ++x) {
+                row_out[x] = row_in[x] * mul;
+              }
+            }
+          },
+          "ModularExtraChannelToFloat");
     }
   }
   return true;
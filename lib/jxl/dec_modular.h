@@ -117,6 +117,9 @@ class ModularFrameDecoder {
   Status FinalizeDecoding(PassesDecoderState* dec_state, jxl::ThreadPool* pool,
                           ImageBundle* output);
   bool have_dc() const { return have_something; }
+  // Whether the global stream uses transforms that span the whole frame, such
+  // as Squeeze or Palette. Only valid after DecodeGlobalInfo.
+  bool HasGlobalTransforms() const { return !full_image.transform.empty(); }
 
  private:
   Image full_image;
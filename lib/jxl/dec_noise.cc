@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <algorithm>
 #include <numeric>
@@ -210,6 +211,135 @@ void RandomImage3(size_t seed, const Rect& rect, Image3F* JXL_RESTRICT noise) {
   RandomImage(&rng, rect, &noise->Plane(2));
 }
 
+void RandomNoiseRect(size_t seed, const FrameDimensions& frame_dim,
+                     const Rect& rect, Image3F* JXL_RESTRICT raw) {
+  const int64_t xsize = frame_dim.xsize_padded;
+  const int64_t ysize = frame_dim.ysize_padded;
+  const int64_t border = kNoiseBorder;
+  JXL_DASSERT(raw->xsize() >= rect.xsize() + 2 * kNoiseBorder);
+  JXL_DASSERT(raw->ysize() >= rect.ysize() + 2 * kNoiseBorder);
+  // Offsets from frame coordinates to coordinates in `raw`.
+  const int64_t off_x = border - static_cast<int64_t>(rect.x0());
+  const int64_t off_y = border - static_cast<int64_t>(rect.y0());
+  // Pixels of the frame that are needed, including the border.
+  const size_t x0 = std::max<int64_t>(0, rect.x0() - border);
+  const size_t y0 = std::max<int64_t>(0, rect.y0() - border);
+  const size_t x1 = std::min<int64_t>(xsize, rect.x0() + rect.xsize() + border);
+  const size_t y1 = std::min<int64_t>(ysize, rect.y0() + rect.ysize() + border);
+
+  // Same layout as the output of RandomImage: for each group, all the rows of
+  // the first plane, then of the second and of the third, each row starting
+  // with a new batch and using one batch more than it needs when its size is
+  // a multiple of kFloatsPerBatch.
+  constexpr size_t kFloatsPerBatch =
+      Xorshift128Plus::N * sizeof(uint64_t) / sizeof(float);
+  HWY_ALIGN uint64_t batch[Xorshift128Plus::N];
+  const uint32_t* JXL_RESTRICT bits = reinterpret_cast<const uint32_t*>(batch);
+  const size_t group_dim = frame_dim.group_dim;
+  for (size_t gy = y0 / group_dim; gy <= (y1 - 1) / group_dim; gy++) {
+    for (size_t gx = x0 / group_dim; gx <= (x1 - 1) / group_dim; gx++) {
+      const Rect group(gx * group_dim, gy * group_dim, group_dim, group_dim,
+                       xsize, ysize);
+      const size_t batches_per_row = group.xsize() / kFloatsPerBatch + 1;
+      // Part of the group that is needed, relative to the group.
+      const size_t begin_x = std::max(x0, group.x0()) - group.x0();
+      const size_t end_x =
+          std::min(x1, group.x0() + group.xsize()) - group.x0();
+      const size_t begin_y = std::max(y0, group.y0()) - group.y0();
+      const size_t end_y =
+          std::min(y1, group.y0() + group.ysize()) - group.y0();
+
+      HWY_ALIGN Xorshift128Plus rng(seed + gy * frame_dim.xsize_groups + gx);
+      uint64_t num_fills = 0;
+      for (size_t c = 0; c < 3; c++) {
+        for (size_t y = begin_y; y < end_y; y++) {
+          float* JXL_RESTRICT row =
+              raw->PlaneRow(c, group.y0() + y + off_y) + group.x0() + off_x;
+          const uint64_t first_fill =
+              (c * group.ysize() + y) * batches_per_row +
+              begin_x / kFloatsPerBatch;
+          rng.Skip(first_fill - num_fills);
+          num_fills = first_fill;
+          for (size_t x = begin_x; x < end_x;) {
+            rng.Fill(batch);
+            num_fills++;
+            const size_t batch_end = std::min(
+                end_x, (x / kFloatsPerBatch + 1) * kFloatsPerBatch);
+            for (; x < batch_end; x++) {
+              // 1.0 + 23 random mantissa bits = [1, 2), as in BitsToFloat.
+              const uint32_t rand12 =
+                  (bits[x % kFloatsPerBatch] >> 9) | 0x3F800000;
+              memcpy(row + x, &rand12, sizeof(rand12));
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // Mirror the pixels outside of the frame, as Symmetric5 would: first the
+  // columns of the rows inside of the frame, then the rows outside of it.
+  const int64_t raw_xsize = rect.xsize() + 2 * kNoiseBorder;
+  for (size_t c = 0; c < 3; c++) {
+    for (size_t y = y0; y < y1; y++) {
+      float* JXL_RESTRICT row = raw->PlaneRow(c, y + off_y);
+      for (int64_t x = -off_x; x < 0; x++) {
+        row[x + off_x] = row[Mirror(x, xsize) + off_x];
+      }
+      for (int64_t x = x1; x < raw_xsize - off_x; x++) {
+        row[x + off_x] = row[Mirror(x, xsize) + off_x];
+      }
+    }
+    const int64_t raw_ysize = rect.ysize() + 2 * kNoiseBorder;
+    for (int64_t y = -off_y; y < raw_ysize - off_y; y++) {
+      if (y >= 0 && y < ysize) continue;
+      memcpy(raw->PlaneRow(c, y + off_y),
+             raw->ConstPlaneRow(c, Mirror(y, ysize) + off_y),
+             raw_xsize * sizeof(float));
+    }
+  }
+}
+
+// Weighted sum of 1x5 pixels around `center` with [wx2 wx1 wx0 wx1 wx2], as in
+// Symmetric5.
+template <class DF, class V>
+static HWY_INLINE V WeightedSum5(DF df, const float* JXL_RESTRICT center,
+                                 const V wx0, const V wx1, const V wx2) {
+  const auto in_m2 = LoadU(df, center - 2);
+  const auto in_p2 = LoadU(df, center + 2);
+  const auto in_m1 = LoadU(df, center - 1);
+  const auto in_p1 = LoadU(df, center + 1);
+  const auto in_00 = LoadU(df, center);
+  const auto sum_2 = wx2 * (in_m2 + in_p2);
+  const auto sum_1 = wx1 * (in_m1 + in_p1);
+  const auto sum_0 = wx0 * in_00;
+  return sum_2 + sum_1 + sum_0;
+}
+
+void HighPassNoiseRow(const Image3F& raw, size_t xsize, size_t y,
+                      Image3F* JXL_RESTRICT out) {
+  const HWY_FULL(float) df;
+  // 4 * (1 - box kernel), with the same order of operations as Symmetric5 so
+  // that the result does not depend on how the frame is split into rects.
+  const auto w0 = Set(df, -3.84f);
+  const auto w1 = Set(df, 0.16f);
+  for (size_t c = 0; c < 3; c++) {
+    const float* JXL_RESTRICT rows[5];
+    for (size_t i = 0; i < 5; i++) {
+      rows[i] = raw.ConstPlaneRow(c, y + i) + kNoiseBorder;
+    }
+    float* JXL_RESTRICT row_out = out->PlaneRow(c, 0);
+    for (size_t x = 0; x < xsize; x += Lanes(df)) {
+      auto sum0 = WeightedSum5(df, rows[2] + x, w0, w1, w1);
+      sum0 += WeightedSum5(df, rows[0] + x, w1, w1, w1);
+      auto sum1 = WeightedSum5(df, rows[4] + x, w1, w1, w1);
+      sum0 += WeightedSum5(df, rows[1] + x, w1, w1, w1);
+      sum1 += WeightedSum5(df, rows[3] + x, w1, w1, w1);
+      Store(sum0 + sum1, df, row_out + x);
+    }
+  }
+}
+
 // NOLINTNEXTLINE(google-readability-namespace-comments)
 }  // namespace HWY_NAMESPACE
 }  // namespace jxl
@@ -231,6 +361,18 @@ void RandomImage3(size_t seed, const Rect& rect, Image3F* JXL_RESTRICT noise) {
   return HWY_DYNAMIC_DISPATCH(RandomImage3)(seed, rect, noise);
 }
 
+HWY_EXPORT(RandomNoiseRect);
+void RandomNoiseRect(size_t seed, const FrameDimensions& frame_dim,
+                     const Rect& rect, Image3F* JXL_RESTRICT raw) {
+  return HWY_DYNAMIC_DISPATCH(RandomNoiseRect)(seed, frame_dim, rect, raw);
+}
+
+HWY_EXPORT(HighPassNoiseRow);
+void HighPassNoiseRow(const Image3F& raw, size_t xsize, size_t y,
+                      Image3F* JXL_RESTRICT out) {
+  return HWY_DYNAMIC_DISPATCH(HighPassNoiseRow)(raw, xsize, y, out);
+}
+
 void DecodeFloatParam(float precision, float* val, BitReader* br) {
   const int absval_quant = br->ReadFixedBits<10>();
   *val = absval_quant / precision;
@@ -23,6 +23,7 @@
 #include "lib/jxl/aux_out_fwd.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/chroma_from_luma.h"
+#include "lib/jxl/common.h"
 #include "lib/jxl/dec_bit_reader.h"
 #include "lib/jxl/image.h"
 #include "lib/jxl/noise.h"
@@ -37,6 +38,24 @@ void AddNoise(const NoiseParams& noise_params, const Rect& noise_rect,
 
 void RandomImage3(size_t seed, const Rect& rect, Image3F* JXL_RESTRICT noise);
 
+// Number of pixels on each side of a rect whose random noise is needed to
+// high-pass filter the noise of the rect.
+constexpr size_t kNoiseBorder = 2;
+
+// Writes to `raw` the random noise that RandomImage3 generates for `rect` when
+// it is called with seed + group_index for each padded group of the frame,
+// with a border of kNoiseBorder pixels around it, mirrored outside of the
+// padded frame. Only generates the batches of random bits that are needed, so
+// the cost is proportional to the size of `rect`.
+void RandomNoiseRect(size_t seed, const FrameDimensions& frame_dim,
+                     const Rect& rect, Image3F* JXL_RESTRICT raw);
+
+// Writes to the first row of `out` the first `xsize` pixels of row `y` of the
+// rect for which RandomNoiseRect generated `raw`, high-pass filtered as by
+// Symmetric5 on the noise of the whole frame.
+void HighPassNoiseRow(const Image3F& raw, size_t xsize, size_t y,
+                      Image3F* JXL_RESTRICT out);
+
 // Must only call if FrameHeader.flags.kNoise.
 Status DecodeNoise(BitReader* br, NoiseParams* noise_params);
 
@@ -0,0 +1,123 @@
+// Copyright (c) the JPEG XL Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lib/jxl/dec_noise.h"
+
+#include <stddef.h>
+
+#include <utility>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "lib/jxl/common.h"
+#include "lib/jxl/convolve.h"
+#include "lib/jxl/filters.h"
+#include "lib/jxl/image.h"
+
+namespace jxl {
+namespace {
+
+// Noise of the whole frame, as the decoder used to generate it before
+// rendering the frame.
+Image3F FrameNoise(size_t seed, const FrameDimensions& frame_dim) {
+  Image3F noise(frame_dim.xsize_padded, frame_dim.ysize_padded);
+  for (size_t gy = 0; gy < frame_dim.ysize_groups; gy++) {
+    for (size_t gx = 0; gx < frame_dim.xsize_groups; gx++) {
+      const Rect group(gx * frame_dim.group_dim, gy * frame_dim.group_dim,
+                       frame_dim.group_dim, frame_dim.group_dim,
+                       frame_dim.xsize_padded, frame_dim.ysize_padded);
+      RandomImage3(seed + gy * frame_dim.xsize_groups + gx, group, &noise);
+    }
+  }
+  // 4 * (1 - box kernel)
+  WeightsSymmetric5 weights{{HWY_REP4(-3.84)}, {HWY_REP4(0.16)},
+                            {HWY_REP4(0.16)},  {HWY_REP4(0.16)},
+                            {HWY_REP4(0.16)},  {HWY_REP4(0.16)}};
+  ImageF noise_tmp(noise.xsize(), noise.ysize());
+  for (size_t c = 0; c < 3; c++) {
+    Symmetric5(noise.Plane(c), Rect(noise), weights, /*pool=*/nullptr,
+               &noise_tmp);
+    std::swap(noise.Plane(c), noise_tmp);
+  }
+  return noise;
+}
+
+// Checks that the noise generated for each of the rects matches the noise of
+// the whole frame.
+void TestNoiseRects(const FrameDimensions& frame_dim,
+                    const std::vector<Rect>& rects) {
+  const size_t kSeed = 1234;
+  const Image3F expected = FrameNoise(kSeed, frame_dim);
+  Image3F raw(kApplyImageFeaturesTileDim + 2 * kNoiseBorder,
+              kApplyImageFeaturesTileDim + 2 * kNoiseBorder);
+  Image3F row(kApplyImageFeaturesTileDim, 1);
+  for (const Rect& rect : rects) {
+    RandomNoiseRect(kSeed, frame_dim, rect, &raw);
+    for (size_t y = 0; y < rect.ysize(); y++) {
+      HighPassNoiseRow(raw, rect.xsize(), y, &row);
+      for (size_t c = 0; c < 3; c++) {
+        const float* JXL_RESTRICT row_expected =
+            rect.ConstPlaneRow(expected, c, y);
+        const float* JXL_RESTRICT row_actual = row.ConstPlaneRow(c, 0);
+        for (size_t x = 0; x < rect.xsize(); x++) {
+          // Allows for differences in the contraction into fused
+          // multiply-adds, the operations are otherwise the same.
+          ASSERT_NEAR(row_expected[x], row_actual[x], 1E-5f)
+              << "c=" << c << " x=" << rect.x0() + x << " y=" << rect.y0() + y;
+        }
+      }
+    }
+  }
+}
+
+// All the rects of the given size that tile the padded frame.
+std::vector<Rect> Tiles(const FrameDimensions& frame_dim, size_t xsize,
+                        size_t ysize) {
+  std::vector<Rect> rects;
+  for (size_t y = 0; y < frame_dim.ysize_padded; y += ysize) {
+    for (size_t x = 0; x < frame_dim.xsize_padded; x += xsize) {
+      rects.emplace_back(x, y, xsize, ysize, frame_dim.xsize_padded,
+                         frame_dim.ysize_padded);
+    }
+  }
+  return rects;
+}
+
+TEST(DecNoiseTest, GroupRects) {
+  FrameDimensions frame_dim;
+  frame_dim.Set(600, 300, /*group_size_shift=*/1, 0, 0,
+                /*modular_mode=*/false, /*upsampling=*/1);
+  TestNoiseRects(frame_dim, Tiles(frame_dim, 256, 256));
+}
+
+TEST(DecNoiseTest, UnalignedRects) {
+  FrameDimensions frame_dim;
+  frame_dim.Set(300, 277, /*group_size_shift=*/0, 0, 0,
+                /*modular_mode=*/false, /*upsampling=*/1);
+  TestNoiseRects(frame_dim, Tiles(frame_dim, 100, 61));
+  // Rects across the gaps between groups, as rendered after the groups.
+  TestNoiseRects(frame_dim, {Rect(0, 124, 256, 8), Rect(124, 8, 8, 112),
+                             Rect(252, 130, 52, 150), Rect(3, 5, 1, 1)});
+}
+
+TEST(DecNoiseTest, SmallModularFrame) {
+  FrameDimensions frame_dim;
+  frame_dim.Set(3, 2, /*group_size_shift=*/1, 0, 0,
+                /*modular_mode=*/true, /*upsampling=*/1);
+  TestNoiseRects(frame_dim, Tiles(frame_dim, 256, 256));
+  TestNoiseRects(frame_dim, Tiles(frame_dim, 1, 1));
+}
+
+}  // namespace
+}  // namespace jxl
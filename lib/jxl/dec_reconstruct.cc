@@ -14,6 +14,7 @@
 
 #include "lib/jxl/dec_reconstruct.h"
 
+#include <algorithm>
 #include <atomic>
 #include <utility>
 
@@ -28,7 +29,6 @@
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/profiler.h"
-#include "lib/jxl/blending.h"
 #include "lib/jxl/color_management.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/dec_noise.h"
@@ -106,6 +106,121 @@ Status UndoXYBInPlace(Image3F* idct, const OpsinParams& opsin_params,
   return true;
 }
 
+// Converts the XYB pixels of `idct_rect` of `idct`, which are the pixels of
+// `rect` of the frame, to 8-bit sRGB and writes them to the channels of
+// dec_state->rgb_output, in a single pass instead of converting `idct` in place
+// and then to integers. With rgb_output_callback, each row is interleaved into
+// the callback row of `thread` and passed to the callback instead.
+void UndoXYBToRGB8(const Image3F& idct, const Rect& idct_rect, const Rect& rect,
+                   const PassesDecoderState* dec_state, size_t thread) {
+  PROFILER_ZONE("UndoXYBToRGB8");
+  const FrameDimensions& frame_dim = dec_state->shared->frame_dim;
+  const OpsinParams& opsin_params = dec_state->shared->opsin_params;
+  // The rect may include the padding of the frame, which is not output.
+  if (rect.x0() >= frame_dim.xsize) return;
+  const size_t xsize = std::min(rect.xsize(), frame_dim.xsize - rect.x0());
+  const size_t num_channels = dec_state->num_rgb_output_channels;
+
+  const HWY_FULL(float) d;
+  const HWY_FULL(int32_t) di;
+  const auto zero = Zero(d);
+  const auto one = Set(d, 1.0f);
+  const auto mul = Set(d, 255.0f);
+  const auto half = Set(d, 0.5f);
+
+  // The integer values are computed for a chunk of the row at a time, and then
+  // interleaved into the output.
+  constexpr size_t kChunkSize = 256;
+  HWY_ALIGN int32_t rgb[3][kChunkSize];
+  for (size_t y = 0; y < rect.ysize(); y++) {
+    if (rect.y0() + y >= frame_dim.ysize) break;
+    const float* JXL_RESTRICT row_x = idct_rect.ConstPlaneRow(idct, 0, y);
+    const float* JXL_RESTRICT row_y = idct_rect.ConstPlaneRow(idct, 1, y);
+    const float* JXL_RESTRICT row_b = idct_rect.ConstPlaneRow(idct, 2, y);
+    uint8_t* row_out[4];
+    uint8_t* JXL_RESTRICT callback_row = nullptr;
+    if (dec_state->rgb_output_callback != nullptr) {
+      callback_row = dec_state->callback_rows[thread].Row(0);
+      for (size_t c = 0; c < num_channels; c++) row_out[c] = callback_row + c;
+    } else {
+      for (size_t c = 0; c < num_channels; c++) {
+        const ChannelOut& out = dec_state->rgb_output[c];
+        row_out[c] = out.data + (rect.y0() + y) * out.row_stride +
+                     rect.x0() * out.pixel_stride;
+      }
+    }
+    for (size_t x0 = 0; x0 < xsize; x0 += kChunkSize) {
+      const size_t chunk_xsize = std::min(kChunkSize, xsize - x0);
+      for (size_t x = 0; x < chunk_xsize; x += Lanes(d)) {
+        const auto in_opsin_x = LoadU(d, row_x + x0 + x);
+        const auto in_opsin_y = LoadU(d, row_y + x0 + x);
+        const auto in_opsin_b = LoadU(d, row_b + x0 + x);
+        JXL_COMPILER_FENCE;
+        auto linear_r = Undefined(d);
+        auto linear_g = Undefined(d);
+        auto linear_b = Undefined(d);
+        XybToRgb(d, in_opsin_x, in_opsin_y, in_opsin_b, opsin_params, &linear_r,
+                 &linear_g, &linear_b);
+        // Same rounding as for integer output in ConvertImage.
+        const auto r = TF_SRGB().EncodedFromDisplay(linear_r);
+        const auto g = TF_SRGB().EncodedFromDisplay(linear_g);
+        const auto b = TF_SRGB().EncodedFromDisplay(linear_b);
+        Store(ConvertTo(di, Min(Max(r, zero), one) * mul + half), di,
+              rgb[0] + x);
+        Store(ConvertTo(di, Min(Max(g, zero), one) * mul + half), di,
+              rgb[1] + x);
+        Store(ConvertTo(di, Min(Max(b, zero), one) * mul + half), di,
+              rgb[2] + x);
+      }
+      for (size_t c = 0; c < num_channels; c++) {
+        const size_t pixel_stride = dec_state->rgb_output[c].pixel_stride;
+        uint8_t* JXL_RESTRICT out = row_out[c] + x0 * pixel_stride;
+        if (c == 3) {
+          for (size_t x = 0; x < chunk_xsize; x++) out[x * pixel_stride] = 255;
+          continue;
+        }
+        for (size_t x = 0; x < chunk_xsize; x++) {
+          out[x * pixel_stride] = rgb[c][x];
+        }
+      }
+    }
+    if (callback_row != nullptr) {
+      dec_state->rgb_output_callback(dec_state->rgb_output_opaque, rect.x0(),
+                                     rect.y0() + y, xsize, callback_row);
+    }
+  }
+}
+
+// Writes a row of a plane of a YCbCr frame, as decoded, to 8-bit samples. All
+// three planes are stored with an offset of -128/255 from full-range JFIF
+// values: the Y plane because it is decoded that way, and the Cb and Cr planes
+// because they are centered at 0.
+void WriteYCbCrRow(const float* JXL_RESTRICT row_in, size_t xsize,
+                   uint8_t* JXL_RESTRICT row_out, size_t pixel_stride) {
+  const HWY_FULL(float) d;
+  const HWY_FULL(int32_t) di;
+  const auto zero = Zero(d);
+  const auto one = Set(d, 1.0f);
+  const auto mul = Set(d, 255.0f);
+  const auto half = Set(d, 0.5f);
+  const auto c128 = Set(d, 128.0f / 255);
+
+  constexpr size_t kChunkSize = 256;
+  HWY_ALIGN int32_t values[kChunkSize];
+  for (size_t x0 = 0; x0 < xsize; x0 += kChunkSize) {
+    const size_t chunk_xsize = std::min(kChunkSize, xsize - x0);
+    for (size_t x = 0; x < chunk_xsize; x += Lanes(d)) {
+      const auto v = LoadU(d, row_in + x0 + x) + c128;
+      // Same rounding as for integer output in ConvertImage.
+      Store(ConvertTo(di, Min(Max(v, zero), one) * mul + half), di, values + x);
+    }
+    uint8_t* JXL_RESTRICT out = row_out + x0 * pixel_stride;
+    for (size_t x = 0; x < chunk_xsize; x++) {
+      out[x * pixel_stride] = values[x];
+    }
+  }
+}
+
 Status ApplyImageFeaturesRow(Image3F* JXL_RESTRICT idct, const Rect& rect,
                              PassesDecoderState* dec_state, ssize_t y,
                              size_t thread) {
@@ -113,6 +228,13 @@ Status ApplyImageFeaturesRow(Image3F* JXL_RESTRICT idct, const Rect& rect,
   const FrameHeader& frame_header = dec_state->shared->frame_header;
   const OpsinParams& opsin_params = dec_state->shared->opsin_params;
 
+  // If the frame is only written to rgb_output, the row is rendered to the
+  // row of the thread instead of to `idct`, which is not allocated.
+  if (dec_state->rgb_output_only) {
+    JXL_DASSERT(rect.xsize() <= kApplyImageFeaturesTileDim);
+    idct = &dec_state->output_rows[thread];
+  }
+
   // ApplyLoopFiltersRow does a memcpy if no filters are applied.
   size_t output_y;
   bool has_output_row =
@@ -120,26 +242,32 @@ Status ApplyImageFeaturesRow(Image3F* JXL_RESTRICT idct, const Rect& rect,
   if (!has_output_row) return true;
 
   const Rect row_rect(rect.x0(), rect.y0() + output_y, rect.xsize(), 1);
+  // Position of the row in `idct`.
+  const Rect idct_rect = dec_state->rgb_output_only
+                             ? Rect(kMaxFilterPadding, 0, rect.xsize(), 1)
+                             : row_rect;
 
-  // At this point, `idct:rect` holds the decoded pixels, independently of epf
-  // or gaborish having been applied.
+  // At this point, `idct:idct_rect` holds the decoded pixels, independently of
+  // epf or gaborish having been applied.
 
   // TODO(veluca): Consider collapsing/inlining some of the following loops.
-  image_features.patches.AddTo(idct, row_rect, row_rect);
-  JXL_RETURN_IF_ERROR(image_features.splines.AddTo(
-      idct, row_rect, row_rect, dec_state->shared_storage.cmap));
+  image_features.patches.AddTo(idct, idct_rect, row_rect);
+  image_features.splines.AddTo(idct, idct_rect, row_rect);
 
   if (frame_header.flags & FrameHeader::kNoise) {
     PROFILER_ZONE("AddNoise");
-    AddNoise(image_features.noise_params, row_rect, dec_state->noise, row_rect,
-             dec_state->shared_storage.cmap, idct);
+    Image3F* JXL_RESTRICT noise_row = &dec_state->noise_rows[thread];
+    HighPassNoiseRow(dec_state->raw_noise[thread], rect.xsize(), output_y,
+                     noise_row);
+    AddNoise(image_features.noise_params, Rect(0, 0, rect.xsize(), 1),
+             *noise_row, idct_rect, dec_state->shared_storage.cmap, idct);
   }
 
   if (dec_state->pre_color_transform_frame.xsize() != 0) {
     for (size_t c = 0; c < 3; c++) {
       float* JXL_RESTRICT row_out =
           row_rect.PlaneRow(&dec_state->pre_color_transform_frame, c, 0);
-      const float* JXL_RESTRICT row_in = row_rect.ConstPlaneRow(*idct, c, 0);
+      const float* JXL_RESTRICT row_in = idct_rect.ConstPlaneRow(*idct, c, 0);
       memcpy(row_out, row_in, row_rect.xsize() * sizeof(*row_in));
     }
   }
@@ -153,8 +281,12 @@ Status ApplyImageFeaturesRow(Image3F* JXL_RESTRICT idct, const Rect& rect,
 
   if (frame_header.color_transform == ColorTransform::kXYB &&
       frame_header.needs_color_transform() && frame_header.upsampling == 1) {
-    JXL_RETURN_IF_ERROR(UndoXYBInPlace(idct, opsin_params, row_rect,
-                                       dec_state->output_encoding));
+    if (dec_state->num_rgb_output_channels != 0) {
+      UndoXYBToRGB8(*idct, idct_rect, row_rect, dec_state, thread);
+    } else {
+      JXL_RETURN_IF_ERROR(UndoXYBInPlace(idct, opsin_params, row_rect,
+                                         dec_state->output_encoding));
+    }
   }
 
   return true;
@@ -165,6 +297,20 @@ Status FinalizeImageRect(ImageBundle* JXL_RESTRICT decoded, const Rect& rect,
   const LoopFilter& lf = dec_state->shared->frame_header.loop_filter;
   JXL_DASSERT(dec_state->decoded_padding >= kMaxFilterBorder);
 
+  if (dec_state->shared->frame_header.flags & FrameHeader::kNoise) {
+    PROFILER_ZONE("GenerateNoise");
+    JXL_DASSERT(rect.xsize() <= kApplyImageFeaturesTileDim &&
+                rect.ysize() <= kApplyImageFeaturesTileDim);
+    Image3F& raw_noise = dec_state->raw_noise[thread];
+    if (raw_noise.xsize() == 0) {
+      raw_noise = Image3F(kApplyImageFeaturesTileDim + 2 * kNoiseBorder,
+                          kApplyImageFeaturesTileDim + 2 * kNoiseBorder);
+      dec_state->noise_rows[thread] = Image3F(kApplyImageFeaturesTileDim, 1);
+    }
+    RandomNoiseRect(dec_state->frame_noise_seed, dec_state->shared->frame_dim,
+                    rect, &raw_noise);
+  }
+
   for (ssize_t y = -lf.PaddingRows();
        y < static_cast<ssize_t>(lf.PaddingRows() + rect.ysize()); y++) {
     JXL_RETURN_IF_ERROR(
@@ -183,6 +329,89 @@ namespace jxl {
 
 HWY_EXPORT(UndoXYBInPlace);
 
+HWY_EXPORT(WriteYCbCrRow);
+
+namespace {
+
+// Writes the Y, Cb and Cr planes of the frame, at the resolution at which they
+// are decoded, to ycbcr_output.
+void WriteYCbCrOutput(const PassesDecoderState* dec_state, ThreadPool* pool) {
+  const YCbCrChromaSubsampling& cs =
+      dec_state->shared->frame_header.chroma_subsampling;
+  const FrameDimensions& frame_dim = dec_state->shared->frame_dim;
+  // Channels of the decoded image that hold Y, Cb and Cr.
+  constexpr size_t kChannels[3] = {1, 0, 2};
+  for (size_t i = 0; i < 3; i++) {
+    const size_t c = kChannels[i];
+    const size_t xsize = DivCeil(frame_dim.xsize, size_t{1} << cs.HShift(c));
+    const size_t ysize = DivCeil(frame_dim.ysize, size_t{1} << cs.VShift(c));
+    const ChannelOut& out = dec_state->ycbcr_output[i];
+    RunOnPool(
+        pool, 0, ysize, ThreadPool::SkipInit(),
+        [&](int y, int /*thread*/) {
+          const float* row_in = dec_state->decoded.Plane(c).ConstRow(y) +
+                                dec_state->decoded_padding;
+          HWY_DYNAMIC_DISPATCH(WriteYCbCrRow)
+          (row_in, xsize, out.data + y * out.row_stride, out.pixel_stride);
+        },
+        "WriteYCbCr");
+  }
+}
+
+// Appends to `rects` the rects along the borders between the groups of the
+// rows of groups [ygroup_begin, ygroup_end), and between each of these rows
+// and the row above it, that are not rendered when the groups are decoded
+// because the loop filters read across them.
+void AddGroupBorderRects(const PassesDecoderState* dec_state,
+                         size_t ygroup_begin, size_t ygroup_end,
+                         std::vector<Rect>* rects) {
+  const LoopFilter& lf = dec_state->shared->frame_header.loop_filter;
+  const FrameDimensions& frame_dim = dec_state->shared->frame_dim;
+  size_t xsize = frame_dim.xsize_padded;
+  size_t ysize = frame_dim.ysize_padded;
+  size_t xsize_groups = frame_dim.xsize_groups;
+  size_t ysize_groups = frame_dim.ysize_groups;
+  size_t padx = lf.PaddingCols();
+  size_t pady = lf.PaddingRows();
+  // For every gap between groups, vertically, enqueue top gap with previous
+  // group ...
+  for (size_t ygroup = std::max<size_t>(ygroup_begin, 1); ygroup < ygroup_end;
+       ygroup++) {
+    size_t gystart = (ygroup - 1) * kGroupDim;
+    size_t gyend = std::min(ysize, kGroupDim * ygroup);
+    // Group is processed together with another group.
+    if (gyend <= gystart + kBlockDim) continue;
+    for (size_t xstart = 0; xstart < xsize;
+         xstart += kApplyImageFeaturesTileDim) {
+      rects->emplace_back(xstart, gyend - pady, kApplyImageFeaturesTileDim,
+                          2 * pady, xsize, ysize);
+    }
+  }
+  // For every gap between groups, horizontally, enqueue right gap with next
+  // group, carefully avoiding overlaps with the horizontal gaps enqueued
+  // before...
+  for (size_t xgroup = 0; xgroup < xsize_groups - 1; xgroup++) {
+    size_t gxstart = xgroup == 0 ? kBlockDim : xgroup * kGroupDim;
+    size_t gxend = std::min(xsize, kGroupDim * (xgroup + 1));
+    // Group is processed together with another group.
+    if (gxend <= gxstart + kBlockDim) continue;
+    for (size_t ygroup = ygroup_begin; ygroup < ygroup_end; ygroup++) {
+      size_t gystart = ygroup == 0 ? 0 : ygroup * kGroupDim + pady;
+      size_t gyend = ygroup == ysize_groups - 1
+                         ? ysize
+                         : kGroupDim * (ygroup + 1) - pady;
+      if (gyend <= gystart) continue;
+      for (size_t ystart = gystart; ystart < gyend;
+           ystart += kApplyImageFeaturesTileDim) {
+        rects->emplace_back(gxend - padx, ystart, 2 * padx,
+                            kApplyImageFeaturesTileDim, xsize, gyend);
+      }
+    }
+  }
+}
+
+}  // namespace
+
 HWY_EXPORT(FinalizeImageRect);
 Status FinalizeImageRect(ImageBundle* JXL_RESTRICT decoded, const Rect& rect,
                          PassesDecoderState* dec_state, size_t thread) {
@@ -190,63 +419,73 @@ Status FinalizeImageRect(ImageBundle* JXL_RESTRICT decoded, const Rect& rect,
                                                  thread);
 }
 
+namespace {
+
+// Renders `rects` in parallel on `pool`.
+Status FinalizeImageRects(ImageBundle* decoded, const std::vector<Rect>& rects,
+                          PassesDecoderState* dec_state, ThreadPool* pool) {
+  const auto allocate_storage = [&](size_t num_threads) {
+    dec_state->EnsureStorage(num_threads);
+    return true;
+  };
+
+  std::atomic<bool> apply_features_ok{true};
+  auto run_apply_features = [&](size_t rect_id, size_t thread) {
+    if (!FinalizeImageRect(decoded, rects[rect_id], dec_state, thread)) {
+      apply_features_ok = false;
+    }
+  };
+
+  RunOnPool(pool, 0, rects.size(), allocate_storage, run_apply_features,
+            "ApplyFeatures");
+
+  if (!apply_features_ok) {
+    return JXL_FAILURE("FinalizeImageRect failed");
+  }
+  return true;
+}
+
+}  // namespace
+
+Status FinalizeGroupRowBorders(ImageBundle* JXL_RESTRICT decoded,
+                               size_t ygroup, PassesDecoderState* dec_state,
+                               ThreadPool* pool) {
+  const LoopFilter& lf = dec_state->shared->frame_header.loop_filter;
+  if (!lf.gab && lf.epf_iters == 0) return true;
+  std::vector<Rect> rects;
+  AddGroupBorderRects(dec_state, ygroup, ygroup + 1, &rects);
+  return FinalizeImageRects(decoded, rects, dec_state, pool);
+}
+
 Status FinalizeFrameDecoding(ImageBundle* decoded,
                              PassesDecoderState* dec_state, ThreadPool* pool,
-                             bool rerender, bool skip_blending) {
+                             bool rerender) {
   std::vector<Rect> rects_to_process;
 
   const LoopFilter& lf = dec_state->shared->frame_header.loop_filter;
   const FrameHeader& frame_header = dec_state->shared->frame_header;
   const FrameDimensions& frame_dim = dec_state->shared->frame_dim;
 
+  // The frame has no filters or features to render, and its planes are output
+  // before chroma upsampling and the color transform.
+  if (dec_state->ycbcr_output_only) {
+    WriteYCbCrOutput(dec_state, pool);
+    return true;
+  }
+
+  // The borders between the groups of a banded frame are rendered with each
+  // row of groups, by FinalizeGroupRowBorders.
   if ((lf.epf_iters > 0 || lf.gab) && frame_header.chroma_subsampling.Is444() &&
-      frame_header.encoding != FrameEncoding::kModular && !rerender) {
-    size_t xsize = frame_dim.xsize_padded;
-    size_t ysize = frame_dim.ysize_padded;
-    size_t xsize_groups = frame_dim.xsize_groups;
-    size_t ysize_groups = frame_dim.ysize_groups;
-    size_t padx = lf.PaddingCols();
-    size_t pady = lf.PaddingRows();
-    // For every gap between groups, vertically, enqueue bottom gap with next
-    // group ...
-    for (size_t ygroup = 0; ygroup < ysize_groups - 1; ygroup++) {
-      size_t gystart = ygroup * kGroupDim;
-      size_t gyend = std::min(ysize, kGroupDim * (ygroup + 1));
-      // Group is processed together with another group.
-      if (gyend <= gystart + kBlockDim) continue;
-      for (size_t xstart = 0; xstart < xsize;
-           xstart += kApplyImageFeaturesTileDim) {
-        rects_to_process.emplace_back(xstart, gyend - pady,
-                                      kApplyImageFeaturesTileDim, 2 * pady,
-                                      xsize, ysize);
-      }
-    }
-    // For every gap between groups, horizontally, enqueue right gap with next
-    // group, carefully avoiding overlaps with the horizontal gaps enqueued
-    // before...
-    for (size_t xgroup = 0; xgroup < xsize_groups - 1; xgroup++) {
-      size_t gxstart = xgroup == 0 ? kBlockDim : xgroup * kGroupDim;
-      size_t gxend = std::min(xsize, kGroupDim * (xgroup + 1));
-      // Group is processed together with another group.
-      if (gxend <= gxstart + kBlockDim) continue;
-      for (size_t ygroup = 0; ygroup < ysize_groups; ygroup++) {
-        size_t gystart = ygroup == 0 ? 0 : ygroup * kGroupDim + pady;
-        size_t gyend = ygroup == ysize_groups - 1
-                           ? ysize
-                           : kGroupDim * (ygroup + 1) - pady;
-        if (gyend <= gystart) continue;
-        for (size_t ystart = gystart; ystart < gyend;
-             ystart += kApplyImageFeaturesTileDim) {
-          rects_to_process.emplace_back(gxend - padx, ystart, 2 * padx,
-                                        kApplyImageFeaturesTileDim, xsize,
-                                        gyend);
-        }
-      }
-    }
+      frame_header.encoding != FrameEncoding::kModular && !rerender &&
+      !dec_state->banded) {
+    AddGroupBorderRects(dec_state, 0, frame_dim.ysize_groups,
+                        &rects_to_process);
   }
   // If we used chroma subsampling, we upsample chroma now and run
-  // ApplyImageFeatures after.
-  if (!frame_header.chroma_subsampling.Is444()) {
+  // ApplyImageFeatures after. Without loop filters, chroma is instead
+  // upsampled one row at a time while the rects are rendered.
+  if (!frame_header.chroma_subsampling.Is444() &&
+      (lf.epf_iters > 0 || lf.gab)) {
     for (size_t c = 0; c < 3; c++) {
       // This implementation of Upsample assumes that the image dimension in
       // xsize_padded, ysize_padded is a multiple of 8x8.
@@ -262,13 +501,21 @@ Status FinalizeFrameDecoding(ImageBundle* decoded,
            frame_header.chroma_subsampling.HShift(c)) +
               2 * dec_state->decoded_padding,
           frame_dim.ysize_padded >> frame_header.chroma_subsampling.VShift(c));
-      for (size_t i = 0; i < frame_header.chroma_subsampling.HShift(c); i++) {
-        plane.InitializePaddingForUnalignedAccesses();
-        plane = UpsampleH2(plane, dec_state->decoded_padding, pool);
-      }
-      for (size_t i = 0; i < frame_header.chroma_subsampling.VShift(c); i++) {
+      const size_t hshift = frame_header.chroma_subsampling.HShift(c);
+      const size_t vshift = frame_header.chroma_subsampling.VShift(c);
+      if (hshift == 1 && vshift == 1) {
+        // 4:2:0, done in a single pass over the plane.
         plane.InitializePaddingForUnalignedAccesses();
-        plane = UpsampleV2(plane, pool);
+        plane = UpsampleHV2(plane, dec_state->decoded_padding, pool);
+      } else {
+        for (size_t i = 0; i < hshift; i++) {
+          plane.InitializePaddingForUnalignedAccesses();
+          plane = UpsampleH2(plane, dec_state->decoded_padding, pool);
+        }
+        for (size_t i = 0; i < vshift; i++) {
+          plane.InitializePaddingForUnalignedAccesses();
+          plane = UpsampleV2(plane, pool);
+        }
       }
       JXL_DASSERT(SameSize(plane, dec_state->decoded));
     }
@@ -287,35 +534,34 @@ Status FinalizeFrameDecoding(ImageBundle* decoded,
       FillImage(kInvSigmaNum / lf.epf_sigma_for_modular,
                 &dec_state->filter_weights.sigma);
     }
-    for (size_t y = 0; y < decoded->ysize(); y += kGroupDim) {
-      for (size_t x = 0; x < decoded->xsize(); x += kGroupDim) {
+    for (size_t y = 0; y < frame_dim.ysize; y += kGroupDim) {
+      for (size_t x = 0; x < frame_dim.xsize; x += kGroupDim) {
         Rect rect(x, y, kGroupDim, kGroupDim, frame_dim.xsize, frame_dim.ysize);
         if (rect.xsize() == 0 || rect.ysize() == 0) continue;
         rects_to_process.push_back(rect);
       }
     }
   }
-  const auto allocate_storage = [&](size_t num_threads) {
-    dec_state->EnsureStorage(num_threads);
-    return true;
-  };
-
-  std::atomic<bool> apply_features_ok{true};
-  auto run_apply_features = [&](size_t rect_id, size_t thread) {
-    if (!FinalizeImageRect(decoded, rects_to_process[rect_id], dec_state,
-                           thread)) {
-      apply_features_ok = false;
-    }
-  };
-
-  RunOnPool(pool, 0, rects_to_process.size(), allocate_storage,
-            run_apply_features, "ApplyFeatures");
-
-  if (!apply_features_ok) {
-    return JXL_FAILURE("FinalizeImageRect failed");
+  const Rect& render_rect = dec_state->render_rect;
+  if (render_rect.xsize() != 0) {
+    // Only keep the rects that contribute to the pixels that are needed.
+    auto outside_render_rect = [&render_rect](const Rect& rect) {
+      return rect.x0() >= render_rect.x0() + render_rect.xsize() ||
+             render_rect.x0() >= rect.x0() + rect.xsize() ||
+             rect.y0() >= render_rect.y0() + render_rect.ysize() ||
+             render_rect.y0() >= rect.y0() + rect.ysize();
+    };
+    rects_to_process.erase(
+        std::remove_if(rects_to_process.begin(), rects_to_process.end(),
+                       outside_render_rect),
+        rects_to_process.end());
   }
+  JXL_RETURN_IF_ERROR(
+      FinalizeImageRects(decoded, rects_to_process, dec_state, pool));
 
-  {
+  // Without the decoded image, the frame is already fully written to
+  // rgb_output.
+  if (!dec_state->rgb_output_only) {
     Image3F* idct = decoded->color();
     if (frame_header.color_transform == ColorTransform::kYCbCr &&
         frame_header.needs_color_transform()) {
@@ -327,16 +573,16 @@ Status FinalizeFrameDecoding(ImageBundle* decoded,
     idct->ShrinkTo(frame_dim.xsize, frame_dim.ysize);
     // TODO(veluca): consider making upsampling happen per-line.
     if (frame_header.upsampling != 1) {
-      Image3F temp(idct->xsize() * frame_header.upsampling,
-                   idct->ysize() * frame_header.upsampling);
-      dec_state->upsampler.UpsampleRect(*idct, Rect(*idct), &temp, Rect(temp));
-      *idct = std::move(temp);
-    }
-    // Do color transform now if upsampling was done.
-    if (frame_header.color_transform == ColorTransform::kXYB &&
-        frame_header.upsampling != 1 && frame_header.needs_color_transform()) {
-      size_t num_x_groups = DivCeil(idct->xsize(), kGroupDim);
-      size_t num_y_groups = DivCeil(idct->ysize(), kGroupDim);
+      // Upsampling, and the color transform that has to be done after it, are
+      // done one group of the upsampled image at a time, so that the group
+      // stays in cache between them.
+      const size_t upsampling = frame_header.upsampling;
+      const bool undo_xyb =
+          frame_header.color_transform == ColorTransform::kXYB &&
+          frame_header.needs_color_transform();
+      Image3F temp(idct->xsize() * upsampling, idct->ysize() * upsampling);
+      size_t num_x_groups = DivCeil(temp.xsize(), kGroupDim);
+      size_t num_y_groups = DivCeil(temp.ysize(), kGroupDim);
       std::atomic<bool> undo_xyb_ok{true};
       RunOnPool(
           pool, 0, num_x_groups * num_y_groups, ThreadPool::SkipInit(),
@@ -344,17 +590,23 @@ Status FinalizeFrameDecoding(ImageBundle* decoded,
             size_t gx = g % num_x_groups;
             size_t gy = g / num_x_groups;
             const Rect rect(gx * kGroupDim, gy * kGroupDim, kGroupDim,
-                            kGroupDim, idct->xsize(), idct->ysize());
-            if (!HWY_DYNAMIC_DISPATCH(UndoXYBInPlace)(
-                    idct, dec_state->shared->opsin_params, rect,
-                    dec_state->output_encoding)) {
+                            kGroupDim, temp.xsize(), temp.ysize());
+            // kGroupDim is a multiple of the upsampling factor.
+            const Rect src_rect(rect.x0() / upsampling, rect.y0() / upsampling,
+                                rect.xsize() / upsampling,
+                                rect.ysize() / upsampling);
+            dec_state->upsampler.UpsampleRect(*idct, src_rect, &temp, rect);
+            if (undo_xyb && !HWY_DYNAMIC_DISPATCH(UndoXYBInPlace)(
+                                &temp, dec_state->shared->opsin_params, rect,
+                                dec_state->output_encoding)) {
               undo_xyb_ok = false;
             }
           },
-          "XYB with upsample");
+          "UpsampleAndUndoXYB");
       if (!undo_xyb_ok) {
         return JXL_FAILURE("Undo XYB failed");
       }
+      *idct = std::move(temp);
     }
   }
 
@@ -366,10 +618,6 @@ Status FinalizeFrameDecoding(ImageBundle* decoded,
     dec_state->pre_color_transform_frame.ShrinkTo(xsize, ysize);
   }
 
-  if (!skip_blending) {
-    JXL_RETURN_IF_ERROR(DoBlending(dec_state, decoded));
-  }
-
   return true;
 }
 
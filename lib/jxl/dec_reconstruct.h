@@ -38,18 +38,25 @@ namespace jxl {
 // `SaveBeforeColorTransform()`) and applying upsampling.
 //
 // Writes pixels in the appropriate colorspace to `idct`, shrinking it if
-// necessary.
-// `skip_blending` is necessary because the encoder butteraugli loop does not
-// (yet) handle blending.
+// necessary. Blending with the reference frames is left to the caller (see
+// DoBlending), since the encoder butteraugli loop does not (yet) handle it.
 Status FinalizeFrameDecoding(ImageBundle* JXL_RESTRICT decoded,
                              PassesDecoderState* dec_state, ThreadPool* pool,
-                             bool rerender, bool skip_blending);
+                             bool rerender);
 
 // Render the `rect` portion of `decoded`, taking data from `dec_state`.
 // Takes an ImageBundle to have access to extra channels.
 Status FinalizeImageRect(ImageBundle* JXL_RESTRICT decoded, const Rect& rect,
                          PassesDecoderState* dec_state, size_t thread);
 
+// Renders the parts of row `ygroup` of groups of a banded frame that are not
+// rendered when its groups are decoded, because the loop filters read across
+// them: the borders between the groups of the row, and the border with the
+// row above. All groups of the row must be decoded.
+Status FinalizeGroupRowBorders(ImageBundle* JXL_RESTRICT decoded,
+                               size_t ygroup, PassesDecoderState* dec_state,
+                               ThreadPool* pool);
+
 }  // namespace jxl
 
 #endif  // LIB_JXL_DEC_RECONSTRUCT_H_
@@ -16,6 +16,8 @@
 
 #include <string.h>
 
+#include <vector>
+
 #undef HWY_TARGET_INCLUDE
 #define HWY_TARGET_INCLUDE "lib/jxl/dec_xyb.cc"
 #include <hwy/foreach_target.h>
@@ -178,12 +180,25 @@ void YcbcrToRgb(const ImageF& y_plane, const ImageF& cb_plane,
  *  |u1 u2 u3 u4| =: (u, d)
  *  |d1 d2 d3 d4|
  */
-ImageF UpsampleV2(const ImageF& src, ThreadPool* pool) {
+// Computes the two rows of the vertical upsampling of current_row.
+void UpsampleRowsV2(const float* JXL_RESTRICT prev_row,
+                    const float* JXL_RESTRICT current_row,
+                    const float* JXL_RESTRICT next_row, size_t xsize,
+                    float* JXL_RESTRICT dst1_row,
+                    float* JXL_RESTRICT dst2_row) {
   const HWY_FULL(float) df;
-  const size_t S = Lanes(df);
   const auto c14 = Set(df, 0.25f);
   const auto c34 = Set(df, 0.75f);
+  for (size_t x = 0; x < xsize; x += Lanes(df)) {
+    const auto current34 = Load(df, current_row + x) * c34;
+    const auto prev = Load(df, prev_row + x);
+    const auto next = Load(df, next_row + x);
+    Store(MulAdd(prev, c14, current34), df, dst1_row + x);
+    Store(MulAdd(next, c14, current34), df, dst2_row + x);
+  }
+}
 
+ImageF UpsampleV2(const ImageF& src, ThreadPool* pool) {
   const size_t xsize = src.xsize();
   const size_t ysize = src.ysize();
   JXL_ASSERT(xsize != 0);
@@ -200,19 +215,9 @@ ImageF UpsampleV2(const ImageF& src, ThreadPool* pool) {
       const size_t y0 = idx * lines_per_group;
       const size_t y1 = std::min<size_t>(y0 + lines_per_group, ysize);
       for (size_t y = y0; y < y1; ++y) {
-        const float* JXL_RESTRICT prev_row = src.ConstRow(y == 0 ? 1 : y - 1);
-        const float* JXL_RESTRICT current_row = src.ConstRow(y);
-        const float* JXL_RESTRICT next_row =
-            src.ConstRow(y == ysize - 1 ? ysize - 2 : y + 1);
-        float* JXL_RESTRICT dst1_row = dst.Row(2 * y);
-        float* JXL_RESTRICT dst2_row = dst.Row(2 * y + 1);
-        for (size_t x = 0; x < xsize; x += S) {
-          const auto current34 = Load(df, current_row + x) * c34;
-          const auto prev = Load(df, prev_row + x);
-          const auto next = Load(df, next_row + x);
-          Store(MulAdd(prev, c14, current34), df, dst1_row + x);
-          Store(MulAdd(next, c14, current34), df, dst2_row + x);
-        }
+        UpsampleRowsV2(src.ConstRow(y == 0 ? 1 : y - 1), src.ConstRow(y),
+                       src.ConstRow(y == ysize - 1 ? ysize - 2 : y + 1), xsize,
+                       dst.Row(2 * y), dst.Row(2 * y + 1));
       }
     };
     RunOnPool(pool, 0, static_cast<int>(num_stripes), ThreadPool::SkipInit(),
@@ -234,6 +239,37 @@ ImageF UpsampleV2(const ImageF& src, ThreadPool* pool) {
  *  output:
  *   |o1 e1 o2 e2 o3 e3 o4 e4| =: (o, e)
  */
+// Computes the horizontal upsampling of the xsize pixels of current_row.
+void UpsampleRowH2(const float* JXL_RESTRICT current_row, size_t xsize,
+                   float* JXL_RESTRICT dst_row) {
+  HWY_CAPPED(float, 4) d;  // necessary for interleaving.
+  const auto c34 = Set(d, 0.75f);
+  const auto c14 = Set(d, 0.25f);
+  for (size_t x = 1; x < xsize - 1; x += Lanes(d)) {
+    auto current = LoadU(d, current_row + x) * c34;
+    auto prev = LoadU(d, current_row + x - 1);
+    auto next = LoadU(d, current_row + x + 1);
+    auto left = MulAdd(c14, prev, current);
+    auto right = MulAdd(c14, next, current);
+#if HWY_TARGET == HWY_SCALAR
+    StoreU(left, d, dst_row + x * 2);
+    StoreU(right, d, dst_row + x * 2 + 1);
+#else
+    StoreU(InterleaveLower(left, right), d, dst_row + x * 2);
+    StoreU(InterleaveUpper(left, right), d, dst_row + x * 2 + Lanes(d));
+#endif
+  }
+  if (xsize == 1) {
+    dst_row[0] = dst_row[1] = current_row[0];
+  } else {
+    const float leftmost = current_row[0] * 0.75f + current_row[1] * 0.25f;
+    dst_row[0] = dst_row[1] = leftmost;
+    const float rightmost =
+        current_row[xsize - 1] * 0.75f + current_row[xsize - 2] * 0.25f;
+    dst_row[xsize * 2 - 2] = dst_row[xsize * 2 - 1] = rightmost;
+  }
+}
+
 ImageF UpsampleH2(const ImageF& src, size_t xpadding, ThreadPool* pool) {
   JXL_ASSERT(src.xsize() > 2 * xpadding);
   const size_t xsize = src.xsize() - 2 * xpadding;
@@ -246,39 +282,11 @@ ImageF UpsampleH2(const ImageF& src, size_t xpadding, ThreadPool* pool) {
   const size_t lines_per_group = DivCeil(kGroupArea, xsize);
   const size_t num_stripes = DivCeil(ysize, lines_per_group);
 
-  HWY_CAPPED(float, 4) d;  // necessary for interleaving.
-
   const auto upsample = [&](int idx, int /* thread*/) {
     const size_t y0 = idx * lines_per_group;
     const size_t y1 = std::min<size_t>(y0 + lines_per_group, ysize);
     for (size_t y = y0; y < y1; ++y) {
-      const float* JXL_RESTRICT current_row = src.ConstRow(y) + xpadding;
-      float* JXL_RESTRICT dst_row = dst.Row(y) + xpadding;
-      const auto c34 = Set(d, 0.75f);
-      const auto c14 = Set(d, 0.25f);
-      for (size_t x = 1; x < xsize - 1; x += Lanes(d)) {
-        auto current = LoadU(d, current_row + x) * c34;
-        auto prev = LoadU(d, current_row + x - 1);
-        auto next = LoadU(d, current_row + x + 1);
-        auto left = MulAdd(c14, prev, current);
-        auto right = MulAdd(c14, next, current);
-#if HWY_TARGET == HWY_SCALAR
-        StoreU(left, d, dst_row + x * 2);
-        StoreU(right, d, dst_row + x * 2 + 1);
-#else
-        StoreU(InterleaveLower(left, right), d, dst_row + x * 2);
-        StoreU(InterleaveUpper(left, right), d, dst_row + x * 2 + Lanes(d));
-#endif
-      }
-      if (xsize == 1) {
-        dst_row[0] = dst_row[1] = current_row[0];
-      } else {
-        const float leftmost = current_row[0] * 0.75f + current_row[1] * 0.25f;
-        dst_row[0] = dst_row[1] = leftmost;
-        const float rightmost =
-            current_row[xsize - 1] * 0.75f + current_row[xsize - 2] * 0.25f;
-        dst_row[xsize * 2 - 2] = dst_row[xsize * 2 - 1] = rightmost;
-      }
+      UpsampleRowH2(src.ConstRow(y) + xpadding, xsize, dst.Row(y) + xpadding);
     }
   };
   RunOnPool(pool, 0, static_cast<int>(num_stripes), ThreadPool::SkipInit(),
@@ -286,6 +294,64 @@ ImageF UpsampleH2(const ImageF& src, size_t xpadding, ThreadPool* pool) {
   return dst;
 }
 
+/* Horizontal and vertical upsampling at once: the same as UpsampleH2 followed
+ * by UpsampleV2, but each stripe of rows is upsampled horizontally into a
+ * per-thread buffer that stays in cache, instead of into a full intermediate
+ * image.
+ */
+ImageF UpsampleHV2(const ImageF& src, size_t xpadding, ThreadPool* pool) {
+  JXL_ASSERT(src.xsize() > 2 * xpadding);
+  const size_t xsize = src.xsize() - 2 * xpadding;
+  const size_t ysize = src.ysize();
+  JXL_ASSERT(xsize != 0);
+  JXL_ASSERT(ysize != 0);
+  const size_t dst_xsize = xsize * 2 + 2 * xpadding;
+  ImageF dst(dst_xsize, ysize * 2);
+
+  constexpr size_t kGroupArea = kGroupDim * kGroupDim;
+  const size_t lines_per_group = DivCeil(kGroupArea, dst_xsize);
+  const size_t num_stripes = DivCeil(ysize, lines_per_group);
+
+  // Horizontally upsampled rows of a stripe, with the row above and the row
+  // below it.
+  std::vector<ImageF> stripes;
+  const auto init_stripes = [&](size_t num_threads) {
+    stripes.clear();
+    for (size_t i = 0; i < num_threads; i++) {
+      stripes.emplace_back(dst_xsize, std::min(lines_per_group, ysize) + 2);
+    }
+    return true;
+  };
+  const auto upsample = [&](int idx, int thread) {
+    const size_t y0 = idx * lines_per_group;
+    const size_t y1 = std::min<size_t>(y0 + lines_per_group, ysize);
+    ImageF& stripe = stripes[thread];
+    // Row i of the stripe is row y0 + i - 1 of src, mirrored at the borders
+    // as in UpsampleV2.
+    for (size_t i = 0; i < y1 - y0 + 2; i++) {
+      size_t y = y0 + i - 1;
+      if (y0 + i == 0) y = ysize == 1 ? 0 : 1;
+      if (y0 + i > ysize) y = ysize == 1 ? 0 : ysize - 2;
+      UpsampleRowH2(src.ConstRow(y) + xpadding, xsize,
+                    stripe.Row(i) + xpadding);
+    }
+    for (size_t y = y0; y < y1; ++y) {
+      const size_t i = y - y0 + 1;
+      if (ysize == 1) {
+        memcpy(dst.Row(0), stripe.ConstRow(i), dst_xsize * sizeof(float));
+        memcpy(dst.Row(1), stripe.ConstRow(i), dst_xsize * sizeof(float));
+        continue;
+      }
+      UpsampleRowsV2(stripe.ConstRow(i - 1), stripe.ConstRow(i),
+                     stripe.ConstRow(i + 1), dst_xsize, dst.Row(2 * y),
+                     dst.Row(2 * y + 1));
+    }
+  };
+  RunOnPool(pool, 0, static_cast<int>(num_stripes), init_stripes, upsample,
+            "UpsampleHV2");
+  return dst;
+}
+
 // NOLINTNEXTLINE(google-readability-namespace-comments)
 }  // namespace HWY_NAMESPACE
 }  // namespace jxl
@@ -326,6 +392,41 @@ ImageF UpsampleH2(const ImageF& src, size_t xpadding, ThreadPool* pool) {
   return HWY_DYNAMIC_DISPATCH(UpsampleH2)(src, xpadding, pool);
 }
 
+HWY_EXPORT(UpsampleHV2);
+ImageF UpsampleHV2(const ImageF& src, size_t xpadding, ThreadPool* pool) {
+  return HWY_DYNAMIC_DISPATCH(UpsampleHV2)(src, xpadding, pool);
+}
+
+void UpsampleRow(const ImageF& src, size_t xpadding, size_t src_xsize,
+                 size_t src_ysize, size_t hshift, size_t vshift, size_t x0,
+                 size_t y, size_t xsize, float* JXL_RESTRICT row_out) {
+  JXL_DASSERT(hshift <= 1 && vshift <= 1);
+  // Index of the sample that contributes 1/4 to the output pixel `i` next to
+  // sample `i >> 1`, mirrored at the borders as in UpsampleH2 and UpsampleV2.
+  const auto neighbor = [](size_t i, size_t size) -> size_t {
+    if (size == 1) return 0;
+    const size_t s = i >> 1;
+    if (i & 1) return s + 1 == size ? size - 2 : s + 1;
+    return s == 0 ? 1 : s - 1;
+  };
+  const size_t sy = y >> vshift;
+  const float* JXL_RESTRICT row = src.ConstRow(sy) + xpadding;
+  const float* JXL_RESTRICT row_next =
+      src.ConstRow(vshift == 0 ? sy : neighbor(y, src_ysize)) + xpadding;
+  for (size_t i = 0; i < xsize; i++) {
+    const size_t x = x0 + i;
+    const size_t sx = x >> hshift;
+    float v = row[sx];
+    float v_next = row_next[sx];
+    if (hshift != 0) {
+      const size_t nx = neighbor(x, src_xsize);
+      v = v * 0.75f + row[nx] * 0.25f;
+      v_next = v_next * 0.75f + row_next[nx] * 0.25f;
+    }
+    row_out[i] = vshift == 0 ? v : v * 0.75f + v_next * 0.25f;
+  }
+}
+
 void OpsinParams::Init(float intensity_target) {
   InitSIMDInverseMatrix(GetOpsinAbsorbanceInverseMatrix(), inverse_opsin_matrix,
                         intensity_target);
@@ -59,6 +59,19 @@ ImageF UpsampleV2(const ImageF& src, ThreadPool* pool);
 // src.InitializePaddingForUnalignedAccesses() to avoid msan crashes.
 ImageF UpsampleH2(const ImageF& src, size_t xpadding, ThreadPool* pool);
 
+// Same as UpsampleH2 followed by UpsampleV2, in a single pass.
+// WARNING: this uses unaligned accesses, so the caller must first call
+// src.InitializePaddingForUnalignedAccesses() to avoid msan crashes.
+ImageF UpsampleHV2(const ImageF& src, size_t xpadding, ThreadPool* pool);
+
+// Computes `xsize` pixels, starting at column `x0`, of row `y` of the plane
+// obtained by upsampling `src` by (1 << hshift, 1 << vshift) as UpsampleH2 and
+// UpsampleV2 do. `src` holds src_xsize x src_ysize samples, starting at column
+// `xpadding`. The shifts are at most 1.
+void UpsampleRow(const ImageF& src, size_t xpadding, size_t src_xsize,
+                 size_t src_ysize, size_t hshift, size_t vshift, size_t x0,
+                 size_t y, size_t xsize, float* JXL_RESTRICT row_out);
+
 }  // namespace jxl
 
 #endif  // LIB_JXL_DEC_XYB_H_
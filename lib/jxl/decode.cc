@@ -14,7 +14,10 @@
 
 #include "jxl/decode.h"
 
+#include <algorithm>
+
 #include "lib/jxl/base/byte_order.h"
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/dec_file.h"
@@ -24,6 +27,8 @@
 #include "lib/jxl/fields.h"
 #include "lib/jxl/headers.h"
 #include "lib/jxl/icc_codec.h"
+#include "lib/jxl/jpeg/dec_jpeg_data.h"
+#include "lib/jxl/jpeg/dec_jpeg_data_writer.h"
 #include "lib/jxl/loop_filter.h"
 #include "lib/jxl/memory_manager_internal.h"
 #include "lib/jxl/toc.h"
@@ -166,6 +171,20 @@ enum class DecoderStage : uint32_t {
   kError,     // Error occured, decoder object no longer useable
 };
 
+// Entry of the frame index: where a frame is, and which reference slots it
+// saves to and reads from. Slots are bitmasks with bits 0-3 for the reference
+// frames and bits 4-7 for the DC frames of dc_level 1-4.
+struct FrameRef {
+  // Start of the frame in codestream bytes.
+  size_t start;
+  size_t size;
+  int saved_as;
+  int references;
+  // Whether this is the last frame of a still, i.e. a displayed frame.
+  bool displayed;
+  bool is_last;
+};
+
 struct JxlDecoderStruct {
   JxlDecoderStruct() = default;
 
@@ -212,6 +231,12 @@ struct JxlDecoderStruct {
 
   // Settings
   bool keep_orientation;
+  // Region of the image to output, empty to output the whole image.
+  jxl::Rect crop_rect;
+  // Factor by which the output image is downsampled.
+  size_t downsampling;
+  // Maximum size in bytes of the pixel buffers of a frame, 0 for no limit.
+  size_t memory_limit;
 
   // Bitfield, for which informative events (JXL_DEC_BASIC_INFO, etc...) the
   // decoder returns a status. By default, do not return for any of the events,
@@ -239,11 +264,31 @@ struct JxlDecoderStruct {
   // Owned by the caller, buffers for DC image and full resolution images
   void* preview_out_buffer;
   void* dc_out_buffer;
-  void* image_out_buffer;
+  // Where each channel of the full resolution image is written, in the order
+  // of image_out_format. Set either from an interleaved buffer or from a
+  // JxlImageOutLayout.
+  jxl::ChannelOut image_out_channels[4];
+  // Alternative to image_out_channels: receives the full resolution image one
+  // scanline at a time.
+  JxlImageOutCallback image_out_callback;
+  void* image_out_opaque;
+  // Whether the current still is written to image_out_channels while it is
+  // decoded, rather than converted to it once decoded.
+  bool image_out_direct;
+  // Whether image_out_channels are the Y, Cb and Cr planes of the still, from
+  // JxlDecoderSetYCbCrOutLayout.
+  bool image_out_ycbcr;
 
   size_t preview_out_size;
   size_t dc_out_size;
-  size_t image_out_size;
+
+  // Owned by the caller, buffer for the reconstructed JPEG: next byte to write
+  // and amount of bytes left.
+  uint8_t* jpeg_out_next;
+  size_t jpeg_out_avail;
+  // Whether JxlDecoderSetJPEGBuffer was used, so the still is reconstructed
+  // as JPEG instead of decoded to pixels.
+  bool jpeg_out_buffer_set;
 
   // TODO(lode): merge these?
   JxlPixelFormat preview_out_format;
@@ -253,7 +298,54 @@ struct JxlDecoderStruct {
   jxl::CodecMetadata metadata;
   std::unique_ptr<jxl::ImageBundle> ib;
 
+  // Contents of the "jbrd" box, only kept if JXL_DEC_JPEG_RECONSTRUCTION is
+  // subscribed to, until they are decoded into jpeg_data.
+  std::vector<uint8_t> jpeg_reconstruction_box;
+  // JPEG reconstruction data, moved into ib once its still is decoded to JPEG.
+  std::unique_ptr<jxl::jpeg::JPEGData> jpeg_data;
+  // Progress of writing the reconstructed JPEG to the JPEG buffers.
+  std::unique_ptr<jxl::jpeg::SerializationState> jpeg_serialization_state;
+
   std::unique_ptr<jxl::PassesDecoderState> passes_state;
+  // Whether passes_state is kept for the next image, rather than freed, after
+  // the last frame and on reset. Unlike the other settings, it is not changed
+  // by JxlDecoderReset.
+  bool reuse_allocations;
+
+  // Decoder for the frame that is currently being decoded to pixels. It is
+  // kept across JxlDecoderProcessInput calls so that each section of the frame
+  // can be decoded as soon as its bytes are available, rather than only once
+  // the whole frame is in the input.
+  std::unique_ptr<jxl::FrameDecoder> frame_dec;
+  // Whether frame_dec holds an initialized frame that is not yet finalized.
+  bool frame_dec_in_progress;
+  // Start of the frame that frame_dec decodes, or will decode next, in
+  // codestream bytes.
+  size_t frame_dec_start;
+  // Size in bytes of the frame header and TOC of that frame: the section
+  // offsets of the TOC are relative to this position.
+  size_t frame_dec_toc_end;
+  // For each section of the frame in frame_dec, whether it was decoded already.
+  std::vector<uint8_t> section_processed;
+  // Whether the current still consists of a single frame of which only the DC
+  // is decoded, for an image downsampled by 8.
+  bool dc_only_still;
+  // Whether the frame in progress is the only frame of the still, and can be
+  // output before it is fully decoded, for JXL_DEC_FRAME_PROGRESSION and
+  // JxlDecoderFlushImage.
+  bool frame_dec_flushable;
+
+  // Index of the frames (excluding the preview) seen so far. It is kept by
+  // JxlDecoderRewind, since it remains valid for the same input.
+  std::vector<FrameRef> frame_refs;
+  // Amount of displayed frames still to skip, from JxlDecoderSkipFrames.
+  size_t skip_frames;
+  // Whether the current still is skipped. Only the frames of it that a later
+  // frame depends on are decoded, and no events are returned for it.
+  bool skipping_still;
+  // For each frame of frame_refs, whether it must be decoded for the frame
+  // that is skipped to. Empty if not computed yet, or not skipping.
+  std::vector<uint8_t> frame_required;
 
   // headers and TOC for the current frame. When got_toc is true, this is
   // always the frame header of the last frame of the current still series,
@@ -309,6 +401,20 @@ JxlDecoderStatus JxlDecoderDefaultPixelFormat(const JxlDecoder* dec,
   return JXL_DEC_SUCCESS;
 }
 
+namespace {
+
+// Frees the passes state after the last frame of an image, or keeps its
+// buffers for the next image if the decoder reuses allocations.
+void ReleasePassesState(JxlDecoder* dec) {
+  if (dec->reuse_allocations && dec->passes_state) {
+    dec->passes_state->ResetForNextImage();
+  } else {
+    dec->passes_state.reset(nullptr);
+  }
+}
+
+}  // namespace
+
 void JxlDecoderReset(JxlDecoder* dec) {
   dec->thread_pool.reset();
   dec->stage = DecoderStage::kInited;
@@ -327,6 +433,9 @@ void JxlDecoderReset(JxlDecoder* dec) {
   dec->codestream_begin = 0;
   dec->codestream_end = 0;
   dec->keep_orientation = false;
+  dec->crop_rect = jxl::Rect();
+  dec->downsampling = 1;
+  dec->memory_limit = 0;
   dec->events_wanted = 0;
   dec->orig_events_wanted = 0;
   dec->basic_info_size_hint = InitialBasicInfoSizeHint();
@@ -339,23 +448,71 @@ void JxlDecoderReset(JxlDecoder* dec) {
   dec->need_image_out_buffer = false;
   dec->preview_out_buffer = nullptr;
   dec->dc_out_buffer = nullptr;
-  dec->image_out_buffer = nullptr;
+  dec->image_out_callback = nullptr;
+  dec->image_out_opaque = nullptr;
+  dec->image_out_direct = false;
+  dec->image_out_ycbcr = false;
   dec->preview_out_size = 0;
   dec->dc_out_size = 0;
-  dec->image_out_size = 0;
+  dec->jpeg_out_next = nullptr;
+  dec->jpeg_out_avail = 0;
+  dec->jpeg_out_buffer_set = false;
   dec->dec_pixels = 0;
   dec->next_in = 0;
   dec->avail_in = 0;
 
-  dec->passes_state.reset(nullptr);
+  dec->frame_dec.reset();
+  dec->frame_dec_in_progress = false;
+  dec->frame_dec_start = 0;
+  dec->frame_dec_toc_end = 0;
+  dec->section_processed.clear();
+  dec->dc_only_still = false;
+  dec->frame_dec_flushable = false;
+  ReleasePassesState(dec);
 
   dec->ib.reset();
+  dec->jpeg_reconstruction_box.clear();
+  dec->jpeg_data.reset();
+  dec->jpeg_serialization_state.reset();
   dec->metadata = jxl::CodecMetadata();
   dec->frame_header.reset(new jxl::FrameHeader(&dec->metadata));
   dec->frame_dim = jxl::FrameDimensions();
+  dec->frame_refs.clear();
+  dec->skip_frames = 0;
+  dec->skipping_still = false;
+  dec->frame_required.clear();
   dec->codestream.clear();
 }
 
+void JxlDecoderRewind(JxlDecoder* dec) {
+  // Keep the settings, and the frame index which remains valid for the same
+  // input.
+  std::unique_ptr<jxl::ThreadPool> thread_pool = std::move(dec->thread_pool);
+  int orig_events_wanted = dec->orig_events_wanted;
+  bool keep_orientation = dec->keep_orientation;
+  jxl::Rect crop_rect = dec->crop_rect;
+  size_t downsampling = dec->downsampling;
+  uint64_t memory_limit = dec->memory_limit;
+  std::vector<FrameRef> frame_refs = std::move(dec->frame_refs);
+
+  JxlDecoderReset(dec);
+
+  dec->thread_pool = std::move(thread_pool);
+  dec->events_wanted = orig_events_wanted;
+  dec->orig_events_wanted = orig_events_wanted;
+  dec->keep_orientation = keep_orientation;
+  dec->crop_rect = crop_rect;
+  dec->downsampling = downsampling;
+  dec->memory_limit = memory_limit;
+  dec->frame_refs = std::move(frame_refs);
+}
+
+void JxlDecoderSkipFrames(JxlDecoder* dec, size_t amount) {
+  dec->skip_frames += amount;
+  // The frame that is skipped to changed.
+  dec->frame_required.clear();
+}
+
 JxlDecoder* JxlDecoderCreate(const JxlMemoryManager* memory_manager) {
   JxlMemoryManager local_memory_manager;
   if (!jxl::MemoryManagerInit(&local_memory_manager, memory_manager))
@@ -367,6 +524,7 @@ JxlDecoder* JxlDecoderCreate(const JxlMemoryManager* memory_manager) {
   // Placement new constructor on allocated memory
   JxlDecoder* dec = new (alloc) JxlDecoder();
   dec->memory_manager = local_memory_manager;
+  dec->reuse_allocations = false;
 
   JxlDecoderReset(dec);
 
@@ -416,6 +574,12 @@ JxlDecoderStatus JxlDecoderSetKeepOrientation(JxlDecoder* dec,
   return JXL_DEC_SUCCESS;
 }
 
+JxlDecoderStatus JxlDecoderSetReuseAllocations(JxlDecoder* dec,
+                                               JXL_BOOL reuse_allocations) {
+  dec->reuse_allocations = !!reuse_allocations;
+  return JXL_DEC_SUCCESS;
+}
+
 namespace jxl {
 namespace {
 
@@ -555,19 +719,44 @@ JxlDecoderStatus JxlDecoderReadAllHeaders(JxlDecoder* dec, const uint8_t* in,
   return JXL_DEC_SUCCESS;
 }
 
-static JxlDecoderStatus ConvertImage(const JxlDecoder* dec,
-                                     const jxl::ImageBundle& frame,
-                                     const JxlPixelFormat& format,
-                                     void* out_image, size_t out_size) {
+// Returns the size in bytes of a row of pixels of the given format.
+static size_t ImageOutStride(const JxlPixelFormat& format, size_t xsize) {
+  size_t stride = xsize * (BitsPerChannel(format.data_type) *
+                           format.num_channels / jxl::kBitsPerByte);
+  if (format.align > 1) {
+    stride = jxl::DivCeil(stride, format.align) * format.align;
+  }
+  return stride;
+}
+
+// Sets channels to the locations of the channels of pixels in the given format
+// in an interleaved buffer.
+static void InterleavedChannels(const JxlPixelFormat& format, void* buffer,
+                                size_t xsize, jxl::ChannelOut* channels) {
+  const size_t bytes_per_sample =
+      BitsPerChannel(format.data_type) / jxl::kBitsPerByte;
+  const size_t stride = ImageOutStride(format, xsize);
+  for (size_t c = 0; c < format.num_channels; c++) {
+    channels[c].data =
+        reinterpret_cast<uint8_t*>(buffer) + c * bytes_per_sample;
+    channels[c].pixel_stride = bytes_per_sample * format.num_channels;
+    channels[c].row_stride = stride;
+  }
+}
+
+// Converts frame to the pixels of format, written to out_image, to
+// channels_out if it is not null, or passed to out_callback if that is not
+// null.
+static JxlDecoderStatus ConvertImage(
+    const JxlDecoder* dec, const jxl::ImageBundle& frame,
+    const JxlPixelFormat& format, void* out_image, size_t out_size,
+    JxlImageOutCallback out_callback = nullptr, void* out_opaque = nullptr,
+    const jxl::ChannelOut* channels_out = nullptr) {
   // TODO(lode): handle mismatch of RGB/grayscale color profiles and pixel data
   // color/grayscale format
   const auto& metadata = dec->metadata.m;
 
-  size_t stride = frame.xsize() * (BitsPerChannel(format.data_type) *
-                                   format.num_channels / jxl::kBitsPerByte);
-  if (format.align > 1) {
-    stride = jxl::DivCeil(stride, format.align) * format.align;
-  }
+  size_t stride = ImageOutStride(format, frame.xsize());
 
   bool apply_srgb_tf = false;
   if (metadata.xyb_encoded) {
@@ -585,11 +774,19 @@ static JxlDecoderStatus ConvertImage(const JxlDecoder* dec,
   jxl::Orientation undo_orientation = dec->keep_orientation
                                           ? metadata.GetOrientation()
                                           : jxl::Orientation::kIdentity;
-  jxl::Status status = jxl::ConvertImage(
-      frame, BitsPerChannel(format.data_type),
-      format.data_type == JXL_TYPE_FLOAT, apply_srgb_tf, format.num_channels,
-      format.endianness, stride, dec->thread_pool.get(), out_image, out_size,
-      undo_orientation);
+  jxl::Status status =
+      channels_out
+          ? jxl::ConvertImage(frame, BitsPerChannel(format.data_type),
+                              format.data_type == JXL_TYPE_FLOAT,
+                              apply_srgb_tf, format.num_channels,
+                              format.endianness, channels_out,
+                              dec->thread_pool.get(), undo_orientation)
+          : jxl::ConvertImage(frame, BitsPerChannel(format.data_type),
+                              format.data_type == JXL_TYPE_FLOAT,
+                              apply_srgb_tf, format.num_channels,
+                              format.endianness, stride,
+                              dec->thread_pool.get(), out_image, out_size,
+                              out_callback, out_opaque, undo_orientation);
 
   return status ? JXL_DEC_SUCCESS : JXL_DEC_ERROR;
 }
@@ -688,6 +885,700 @@ JxlDecoderStatus ParseFrameHeader(JxlDecoder* dec,
   return JXL_DEC_SUCCESS;
 }
 
+// Adds the frame starting at codestream position `start` to the frame index,
+// unless it is there already.
+void AddFrameRef(JxlDecoder* dec, size_t start, size_t size,
+                 const FrameHeader& frame_header) {
+  if (!dec->frame_refs.empty() && dec->frame_refs.back().start >= start) {
+    return;
+  }
+  FrameRef ref;
+  ref.start = start;
+  ref.size = size;
+  ref.saved_as = 0;
+  if (frame_header.frame_type == FrameType::kDCFrame) {
+    ref.saved_as = 1 << (4 + frame_header.dc_level - 1);
+  } else if (frame_header.CanBeReferenced()) {
+    ref.saved_as = 1 << frame_header.save_as_reference;
+  }
+  ref.references = 0;
+  if (frame_header.frame_type == FrameType::kRegularFrame ||
+      frame_header.frame_type == FrameType::kSkipProgressive) {
+    bool replace_all = frame_header.blending_info.mode == BlendMode::kReplace;
+    for (const BlendingInfo& info : frame_header.extra_channel_blending_info) {
+      replace_all &= info.mode == BlendMode::kReplace;
+    }
+    if (!replace_all || frame_header.custom_size_or_origin) {
+      ref.references |= 1 << frame_header.blending_info.source;
+    }
+  }
+  if (frame_header.flags & FrameHeader::kPatches) {
+    // Which reference frames the patches use is only known once the frame is
+    // decoded, so assume all of them.
+    ref.references |= 0xF;
+  }
+  if (frame_header.flags & FrameHeader::kUseDcFrame) {
+    ref.references |= 1 << (4 + frame_header.dc_level);
+  }
+  ref.displayed =
+      frame_header.is_last || frame_header.animation_frame.duration > 0;
+  ref.is_last = frame_header.is_last;
+  dec->frame_refs.push_back(ref);
+}
+
+// Returns the index in the frame index of the frame starting at codestream
+// position `start`, or the size of the frame index if it is not there.
+size_t FrameRefIndex(const JxlDecoder* dec, size_t start) {
+  auto it = std::lower_bound(
+      dec->frame_refs.begin(), dec->frame_refs.end(), start,
+      [](const FrameRef& ref, size_t start) { return ref.start < start; });
+  if (it == dec->frame_refs.end() || it->start != start) {
+    return dec->frame_refs.size();
+  }
+  return it - dec->frame_refs.begin();
+}
+
+// Sets dec->frame_required for the frames from the current still, which is
+// skipped, up to the still that JxlDecoderSkipFrames skips to: that still
+// itself, the frames it depends on through reference frames, and the frames
+// that leave the reference slots as the frames after it expect them. Extends
+// the frame index with the headers of the frames up to there.
+JxlDecoderStatus ComputeRequiredFrames(JxlDecoder* dec, const uint8_t* in,
+                                       size_t size) {
+  const size_t first = FrameRefIndex(dec, dec->still_start);
+  if (first == dec->frame_refs.size()) {
+    return JXL_API_ERROR("current still is not in the frame index");
+  }
+  // Find the still that is skipped to, as the range of frames
+  // [target_begin, target_end).
+  size_t target_begin = first;
+  size_t target_end = first;
+  size_t still = 0;
+  for (size_t i = first;; i++) {
+    if (i == dec->frame_refs.size()) {
+      // Skipping past the last frame: none of the frames is required.
+      if (dec->frame_refs.back().is_last) break;
+      const FrameRef& back = dec->frame_refs.back();
+      const size_t start = back.start + back.size;
+      if (start < dec->codestream_pos) {
+        return JXL_API_ERROR("frame index is ahead of the input");
+      }
+      const size_t pos = start - dec->codestream_pos;
+      if (pos >= size) return JXL_DEC_NEED_MORE_INPUT;
+      FrameHeader frame_header(&dec->metadata);
+      size_t frame_size;
+      // ParseFrameHeader also sets dec->frame_dim, which must stay that of the
+      // current frame.
+      const FrameDimensions frame_dim = dec->frame_dim;
+      JxlDecoderStatus status = ParseFrameHeader(
+          dec, &frame_header, in, size, pos, /*is_preview=*/false,
+          &frame_size, nullptr, nullptr, nullptr, nullptr);
+      dec->frame_dim = frame_dim;
+      if (status != JXL_DEC_SUCCESS) return status;
+      AddFrameRef(dec, start, frame_size, frame_header);
+    }
+    if (!dec->frame_refs[i].displayed) continue;
+    if (still == dec->skip_frames + 1) {
+      target_end = i + 1;
+      break;
+    }
+    still++;
+    target_begin = i + 1;
+  }
+
+  dec->frame_required.assign(dec->frame_refs.size(), 0);
+  // Reference slots that are read by a required frame, but not yet saved by a
+  // frame after the current one in the backwards scan. The frames decoded after
+  // the target still may read any reference slot, so the last frame saved to
+  // each of them before the end of the target still is required too.
+  int slots = 0xF;
+  for (size_t i = target_end; i > first; i--) {
+    const FrameRef& ref = dec->frame_refs[i - 1];
+    if (i - 1 < target_begin && !(ref.saved_as & slots)) continue;
+    dec->frame_required[i - 1] = 1;
+    slots &= ~ref.saved_as;
+    slots |= ref.references;
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+// Returns the pixels of the still that was just decoded. They are in ib,
+// unless its last frame is also saved as a reference: the frame decoder then
+// moves them to the reference slot instead of copying them, leaving ib empty.
+const jxl::ImageBundle& StillPixels(const JxlDecoder* dec) {
+  const jxl::ImageBundle* saved =
+      dec->frame_dec ? dec->frame_dec->SavedOutput() : nullptr;
+  if (saved != nullptr && !dec->ib->HasColor()) return *saved;
+  return *dec->ib;
+}
+
+// Returns whether the crop rect, if any, lies within the image dimensions.
+bool CropRectInsideImage(const JxlDecoder* dec) {
+  const jxl::Rect& crop = dec->crop_rect;
+  return crop.x0() + crop.xsize() <= dec->metadata.size.xsize() &&
+         crop.y0() + crop.ysize() <= dec->metadata.size.ysize();
+}
+
+// Sets the pixels of `ib` to the `crop` region of those of `in`, which may be
+// `ib` itself.
+void CropImageBundle(const jxl::Rect& crop, const jxl::ImageBundle& in,
+                     jxl::ImageBundle* ib) {
+  Image3F color(crop.xsize(), crop.ysize());
+  CopyImageTo(crop, in.color(), Rect(color), &color);
+  std::vector<ImageF> extra_channels;
+  for (size_t i = 0; i < in.extra_channels().size(); i++) {
+    const ImageF& ec = in.extra_channels()[i];
+    const auto& eci = in.metadata()->extra_channel_info[i];
+    const Rect ec_rect(crop.x0() >> eci.dim_shift, crop.y0() >> eci.dim_shift,
+                       eci.Size(crop.xsize()), eci.Size(crop.ysize()),
+                       ec.xsize(), ec.ysize());
+    extra_channels.emplace_back(ec_rect.xsize(), ec_rect.ysize());
+    CopyImageTo(ec_rect, ec, Rect(extra_channels.back()),
+                &extra_channels.back());
+  }
+  const ColorEncoding c_current = in.c_current();
+  ib->ClearExtraChannels();
+  ib->SetFromImage(std::move(color), c_current);
+  if (!extra_channels.empty()) {
+    ib->SetExtraChannels(std::move(extra_channels));
+  }
+}
+
+// Sets the pixels of `ib` to the average of those of `in`, which may be `ib`
+// itself, over blocks of `factor` x `factor` pixels. The rows of the output are
+// computed in parallel on `pool`.
+void DownsampleImageBundle(size_t factor, jxl::ThreadPool* pool,
+                           const jxl::ImageBundle& in, jxl::ImageBundle* ib) {
+  auto downsample = [factor, pool](const ImageF& in) {
+    ImageF out(jxl::DivCeil(in.xsize(), factor),
+               jxl::DivCeil(in.ysize(), factor));
+    RunOnPool(
+        pool, 0, out.ysize(), jxl::ThreadPool::SkipInit(),
+        [&](int y, int /*thread*/) {
+          float* JXL_RESTRICT row_out = out.Row(y);
+          const size_t iy_end = std::min((y + 1) * factor, in.ysize());
+          for (size_t x = 0; x < out.xsize(); x++) {
+            const size_t ix_end = std::min((x + 1) * factor, in.xsize());
+            float sum = 0;
+            for (size_t iy = y * factor; iy < iy_end; iy++) {
+              const float* JXL_RESTRICT row_in = in.ConstRow(iy);
+              for (size_t ix = x * factor; ix < ix_end; ix++) {
+                sum += row_in[ix];
+              }
+            }
+            row_out[x] = sum / ((iy_end - y * factor) * (ix_end - x * factor));
+          }
+        },
+        "Downsample");
+    return out;
+  };
+  Image3F color(downsample(in.color().Plane(0)),
+                downsample(in.color().Plane(1)),
+                downsample(in.color().Plane(2)));
+  std::vector<ImageF> extra_channels;
+  for (const ImageF& ec : in.extra_channels()) {
+    extra_channels.emplace_back(downsample(ec));
+  }
+  const ColorEncoding c_current = in.c_current();
+  ib->ClearExtraChannels();
+  ib->SetFromImage(std::move(color), c_current);
+  if (!extra_channels.empty()) {
+    ib->SetExtraChannels(std::move(extra_channels));
+  }
+}
+
+// Decodes the contents of the "jbrd" box into dec->jpeg_data, with the ICC
+// profile from the codestream header in its APP markers.
+JxlDecoderStatus DecodeJPEGReconstruction(JxlDecoder* dec) {
+  dec->jpeg_data.reset(new jpeg::JPEGData());
+  if (!jpeg::DecodeJPEGData(Span<const uint8_t>(dec->jpeg_reconstruction_box),
+                            dec->jpeg_data.get())) {
+    return JXL_API_ERROR("invalid JPEG reconstruction data");
+  }
+  dec->jpeg_reconstruction_box.clear();
+  dec->jpeg_reconstruction_box.shrink_to_fit();
+
+  jpeg::JPEGData* jpeg_data = dec->jpeg_data.get();
+  const PaddedBytes& icc = dec->metadata.m.color_encoding.ICC();
+  size_t icc_pos = 0;
+  for (size_t i = 0; i < jpeg_data->app_data.size(); i++) {
+    if (jpeg_data->app_marker_type[i] != jpeg::AppMarkerType::kICC) {
+      continue;
+    }
+    size_t len = jpeg_data->app_data[i].size() - 17;
+    if (icc_pos + len > icc.size()) {
+      return JXL_API_ERROR("ICC length is less than APP markers");
+    }
+    memcpy(&jpeg_data->app_data[i][17], icc.data() + icc_pos, len);
+    icc_pos += len;
+  }
+  if (icc_pos != icc.size() && icc_pos != 0) {
+    return JXL_API_ERROR("ICC length is more than APP markers");
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+// Writes the JPEG reconstructed from dec->ib to the JPEG buffer, continuing
+// where the previous call stopped. Returns JXL_DEC_JPEG_NEED_MORE_OUTPUT if
+// the buffer is full before the end of the JPEG.
+JxlDecoderStatus WriteReconstructedJPEG(JxlDecoder* dec) {
+  if (!dec->jpeg_serialization_state) {
+    dec->jpeg_serialization_state.reset(new jpeg::SerializationState());
+  }
+  const auto out = [dec](const uint8_t* buf, size_t len) -> size_t {
+    size_t num_written = std::min(len, dec->jpeg_out_avail);
+    if (num_written == 0) return 0;
+    memcpy(dec->jpeg_out_next, buf, num_written);
+    dec->jpeg_out_next += num_written;
+    dec->jpeg_out_avail -= num_written;
+    return num_written;
+  };
+  bool done;
+  if (!jpeg::WriteJpegIncrementally(*dec->ib->jpeg_data,
+                                    dec->jpeg_serialization_state.get(), out,
+                                    &done)) {
+    return JXL_API_ERROR("JPEG reconstruction failed");
+  }
+  if (!done) return JXL_DEC_JPEG_NEED_MORE_OUTPUT;
+  dec->jpeg_serialization_state.reset();
+  return JXL_DEC_SUCCESS;
+}
+
+// Makes frame_dec write the pixels of the frame directly to the image out
+// buffer, or pass them to the image out callback row by row as it renders
+// them, if the output is 8-bit RGB(A) and ConvertImage would do nothing more
+// than converting the XYB pixels of the frame to sRGB and to integers. This
+// avoids the passes over the whole decoded image in floating point. The planes
+// of a frame output as YCbCr are always written directly.
+void SetupDirectImageOutput(JxlDecoder* dec) {
+  PassesDecoderState* passes_state = dec->passes_state.get();
+  passes_state->num_rgb_output_channels = 0;
+  passes_state->rgb_output_callback = nullptr;
+  passes_state->rgb_output_opaque = nullptr;
+  passes_state->rgb_output_only = false;
+  passes_state->ycbcr_output_only = false;
+  dec->image_out_direct = false;
+
+  if (dec->image_out_ycbcr) {
+    // JxlDecoderSetYCbCrOutLayout checked that the frame can be output so.
+    for (size_t c = 0; c < 3; c++) {
+      passes_state->ycbcr_output[c] = dec->image_out_channels[c];
+    }
+    passes_state->ycbcr_output_only = true;
+    dec->image_out_direct = true;
+    return;
+  }
+
+  const FrameHeader& frame_header = dec->frame_dec->GetFrameHeader();
+  const JxlPixelFormat& format = dec->image_out_format;
+  const ImageMetadata& metadata = dec->metadata.m;
+  const Orientation undo_orientation = dec->keep_orientation
+                                           ? metadata.GetOrientation()
+                                           : Orientation::kIdentity;
+  if (!dec->image_out_buffer_set || dec->skipping_still || dec->ib->IsJPEG() ||
+      dec->crop_rect.xsize() != 0 || dec->downsampling != 1 ||
+      undo_orientation != Orientation::kIdentity) {
+    return;
+  }
+  if (format.data_type != JXL_TYPE_UINT8 ||
+      (format.num_channels != 3 && format.num_channels != 4) ||
+      (format.num_channels == 4 && metadata.HasAlpha()) ||
+      !metadata.xyb_encoded || metadata.color_encoding.IsGray()) {
+    return;
+  }
+  // The frame must be the only one of the still, and be shown as is.
+  bool replace_all = frame_header.blending_info.mode == BlendMode::kReplace;
+  for (const BlendingInfo& info : frame_header.extra_channel_blending_info) {
+    if (info.mode != BlendMode::kReplace) replace_all = false;
+  }
+  if (dec->frame_dec_start != dec->still_start ||
+      frame_header.frame_type != FrameType::kRegularFrame ||
+      frame_header.CanBeReferenced() || frame_header.custom_size_or_origin ||
+      !replace_all || frame_header.upsampling != 1 ||
+      frame_header.color_transform != ColorTransform::kXYB ||
+      !frame_header.needs_color_transform()) {
+    return;
+  }
+
+  if (dec->image_out_callback) {
+    // The rows are interleaved by the decoder and passed to the callback as
+    // they are rendered.
+    for (size_t c = 0; c < format.num_channels; c++) {
+      passes_state->rgb_output[c] = {nullptr, format.num_channels, 0};
+    }
+    passes_state->rgb_output_callback = dec->image_out_callback;
+    passes_state->rgb_output_opaque = dec->image_out_opaque;
+  } else {
+    for (size_t c = 0; c < format.num_channels; c++) {
+      passes_state->rgb_output[c] = dec->image_out_channels[c];
+    }
+  }
+  passes_state->num_rgb_output_channels = format.num_channels;
+  // Nothing else is output for the frame, so its pixels need not be kept.
+  passes_state->rgb_output_only = metadata.num_extra_channels == 0;
+  dec->image_out_direct = true;
+}
+
+// Returns whether the current still can be written as planar YCbCr to the
+// image out buffer: it must consist of a single YCbCr frame, such as a
+// recompressed JPEG, whose decoded planes are shown as they are.
+bool CanOutputYCbCr(const JxlDecoder* dec) {
+  if (!dec->got_toc || !dec->frame_header || dec->skipping_still ||
+      dec->jpeg_out_buffer_set || dec->crop_rect.xsize() != 0 ||
+      dec->downsampling != 1 || dec->metadata.m.num_extra_channels != 0) {
+    return false;
+  }
+  const size_t index = FrameRefIndex(dec, dec->still_start);
+  if (index == dec->frame_refs.size() ||
+      dec->frame_refs[index].size != dec->still_end - dec->still_start) {
+    return false;
+  }
+  const FrameHeader& frame_header = *dec->frame_header;
+  const LoopFilter& lf = frame_header.loop_filter;
+  constexpr uint64_t kFeatures =
+      FrameHeader::kNoise | FrameHeader::kPatches | FrameHeader::kSplines;
+  return frame_header.encoding == FrameEncoding::kVarDCT &&
+         frame_header.color_transform == ColorTransform::kYCbCr &&
+         frame_header.needs_color_transform() &&
+         frame_header.frame_type == FrameType::kRegularFrame &&
+         !frame_header.CanBeReferenced() &&
+         !frame_header.custom_size_or_origin &&
+         frame_header.blending_info.mode == BlendMode::kReplace &&
+         frame_header.upsampling == 1 &&
+         (frame_header.flags & kFeatures) == 0 && !lf.gab &&
+         lf.epf_iters == 0;
+}
+
+// Estimates the size in bytes of the buffers holding the pixels of the frame in
+// frame_dec while it is decoded. Only the buffers whose size grows with the
+// number of pixels are counted.
+uint64_t FramePixelMemory(const JxlDecoder* dec) {
+  const FrameHeader& frame_header = dec->frame_dec->GetFrameHeader();
+  const FrameDimensions frame_dim = frame_header.ToFrameDimensions();
+  const uint64_t pixels =
+      static_cast<uint64_t>(frame_dim.xsize_padded) * frame_dim.ysize_padded;
+  const uint64_t color_bytes = 3 * sizeof(float) * pixels;
+  if (dec->dc_only_still) {
+    // The DC, and the image converted from it.
+    return 2 * 3 * sizeof(float) *
+           static_cast<uint64_t>(frame_dim.xsize_blocks) *
+           frame_dim.ysize_blocks;
+  }
+  // The decoded image, padded for the filters, or the band of its rows that
+  // a banded frame holds. Planes output as YCbCr only have their subsampled
+  // size.
+  uint64_t bytes = 0;
+  const YCbCrChromaSubsampling& cs = frame_header.chroma_subsampling;
+  const bool banded = dec->passes_state->banded;
+  for (size_t c = 0; c < 3; c++) {
+    const bool subsampled = dec->passes_state->ycbcr_output_only;
+    const size_t hshift = subsampled ? cs.HShift(c) : 0;
+    const size_t vshift = subsampled ? cs.VShift(c) : 0;
+    const size_t decoded_ysize =
+        PassesDecoderState::DecodedYSize(frame_dim, banded);
+    bytes += sizeof(float) * static_cast<uint64_t>(decoded_ysize >> vshift) *
+             ((frame_dim.xsize_padded >> hshift) + 2 * kMaxFilterPadding);
+  }
+  if (!dec->passes_state->rgb_output_only &&
+      !dec->passes_state->ycbcr_output_only) {
+    // The rendered frame, and its upsampled copy.
+    bytes += color_bytes;
+    if (frame_header.upsampling != 1) {
+      bytes += 3 * sizeof(float) *
+               static_cast<uint64_t>(frame_dim.xsize_upsampled) *
+               frame_dim.ysize_upsampled;
+    }
+  }
+  for (const ExtraChannelInfo& eci : dec->metadata.m.extra_channel_info) {
+    bytes += sizeof(float) *
+             static_cast<uint64_t>(eci.Size(frame_dim.xsize_padded)) *
+             eci.Size(frame_dim.ysize_padded);
+  }
+  if (frame_header.encoding == FrameEncoding::kModular) {
+    // The modular image, with one integer per sample of every channel.
+    bytes += (3 + dec->metadata.m.num_extra_channels) * sizeof(int32_t) *
+             pixels;
+  } else if (frame_header.passes.num_passes > 1 && !banded) {
+    // The coefficients, accumulated over the passes.
+    bytes += 3 * sizeof(int32_t) * pixels;
+  }
+  if (dec->downsampling > 1) {
+    // The downsampled copy of the rendered frame.
+    const size_t factor = dec->downsampling;
+    const uint64_t downsampled_pixels =
+        static_cast<uint64_t>(jxl::DivCeil(frame_dim.xsize, factor)) *
+        jxl::DivCeil(frame_dim.ysize, factor);
+    bytes += (3 + dec->metadata.m.num_extra_channels) * sizeof(float) *
+             downsampled_pixels;
+  }
+  return bytes;
+}
+
+// Computes the size in bytes of the frame in frame_dec, from its start to the
+// end of its last section.
+JxlDecoderStatus GetFrameDecSize(const JxlDecoder* dec, size_t* frame_size) {
+  const FrameDecoder* frame_dec = dec->frame_dec.get();
+  const size_t toc_end = dec->frame_dec_toc_end;
+  *frame_size = toc_end;
+  for (size_t i = 0; i < frame_dec->NumSections(); i++) {
+    const size_t offset = frame_dec->SectionOffsets()[i];
+    const size_t size = frame_dec->SectionSizes()[i];
+    if (SumOverflows(toc_end, offset) || SumOverflows(toc_end + offset, size)) {
+      return JXL_API_ERROR("section size overflows");
+    }
+    *frame_size = std::max(*frame_size, toc_end + offset + size);
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+// Sets whether the frame in frame_dec can be output before it is fully
+// decoded: the still must consist of only this frame, shown as is, and the
+// output must not need to be post-processed after decoding.
+JxlDecoderStatus SetupFlushableFrame(JxlDecoder* dec) {
+  dec->frame_dec_flushable = false;
+  FrameDecoder* frame_dec = dec->frame_dec.get();
+  const FrameHeader& frame_header = frame_dec->GetFrameHeader();
+  // Each pixel is passed to an image out callback only once, so such a frame
+  // is never rendered before it is complete.
+  if (dec->skipping_still || dec->ib->IsJPEG() || dec->crop_rect.xsize() != 0 ||
+      dec->downsampling != 1 || dec->image_out_callback ||
+      !frame_dec->SupportsPartialFlush()) {
+    return JXL_DEC_SUCCESS;
+  }
+  size_t frame_size;
+  JxlDecoderStatus status = GetFrameDecSize(dec, &frame_size);
+  if (status != JXL_DEC_SUCCESS) return status;
+  bool replace_all = frame_header.blending_info.mode == BlendMode::kReplace;
+  for (const BlendingInfo& info : frame_header.extra_channel_blending_info) {
+    if (info.mode != BlendMode::kReplace) replace_all = false;
+  }
+  dec->frame_dec_flushable =
+      dec->frame_dec_start == dec->still_start &&
+      dec->frame_dec_start + frame_size == dec->still_end &&
+      frame_header.frame_type == FrameType::kRegularFrame &&
+      !frame_header.custom_size_or_origin && replace_all;
+  return JXL_DEC_SUCCESS;
+}
+
+// Makes frame_dec decode its frame one row of groups at a time, holding only a
+// band of rows of it, if the memory limit is exceeded otherwise. Only frames
+// that are rendered straight to the image out buffer or callback can be, since
+// their pixels are not kept. Must be called after SetupFlushableFrame.
+void SetupBandedFrame(JxlDecoder* dec) {
+  PassesDecoderState* passes_state = dec->passes_state.get();
+  passes_state->banded = false;
+  if (dec->memory_limit == 0 || !passes_state->rgb_output_only) return;
+  const FrameHeader& frame_header = dec->frame_dec->GetFrameHeader();
+  if (frame_header.encoding != FrameEncoding::kVarDCT ||
+      !frame_header.chroma_subsampling.Is444() ||
+      frame_header.save_before_color_transform ||
+      frame_header.ToFrameDimensions().ysize_groups < 2 ||
+      FramePixelMemory(dec) <= dec->memory_limit) {
+    return;
+  }
+  passes_state->banded = true;
+  // The frame is decoded once all of its sections are available, and is never
+  // rendered before that.
+  dec->frame_dec_flushable = false;
+}
+
+// Renders the sections of the frame in progress decoded so far, and writes
+// the pixels to the image out buffer. Frames output with a callback are not
+// flushable: each pixel is passed to it once, from its final rendering.
+JxlDecoderStatus FlushImageOut(JxlDecoder* dec) {
+  JXL_API_RETURN_IF_ERROR(dec->frame_dec->Flush());
+  if (dec->image_out_direct || dec->image_out_callback) {
+    return JXL_DEC_SUCCESS;
+  }
+  return ConvertImage(dec, *dec->ib, dec->image_out_format,
+                      /*out_image=*/nullptr, /*out_size=*/0,
+                      /*out_callback=*/nullptr, /*out_opaque=*/nullptr,
+                      dec->image_out_channels);
+}
+
+// Limits the passes that frame_dec decodes to those needed for the requested
+// downsampling. If the still consists of only this frame, and the frame allows
+// it, only its DC is decoded for downsampling 8.
+JxlDecoderStatus SetupDownsampledFrame(JxlDecoder* dec) {
+  FrameDecoder* frame_dec = dec->frame_dec.get();
+  const FrameHeader& frame_header = frame_dec->GetFrameHeader();
+  size_t downsampling;
+  frame_dec->SetMaxPasses(jxl::PassesForDownsampling(
+      frame_header, dec->downsampling, frame_header.passes.num_passes,
+      &downsampling));
+
+  size_t frame_size;
+  JxlDecoderStatus status = GetFrameDecSize(dec, &frame_size);
+  if (status != JXL_DEC_SUCCESS) return status;
+  const size_t num_dc_sections =
+      1 + frame_header.ToFrameDimensions().num_dc_groups;
+  dec->dc_only_still =
+      downsampling == 8 && dec->frame_dec_start == dec->still_start &&
+      dec->frame_dec_start + frame_size == dec->still_end &&
+      frame_dec->NumSections() > num_dc_sections &&
+      frame_header.encoding == FrameEncoding::kVarDCT &&
+      frame_header.frame_type == FrameType::kRegularFrame &&
+      !frame_header.custom_size_or_origin && frame_header.upsampling == 1 &&
+      !(frame_header.flags & FrameHeader::kUseDcFrame) &&
+      !frame_header.CanBeReferenced() && dec->metadata.m.xyb_encoded &&
+      dec->metadata.m.num_extra_channels == 0 && dec->crop_rect.xsize() == 0;
+
+  for (size_t i = 0; i < frame_dec->NumSections(); i++) {
+    if (dec->dc_only_still ? i >= num_dc_sections
+                           : frame_dec->SectionIsBeyondMaxPasses(i)) {
+      dec->section_processed[i] = 1;
+    }
+  }
+  // The box average over 2x2 or 4x4 pixels mostly removes what the loop
+  // filters do, so they are skipped, unless later frames may use this one.
+  if (!dec->dc_only_still &&
+      frame_header.frame_type == FrameType::kRegularFrame &&
+      !frame_header.CanBeReferenced()) {
+    frame_dec->DisableLoopFilters();
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+// Decodes all sections of the frame starting at dec->frame_dec_start that are
+// available in the input and were not decoded yet. Returns JXL_DEC_SUCCESS once
+// all sections are decoded and the frame is finalized, at which point
+// dec->frame_dec_start is moved to the next frame, or JXL_DEC_NEED_MORE_INPUT
+// if some sections are still missing.
+JxlDecoderStatus JxlDecoderProcessSections(JxlDecoder* dec, const uint8_t* in,
+                                           size_t size) {
+  size_t pos = dec->frame_dec_start - dec->codestream_pos;
+  if (pos >= size) return JXL_DEC_NEED_MORE_INPUT;
+  Span<const uint8_t> span(in + pos, size - pos);
+
+  if (!dec->frame_dec_in_progress) {
+    auto reader = GetBitReader(span);
+    dec->frame_dec.reset(new FrameDecoder(
+        dec->passes_state.get(), dec->metadata, dec->thread_pool.get()));
+    // The pixels of frames that are saved as references are output from the
+    // reference slot, before the next frame is decoded.
+    dec->frame_dec->SetMoveSavedOutput();
+    if (!dec->ib->IsJPEG()) dec->frame_dec->SetCropRect(dec->crop_rect);
+    jxl::Status status = dec->frame_dec->InitFrame(
+        reader.get(), dec->ib.get(), /*is_preview=*/false,
+        /*allow_partial_frames=*/false, /*allow_partial_dc_global=*/false);
+    if (!reader->AllReadsWithinBounds()) return JXL_DEC_NEED_MORE_INPUT;
+    if (!status) return JXL_API_ERROR("invalid frame header or TOC");
+    dec->frame_dec_toc_end = reader->TotalBitsConsumed() / kBitsPerByte;
+    dec->section_processed.clear();
+    dec->section_processed.resize(dec->frame_dec->NumSections(), 0);
+    dec->dc_only_still = false;
+    if (dec->downsampling > 1 && !dec->ib->IsJPEG()) {
+      JXL_API_RETURN_IF_ERROR(SetupDownsampledFrame(dec));
+    }
+    // A DC-only frame needs neither the decoded image nor the filters.
+    dec->passes_state->dc_only = dec->dc_only_still;
+    SetupDirectImageOutput(dec);
+    JXL_API_RETURN_IF_ERROR(SetupFlushableFrame(dec));
+    SetupBandedFrame(dec);
+    if (dec->memory_limit != 0 && !dec->ib->IsJPEG() &&
+        FramePixelMemory(dec) > dec->memory_limit) {
+      return JXL_API_ERROR("frame needs more memory than the memory limit");
+    }
+    dec->frame_dec_in_progress = true;
+  }
+
+  FrameDecoder* frame_dec = dec->frame_dec.get();
+  const size_t toc_end = dec->frame_dec_toc_end;
+  // End of the last section, relative to the start of the frame.
+  size_t frame_end = toc_end;
+  bool all_available = true;
+
+  // For progression events, the AC groups are decoded one pass at a time.
+  const bool pass_by_pass = dec->frame_dec_flushable &&
+                            (dec->events_wanted & JXL_DEC_FRAME_PROGRESSION);
+  const size_t complete_passes = frame_dec->NumCompletePasses();
+
+  jxl::Status close_ok = true;
+  std::vector<std::unique_ptr<BitReader>> section_readers;
+  std::vector<std::unique_ptr<BitReaderScopedCloser>> section_closers;
+  std::vector<FrameDecoder::SectionInfo> section_info;
+  std::vector<FrameDecoder::SectionStatus> section_status;
+  for (size_t i = 0; i < frame_dec->NumSections(); i++) {
+    if (SumOverflows(toc_end, frame_dec->SectionOffsets()[i]) ||
+        SumOverflows(toc_end + frame_dec->SectionOffsets()[i],
+                     frame_dec->SectionSizes()[i])) {
+      return JXL_API_ERROR("section size overflows");
+    }
+    size_t b = toc_end + frame_dec->SectionOffsets()[i];
+    size_t e = b + frame_dec->SectionSizes()[i];
+    frame_end = std::max(frame_end, e);
+    if (dec->section_processed[i]) continue;
+    if (e > span.size()) {
+      // Not all bytes of this section are available yet.
+      all_available = false;
+      continue;
+    }
+    if (pass_by_pass && frame_dec->SectionPass(i) > complete_passes) continue;
+    auto br =
+        make_unique<BitReader>(Span<const uint8_t>(span.data() + b, e - b));
+    section_info.emplace_back(FrameDecoder::SectionInfo{br.get(), i});
+    section_closers.emplace_back(
+        make_unique<BitReaderScopedCloser>(br.get(), &close_ok));
+    section_readers.emplace_back(std::move(br));
+  }
+
+  // The groups of a banded frame are decoded in order, all at once.
+  if (dec->passes_state->banded && !all_available) {
+    return JXL_DEC_NEED_MORE_INPUT;
+  }
+
+  if (!section_info.empty()) {
+    section_status.resize(section_info.size());
+    JXL_API_RETURN_IF_ERROR(frame_dec->ProcessSections(
+        section_info.data(), section_info.size(), section_status.data()));
+    for (size_t i = 0; i < section_status.size(); i++) {
+      if (section_status[i] == FrameDecoder::kDone) {
+        dec->section_processed[section_info[i].id] = 1;
+      }
+    }
+  }
+  section_closers.clear();
+  if (!close_ok) return JXL_API_ERROR("decoding frame sections failed");
+
+  if (pass_by_pass && frame_dec->NumCompletePasses() > complete_passes &&
+      frame_dec->NumCompletePasses() <
+          frame_dec->GetFrameHeader().passes.num_passes) {
+    JxlDecoderStatus status = FlushImageOut(dec);
+    if (status != JXL_DEC_SUCCESS) return status;
+    return JXL_DEC_FRAME_PROGRESSION;
+  }
+
+  for (size_t i = 0; i < dec->section_processed.size(); i++) {
+    if (dec->section_processed[i]) continue;
+    // Sections can only be skipped because sections they depend on are not
+    // yet available. If all of them are, the frame is invalid.
+    if (all_available) return JXL_API_ERROR("not all sections were decoded");
+    return JXL_DEC_NEED_MORE_INPUT;
+  }
+
+  if (dec->dc_only_still) {
+    // The image is the DC itself: there is nothing left to render.
+    const PassesSharedState& shared = dec->passes_state->shared_storage;
+    Image3F dc(jxl::DivCeil(dec->metadata.size.xsize(), jxl::kBlockDim),
+               jxl::DivCeil(dec->metadata.size.ysize(), jxl::kBlockDim));
+    OpsinToLinear(
+        shared.dc_storage, Rect(dc), dec->thread_pool.get(), &dc,
+        dec->metadata.transform_data.opsin_inverse_matrix.ToOpsinParams(
+            dec->metadata.m.IntensityTarget()));
+    dec->ib->SetFromImage(
+        std::move(dc),
+        ColorEncoding::LinearSRGB(dec->metadata.m.color_encoding.IsGray()));
+  } else {
+    JXL_API_RETURN_IF_ERROR(frame_dec->FinalizeFrame());
+  }
+  dec->frame_dec_in_progress = false;
+  if (frame_dec->GetFrameHeader().is_last) {
+    dec->last_frame_reached = true;
+  }
+  dec->frame_dec_start += frame_end;
+  return JXL_DEC_SUCCESS;
+}
+
 // TODO(eustas): no CodecInOut -> no image size reinforcement -> possible OOM.
 JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
                                            size_t size) {
@@ -726,6 +1617,17 @@ JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
     return JXL_DEC_COLOR_ENCODING;
   }
 
+  if (dec->events_wanted & JXL_DEC_JPEG_RECONSTRUCTION) {
+    dec->events_wanted &= ~JXL_DEC_JPEG_RECONSTRUCTION;
+    // The "jbrd" box precedes the codestream, so it was seen by now if the
+    // image has one.
+    if (!dec->jpeg_reconstruction_box.empty()) {
+      JxlDecoderStatus status = DecodeJPEGReconstruction(dec);
+      if (status != JXL_DEC_SUCCESS) return status;
+      return JXL_DEC_JPEG_RECONSTRUCTION;
+    }
+  }
+
   // Decode to pixels, only if required for the events the user wants.
   if (!dec->got_preview_image && (dec->events_wanted & JXL_DEC_PREVIEW_IMAGE)) {
     if (!dec->metadata.m.have_preview) {
@@ -810,6 +1712,9 @@ JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
             dec, dec->frame_header.get(), in, size, pos, is_preview,
             &frame_size, &header_size, nullptr, &group_offsets, &group_sizes);
         if (status != JXL_DEC_SUCCESS) return status;
+        if (!is_preview) {
+          AddFrameRef(dec, dec->frame_start, frame_size, *dec->frame_header);
+        }
 
         // last of the current still frame series. That means it's the last if
         // it has a duration or if it's the last frame of the entire codestream.
@@ -834,17 +1739,31 @@ JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
         dec->got_toc = true;
         // frame_start has already been incremented to the next frame
         dec->still_end = dec->frame_start;
+        // Skipping applies from the first still that was not started yet.
+        dec->skipping_still = dec->skip_frames > 0;
+        if (dec->skipping_still) {
+          dec->skip_frames--;
+        } else {
+          dec->frame_required.clear();
+        }
         break;
       }
     }
 
-    if (dec->events_wanted & JXL_DEC_FRAME) {
+    if (dec->skipping_still && dec->frame_required.empty() &&
+        (dec->events_wanted & JXL_DEC_FULL_IMAGE)) {
+      JxlDecoderStatus status = ComputeRequiredFrames(dec, in, size);
+      if (status != JXL_DEC_SUCCESS) return status;
+    }
+
+    if (!dec->skipping_still && (dec->events_wanted & JXL_DEC_FRAME)) {
       dec->events_wanted &= ~JXL_DEC_FRAME;
       return JXL_DEC_FRAME;
     }
 
     // Decode to pixels, only if required for the events the user wants.
-    if (!dec->got_dc_image && (dec->events_wanted & JXL_DEC_DC_IMAGE)) {
+    if (!dec->skipping_still && !dec->got_dc_image &&
+        (dec->events_wanted & JXL_DEC_DC_IMAGE)) {
       PassesDecoderState passes;
       // Creating temporary metadata, rather than reusing the one from the
       // decoder, because amount of extra channels may differ, causing issues.
@@ -954,57 +1873,87 @@ JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
 
     // Decode to pixels, only if required for the events the user wants.
     if (!dec->got_full_image && (dec->events_wanted & JXL_DEC_FULL_IMAGE)) {
-      if (dec->still_end - dec->codestream_pos > size)
-        return JXL_DEC_NEED_MORE_INPUT;
-      // If we got here, we know for sure there are enough bytes in the input
-      // for all frames, this was checked during the TOC parsing
-      // TODO(lode): allow to customize dparams through API settings, and share
-      // these params for DC and preview too
-      jxl::DecompressParams dparams;
-      jxl::Span<const uint8_t> compressed(
-          in + (dec->still_start - dec->codestream_pos),
-          size - (dec->still_start - dec->codestream_pos));
-      auto reader = GetBitReader(compressed);
-      dec->ib.reset(new jxl::ImageBundle(&dec->metadata.m));
-
+      if (!dec->ib && !dec->skipping_still && !dec->jpeg_out_buffer_set &&
+          !dec->image_out_buffer_set) {
+        // The buffer is requested before decoding, so that the pixels can be
+        // written to it while the frame is rendered.
+        dec->need_image_out_buffer = true;
+        return JXL_DEC_NEED_IMAGE_OUT_BUFFER;
+      }
+      if (!dec->ib) {
+        // Starting on a new still.
+        if (!CropRectInsideImage(dec)) {
+          return JXL_API_ERROR("Crop rect is outside of the image");
+        }
+        dec->ib.reset(new jxl::ImageBundle(&dec->metadata.m));
+        if (dec->jpeg_out_buffer_set) {
+          if (!dec->jpeg_data) {
+            return JXL_API_ERROR("Only one frame can be reconstructed as JPEG");
+          }
+          dec->ib->jpeg_data = std::move(dec->jpeg_data);
+        }
+        dec->frame_dec_start = dec->still_start;
+      }
       if (!dec->passes_state) {
         dec->passes_state.reset(new jxl::PassesDecoderState());
       }
-      const jxl::FrameHeader& frame_header =
-          dec->passes_state->shared->frame_header;
-
-      bool done = false;
-      while (!done) {
-        // Skip frames that are not displayed.
-        do {
-          if (!DecodeFrame(dparams, dec->passes_state.get(),
-                           dec->thread_pool.get(), reader.get(),
-                           /*aux_out=*/nullptr, dec->ib.get(), dec->metadata,
-                           /*constraints=*/nullptr)) {
-            return JXL_API_ERROR("decoding frame failed");
+      // The frames of the still are decoded one after the other; the sections
+      // of each of them as soon as they are available in the input.
+      while (dec->frame_dec_start < dec->still_end) {
+        if (dec->skipping_still && !dec->frame_dec_in_progress) {
+          size_t index = FrameRefIndex(dec, dec->frame_dec_start);
+          if (index < dec->frame_required.size() &&
+              !dec->frame_required[index]) {
+            // Not needed for the still that is skipped to.
+            dec->frame_dec_start += dec->frame_refs[index].size;
+            continue;
           }
-          if (frame_header.is_last) {
-            dec->last_frame_reached = true;
-            done = true;
-          }
-          if (dec->frame_header->animation_frame.duration > 0) {
-            done = true;
-          }
-        } while (frame_header.frame_type != FrameType::kRegularFrame);
-        dec->dec_pixels += dec->ib->xsize() * dec->ib->ysize();
+        }
+        JxlDecoderStatus status = JxlDecoderProcessSections(dec, in, size);
+        if (status != JXL_DEC_SUCCESS) return status;
+      }
+      // Cropping and downsampling write to ib, and leave a frame that is
+      // saved as a reference as it is.
+      if (dec->crop_rect.xsize() != 0 && !dec->ib->IsJPEG()) {
+        CropImageBundle(dec->crop_rect, StillPixels(dec), dec->ib.get());
+      }
+      if (dec->downsampling > 1 && !dec->dc_only_still &&
+          !dec->ib->IsJPEG()) {
+        DownsampleImageBundle(dec->downsampling, dec->thread_pool.get(),
+                              StillPixels(dec), dec->ib.get());
+      }
+      if (dec->image_out_direct) {
+        // The pixels were written to the image out buffer and may not be held
+        // in ib, but such a frame is neither cropped nor downsampled.
+        dec->dec_pixels += static_cast<uint64_t>(dec->metadata.xsize()) *
+                           dec->metadata.ysize();
+      } else {
+        dec->dec_pixels += StillPixels(dec).xsize() * StillPixels(dec).ysize();
       }
       dec->got_full_image = true;
     }
 
+    if (dec->skipping_still && dec->frame_header->is_last) {
+      // The last frame is not necessarily decoded when skipping.
+      dec->last_frame_reached = true;
+    }
+
     if (dec->last_frame_reached) {
-      // No more reason to keep the passes state in memory
-      dec->passes_state.reset(nullptr);
+      // No more reason to keep the passes state in memory, unless it is
+      // reused for the next image.
+      dec->frame_dec.reset();
+      ReleasePassesState(dec);
     }
 
     bool return_full_image = false;
 
-    if (dec->events_wanted & JXL_DEC_FULL_IMAGE) {
-      if (!dec->image_out_buffer_set) {
+    if (!dec->skipping_still && (dec->events_wanted & JXL_DEC_FULL_IMAGE)) {
+      if (dec->ib->IsJPEG()) {
+        // Written before anything else changes, so that this point is reached
+        // again after JXL_DEC_JPEG_NEED_MORE_OUTPUT.
+        JxlDecoderStatus status = WriteReconstructedJPEG(dec);
+        if (status != JXL_DEC_SUCCESS) return status;
+      } else if (!dec->image_out_buffer_set) {
         dec->need_image_out_buffer = true;
         return JXL_DEC_NEED_IMAGE_OUT_BUFFER;
       }
@@ -1020,18 +1969,27 @@ JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
 
       dec->events_wanted =
           dec->orig_events_wanted &
-          (JXL_DEC_FULL_IMAGE | JXL_DEC_DC_IMAGE | JXL_DEC_FRAME);
+          (JXL_DEC_FULL_IMAGE | JXL_DEC_DC_IMAGE | JXL_DEC_FRAME |
+           JXL_DEC_FRAME_PROGRESSION);
     }
 
     // Copy pixels to output buffer if desired. If no output buffer was set,
     // we merely return the JXL_DEC_FULL_IMAGE status without outputting
     // pixels.
-    if (return_full_image && dec->image_out_buffer_set) {
-      JxlDecoderStatus status =
-          ConvertImage(dec, *dec->ib, dec->image_out_format,
-                       dec->image_out_buffer, dec->image_out_size);
-      if (status != JXL_DEC_SUCCESS) return status;
+    if (return_full_image && dec->image_out_buffer_set &&
+        !dec->ib->IsJPEG()) {
+      if (!dec->image_out_direct) {
+        JxlDecoderStatus status = ConvertImage(
+            dec, StillPixels(dec), dec->image_out_format, /*out_image=*/nullptr,
+            /*out_size=*/0, dec->image_out_callback, dec->image_out_opaque,
+            dec->image_out_callback ? nullptr : dec->image_out_channels);
+        if (status != JXL_DEC_SUCCESS) return status;
+      }
+      dec->image_out_direct = false;
+      dec->image_out_ycbcr = false;
       dec->image_out_buffer_set = false;
+      dec->image_out_callback = nullptr;
+      dec->image_out_opaque = nullptr;
     }
 
     // The pixels have been output or are not needed, do not keep them in
@@ -1053,6 +2011,64 @@ JxlDecoderStatus JxlDecoderProcessInternal(JxlDecoder* dec, const uint8_t* in,
 }  // namespace
 }  // namespace jxl
 
+JxlDecoderStatus JxlDecoderSetCrop(JxlDecoder* dec, size_t x0, size_t y0,
+                                   size_t xsize, size_t ysize) {
+  if (dec->frame_dec_in_progress || dec->ib || dec->image_out_buffer_set) {
+    return JXL_API_ERROR("Cannot change the crop while decoding a frame");
+  }
+  if ((xsize == 0) != (ysize == 0)) {
+    return JXL_API_ERROR("Crop rect must be empty or have nonzero size");
+  }
+  dec->crop_rect = jxl::Rect(x0, y0, xsize, ysize);
+  if (dec->got_basic_info && !jxl::CropRectInsideImage(dec)) {
+    dec->crop_rect = jxl::Rect();
+    return JXL_API_ERROR("Crop rect is outside of the image");
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetDownsampling(JxlDecoder* dec,
+                                           uint32_t downsampling) {
+  if (dec->frame_dec_in_progress || dec->ib || dec->image_out_buffer_set) {
+    return JXL_API_ERROR("Cannot change downsampling while decoding a frame");
+  }
+  if (downsampling != 1 && downsampling != 2 && downsampling != 4 &&
+      downsampling != 8) {
+    return JXL_API_ERROR("Downsampling must be 1, 2, 4 or 8");
+  }
+  dec->downsampling = downsampling;
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetMemoryLimit(JxlDecoder* dec, size_t max_bytes) {
+  if (dec->frame_dec_in_progress) {
+    return JXL_API_ERROR("Cannot change memory limit while decoding a frame");
+  }
+  dec->memory_limit = max_bytes;
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetJPEGBuffer(JxlDecoder* dec, uint8_t* data,
+                                         size_t size) {
+  if (dec->jpeg_out_next) {
+    return JXL_API_ERROR("JPEG buffer already set, release it first");
+  }
+  if (!dec->jpeg_data && !dec->jpeg_out_buffer_set) {
+    return JXL_API_ERROR("No JPEG reconstruction data available");
+  }
+  dec->jpeg_out_next = data;
+  dec->jpeg_out_avail = size;
+  dec->jpeg_out_buffer_set = true;
+  return JXL_DEC_SUCCESS;
+}
+
+size_t JxlDecoderReleaseJPEGBuffer(JxlDecoder* dec) {
+  size_t result = dec->jpeg_out_next ? dec->jpeg_out_avail : 0;
+  dec->jpeg_out_next = nullptr;
+  dec->jpeg_out_avail = 0;
+  return result;
+}
+
 JxlDecoderStatus JxlDecoderSetInput(JxlDecoder* dec, const uint8_t* data,
                                     size_t size) {
   if (dec->next_in) return JXL_DEC_ERROR;
@@ -1246,6 +2262,13 @@ JxlDecoderStatus JxlDecoderProcessInput(JxlDecoder* dec) {
                                         contents_size - dec->file_pos;
             return JXL_DEC_NEED_MORE_INPUT;
           }
+          if (strcmp(type, "jbrd") == 0 &&
+              (dec->orig_events_wanted & JXL_DEC_JPEG_RECONSTRUCTION)) {
+            // The box may be seen again if the input is not consumed, so
+            // replace rather than append.
+            dec->jpeg_reconstruction_box.assign(in + pos,
+                                                in + pos + contents_size);
+          }
           pos += contents_size;
           if (!(dec->codestream.empty() && dec->first_codestream_seen)) {
             if (box_size == 0) break;  // last box, nothing to do anymore
@@ -1693,13 +2716,21 @@ JXL_EXPORT JxlDecoderStatus JxlDecoderImageOutBufferSize(
   JxlDecoderStatus status = PrepareSizeCheck(dec, format, &bits);
   if (status != JXL_DEC_SUCCESS) return status;
 
+  size_t xsize = dec->metadata.size.xsize();
+  size_t ysize = dec->metadata.size.ysize();
+  if (dec->crop_rect.xsize() != 0) {
+    xsize = dec->crop_rect.xsize();
+    ysize = dec->crop_rect.ysize();
+  }
+  xsize = jxl::DivCeil(xsize, dec->downsampling);
+  ysize = jxl::DivCeil(ysize, dec->downsampling);
+
   size_t row_size =
-      jxl::DivCeil(dec->metadata.size.xsize() * format->num_channels * bits,
-                   jxl::kBitsPerByte);
+      jxl::DivCeil(xsize * format->num_channels * bits, jxl::kBitsPerByte);
   if (format->align > 1) {
     row_size = jxl::DivCeil(row_size, format->align) * format->align;
   }
-  *size = row_size * dec->metadata.size.ysize();
+  *size = row_size * ysize;
 
   return JXL_DEC_SUCCESS;
 }
@@ -1719,15 +2750,143 @@ JxlDecoderStatus JxlDecoderSetImageOutBuffer(JxlDecoder* dec,
 
   if (size < min_size) return JXL_DEC_ERROR;
 
+  size_t xsize = dec->metadata.size.xsize();
+  if (dec->crop_rect.xsize() != 0) xsize = dec->crop_rect.xsize();
+  xsize = jxl::DivCeil(xsize, dec->downsampling);
+
   dec->need_image_out_buffer = false;
   dec->image_out_buffer_set = true;
-  dec->image_out_buffer = buffer;
-  dec->image_out_size = size;
+  jxl::InterleavedChannels(*format, buffer, xsize, dec->image_out_channels);
+  dec->image_out_callback = nullptr;
+  dec->image_out_opaque = nullptr;
   dec->image_out_format = *format;
 
   return JXL_DEC_SUCCESS;
 }
 
+JxlDecoderStatus JxlDecoderSetImageOutLayout(JxlDecoder* dec,
+                                             const JxlPixelFormat* format,
+                                             const JxlImageOutLayout* layout) {
+  if (!dec->need_image_out_buffer) {
+    return JXL_API_ERROR("No image out buffer needed at this time");
+  }
+  size_t bits;
+  // This checks whether the format is valid and supported and basic info is
+  // available.
+  JxlDecoderStatus status = PrepareSizeCheck(dec, format, &bits);
+  if (status != JXL_DEC_SUCCESS) return status;
+  if (bits % jxl::kBitsPerByte != 0) {
+    return JXL_API_ERROR("Data type not supported for a layout");
+  }
+
+  for (size_t c = 0; c < format->num_channels; c++) {
+    if (!layout->data[c]) return JXL_API_ERROR("Must provide all channels");
+    if (layout->pixel_stride[c] < bits / jxl::kBitsPerByte) {
+      return JXL_API_ERROR("Pixel stride smaller than a sample");
+    }
+  }
+
+  dec->need_image_out_buffer = false;
+  dec->image_out_buffer_set = true;
+  for (size_t c = 0; c < format->num_channels; c++) {
+    dec->image_out_channels[c].data =
+        reinterpret_cast<uint8_t*>(layout->data[c]);
+    dec->image_out_channels[c].pixel_stride = layout->pixel_stride[c];
+    dec->image_out_channels[c].row_stride = layout->row_stride[c];
+  }
+  dec->image_out_callback = nullptr;
+  dec->image_out_opaque = nullptr;
+  dec->image_out_format = *format;
+
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderGetYCbCrInfo(const JxlDecoder* dec,
+                                        JxlYCbCrInfo* info) {
+  if (!jxl::CanOutputYCbCr(dec)) {
+    return JXL_API_ERROR("image cannot be output as YCbCr");
+  }
+  if (info) {
+    const jxl::YCbCrChromaSubsampling& cs =
+        dec->frame_header->chroma_subsampling;
+    // Channels of the frame that hold Y, Cb and Cr.
+    constexpr size_t kChannels[3] = {1, 0, 2};
+    for (size_t i = 0; i < 3; i++) {
+      const size_t c = kChannels[i];
+      info->xsize[i] =
+          jxl::DivCeil(dec->metadata.size.xsize(), size_t{1} << cs.HShift(c));
+      info->ysize[i] =
+          jxl::DivCeil(dec->metadata.size.ysize(), size_t{1} << cs.VShift(c));
+    }
+  }
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetYCbCrOutLayout(JxlDecoder* dec,
+                                             const JxlImageOutLayout* layout) {
+  if (!dec->need_image_out_buffer) {
+    return JXL_API_ERROR("No image out buffer needed at this time");
+  }
+  if (!jxl::CanOutputYCbCr(dec)) {
+    return JXL_API_ERROR("image cannot be output as YCbCr");
+  }
+  for (size_t c = 0; c < 3; c++) {
+    if (!layout->data[c]) return JXL_API_ERROR("Must provide all planes");
+    if (layout->pixel_stride[c] == 0) {
+      return JXL_API_ERROR("Pixel stride smaller than a sample");
+    }
+  }
+
+  dec->need_image_out_buffer = false;
+  dec->image_out_buffer_set = true;
+  dec->image_out_ycbcr = true;
+  for (size_t c = 0; c < 3; c++) {
+    dec->image_out_channels[c].data =
+        reinterpret_cast<uint8_t*>(layout->data[c]);
+    dec->image_out_channels[c].pixel_stride = layout->pixel_stride[c];
+    dec->image_out_channels[c].row_stride = layout->row_stride[c];
+  }
+  dec->image_out_callback = nullptr;
+  dec->image_out_opaque = nullptr;
+  dec->image_out_format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderSetImageOutCallback(JxlDecoder* dec,
+                                               const JxlPixelFormat* format,
+                                               JxlImageOutCallback callback,
+                                               void* opaque) {
+  if (!dec->need_image_out_buffer) {
+    return JXL_API_ERROR("No image out buffer needed at this time");
+  }
+  if (!callback) return JXL_API_ERROR("Must provide a callback");
+  size_t bits;
+  // This checks whether the format is valid and supported and basic info is
+  // available.
+  JxlDecoderStatus status = PrepareSizeCheck(dec, format, &bits);
+  if (status != JXL_DEC_SUCCESS) return status;
+
+  dec->need_image_out_buffer = false;
+  dec->image_out_buffer_set = true;
+  dec->image_out_callback = callback;
+  dec->image_out_opaque = opaque;
+  dec->image_out_format = *format;
+
+  return JXL_DEC_SUCCESS;
+}
+
+JxlDecoderStatus JxlDecoderFlushImage(JxlDecoder* dec) {
+  if (!dec->frame_dec_in_progress || !dec->frame_dec_flushable ||
+      !dec->frame_dec->HasDecodedACGlobal()) {
+    return JXL_API_ERROR("No frame that can be flushed in progress");
+  }
+  if (!dec->image_out_buffer_set || dec->image_out_callback) {
+    return JXL_API_ERROR("No image out buffer to flush to");
+  }
+  return jxl::FlushImageOut(dec);
+}
+
 JxlDecoderStatus JxlDecoderGetFrameHeader(const JxlDecoder* dec,
                                           JxlFrameHeader* header) {
   if (!dec->frame_header || !dec->got_toc) {
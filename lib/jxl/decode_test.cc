@@ -16,25 +16,34 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "jxl/thread_parallel_runner.h"
+#include "lib/extras/codec.h"
 #include "lib/jxl/base/byte_order.h"
+#include "lib/jxl/base/cache_aligned.h"
 #include "lib/jxl/base/file_io.h"
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/dec_file.h"
+#include "lib/jxl/dec_frame.h"
 #include "lib/jxl/enc_butteraugli_comparator.h"
+#include "lib/jxl/enc_cache.h"
 #include "lib/jxl/enc_gamma_correct.h"
 #include "lib/jxl/external_image.h"
 #include "lib/jxl/fields.h"
 #include "lib/jxl/headers.h"
 #include "lib/jxl/icc_codec.h"
 #include "lib/jxl/test_utils.h"
+#include "lib/jxl/testdata.h"
 #include "tools/box/box.h"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -227,6 +236,39 @@ std::vector<uint8_t> DecodeWithAPI(Span<const uint8_t> compressed,
   return pixels;
 }
 
+// Returns the start and end in `data` of the section of AC group `group` of
+// the first frame of the bare codestream `data`, which has a single pass, and
+// neither an ICC profile nor a preview.
+std::pair<size_t, size_t> GetACGroupSection(const PaddedBytes& data,
+                                            size_t group) {
+  BitReader reader(Span<const uint8_t>(data.data(), data.size()));
+  (void)reader.ReadFixedBits<16>();  // skip marker
+  CodecMetadata metadata;
+  EXPECT_TRUE(ReadSizeHeader(&reader, &metadata.size));
+  EXPECT_TRUE(ReadImageMetadata(&reader, &metadata.m));
+  metadata.transform_data.nonserialized_xyb_encoded = metadata.m.xyb_encoded;
+  EXPECT_TRUE(Bundle::Read(&reader, &metadata.transform_data));
+  EXPECT_FALSE(metadata.m.color_encoding.WantICC());
+  EXPECT_FALSE(metadata.m.have_preview);
+  EXPECT_TRUE(reader.JumpToByteBoundary());
+
+  PassesDecoderState dec_state;
+  FrameDecoder frame_dec(&dec_state, metadata, /*pool=*/nullptr);
+  ImageBundle ib(&metadata.m);
+  EXPECT_TRUE(frame_dec.InitFrame(&reader, &ib, /*is_preview=*/false,
+                                  /*allow_partial_frames=*/true,
+                                  /*allow_partial_dc_global=*/false));
+  const size_t toc_end = DivCeil(reader.TotalBitsConsumed(), kBitsPerByte);
+  EXPECT_TRUE(reader.Close());
+  const FrameDimensions& frame_dim = dec_state.shared->frame_dim;
+  EXPECT_EQ(1u, dec_state.shared->frame_header.passes.num_passes);
+  EXPECT_LT(group, frame_dim.num_groups);
+  // The DC global, DC group and AC global sections come first.
+  const size_t id = frame_dim.num_dc_groups + 2 + group;
+  const size_t start = toc_end + frame_dec.SectionOffsets()[id];
+  return std::make_pair(start, start + frame_dec.SectionSizes()[id]);
+}
+
 }  // namespace
 }  // namespace jxl
 
@@ -1160,6 +1202,406 @@ TEST(DecodeTest, PixelTest) {
   JxlDecoderDestroy(dec);
 }
 
+struct ImageOutCallbackData {
+  std::vector<uint8_t> pixels;
+  size_t xsize;
+  size_t bytes_per_pixel;
+  std::atomic<size_t> num_calls{0};
+  std::atomic<size_t> num_pixels{0};
+};
+
+void ImageOutCallback(void* opaque, size_t x, size_t y, size_t num_pixels,
+                      const void* pixels) {
+  ImageOutCallbackData* data = static_cast<ImageOutCallbackData*>(opaque);
+  memcpy(data->pixels.data() + (y * data->xsize + x) * data->bytes_per_pixel,
+         pixels, num_pixels * data->bytes_per_pixel);
+  data->num_calls++;
+  data->num_pixels += num_pixels;
+}
+
+TEST(DecodeTest, ImageOutCallbackTest) {
+  size_t xsize = 123, ysize = 77;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 4, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes compressed = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 4,
+      cparams, kCSBF_None, false);
+
+  for (uint32_t channels = 3; channels <= 4; ++channels) {
+    JxlPixelFormat format = {channels, JXL_TYPE_UINT16, JXL_LITTLE_ENDIAN, 0};
+    std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+        jxl::Span<const uint8_t>(compressed.data(), compressed.size()), format);
+
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    void* runner = JxlThreadParallelRunnerCreate(
+        NULL, JxlThreadParallelRunnerDefaultNumWorkerThreads());
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetParallelRunner(
+                                   dec, JxlThreadParallelRunner, runner));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+
+    ImageOutCallbackData data;
+    data.xsize = xsize;
+    data.bytes_per_pixel = channels * 2;
+    data.pixels.resize(xsize * ysize * data.bytes_per_pixel);
+
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutCallback(dec, &format, ImageOutCallback,
+                                            &data));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+
+    EXPECT_EQ(ysize, data.num_calls);
+    EXPECT_EQ(xsize * ysize, data.num_pixels);
+    EXPECT_EQ(expected, data.pixels);
+
+    JxlThreadParallelRunnerDestroy(runner);
+    JxlDecoderDestroy(dec);
+  }
+}
+
+TEST(DecodeTest, DirectImageOutTest) {
+  // Not a multiple of the block or group size, so that the frame is padded.
+  size_t xsize = 300, ysize = 277;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes compressed = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+
+  for (uint32_t channels = 3; channels <= 4; ++channels) {
+    // Both the 8-bit buffer and callback outputs are written while the frame
+    // is rendered, without holding the rendered frame in floating point.
+    JxlPixelFormat format = {channels, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 64};
+    std::vector<uint8_t> direct = jxl::DecodeWithAPI(
+        jxl::Span<const uint8_t>(compressed.data(), compressed.size()), format);
+    size_t stride = jxl::DivCeil(xsize * channels, 64) * 64;
+    ASSERT_EQ(stride * ysize, direct.size());
+
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    // Enough for one floating point copy of the frame, but not for two.
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetMemoryLimit(
+                  dec, 3 * sizeof(float) * xsize * ysize * 3 / 2));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+    // Without the last byte, the last group is missing, but the rows of the
+    // others are already passed to the callback.
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec, compressed.data(),
+                                                  compressed.size() - 1));
+    ImageOutCallbackData data;
+    data.xsize = xsize;
+    data.bytes_per_pixel = channels;
+    data.pixels.resize(xsize * ysize * data.bytes_per_pixel);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutCallback(dec, &format, ImageOutCallback,
+                                            &data));
+    EXPECT_EQ(JXL_DEC_NEED_MORE_INPUT, JxlDecoderProcessInput(dec));
+    EXPECT_LT(0u, data.num_pixels);
+    EXPECT_GT(xsize * ysize, data.num_pixels);
+    size_t consumed = compressed.size() - 1 - JxlDecoderReleaseInput(dec);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, compressed.data() + consumed,
+                                 compressed.size() - consumed));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    JxlDecoderDestroy(dec);
+
+    // Each pixel is passed to the callback once, as written to the buffer.
+    EXPECT_EQ(xsize * ysize, data.num_pixels);
+    for (size_t y = 0; y < ysize; y++) {
+      EXPECT_EQ(0, memcmp(direct.data() + y * stride,
+                          data.pixels.data() + y * xsize * channels,
+                          xsize * channels))
+          << "channels: " << channels << ", y: " << y;
+      if (channels == 4) {
+        for (size_t x = 0; x < xsize; x++) {
+          EXPECT_EQ(255, direct[y * stride + x * 4 + 3]);
+        }
+      }
+    }
+  }
+}
+
+TEST(DecodeTest, ImageOutLayoutTest) {
+  size_t xsize = 123, ysize = 77;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes compressed = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+
+  // 8-bit output is written while the frame is rendered, 16-bit output is
+  // converted from the decoded image.
+  for (JxlDataType data_type : {JXL_TYPE_UINT8, JXL_TYPE_UINT16}) {
+    JxlPixelFormat format = {4, data_type, JXL_BIG_ENDIAN, 0};
+    std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+        jxl::Span<const uint8_t>(compressed.data(), compressed.size()), format);
+    size_t bytes_per_sample = data_type == JXL_TYPE_UINT8 ? 1 : 2;
+
+    // The color channels as BGR with padded rows, alpha in a separate plane.
+    size_t color_stride = xsize * 3 * bytes_per_sample + 17;
+    size_t alpha_stride = xsize * bytes_per_sample;
+    std::vector<uint8_t> color(color_stride * ysize);
+    std::vector<uint8_t> alpha(alpha_stride * ysize);
+    JxlImageOutLayout layout;
+    for (size_t c = 0; c < 3; c++) {
+      layout.data[c] = color.data() + (2 - c) * bytes_per_sample;
+      layout.pixel_stride[c] = 3 * bytes_per_sample;
+      layout.row_stride[c] = color_stride;
+    }
+    layout.data[3] = alpha.data();
+    layout.pixel_stride[3] = bytes_per_sample;
+    layout.row_stride[3] = alpha_stride;
+
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutLayout(dec, &format, &layout));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    JxlDecoderDestroy(dec);
+
+    for (size_t y = 0; y < ysize; y++) {
+      for (size_t x = 0; x < xsize; x++) {
+        for (size_t i = 0; i < bytes_per_sample; i++) {
+          const uint8_t* pixel =
+              expected.data() + (y * xsize + x) * 4 * bytes_per_sample;
+          for (size_t c = 0; c < 3; c++) {
+            ASSERT_EQ(pixel[c * bytes_per_sample + i],
+                      color[y * color_stride +
+                            (x * 3 + 2 - c) * bytes_per_sample + i]);
+          }
+          ASSERT_EQ(pixel[3 * bytes_per_sample + i],
+                    alpha[y * alpha_stride + x * bytes_per_sample + i]);
+        }
+      }
+    }
+  }
+}
+
+TEST(DecodeTest, FrameProgressionTest) {
+  size_t xsize = 600, ysize = 400;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  cparams.progressive_mode = true;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+  jxl::Span<const uint8_t> span(data.data(), data.size());
+
+  for (JxlDataType data_type : {JXL_TYPE_UINT8, JXL_TYPE_UINT16}) {
+    JxlPixelFormat format = {3, data_type, JXL_LITTLE_ENDIAN, 0};
+    std::vector<uint8_t> expected = jxl::DecodeWithAPI(span, format);
+
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(
+                  dec, JXL_DEC_FULL_IMAGE | JXL_DEC_FRAME_PROGRESSION));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, data.data(), data.size()));
+    std::vector<uint8_t> out(expected.size());
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(
+                                   dec, &format, out.data(), out.size()));
+    // Each pass but the last one gives a progression event, with an image
+    // that is closer to the final one than the previous.
+    size_t num_progressions = 0;
+    size_t prev_diff = expected.size() * 65536;
+    JxlDecoderStatus status;
+    while ((status = JxlDecoderProcessInput(dec)) ==
+           JXL_DEC_FRAME_PROGRESSION) {
+      num_progressions++;
+      size_t diff = 0;
+      for (size_t i = 0; i < out.size(); i++) {
+        diff += std::abs(static_cast<int>(out[i]) - expected[i]);
+      }
+      EXPECT_LE(diff, prev_diff);
+      prev_diff = diff;
+    }
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, status);
+    EXPECT_GT(num_progressions, 0);
+    EXPECT_EQ(expected, out);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+    JxlDecoderDestroy(dec);
+  }
+}
+
+TEST(DecodeTest, FlushImageTest) {
+  size_t xsize = 600, ysize = 400;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  cparams.progressive_mode = true;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+  std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+      jxl::Span<const uint8_t>(data.data(), data.size()), format);
+
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+  // Nothing to flush before a frame is decoded.
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderFlushImage(dec));
+  size_t partial_size = data.size() / 2;
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, data.data(), partial_size));
+  std::vector<uint8_t> out(expected.size(), 0);
+  EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(dec, &format,
+                                                         out.data(),
+                                                         out.size()));
+  EXPECT_EQ(JXL_DEC_NEED_MORE_INPUT, JxlDecoderProcessInput(dec));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderFlushImage(dec));
+  // The partial image is closer to the final one than the empty buffer.
+  size_t diff = 0, empty_diff = 0;
+  for (size_t i = 0; i < out.size(); i++) {
+    diff += std::abs(static_cast<int>(out[i]) - expected[i]);
+    empty_diff += expected[i];
+  }
+  EXPECT_LT(diff, empty_diff);
+
+  size_t remaining = JxlDecoderReleaseInput(dec);
+  size_t consumed = partial_size - remaining;
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, data.data() + consumed,
+                               data.size() - consumed));
+  EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+  EXPECT_EQ(expected, out);
+  JxlDecoderDestroy(dec);
+}
+
+TEST(DecodeTest, MemoryLimitTest) {
+  size_t xsize = 300, ysize = 277;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+  // Enough for one floating point copy of the frame, but not for two.
+  const size_t limit = 3 * sizeof(float) * xsize * ysize * 3 / 2;
+
+  // The 8-bit output is rendered row by row, and only needs one copy.
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+  std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+      jxl::Span<const uint8_t>(data.data(), data.size()), format);
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetMemoryLimit(dec, limit));
+  EXPECT_EQ(expected,
+            jxl::DecodeWithAPI(
+                dec, jxl::Span<const uint8_t>(data.data(), data.size()),
+                format));
+  JxlDecoderDestroy(dec);
+
+  // Float output is converted from the rendered frame, which does not fit.
+  JxlPixelFormat float_format = {3, JXL_TYPE_FLOAT, JXL_LITTLE_ENDIAN, 0};
+  for (size_t max_bytes : {limit, size_t(0)}) {
+    dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetMemoryLimit(dec, max_bytes));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, data.data(), data.size()));
+    std::vector<float> out(xsize * ysize * 3);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec, &float_format, out.data(),
+                                          out.size() * sizeof(float)));
+    EXPECT_EQ(max_bytes == 0 ? JXL_DEC_FULL_IMAGE : JXL_DEC_ERROR,
+              JxlDecoderProcessInput(dec));
+
+    // The limit is a setting, which JxlDecoderRewind keeps.
+    JxlDecoderRewind(dec);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, data.data(), data.size()));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec, &float_format, out.data(),
+                                          out.size() * sizeof(float)));
+    EXPECT_EQ(max_bytes == 0 ? JXL_DEC_FULL_IMAGE : JXL_DEC_ERROR,
+              JxlDecoderProcessInput(dec));
+    JxlDecoderDestroy(dec);
+  }
+}
+
+TEST(DecodeTest, MemoryLimitBandedTest) {
+  // Three rows of groups, so that the band moves down twice.
+  size_t xsize = 300, ysize = 700;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  // Enough for a band of rows of the frame, but not for all of it.
+  const size_t limit = 3 * sizeof(float) * xsize * ysize / 2;
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+
+  for (bool progressive : {false, true}) {
+    jxl::CompressParams cparams;
+    cparams.progressive_mode = progressive;
+    jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+        jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize,
+        3, cparams, kCSBF_None, false);
+    std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+        jxl::Span<const uint8_t>(data.data(), data.size()), format);
+    ASSERT_EQ(xsize * ysize * 3, expected.size());
+
+    // The banded frame is rendered exactly as the whole frame.
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetMemoryLimit(dec, limit));
+    EXPECT_EQ(expected,
+              jxl::DecodeWithAPI(
+                  dec, jxl::Span<const uint8_t>(data.data(), data.size()),
+                  format));
+    JxlDecoderDestroy(dec);
+
+    // With a callback, nothing is rendered before all of the frame is
+    // available, then each pixel is passed once.
+    dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetMemoryLimit(dec, limit));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, data.data(), data.size() - 1));
+    ImageOutCallbackData callback_data;
+    callback_data.xsize = xsize;
+    callback_data.bytes_per_pixel = 3;
+    callback_data.pixels.resize(xsize * ysize * 3);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutCallback(dec, &format, ImageOutCallback,
+                                            &callback_data));
+    EXPECT_EQ(JXL_DEC_NEED_MORE_INPUT, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(0u, callback_data.num_pixels);
+    size_t consumed = data.size() - 1 - JxlDecoderReleaseInput(dec);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec, data.data() + consumed,
+                                                  data.size() - consumed));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    JxlDecoderDestroy(dec);
+    EXPECT_EQ(xsize * ysize, callback_data.num_pixels);
+    EXPECT_EQ(expected, callback_data.pixels) << "progressive: " << progressive;
+
+    // Float output still needs all of the frame, which does not fit.
+    JxlPixelFormat float_format = {3, JXL_TYPE_FLOAT, JXL_LITTLE_ENDIAN, 0};
+    dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetMemoryLimit(dec, limit));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(dec, data.data(), data.size()));
+    std::vector<float> out(xsize * ysize * 3);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec, &float_format, out.data(),
+                                          out.size() * sizeof(float)));
+    EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderProcessInput(dec));
+    JxlDecoderDestroy(dec);
+  }
+}
+
 TEST(DecodeTest, GrayscaleTest) {
   size_t xsize = 123, ysize = 77;
   size_t num_pixels = xsize * ysize;
@@ -1325,6 +1767,219 @@ TEST(DecodeTest, PixelPartialTest) {
   }
 }
 
+// Tests that a multi-group frame that is received in small chunks, and thus
+// decoded section by section, results in the same pixels as a one-shot decode.
+TEST(DecodeTest, PixelStreamingSectionsTest) {
+  size_t xsize = 600, ysize = 400;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+
+  std::vector<uint8_t> expected = jxl::DecodeWithAPI(
+      jxl::Span<const uint8_t>(data.data(), data.size()), format);
+
+  std::vector<uint8_t> pixels2(expected.size());
+  const uint8_t* next_in = data.data();
+  size_t avail_in = 0;
+  size_t total_size = 0;
+  size_t need_more_input_count = 0;
+  bool seen_full_image = false;
+
+  JxlDecoder* dec = JxlDecoderCreate(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+
+  for (;;) {
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec, next_in, avail_in));
+    JxlDecoderStatus status = JxlDecoderProcessInput(dec);
+    size_t remaining = JxlDecoderReleaseInput(dec);
+    EXPECT_LE(remaining, avail_in);
+    next_in += avail_in - remaining;
+    avail_in = remaining;
+    if (status == JXL_DEC_NEED_MORE_INPUT) {
+      if (total_size >= data.size()) {
+        FAIL();
+        break;
+      }
+      need_more_input_count++;
+      size_t increment = std::min<size_t>(data.size() - total_size, 512);
+      total_size += increment;
+      avail_in += increment;
+    } else if (status == JXL_DEC_NEED_IMAGE_OUT_BUFFER) {
+      EXPECT_EQ(JXL_DEC_SUCCESS,
+                JxlDecoderSetImageOutBuffer(dec, &format, pixels2.data(),
+                                            pixels2.size()));
+    } else if (status == JXL_DEC_FULL_IMAGE) {
+      EXPECT_FALSE(seen_full_image);
+      seen_full_image = true;
+      EXPECT_EQ(expected, pixels2);
+    } else if (status == JXL_DEC_SUCCESS) {
+      break;
+    } else {
+      FAIL();
+      break;
+    }
+  }
+
+  EXPECT_TRUE(seen_full_image);
+  EXPECT_GT(need_more_input_count, data.size() / 512);
+  JxlDecoderDestroy(dec);
+}
+
+TEST(DecodeTest, CropTest) {
+  // Large enough to have several groups, so that most of them can be skipped.
+  size_t xsize = 1000, ysize = 700;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+  JxlPixelFormat format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+  const size_t bytes_per_pixel = 6;
+
+  std::vector<uint8_t> full = jxl::DecodeWithAPI(
+      jxl::Span<const uint8_t>(data.data(), data.size()), format);
+  ASSERT_EQ(xsize * ysize * bytes_per_pixel, full.size());
+
+  // Includes a rect on the image border, and one crossing group borders.
+  const size_t crops[3][4] = {
+      {600, 300, 150, 100}, {0, 650, 1000, 50}, {250, 200, 20, 80}};
+  for (const auto& crop : crops) {
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetCrop(dec, crop[0], crop[1], crop[2], crop[3]));
+    std::vector<uint8_t> cropped = jxl::DecodeWithAPI(
+        dec, jxl::Span<const uint8_t>(data.data(), data.size()), format);
+    JxlDecoderDestroy(dec);
+    ASSERT_EQ(crop[2] * crop[3] * bytes_per_pixel, cropped.size());
+    for (size_t y = 0; y < crop[3]; y++) {
+      const uint8_t* expected_row =
+          full.data() + ((crop[1] + y) * xsize + crop[0]) * bytes_per_pixel;
+      const uint8_t* row = cropped.data() + y * crop[2] * bytes_per_pixel;
+      EXPECT_EQ(0, memcmp(expected_row, row, crop[2] * bytes_per_pixel));
+    }
+  }
+
+  // The groups far from the crop are not decoded: the crop still decodes if
+  // the section of the first group, at the top left, is corrupted.
+  const size_t crop[4] = {600, 300, 150, 100};
+  jxl::PaddedBytes corrupted = data;
+  const std::pair<size_t, size_t> section = jxl::GetACGroupSection(data, 0);
+  for (size_t i = section.first; i < section.second; i++) corrupted[i] ^= 0x5A;
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetCrop(dec, crop[0], crop[1], crop[2], crop[3]));
+  std::vector<uint8_t> cropped = jxl::DecodeWithAPI(
+      dec, jxl::Span<const uint8_t>(corrupted.data(), corrupted.size()),
+      format);
+  JxlDecoderDestroy(dec);
+  ASSERT_EQ(crop[2] * crop[3] * bytes_per_pixel, cropped.size());
+  for (size_t y = 0; y < crop[3]; y++) {
+    const uint8_t* expected_row =
+        full.data() + ((crop[1] + y) * xsize + crop[0]) * bytes_per_pixel;
+    const uint8_t* row = cropped.data() + y * crop[2] * bytes_per_pixel;
+    EXPECT_EQ(0, memcmp(expected_row, row, crop[2] * bytes_per_pixel));
+  }
+  // Without the crop, the corrupted section is decoded.
+  dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, corrupted.data(), corrupted.size()));
+  std::vector<uint8_t> uncropped(full.size());
+  EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetImageOutBuffer(dec, &format, uncropped.data(),
+                                        uncropped.size()));
+  EXPECT_TRUE(JxlDecoderProcessInput(dec) != JXL_DEC_FULL_IMAGE ||
+              uncropped != full);
+  JxlDecoderDestroy(dec);
+
+  // The crop must be inside the image.
+  dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetCrop(dec, 990, 0, 20, 20));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSubscribeEvents(
+                                 dec, JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetInput(dec, data.data(), data.size()));
+  EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetCrop(dec, 990, 0, 20, 20));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetCrop(dec, 980, 0, 20, 20));
+  size_t buffer_size;
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderImageOutBufferSize(dec, &format, &buffer_size));
+  EXPECT_EQ(20 * 20 * bytes_per_pixel, buffer_size);
+  JxlDecoderDestroy(dec);
+}
+
+TEST(DecodeTest, DownsamplingTest) {
+  size_t xsize = 600, ysize = 400;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+
+  std::vector<uint8_t> full = jxl::DecodeWithAPI(
+      jxl::Span<const uint8_t>(data.data(), data.size()), format);
+  ASSERT_EQ(xsize * ysize * 3, full.size());
+
+  for (uint32_t downsampling : {2, 4, 8}) {
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetDownsampling(dec, downsampling));
+    std::vector<uint8_t> small = jxl::DecodeWithAPI(
+        dec, jxl::Span<const uint8_t>(data.data(), data.size()), format);
+    JxlDecoderDestroy(dec);
+    size_t small_xsize = jxl::DivCeil(xsize, downsampling);
+    size_t small_ysize = jxl::DivCeil(ysize, downsampling);
+    ASSERT_EQ(small_xsize * small_ysize * 3, small.size());
+
+    // Compare with the average of the corresponding full resolution pixels.
+    double total_error = 0;
+    for (size_t y = 0; y < small_ysize; y++) {
+      for (size_t x = 0; x < small_xsize; x++) {
+        for (size_t c = 0; c < 3; c++) {
+          double sum = 0;
+          size_t count = 0;
+          for (size_t iy = y * downsampling;
+               iy < (y + 1) * downsampling && iy < ysize; iy++) {
+            for (size_t ix = x * downsampling;
+                 ix < (x + 1) * downsampling && ix < xsize; ix++) {
+              sum += full[(iy * xsize + ix) * 3 + c];
+              count++;
+            }
+          }
+          total_error +=
+              std::abs(sum / count - small[(y * small_xsize + x) * 3 + c]);
+        }
+      }
+    }
+    EXPECT_LE(total_error / small.size(), 6.0)
+        << "downsampling: " << downsampling;
+  }
+
+  // Only the DC is decoded and held for downsampling 8, which fits in less
+  // than one full resolution floating point plane.
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetMemoryLimit(dec, sizeof(float) * xsize * ysize));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetDownsampling(dec, 8));
+  EXPECT_EQ(jxl::DivCeil(xsize, 8) * jxl::DivCeil(ysize, 8) * 3,
+            jxl::DecodeWithAPI(
+                dec, jxl::Span<const uint8_t>(data.data(), data.size()),
+                format)
+                .size());
+  JxlDecoderDestroy(dec);
+
+  dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetDownsampling(dec, 3));
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderSetDownsampling(dec, 16));
+  JxlDecoderDestroy(dec);
+}
+
 TEST(DecodeTest, DCTest) {
   using jxl::kBlockDim;
 
@@ -1819,3 +2474,541 @@ TEST(DecodeTest, AnimationTestStreaming) {
   JxlThreadParallelRunnerDestroy(runner);
   JxlDecoderDestroy(dec);
 }
+
+TEST(DecodeTest, SkipFramesTest) {
+  size_t xsize = 90, ysize = 120;
+  constexpr size_t num_frames = 5;
+  std::vector<uint8_t> frames[num_frames];
+  for (size_t i = 0; i < num_frames; i++) {
+    frames[i] = jxl::test::GetSomeTestImage(xsize, ysize, 3, i);
+  }
+  JxlPixelFormat format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+
+  jxl::CodecInOut io;
+  io.SetSize(xsize, ysize);
+  io.metadata.m.SetUintSamples(16);
+  io.metadata.m.color_encoding = jxl::ColorEncoding::SRGB(false);
+  io.metadata.m.have_animation = true;
+  io.frames.clear();
+  io.frames.reserve(num_frames);
+
+  for (size_t i = 0; i < num_frames; ++i) {
+    jxl::ImageBundle bundle(&io.metadata.m);
+    // Frame 2 only covers part of the image, so that it depends on frame 1.
+    size_t frame_xsize = i == 2 ? xsize / 2 : xsize;
+    size_t frame_ysize = i == 2 ? ysize / 3 : ysize;
+    EXPECT_TRUE(ConvertImage(
+        jxl::Span<const uint8_t>(frames[i].data(),
+                                 frame_xsize * frame_ysize * 6),
+        frame_xsize, frame_ysize, jxl::ColorEncoding::SRGB(/*is_gray=*/false),
+        /*has_alpha=*/false, /*alpha_is_premultiplied=*/false,
+        /*bits_per_sample=*/16, JXL_BIG_ENDIAN, /*flipped_y=*/false,
+        /*pool=*/nullptr, &bundle));
+    if (i == 2) bundle.origin = {7, 11};
+    bundle.use_for_next_frame = (i == 1);
+    bundle.duration = 5 + i;
+    io.frames.push_back(std::move(bundle));
+  }
+
+  jxl::CompressParams cparams;
+  cparams.SetLossless();
+  jxl::PaddedBytes compressed;
+  jxl::PassesEncoderState enc_state;
+  EXPECT_TRUE(jxl::EncodeFile(cparams, &io, &enc_state, &compressed, nullptr,
+                              nullptr));
+
+  size_t buffer_size = xsize * ysize * 6;
+  // Decode all frames without skipping, to compare with.
+  std::vector<std::vector<uint8_t>> expected;
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  for (size_t i = 0; i < num_frames; ++i) {
+    expected.emplace_back(buffer_size);
+    EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec, &format, expected.back().data(),
+                                          buffer_size));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+  }
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+
+  const auto expect_frame = [&](size_t index) {
+    std::vector<uint8_t> pixels(buffer_size);
+    EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec));
+    JxlFrameHeader frame_header;
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetFrameHeader(dec, &frame_header));
+    EXPECT_EQ(5 + index, frame_header.duration);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(
+                                   dec, &format, pixels.data(), pixels.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(0, ComparePixels(expected[index].data(), pixels.data(), xsize,
+                               ysize, format, format));
+  };
+
+  JxlDecoderRewind(dec);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  JxlDecoderSkipFrames(dec, 2);
+  expect_frame(2);
+  JxlDecoderSkipFrames(dec, 1);
+  expect_frame(4);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+
+  // Seek back, using the frame index built so far.
+  JxlDecoderRewind(dec);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  JxlDecoderSkipFrames(dec, 1);
+  expect_frame(1);
+  expect_frame(2);
+  // Skipping past the end ends decoding.
+  JxlDecoderSkipFrames(dec, 5);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+
+  JxlDecoderDestroy(dec);
+}
+
+TEST(DecodeTest, SkipFramesKeepsReferencesTest) {
+  // Frame 0 is saved as a reference, frame 1 replaces the whole image without
+  // using it, and frame 2 only covers part of the image, so that it is blended
+  // onto frame 0. Skipping to frame 1 must still decode frame 0.
+  size_t xsize = 90, ysize = 120;
+  constexpr size_t num_frames = 4;
+  std::vector<uint8_t> frames[num_frames];
+  for (size_t i = 0; i < num_frames; i++) {
+    frames[i] = jxl::test::GetSomeTestImage(xsize, ysize, 3, i);
+  }
+  JxlPixelFormat format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+
+  jxl::CodecInOut io;
+  io.SetSize(xsize, ysize);
+  io.metadata.m.SetUintSamples(16);
+  io.metadata.m.color_encoding = jxl::ColorEncoding::SRGB(false);
+  io.metadata.m.have_animation = true;
+  io.frames.clear();
+  io.frames.reserve(num_frames);
+
+  for (size_t i = 0; i < num_frames; ++i) {
+    jxl::ImageBundle bundle(&io.metadata.m);
+    size_t frame_xsize = i == 2 ? xsize / 2 : xsize;
+    size_t frame_ysize = i == 2 ? ysize / 3 : ysize;
+    EXPECT_TRUE(ConvertImage(
+        jxl::Span<const uint8_t>(frames[i].data(),
+                                 frame_xsize * frame_ysize * 6),
+        frame_xsize, frame_ysize, jxl::ColorEncoding::SRGB(/*is_gray=*/false),
+        /*has_alpha=*/false, /*alpha_is_premultiplied=*/false,
+        /*bits_per_sample=*/16, JXL_BIG_ENDIAN, /*flipped_y=*/false,
+        /*pool=*/nullptr, &bundle));
+    if (i == 2) bundle.origin = {7, 11};
+    bundle.use_for_next_frame = (i == 0);
+    bundle.duration = 5 + i;
+    io.frames.push_back(std::move(bundle));
+  }
+
+  jxl::CompressParams cparams;
+  cparams.SetLossless();
+  jxl::PaddedBytes compressed;
+  jxl::PassesEncoderState enc_state;
+  EXPECT_TRUE(jxl::EncodeFile(cparams, &io, &enc_state, &compressed, nullptr,
+                              nullptr));
+
+  size_t buffer_size = xsize * ysize * 6;
+  // Decode all frames without skipping, to compare with.
+  std::vector<std::vector<uint8_t>> expected;
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  for (size_t i = 0; i < num_frames; ++i) {
+    expected.emplace_back(buffer_size);
+    EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(dec, &format, expected.back().data(),
+                                          buffer_size));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+  }
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+
+  // Seek to frame 1, then keep decoding past it.
+  JxlDecoderRewind(dec);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  JxlDecoderSkipFrames(dec, 1);
+  for (size_t i = 1; i < num_frames; ++i) {
+    std::vector<uint8_t> pixels(buffer_size);
+    EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec));
+    JxlFrameHeader frame_header;
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetFrameHeader(dec, &frame_header));
+    EXPECT_EQ(5 + i, frame_header.duration);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(
+                                   dec, &format, pixels.data(), pixels.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(0, ComparePixels(expected[i].data(), pixels.data(), xsize, ysize,
+                               format, format))
+        << "frame: " << i;
+  }
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+
+  JxlDecoderDestroy(dec);
+}
+
+TEST(DecodeTest, AnimationSavedFramesTest) {
+  // Lossy frames that are both displayed and saved as references, so that
+  // the decoder moves them to their slot and outputs them from there. Frames 2
+  // and 3 only cover part of the image and are blended onto the saved frames.
+  size_t xsize = 90, ysize = 120;
+  constexpr size_t num_frames = 4;
+  JxlPixelFormat format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+
+  jxl::CodecInOut io;
+  io.SetSize(xsize, ysize);
+  io.metadata.m.SetUintSamples(16);
+  io.metadata.m.color_encoding = jxl::ColorEncoding::SRGB(false);
+  io.metadata.m.have_animation = true;
+  io.frames.clear();
+  io.frames.reserve(num_frames);
+
+  for (size_t i = 0; i < num_frames; ++i) {
+    size_t frame_xsize = i >= 2 ? xsize / 2 : xsize;
+    size_t frame_ysize = i >= 2 ? ysize / 3 : ysize;
+    std::vector<uint8_t> pixels =
+        jxl::test::GetSomeTestImage(frame_xsize, frame_ysize, 3, i);
+    jxl::ImageBundle bundle(&io.metadata.m);
+    EXPECT_TRUE(ConvertImage(
+        jxl::Span<const uint8_t>(pixels.data(), pixels.size()), frame_xsize,
+        frame_ysize, jxl::ColorEncoding::SRGB(/*is_gray=*/false),
+        /*has_alpha=*/false, /*alpha_is_premultiplied=*/false,
+        /*bits_per_sample=*/16, JXL_BIG_ENDIAN, /*flipped_y=*/false,
+        /*pool=*/nullptr, &bundle));
+    if (i >= 2) bundle.origin = {static_cast<int>(5 * i), 11};
+    bundle.use_for_next_frame = (i + 1 < num_frames);
+    bundle.duration = 1;
+    io.frames.push_back(std::move(bundle));
+  }
+
+  jxl::CompressParams cparams;
+  jxl::PaddedBytes compressed;
+  jxl::PassesEncoderState enc_state;
+  EXPECT_TRUE(jxl::EncodeFile(cparams, &io, &enc_state, &compressed, nullptr,
+                              nullptr));
+
+  // The frames as decoded by DecodeFile, which copies the saved frames.
+  jxl::DecompressParams dparams;
+  jxl::CodecInOut io2;
+  EXPECT_TRUE(jxl::DecodeFile(dparams, compressed, &io2));
+  ASSERT_EQ(num_frames, io2.frames.size());
+
+  size_t buffer_size = xsize * ysize * 6;
+  const size_t crop[4] = {20, 30, 40, 50};
+  size_t crop_size = crop[2] * crop[3] * 6;
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  JxlDecoder* crop_dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetCrop(crop_dec, crop[0], crop[1], crop[2], crop[3]));
+  for (JxlDecoder* d : {dec, crop_dec}) {
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSubscribeEvents(d, JXL_DEC_FULL_IMAGE));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetInput(d, compressed.data(), compressed.size()));
+  }
+  for (size_t i = 0; i < num_frames; ++i) {
+    const jxl::ImageBundle& frame = io2.frames[i];
+    std::vector<uint8_t> expected(buffer_size);
+    EXPECT_TRUE(jxl::ConvertImage(
+        frame, /*bits_per_sample=*/16, /*float_out=*/false,
+        /*apply_srgb_tf=*/frame.c_current().IsLinearSRGB(),
+        /*num_channels=*/3, JXL_BIG_ENDIAN, /*stride_out=*/xsize * 6,
+        /*thread_pool=*/nullptr, expected.data(), expected.size(),
+        jxl::Orientation::kIdentity));
+
+    std::vector<uint8_t> pixels(buffer_size);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(
+                                   dec, &format, pixels.data(), pixels.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(0, ComparePixels(expected.data(), pixels.data(), xsize, ysize,
+                               format, format))
+        << "frame: " << i;
+
+    // Cropping must not modify the saved frame that later frames blend onto.
+    std::vector<uint8_t> cropped(crop_size);
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(crop_dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetImageOutBuffer(crop_dec, &format, cropped.data(),
+                                          cropped.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(crop_dec));
+    for (size_t y = 0; y < crop[3]; y++) {
+      const uint8_t* expected_row =
+          expected.data() + ((crop[1] + y) * xsize + crop[0]) * 6;
+      EXPECT_EQ(0, memcmp(expected_row, cropped.data() + y * crop[2] * 6,
+                          crop[2] * 6))
+          << "frame: " << i << " row: " << y;
+    }
+  }
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(crop_dec));
+
+  JxlDecoderDestroy(dec);
+  JxlDecoderDestroy(crop_dec);
+}
+
+TEST(DecodeTest, AnimationPatchesTest) {
+  // Small frames replacing parts of a full canvas, as in animated stickers.
+  // All but frame 3 are saved in place of the canvas they are blended onto,
+  // so that both the in-place and the copying blending paths are used.
+  size_t xsize = 90, ysize = 120;
+  size_t patch_xsize = 16, patch_ysize = 12;
+  constexpr size_t num_frames = 5;
+  const int origins[num_frames][2] = {{0, 0}, {3, 5}, {40, 70}, {1, 100},
+                                      {70, 2}};
+  JxlPixelFormat format = {3, JXL_TYPE_UINT16, JXL_BIG_ENDIAN, 0};
+
+  jxl::CodecInOut io;
+  io.SetSize(xsize, ysize);
+  io.metadata.m.SetUintSamples(16);
+  io.metadata.m.color_encoding = jxl::ColorEncoding::SRGB(false);
+  io.metadata.m.have_animation = true;
+  io.frames.clear();
+  io.frames.reserve(num_frames);
+
+  // The expected output of each frame.
+  std::vector<std::vector<uint8_t>> expected;
+  std::vector<uint8_t> canvas;
+  std::vector<uint8_t> saved;
+  for (size_t i = 0; i < num_frames; ++i) {
+    size_t frame_xsize = i == 0 ? xsize : patch_xsize;
+    size_t frame_ysize = i == 0 ? ysize : patch_ysize;
+    std::vector<uint8_t> pixels =
+        jxl::test::GetSomeTestImage(frame_xsize, frame_ysize, 3, i);
+    jxl::ImageBundle bundle(&io.metadata.m);
+    EXPECT_TRUE(ConvertImage(
+        jxl::Span<const uint8_t>(pixels.data(), pixels.size()), frame_xsize,
+        frame_ysize, jxl::ColorEncoding::SRGB(/*is_gray=*/false),
+        /*has_alpha=*/false, /*alpha_is_premultiplied=*/false,
+        /*bits_per_sample=*/16, JXL_BIG_ENDIAN, /*flipped_y=*/false,
+        /*pool=*/nullptr, &bundle));
+    bundle.origin = {origins[i][0], origins[i][1]};
+    bundle.use_for_next_frame = (i != 3);
+    bundle.duration = 1;
+    io.frames.push_back(std::move(bundle));
+
+    canvas = i == 0 ? pixels : saved;
+    for (size_t y = 0; y < frame_ysize && i != 0; ++y) {
+      memcpy(&canvas[((y + origins[i][1]) * xsize + origins[i][0]) * 6],
+             &pixels[y * frame_xsize * 6], frame_xsize * 6);
+    }
+    if (i != 3) saved = canvas;
+    expected.push_back(canvas);
+  }
+
+  jxl::CompressParams cparams;
+  cparams.SetLossless();
+  jxl::PaddedBytes compressed;
+  jxl::PassesEncoderState enc_state;
+  EXPECT_TRUE(jxl::EncodeFile(cparams, &io, &enc_state, &compressed, nullptr,
+                              nullptr));
+
+  JxlDecoder* dec = JxlDecoderCreate(NULL);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FRAME | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  for (size_t i = 0; i < num_frames; ++i) {
+    std::vector<uint8_t> pixels(xsize * ysize * 6);
+    EXPECT_EQ(JXL_DEC_FRAME, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetImageOutBuffer(
+                                   dec, &format, pixels.data(), pixels.size()));
+    EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+    EXPECT_EQ(0, ComparePixels(expected[i].data(), pixels.data(), xsize,
+                               ysize, format, format));
+  }
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+  JxlDecoderDestroy(dec);
+}
+
+TEST(DecodeTest, ReuseAllocationsTest) {
+  size_t xsize = 600, ysize = 400;
+  std::vector<uint8_t> pixels = jxl::test::GetSomeTestImage(xsize, ysize, 3, 0);
+  jxl::CompressParams cparams;
+  // Several passes, so that the coefficients are stored as well.
+  cparams.progressive_mode = true;
+  jxl::PaddedBytes data = jxl::CreateTestJXLCodestream(
+      jxl::Span<const uint8_t>(pixels.data(), pixels.size()), xsize, ysize, 3,
+      cparams, kCSBF_None, false);
+  jxl::Span<const uint8_t> span(data.data(), data.size());
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_LITTLE_ENDIAN, 0};
+
+  std::vector<uint8_t> expected = jxl::DecodeWithAPI(span, format);
+
+  // Allocations made for decoding the second image with the same decoder,
+  // without and with reuse.
+  size_t allocations[2];
+  for (int reuse = 0; reuse < 2; reuse++) {
+    JxlDecoder* dec = JxlDecoderCreate(NULL);
+    EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetReuseAllocations(dec, reuse));
+    EXPECT_EQ(expected, jxl::DecodeWithAPI(dec, span, format));
+    // The setting is kept by the reset.
+    JxlDecoderReset(dec);
+    size_t before = jxl::CacheAligned::NumAllocations();
+    EXPECT_EQ(expected, jxl::DecodeWithAPI(dec, span, format));
+    allocations[reuse] = jxl::CacheAligned::NumAllocations() - before;
+    JxlDecoderDestroy(dec);
+  }
+  EXPECT_LT(allocations[1], allocations[0])
+      << "Allocations for the second image: " << allocations[0]
+      << ", with reuse: " << allocations[1];
+}
+
+#if JPEGXL_ENABLE_JPEG
+TEST(DecodeTest, JPEGReconstructionTest) {
+  const jxl::PaddedBytes orig = jxl::ReadTestData(
+      "imagecompression.info/flower_foveon.png.im_q85_444.jpg");
+  jxl::CodecInOut io;
+  io.dec_target = jxl::DecodeTarget::kQuantizedCoeffs;
+  ASSERT_TRUE(jxl::SetFromBytes(jxl::Span<const uint8_t>(orig), &io));
+  jxl::CompressParams cparams;
+  cparams.color_transform = jxl::ColorTransform::kYCbCr;
+  jxl::PassesEncoderState enc_state;
+  jxl::PaddedBytes compressed;
+  ASSERT_TRUE(jpegxl::tools::EncodeJpegToJpegXL(cparams, &io, &enc_state,
+                                                &compressed,
+                                                /*aux_out=*/nullptr,
+                                                /*pool=*/nullptr));
+
+  JxlDecoder* dec = JxlDecoderCreate(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(
+                dec, JXL_DEC_JPEG_RECONSTRUCTION | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  EXPECT_EQ(JXL_DEC_JPEG_RECONSTRUCTION, JxlDecoderProcessInput(dec));
+
+  // The buffer is much smaller than the JPEG, so that it is written out in
+  // several parts.
+  std::vector<uint8_t> buffer(10000);
+  std::vector<uint8_t> reconstructed;
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetJPEGBuffer(dec, buffer.data(), buffer.size()));
+  EXPECT_EQ(JXL_DEC_ERROR,
+            JxlDecoderSetJPEGBuffer(dec, buffer.data(), buffer.size()));
+  JxlDecoderStatus status;
+  size_t num_buffers = 1;
+  while ((status = JxlDecoderProcessInput(dec)) ==
+         JXL_DEC_JPEG_NEED_MORE_OUTPUT) {
+    size_t used = buffer.size() - JxlDecoderReleaseJPEGBuffer(dec);
+    reconstructed.insert(reconstructed.end(), buffer.data(),
+                         buffer.data() + used);
+    EXPECT_EQ(JXL_DEC_SUCCESS,
+              JxlDecoderSetJPEGBuffer(dec, buffer.data(), buffer.size()));
+    num_buffers++;
+  }
+  EXPECT_EQ(JXL_DEC_FULL_IMAGE, status);
+  size_t used = buffer.size() - JxlDecoderReleaseJPEGBuffer(dec);
+  reconstructed.insert(reconstructed.end(), buffer.data(),
+                       buffer.data() + used);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+  EXPECT_GT(num_buffers, 1);
+
+  ASSERT_EQ(orig.size(), reconstructed.size());
+  EXPECT_EQ(0, memcmp(orig.data(), reconstructed.data(), orig.size()));
+
+  JxlDecoderDestroy(dec);
+}
+
+TEST(DecodeTest, YCbCrOutputTest) {
+  const jxl::PaddedBytes orig = jxl::ReadTestData(
+      "imagecompression.info/flower_foveon.png.im_q85_420.jpg");
+  jxl::CodecInOut io;
+  io.dec_target = jxl::DecodeTarget::kQuantizedCoeffs;
+  ASSERT_TRUE(jxl::SetFromBytes(jxl::Span<const uint8_t>(orig), &io));
+  jxl::CompressParams cparams;
+  cparams.color_transform = jxl::ColorTransform::kYCbCr;
+  jxl::PassesEncoderState enc_state;
+  jxl::PaddedBytes compressed;
+  ASSERT_TRUE(jpegxl::tools::EncodeJpegToJpegXL(cparams, &io, &enc_state,
+                                                &compressed,
+                                                /*aux_out=*/nullptr,
+                                                /*pool=*/nullptr));
+
+  JxlDecoder* dec = JxlDecoderCreate(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSubscribeEvents(
+                                 dec, JXL_DEC_BASIC_INFO | JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  EXPECT_EQ(JXL_DEC_BASIC_INFO, JxlDecoderProcessInput(dec));
+  JxlBasicInfo info;
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetBasicInfo(dec, &info));
+  const size_t xsize = info.xsize;
+  const size_t ysize = info.ysize;
+  EXPECT_EQ(JXL_DEC_ERROR, JxlDecoderGetYCbCrInfo(dec, nullptr));
+  EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+
+  JxlYCbCrInfo ycbcr_info;
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetYCbCrInfo(dec, &ycbcr_info));
+  EXPECT_EQ(xsize, ycbcr_info.xsize[0]);
+  EXPECT_EQ(ysize, ycbcr_info.ysize[0]);
+  for (size_t c = 1; c < 3; c++) {
+    EXPECT_EQ((xsize + 1) / 2, ycbcr_info.xsize[c]);
+    EXPECT_EQ((ysize + 1) / 2, ycbcr_info.ysize[c]);
+  }
+  // The planes are written with a row stride larger than their width.
+  std::vector<uint8_t> planes[3];
+  JxlImageOutLayout layout;
+  for (size_t c = 0; c < 3; c++) {
+    layout.row_stride[c] = ycbcr_info.xsize[c] + 7;
+    layout.pixel_stride[c] = 1;
+    planes[c].resize(layout.row_stride[c] * ycbcr_info.ysize[c]);
+    layout.data[c] = planes[c].data();
+  }
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetYCbCrOutLayout(dec, &layout));
+  EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderProcessInput(dec));
+  JxlDecoderDestroy(dec);
+
+  // The same image decoded to RGB, from the chroma planes upsampled.
+  JxlPixelFormat format = {3, JXL_TYPE_UINT8, JXL_NATIVE_ENDIAN, 0};
+  std::vector<uint8_t> rgb = jxl::DecodeWithAPI(
+      jxl::Span<const uint8_t>(compressed.data(), compressed.size()), format);
+  ASSERT_EQ(xsize * ysize * 3, rgb.size());
+
+  // Converting the RGB pixels back to YCbCr gives the luma as it was output,
+  // up to rounding and clamping, and the chroma averaged over each 2x2 block
+  // close to the chroma that was output.
+  double luma_error = 0;
+  double chroma_error = 0;
+  for (size_t y = 0; y < ysize; y++) {
+    for (size_t x = 0; x < xsize; x++) {
+      const uint8_t* p = rgb.data() + (y * xsize + x) * 3;
+      const double luma = 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+      luma_error += std::abs(luma - planes[0][y * layout.row_stride[0] + x]);
+    }
+  }
+  for (size_t y = 0; y + 1 < ysize; y += 2) {
+    for (size_t x = 0; x + 1 < xsize; x += 2) {
+      double cb = 0;
+      double cr = 0;
+      for (size_t iy = 0; iy < 2; iy++) {
+        for (size_t ix = 0; ix < 2; ix++) {
+          const uint8_t* p = rgb.data() + ((y + iy) * xsize + x + ix) * 3;
+          cb += 128 - 0.168736 * p[0] - 0.331264 * p[1] + 0.5 * p[2];
+          cr += 128 + 0.5 * p[0] - 0.418688 * p[1] - 0.081312 * p[2];
+        }
+      }
+      const size_t pos = (y / 2) * layout.row_stride[1] + x / 2;
+      chroma_error += std::abs(cb / 4 - planes[1][pos]);
+      chroma_error += std::abs(cr / 4 - planes[2][pos]);
+    }
+  }
+  EXPECT_LT(luma_error / (xsize * ysize), 1.0);
+  EXPECT_LT(chroma_error / (2 * (xsize / 2) * (ysize / 2)), 2.0);
+}
+#endif  // JPEGXL_ENABLE_JPEG
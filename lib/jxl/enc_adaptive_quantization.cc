@@ -1096,7 +1096,7 @@ ImageBundle RoundtripImage(const Image3F& opsin, PassesEncoderState* enc_state,
                                             enc_state->cparams);
   InitializePassesEncoder(opsin, pool, enc_state, &modular_frame_encoder,
                           nullptr);
-  dec_state.Init(pool);
+  dec_state.Init();
 
   ImageBundle decoded(&enc_state->shared.metadata->m);
   decoded.origin = enc_state->shared.frame_header.frame_origin;
@@ -1122,7 +1122,7 @@ ImageBundle RoundtripImage(const Image3F& opsin, PassesEncoderState* enc_state,
   // Fine to do a JXL_ASSERT instead of error handling, since this only happens
   // on the encoder side where we can't be fed with invalid data.
   JXL_CHECK(FinalizeFrameDecoding(&decoded, &dec_state, pool,
-                                  /*rerender=*/false, /*skip_blending=*/true));
+                                  /*rerender=*/false));
   // Ensure we don't create any new special frames.
   enc_state->special_frames.resize(num_special_frames);
 
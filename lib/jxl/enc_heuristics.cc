@@ -226,8 +226,9 @@ Status DefaultEncoderHeuristics::LossyFrameHeuristics(
   // Find and subtract splines.
   if (cparams.speed_tier <= SpeedTier::kSquirrel) {
     shared.image_features.splines = FindSplines(*opsin);
-    JXL_RETURN_IF_ERROR(
-        shared.image_features.splines.SubtractFrom(opsin, shared.cmap));
+    JXL_RETURN_IF_ERROR(shared.image_features.splines.InitializeDrawCache(
+        opsin->xsize(), opsin->ysize(), shared.cmap));
+    shared.image_features.splines.SubtractFrom(opsin);
   }
 
   // Find and subtract patches/dots.
@@ -0,0 +1,175 @@
+// Copyright (c) the JPEG XL Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "lib/jxl/enc_ycbcr.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include <hwy/aligned_allocator.h>
+
+#include "lib/jxl/ac_strategy.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/common.h"
+#include "lib/jxl/enc_transforms.h"
+
+namespace jxl {
+
+namespace {
+
+// Quantization tables of Annex K of T.81 for luma and chroma, in natural
+// (row-major) order.
+constexpr int kBaseQuantTables[2][kDCTBlockSize] = {
+    {16, 11, 10, 16, 24,  40,  51,  61,  12, 12, 14, 19, 26,  58,  60,  55,
+     14, 13, 16, 24, 40,  57,  69,  56,  14, 17, 22, 29, 51,  87,  80,  62,
+     18, 22, 37, 56, 68,  109, 103, 77,  24, 35, 55, 64, 81,  104, 113, 92,
+     49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99},
+    {17, 18, 24, 47, 99, 99, 99, 99, 18, 21, 26, 66, 99, 99, 99, 99,
+     24, 26, 56, 99, 99, 99, 99, 99, 47, 66, 99, 99, 99, 99, 99, 99,
+     99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99,
+     99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99, 99},
+};
+
+// Writes row `y` of plane `c`, which has `xsize` samples, to `row`, scaled to
+// 8 bits and level-shifted to be centered at 0 as in F.1.1.3 of T.81. The last
+// sample is repeated up to `padded_xsize`.
+void LoadRow(const YCbCrPlanes& planes, size_t c, size_t y, size_t xsize,
+             size_t padded_xsize, float* JXL_RESTRICT row) {
+  const uint8_t* in =
+      static_cast<const uint8_t*>(planes.data[c]) + y * planes.row_stride[c];
+  if (planes.bits_per_sample == 8) {
+    for (size_t x = 0; x < xsize; x++) row[x] = in[x] - 128.0f;
+  } else {
+    const float mul = 255.0f / ((1u << planes.bits_per_sample) - 1);
+    for (size_t x = 0; x < xsize; x++) {
+      uint16_t sample;
+      memcpy(&sample, in + 2 * x, sizeof(sample));
+      row[x] = sample * mul - 128.0f;
+    }
+  }
+  for (size_t x = xsize; x < padded_xsize; x++) row[x] = row[xsize - 1];
+}
+
+}  // namespace
+
+Status YCbCrToJPEGData(const YCbCrPlanes& planes, size_t xsize, size_t ysize,
+                       float distance, ThreadPool* pool,
+                       jpeg::JPEGData* jpeg_data) {
+  if (xsize == 0 || ysize == 0) return JXL_FAILURE("Empty image");
+  if (planes.bits_per_sample < 8 || planes.bits_per_sample > 16) {
+    return JXL_FAILURE("Invalid bits per sample");
+  }
+  size_t max_h = 1;
+  size_t max_v = 1;
+  for (size_t c = 0; c < 3; c++) {
+    if (planes.h_samp_factor[c] < 1 || planes.h_samp_factor[c] > 2 ||
+        planes.v_samp_factor[c] < 1 || planes.v_samp_factor[c] > 2) {
+      return JXL_FAILURE("Invalid sampling factor");
+    }
+    max_h = std::max<size_t>(max_h, planes.h_samp_factor[c]);
+    max_v = std::max<size_t>(max_v, planes.v_samp_factor[c]);
+  }
+  const size_t bytes_per_sample = planes.bits_per_sample == 8 ? 1 : 2;
+  for (size_t c = 0; c < 3; c++) {
+    const size_t plane_xsize = DivCeil(xsize * planes.h_samp_factor[c], max_h);
+    if (!planes.data[c]) return JXL_FAILURE("Missing plane");
+    if (planes.row_stride[c] < plane_xsize * bytes_per_sample) {
+      return JXL_FAILURE("Row stride smaller than a row");
+    }
+  }
+
+  jpeg_data->width = xsize;
+  jpeg_data->height = ysize;
+  jpeg_data->restart_interval = 0;
+  // The libjpeg scaling of the tables for quality 90 is 0.2.
+  const float scale = 0.2f * distance;
+  jpeg_data->quant.resize(2);
+  for (size_t i = 0; i < 2; i++) {
+    jpeg::JPEGQuantTable& table = jpeg_data->quant[i];
+    for (size_t k = 0; k < kDCTBlockSize; k++) {
+      const int q = std::lround(kBaseQuantTables[i][k] * scale);
+      table.values[k] = std::min(std::max(q, 1), 255);
+    }
+    table.precision = 0;
+    table.index = i;
+    table.is_last = i == 1;
+  }
+
+  // Blocks of the components cover whole MCUs, as in a JPEG.
+  const size_t xsize_mcus = DivCeil(xsize, 8 * max_h);
+  const size_t ysize_mcus = DivCeil(ysize, 8 * max_v);
+  jpeg_data->components.resize(3);
+  for (size_t c = 0; c < 3; c++) {
+    jpeg::JPEGComponent& component = jpeg_data->components[c];
+    component.id = c + 1;
+    component.h_samp_factor = planes.h_samp_factor[c];
+    component.v_samp_factor = planes.v_samp_factor[c];
+    component.quant_idx = c == 0 ? 0 : 1;
+    component.width_in_blocks = xsize_mcus * planes.h_samp_factor[c];
+    component.height_in_blocks = ysize_mcus * planes.v_samp_factor[c];
+    component.coeffs.resize(static_cast<size_t>(component.width_in_blocks) *
+                            component.height_in_blocks * kDCTBlockSize);
+
+    const size_t plane_xsize = DivCeil(xsize * planes.h_samp_factor[c], max_h);
+    const size_t plane_ysize = DivCeil(ysize * planes.v_samp_factor[c], max_v);
+    const size_t padded_xsize = component.width_in_blocks * 8;
+    const int32_t* quant = jpeg_data->quant[component.quant_idx].values.data();
+    // The transform of the encoder is scaled so that its DC is the mean of the
+    // block; the DCT of A.3.3 of T.81 is 8 times larger.
+    float inv_quant[kDCTBlockSize];
+    for (size_t k = 0; k < kDCTBlockSize; k++) inv_quant[k] = 8.0f / quant[k];
+
+    // Per thread: the 8 rows of a row of blocks, the coefficients of a block
+    // and the scratch space of the transform.
+    const size_t items_per_thread = 8 * padded_xsize + 3 * kDCTBlockSize;
+    hwy::AlignedFreeUniquePtr<float[]> mem;
+    const auto init_func = [&](size_t num_threads) {
+      mem = hwy::AllocateAligned<float>(num_threads * items_per_thread);
+      return true;
+    };
+    const auto process_block_row = [&](int by, int thread) {
+      float* JXL_RESTRICT rows = mem.get() + thread * items_per_thread;
+      float* JXL_RESTRICT block = rows + 8 * padded_xsize;
+      float* JXL_RESTRICT scratch_space = block + kDCTBlockSize;
+      // Repeats the last row of the plane.
+      for (size_t iy = 0; iy < 8; iy++) {
+        const size_t y = std::min<size_t>(by * 8 + iy, plane_ysize - 1);
+        LoadRow(planes, c, y, plane_xsize, padded_xsize,
+                rows + iy * padded_xsize);
+      }
+      jpeg::coeff_t* JXL_RESTRICT out =
+          component.coeffs.data() +
+          static_cast<size_t>(by) * component.width_in_blocks * kDCTBlockSize;
+      for (size_t bx = 0; bx < component.width_in_blocks; bx++) {
+        TransformFromPixels(AcStrategy::Type::DCT, rows + bx * 8, padded_xsize,
+                            block, scratch_space);
+        // The coefficients of the encoder are transposed: block[u * 8 + v]
+        // holds the horizontal frequency u and the vertical frequency v.
+        for (size_t v = 0; v < 8; v++) {
+          for (size_t u = 0; u < 8; u++) {
+            out[bx * kDCTBlockSize + v * 8 + u] =
+                std::lround(block[u * 8 + v] * inv_quant[v * 8 + u]);
+          }
+        }
+      }
+    };
+    RunOnPool(pool, 0, component.height_in_blocks, init_func,
+              process_block_row, "YCbCrToJPEGData");
+  }
+  return true;
+}
+
+}  // namespace jxl
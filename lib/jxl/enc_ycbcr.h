@@ -0,0 +1,55 @@
+// Copyright (c) the JPEG XL Project
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef LIB_JXL_ENC_YCBCR_H_
+#define LIB_JXL_ENC_YCBCR_H_
+
+// Prepares planar YCbCr input, such as video frames, for encoding.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/status.h"
+#include "lib/jxl/jpeg/jpeg_data.h"
+
+namespace jxl {
+
+// Full-range YCbCr planes, in the order Y, Cb, Cr, with the sampling factors
+// of a JPEG: each plane has DivCeil(xsize * h_samp_factor, max h_samp_factor)
+// by DivCeil(ysize * v_samp_factor, max v_samp_factor) samples. Samples have
+// bits_per_sample significant bits, and are stored as uint8_t if that is 8 and
+// as native-endian uint16_t otherwise.
+struct YCbCrPlanes {
+  const void* data[3];
+  // In bytes.
+  size_t row_stride[3];
+  uint8_t h_samp_factor[3];
+  uint8_t v_samp_factor[3];
+  size_t bits_per_sample;
+};
+
+// Fills the components and quantization tables of `jpeg_data` with the
+// quantized DCT coefficients of `planes`, as a baseline JPEG of them would
+// hold, so that the image can be encoded like a recompressed JPEG: with chroma
+// subsampling and without a conversion to RGB. Samples with more than 8 bits
+// are scaled to 8 bits. The quantization tables are those of Annex K of T.81,
+// scaled linearly with `distance`; 1 matches libjpeg quality 90.
+Status YCbCrToJPEGData(const YCbCrPlanes& planes, size_t xsize, size_t ysize,
+                       float distance, ThreadPool* pool,
+                       jpeg::JPEGData* jpeg_data);
+
+}  // namespace jxl
+
+#endif  // LIB_JXL_ENC_YCBCR_H_
@@ -20,6 +20,7 @@
 #include "lib/jxl/base/span.h"
 #include "lib/jxl/codec_in_out.h"
 #include "lib/jxl/enc_file.h"
+#include "lib/jxl/enc_ycbcr.h"
 #include "lib/jxl/encode_internal.h"
 #include "lib/jxl/external_image.h"
 #include "lib/jxl/icc_codec.h"
@@ -72,6 +73,41 @@ JxlEncoderStatus BufferToImageBundle(const JxlPixelFormat& pixel_format,
   return JXL_ENC_SUCCESS;
 }
 
+JxlEncoderStatus YCbCrImageToImageBundle(const JxlYCbCrImage& image,
+                                         uint32_t xsize, uint32_t ysize,
+                                         float distance, jxl::ThreadPool* pool,
+                                         const jxl::ColorEncoding& c_current,
+                                         jxl::ImageBundle* ib) {
+  YCbCrPlanes planes;
+  for (size_t c = 0; c < 3; c++) {
+    if (image.h_samp_factor[c] > 2 || image.v_samp_factor[c] > 2) {
+      return JXL_ENC_ERROR;
+    }
+    planes.data[c] = image.data[c];
+    planes.row_stride[c] = image.row_stride[c];
+    planes.h_samp_factor[c] = image.h_samp_factor[c];
+    planes.v_samp_factor[c] = image.v_samp_factor[c];
+  }
+  planes.bits_per_sample = image.bits_per_sample;
+  YCbCrChromaSubsampling cs;
+  if (!cs.Set(planes.h_samp_factor, planes.v_samp_factor)) {
+    return JXL_ENC_ERROR;
+  }
+
+  ib->jpeg_data = make_unique<jpeg::JPEGData>();
+  if (!YCbCrToJPEGData(planes, xsize, ysize, distance, pool,
+                       ib->jpeg_data.get())) {
+    return JXL_ENC_ERROR;
+  }
+  ib->chroma_subsampling = cs;
+  ib->color_transform = ColorTransform::kYCbCr;
+  // Only the coefficients are encoded, the pixels are not needed.
+  ib->OverrideProfile(c_current);
+  ib->VerifyMetadata();
+
+  return JXL_ENC_SUCCESS;
+}
+
 Status ConvertExternalToInternalColorEncoding(const JxlColorEncoding& external,
                                               ColorEncoding* internal) {
   internal->SetColorSpace(static_cast<ColorSpace>(external.color_space));
@@ -358,6 +394,40 @@ JxlEncoderStatus JxlEncoderAddImageFrame(const JxlEncoderOptions* options,
   return JXL_ENC_SUCCESS;
 }
 
+JxlEncoderStatus JxlEncoderAddYCbCrFrame(const JxlEncoderOptions* options,
+                                         const JxlYCbCrImage* image) {
+  const jxl::ImageMetadata& metadata = options->enc->metadata.m;
+  if (metadata.xyb_encoded) {
+    return JXL_API_ERROR("YCbCr frames need the original color profile");
+  }
+  if (metadata.color_encoding.IsGray() || metadata.HasAlpha()) {
+    return JXL_API_ERROR("YCbCr frames must be color without alpha");
+  }
+  if (options->values.lossless) {
+    return JXL_API_ERROR("YCbCr frames cannot be lossless");
+  }
+  auto queued_frame = jxl::MemoryManagerMakeUnique<jxl::JxlEncoderQueuedFrame>(
+      &options->enc->memory_manager,
+      jxl::JxlEncoderQueuedFrame{options->values,
+                                 jxl::ImageBundle(&options->enc->metadata.m)});
+  if (!queued_frame) {
+    return JXL_ENC_ERROR;
+  }
+
+  if (JXL_ENC_SUCCESS !=
+      jxl::YCbCrImageToImageBundle(
+          *image, options->enc->metadata.xsize(),
+          options->enc->metadata.ysize(),
+          options->values.cparams.butteraugli_distance,
+          options->enc->thread_pool.get(), metadata.color_encoding,
+          &(queued_frame->frame))) {
+    return JXL_ENC_ERROR;
+  }
+
+  options->enc->input_frame_queue.emplace_back(std::move(queued_frame));
+  return JXL_ENC_SUCCESS;
+}
+
 void JxlEncoderCloseInput(JxlEncoder* enc) {
   // TODO(zond): Make this function mark the most recent frame as the last.
 }
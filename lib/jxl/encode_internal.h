@@ -50,6 +50,14 @@ JxlEncoderStatus BufferToImageBundle(const JxlPixelFormat& pixel_format,
                                      const jxl::ColorEncoding& c_current,
                                      jxl::ImageBundle* ib);
 
+// Sets `ib` to be encoded from the quantized DCT coefficients of the planes of
+// `image`, like a recompressed JPEG, with the chroma subsampling of `image`.
+JxlEncoderStatus YCbCrImageToImageBundle(const JxlYCbCrImage& image,
+                                         uint32_t xsize, uint32_t ysize,
+                                         float distance, jxl::ThreadPool* pool,
+                                         const jxl::ColorEncoding& c_current,
+                                         jxl::ImageBundle* ib);
+
 }  // namespace jxl
 
 struct JxlEncoderStruct {
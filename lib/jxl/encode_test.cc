@@ -14,6 +14,9 @@
 
 #include "jxl/encode.h"
 
+#include <cmath>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "lib/jxl/dec_file.h"
 #include "lib/jxl/enc_butteraugli_comparator.h"
@@ -172,3 +175,129 @@ TEST(EncodeTest, OptionsTest) {
   EXPECT_EQ(JXL_ENC_ERROR, JxlEncoderOptionsSetDistance(options, -1));
   JxlEncoderDestroy(enc);
 }
+
+// Encodes planar YCbCr with the given sampling factors, and checks that the
+// decoded planes, output without chroma upsampling, are close to the input.
+void VerifyYCbCrFrameEncoding(const uint32_t h_samp_factor[3],
+                              const uint32_t v_samp_factor[3],
+                              uint32_t bits_per_sample) {
+  const size_t xsize = 123;
+  const size_t ysize = 77;
+  const uint32_t max_value = (1u << bits_per_sample) - 1;
+  JxlYCbCrImage image;
+  image.bits_per_sample = bits_per_sample;
+  std::vector<uint16_t> planes[3];
+  size_t plane_xsize[3];
+  size_t plane_ysize[3];
+  for (size_t c = 0; c < 3; c++) {
+    image.h_samp_factor[c] = h_samp_factor[c];
+    image.v_samp_factor[c] = v_samp_factor[c];
+    // Luma has the largest sampling factors.
+    plane_xsize[c] = jxl::DivCeil(xsize * h_samp_factor[c], h_samp_factor[0]);
+    plane_ysize[c] = jxl::DivCeil(ysize * v_samp_factor[c], v_samp_factor[0]);
+    // Smooth gradients, different for each plane.
+    planes[c].resize(plane_xsize[c] * plane_ysize[c]);
+    for (size_t y = 0; y < plane_ysize[c]; y++) {
+      for (size_t x = 0; x < plane_xsize[c]; x++) {
+        const double v = 0.5 + 0.3 * std::sin(0.05 * (c + 1) * x + 0.07 * y);
+        planes[c][y * plane_xsize[c] + x] = std::lround(v * max_value);
+      }
+    }
+  }
+  std::vector<uint8_t> planes8[3];
+  for (size_t c = 0; c < 3; c++) {
+    if (bits_per_sample == 8) {
+      planes8[c].assign(planes[c].begin(), planes[c].end());
+      image.data[c] = planes8[c].data();
+      image.row_stride[c] = plane_xsize[c];
+    } else {
+      image.data[c] = planes[c].data();
+      image.row_stride[c] = plane_xsize[c] * sizeof(uint16_t);
+    }
+  }
+
+  JxlEncoder* enc = JxlEncoderCreate(nullptr);
+  JxlEncoderOptions* options = JxlEncoderOptionsCreate(enc, nullptr);
+  JxlBasicInfo basic_info = {};
+  basic_info.xsize = xsize;
+  basic_info.ysize = ysize;
+  basic_info.bits_per_sample = 8;
+  basic_info.uses_original_profile = true;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc, &basic_info));
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderAddYCbCrFrame(options, &image));
+  JxlEncoderCloseInput(enc);
+
+  std::vector<uint8_t> compressed = std::vector<uint8_t>(64);
+  uint8_t* next_out = compressed.data();
+  size_t avail_out = compressed.size();
+  JxlEncoderStatus process_result = JXL_ENC_NEED_MORE_OUTPUT;
+  while (process_result == JXL_ENC_NEED_MORE_OUTPUT) {
+    process_result = JxlEncoderProcessOutput(enc, &next_out, &avail_out);
+    if (process_result == JXL_ENC_NEED_MORE_OUTPUT) {
+      size_t offset = next_out - compressed.data();
+      compressed.resize(compressed.size() * 2);
+      next_out = compressed.data() + offset;
+      avail_out = compressed.size() - offset;
+    }
+  }
+  compressed.resize(next_out - compressed.data());
+  EXPECT_EQ(JXL_ENC_SUCCESS, process_result);
+  JxlEncoderDestroy(enc);
+
+  JxlDecoder* dec = JxlDecoderCreate(nullptr);
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSubscribeEvents(dec, JXL_DEC_FULL_IMAGE));
+  EXPECT_EQ(JXL_DEC_SUCCESS,
+            JxlDecoderSetInput(dec, compressed.data(), compressed.size()));
+  EXPECT_EQ(JXL_DEC_NEED_IMAGE_OUT_BUFFER, JxlDecoderProcessInput(dec));
+  JxlYCbCrInfo info;
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderGetYCbCrInfo(dec, &info));
+  std::vector<uint8_t> decoded[3];
+  JxlImageOutLayout layout;
+  for (size_t c = 0; c < 3; c++) {
+    EXPECT_EQ(plane_xsize[c], info.xsize[c]);
+    EXPECT_EQ(plane_ysize[c], info.ysize[c]);
+    decoded[c].resize(plane_xsize[c] * plane_ysize[c]);
+    layout.data[c] = decoded[c].data();
+    layout.pixel_stride[c] = 1;
+    layout.row_stride[c] = plane_xsize[c];
+  }
+  EXPECT_EQ(JXL_DEC_SUCCESS, JxlDecoderSetYCbCrOutLayout(dec, &layout));
+  EXPECT_EQ(JXL_DEC_FULL_IMAGE, JxlDecoderProcessInput(dec));
+  JxlDecoderDestroy(dec);
+
+  for (size_t c = 0; c < 3; c++) {
+    double error = 0;
+    for (size_t i = 0; i < decoded[c].size(); i++) {
+      error += std::abs(planes[c][i] * 255.0 / max_value - decoded[c][i]);
+    }
+    EXPECT_LT(error / decoded[c].size(), 1.5) << "plane " << c;
+  }
+}
+
+TEST(EncodeTest, YCbCrFrameEncodingTest) {
+  const uint32_t factors_420[3] = {2, 1, 1};
+  const uint32_t factors_1[3] = {1, 1, 1};
+  VerifyYCbCrFrameEncoding(factors_420, factors_420, 8);
+  VerifyYCbCrFrameEncoding(factors_420, factors_420, 10);
+  // 4:2:2
+  VerifyYCbCrFrameEncoding(factors_420, factors_1, 8);
+  VerifyYCbCrFrameEncoding(factors_1, factors_1, 8);
+
+  // The image must keep its original profile.
+  JxlEncoder* enc = JxlEncoderCreate(nullptr);
+  JxlEncoderOptions* options = JxlEncoderOptionsCreate(enc, nullptr);
+  JxlBasicInfo basic_info = {};
+  basic_info.xsize = 16;
+  basic_info.ysize = 16;
+  basic_info.bits_per_sample = 8;
+  EXPECT_EQ(JXL_ENC_SUCCESS, JxlEncoderSetBasicInfo(enc, &basic_info));
+  std::vector<uint8_t> plane(16 * 16, 128);
+  JxlYCbCrImage image = {{1, 1, 1},
+                         {1, 1, 1},
+                         8,
+                         {plane.data(), plane.data(), plane.data()},
+                         {16, 16, 16}};
+  EXPECT_EQ(JXL_ENC_ERROR, JxlEncoderAddYCbCrFrame(options, &image));
+  JxlEncoderDestroy(enc);
+}
@@ -39,6 +39,7 @@
 #include "lib/jxl/common.h"
 #include "lib/jxl/convolve.h"
 #include "lib/jxl/dec_cache.h"
+#include "lib/jxl/dec_xyb.h"
 #include "lib/jxl/filters.h"
 #include "lib/jxl/filters_internal.h"
 #include "lib/jxl/image.h"
@@ -621,24 +622,54 @@ Status ApplyLoopFiltersRow(PassesDecoderState* dec_state, const Rect& rect,
   if (!lf.gab && lf.epf_iters == 0) {
     if (y < 0 || y >= static_cast<ssize_t>(rect.ysize())) return false;
     *output_row = y;
+    const FrameHeader& frame_header = dec_state->shared->frame_header;
+    const FrameDimensions& frame_dim = dec_state->shared->frame_dim;
     for (size_t c = 0; c < 3; c++) {
-      memcpy(rect.PlaneRow(out, c, y),
-             rect.ConstPlaneRow(dec_state->decoded, c, y) +
-                 dec_state->decoded_padding,
-             rect.xsize() * sizeof(float));
+      float* JXL_RESTRICT row_out =
+          dec_state->rgb_output_only ? out->PlaneRow(c, 0) + kMaxFilterPadding
+                                     : rect.PlaneRow(out, c, y);
+      // Without filters, subsampled chroma is upsampled here, one row at a
+      // time, instead of in a separate pass over the whole plane.
+      const size_t hshift = frame_header.chroma_subsampling.HShift(c);
+      const size_t vshift = frame_header.chroma_subsampling.VShift(c);
+      if (hshift != 0 || vshift != 0) {
+        UpsampleRow(dec_state->decoded.Plane(c), dec_state->decoded_padding,
+                    frame_dim.xsize_padded >> hshift,
+                    frame_dim.ysize_padded >> vshift, hshift, vshift,
+                    rect.x0(), rect.y0() + y, rect.xsize(), row_out);
+        continue;
+      }
+      const float* JXL_RESTRICT row_in =
+          dec_state->decoded.ConstPlaneRow(
+              c, rect.y0() + y - dec_state->decoded_y0) +
+          rect.x0() + dec_state->decoded_padding;
+      memcpy(row_out, row_in, rect.xsize() * sizeof(float));
     }
     return *output_row < dec_state->shared->frame_dim.ysize;
   }
-  // decoded.ysize() is used for mirroring of the input image last rows. This
-  // checks that the passed image is not padded beyond that.
+  // decoded.ysize() is used for mirroring of the input image last rows, unless
+  // the frame is banded. This checks that the passed image is not padded
+  // beyond that.
   JXL_DASSERT(dec_state->decoded.ysize() <=
               dec_state->shared->frame_dim.ysize_padded);
-  JXL_DASSERT(rect.IsInside(dec_state->decoded));
+  JXL_DASSERT(rect.x0() + rect.xsize() <= dec_state->decoded.xsize() &&
+              rect.y0() + rect.ysize() <=
+                  dec_state->decoded_y0 + dec_state->decoded.ysize());
 
   // Lazy initialization of the FilterPipeline.
   FilterPipeline* fp = &(dec_state->filter_pipelines[thread]);
   if (fp->num_filters == 0) {
     HWY_DYNAMIC_DISPATCH(FilterPipelineInit)(fp, lf, dec_state->decoded, out);
+    if (dec_state->rgb_output_only) {
+      // Every output row goes to the single row of `out`.
+      fp->filters[fp->num_filters - 1].SetOutputCyclicStorage<1>(out, 0);
+    }
+    if (dec_state->banded) {
+      // The rows are mirrored at the borders of the frame, not of the band.
+      fp->filters[0].SetInputBand<kMaxFilterPadding>(
+          &dec_state->decoded, dec_state->shared->frame_dim.ysize_padded,
+          &dec_state->decoded_y0);
+    }
   }
 
   bool ret =
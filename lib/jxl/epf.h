@@ -66,6 +66,8 @@ void EdgePreservingFilter(const LoopFilter& lf,
 // The first row in `rect` corresponds to a value of `y` of 0.
 // This function should be called for `rect.ysize() + 2 * lf.PaddingRows()`
 // values of `y`, in increasing order, starting from `y = -lf.PaddingRows()`.
+// If dec_state->rgb_output_only is set, `out` is a single row instead of the
+// frame, and the output row is written to it starting at x = kMaxFilterPadding.
 Status ApplyLoopFiltersRow(PassesDecoderState* dec_state, const Rect& rect,
                            ssize_t y, size_t thread, Image3F* JXL_RESTRICT out,
                            size_t* JXL_RESTRICT output_row);
@@ -39,12 +39,96 @@ HWY_BEFORE_NAMESPACE();
 namespace jxl {
 namespace HWY_NAMESPACE {
 
+// These templates are not found via ADL.
+using hwy::HWY_NAMESPACE::Rebind;
+using hwy::HWY_NAMESPACE::ShiftLeft;
+using hwy::HWY_NAMESPACE::ShiftRight;
+
 // Input/output uses the codec.h scaling: nominally 0-1 if in-gamut.
 template <class V>
 V LinearToSRGB(V encoded) {
   return TF_SRGB().EncodedFromDisplay(encoded);
 }
 
+// Converts one channel of a row for ConvertImage to the values that
+// StorePreparedRow writes: integers in [0, mul] with the same rounding as
+// StoreFloatRow, or the bits of the floats if `float_out`. For big endian
+// output, the bytes of each value are already swapped. A null `row_in` stands
+// for opaque alpha. `row_out` must have room for xsize rounded up to a whole
+// number of vectors.
+void PrepareRowForStore(const float* JXL_RESTRICT row_in, size_t xsize,
+                        bool float_out, bool apply_srgb_tf, float mul,
+                        size_t bytes_per_channel, bool big_endian,
+                        uint32_t* JXL_RESTRICT row_out) {
+  const HWY_FULL(float) d;
+  const HWY_FULL(int32_t) di;
+  const HWY_FULL(uint32_t) du;
+  const auto zero = Zero(d);
+  const auto one = Set(d, 1.0f);
+  const auto vmul = Set(d, mul);
+  const auto half = Set(d, 0.5f);
+  const auto mask_ff = Set(du, 0xFFu);
+  const auto mask_ff00 = Set(du, 0xFF00u);
+  for (size_t x = 0; x < xsize; x += Lanes(d)) {
+    auto v = row_in ? Load(d, row_in + x) : one;
+    if (apply_srgb_tf) v = LinearToSRGB(v);
+    auto bits = BitCast(du, v);
+    if (!float_out) {
+      // Products are at most 65535, so adding 0.5 in float is exact.
+      const auto scaled = Min(Max(v, zero), one) * vmul + half;
+      bits = BitCast(du, ConvertTo(di, scaled));
+    }
+    if (big_endian && bytes_per_channel == 2) {
+      bits = Or(ShiftLeft<8>(And(bits, mask_ff)), ShiftRight<8>(bits));
+    } else if (big_endian && bytes_per_channel == 4) {
+      bits = Or(Or(ShiftLeft<24>(bits), ShiftRight<24>(bits)),
+                Or(ShiftLeft<8>(And(bits, mask_ff00)),
+                   And(ShiftRight<8>(bits), mask_ff00)));
+    }
+    Store(bits, du, row_out + x);
+  }
+}
+
+// Converts the channels of a row for ConvertImage to 8-bit integers, like
+// PrepareRowForStore, and stores them interleaved to `out`, which has
+// num_channels (3 or 4) bytes per pixel. A null alpha row stands for opaque
+// alpha. The sRGB transfer function is only applied to the color channels.
+void StoreInterleavedRowU8(const float* const* JXL_RESTRICT rows_in,
+                           size_t num_channels, size_t xsize,
+                           bool apply_srgb_tf, uint8_t* JXL_RESTRICT out) {
+  const HWY_FULL(float) d;
+  const HWY_FULL(int32_t) di;
+  const HWY_FULL(uint32_t) du;
+  const Rebind<uint8_t, HWY_FULL(float)> d8;
+  const size_t N = Lanes(d);
+  const auto zero = Zero(d);
+  const auto one = Set(d, 1.0f);
+  const auto mul = Set(d, 255.0f);
+  const auto half = Set(d, 0.5f);
+  // The last, partial vector of the row is interleaved here first, since
+  // StoreInterleaved writes whole vectors.
+  HWY_ALIGN uint8_t tail[4 * MaxLanes(d)];
+  for (size_t x = 0; x < xsize; x += N) {
+    decltype(U8FromU32(Zero(du))) v8[4];
+    for (size_t c = 0; c < num_channels; ++c) {
+      auto v = rows_in[c] ? Load(d, rows_in[c] + x) : one;
+      if (apply_srgb_tf && c < 3) v = LinearToSRGB(v);
+      const auto scaled = Min(Max(v, zero), one) * mul + half;
+      v8[c] = U8FromU32(BitCast(du, ConvertTo(di, scaled)));
+    }
+    const bool whole = x + N <= xsize;
+    uint8_t* JXL_RESTRICT pos = whole ? out + x * num_channels : tail;
+    if (num_channels == 3) {
+      StoreInterleaved3(v8[0], v8[1], v8[2], d8, pos);
+    } else {
+      StoreInterleaved4(v8[0], v8[1], v8[2], v8[3], d8, pos);
+    }
+    if (!whole) {
+      memcpy(out + x * num_channels, tail, (xsize - x) * num_channels);
+    }
+  }
+}
+
 void LinearToSRGBInPlace(jxl::ThreadPool* pool, Image3F* image,
                          size_t color_channels) {
   size_t xsize = image->xsize();
@@ -75,20 +159,6 @@ HWY_AFTER_NAMESPACE();
 namespace jxl {
 namespace {
 
-// Stores a float in big endian
-void StoreBEFloat(float value, uint8_t* p) {
-  uint32_t u;
-  memcpy(&u, &value, 4);
-  StoreBE32(u, p);
-}
-
-// Stores a float in little endian
-void StoreLEFloat(float value, uint8_t* p) {
-  uint32_t u;
-  memcpy(&u, &value, 4);
-  StoreLE32(u, p);
-}
-
 // Loads a float in big endian
 float LoadBEFloat(const uint8_t* p) {
   float value;
@@ -205,6 +275,8 @@ void UndoOrientation(jxl::Orientation undo_orientation, const Plane<T>& image,
 }  // namespace
 
 HWY_EXPORT(LinearToSRGBInPlace);
+HWY_EXPORT(PrepareRowForStore);
+HWY_EXPORT(StoreInterleavedRowU8);
 
 namespace {
 
@@ -224,6 +296,55 @@ void JXL_INLINE StoreFloatRow(const float* JXL_RESTRICT row_in, uint8_t* out,
 
 void JXL_INLINE Store8(uint32_t value, uint8_t* dest) { *dest = value & 0xff; }
 
+// Stores one channel of a row as integers of bits_per_sample bits.
+void StoreUintRow(const float* JXL_RESTRICT row_in, uint8_t* out, float mul,
+                  size_t xsize, size_t bytes_per_pixel, size_t bits_per_sample,
+                  bool little_endian) {
+  // TODO(deymo): add bits_per_sample == 1 case here.
+  if (bits_per_sample <= 8) {
+    StoreFloatRow<Store8>(row_in, out, mul, xsize, bytes_per_pixel);
+  } else if (bits_per_sample <= 16) {
+    if (little_endian) {
+      StoreFloatRow<StoreLE16>(row_in, out, mul, xsize, bytes_per_pixel);
+    } else {
+      StoreFloatRow<StoreBE16>(row_in, out, mul, xsize, bytes_per_pixel);
+    }
+  } else if (bits_per_sample <= 24) {
+    if (little_endian) {
+      StoreFloatRow<StoreLE24>(row_in, out, mul, xsize, bytes_per_pixel);
+    } else {
+      StoreFloatRow<StoreBE24>(row_in, out, mul, xsize, bytes_per_pixel);
+    }
+  } else {
+    if (little_endian) {
+      StoreFloatRow<StoreLE32>(row_in, out, mul, xsize, bytes_per_pixel);
+    } else {
+      StoreFloatRow<StoreBE32>(row_in, out, mul, xsize, bytes_per_pixel);
+    }
+  }
+}
+
+// Stores one channel of a row converted by PrepareRowForStore, whose values
+// are already in the output byte order when stored as little endian.
+void StorePreparedRow(const uint32_t* JXL_RESTRICT row, uint8_t* out,
+                      size_t xsize, size_t pixel_stride,
+                      size_t bytes_per_channel) {
+  if (bytes_per_channel == 1) {
+    for (size_t x = 0; x < xsize; ++x) {
+      out[x * pixel_stride] = row[x];
+    }
+  } else if (bytes_per_channel == 2) {
+    for (size_t x = 0; x < xsize; ++x) {
+      StoreLE16(row[x], out + x * pixel_stride);
+    }
+  } else {
+    JXL_DASSERT(bytes_per_channel == 4);
+    for (size_t x = 0; x < xsize; ++x) {
+      StoreLE32(row[x], out + x * pixel_stride);
+    }
+  }
+}
+
 }  // namespace
 
 void LinearToSRGBInPlace(jxl::ThreadPool* pool, Image3F* image,
@@ -231,11 +352,17 @@ void LinearToSRGBInPlace(jxl::ThreadPool* pool, Image3F* image,
   return HWY_DYNAMIC_DISPATCH(LinearToSRGBInPlace)(pool, image, color_channels);
 }
 
-Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
-                    bool float_out, bool apply_srgb_tf, size_t num_channels,
-                    JxlEndianness endianness, size_t stride,
-                    jxl::ThreadPool* pool, void* out_image, size_t out_size,
-                    jxl::Orientation undo_orientation) {
+namespace {
+
+// Implements the ConvertImage variants: the pixels are either passed to
+// out_callback, if it is not null, or written to channels_out.
+Status ConvertImageInternal(const jxl::ImageBundle& ib, size_t bits_per_sample,
+                            bool float_out, bool apply_srgb_tf,
+                            size_t num_channels, JxlEndianness endianness,
+                            const ChannelOut* channels_out,
+                            JxlImageOutCallback out_callback, void* out_opaque,
+                            jxl::ThreadPool* pool,
+                            jxl::Orientation undo_orientation) {
   if (bits_per_sample < 1 || bits_per_sample > 32) {
     return JXL_FAILURE("Invalid bits_per_sample value.");
   }
@@ -243,11 +370,12 @@ Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
   if (bits_per_sample == 1) {
     return JXL_FAILURE("packed 1-bit per sample is not yet supported");
   }
+  if (float_out && bits_per_sample != 32) {
+    return JXL_FAILURE("non-32-bit float not supported");
+  }
   size_t xsize = ib.xsize();
   size_t ysize = ib.ysize();
 
-  uint8_t* out = reinterpret_cast<uint8_t*>(out_image);
-
   bool want_alpha = num_channels == 2 || num_channels == 4;
   size_t color_channels = num_channels <= 2 ? 1 : 3;
 
@@ -256,17 +384,20 @@ Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
   const size_t bytes_per_channel = DivCeil(bits_per_sample, jxl::kBitsPerByte);
   const size_t bytes_per_pixel = num_channels * bytes_per_channel;
 
-  if (stride < bytes_per_pixel * xsize) {
-    return JXL_FAILURE(
-        "stride is smaller than scanline width in bytes: %zu vs %zu", stride,
-        bytes_per_pixel * xsize);
-  }
+  // Float and up to 16-bit output is converted with SIMD into a per-thread
+  // row before it is stored. Larger integers need more precision than the
+  // float rounding there provides.
+  const bool simd_rows = float_out || bits_per_sample <= 16;
+  // The sRGB transfer function is then applied during that conversion,
+  // unless the orientation has to be undone on the transformed pixels.
+  const bool fuse_srgb_tf =
+      apply_srgb_tf && simd_rows && undo_orientation == Orientation::kIdentity;
 
   const Image3F* color = &ib.color();
   Image3F temp_color;
   const ImageF* alpha = ib.HasAlpha() ? &ib.alpha() : nullptr;
   ImageF temp_alpha;
-  if (apply_srgb_tf) {
+  if (apply_srgb_tf && !fuse_srgb_tf) {
     temp_color = CopyImage(*color);
     LinearToSRGBInPlace(pool, &temp_color, color_channels);
     color = &temp_color;
@@ -293,148 +424,168 @@ Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
       endianness == JXL_LITTLE_ENDIAN ||
       (endianness == JXL_NATIVE_ENDIAN && IsLittleEndian());
 
-  if (float_out) {
-    if (bits_per_sample != 32) {
-      return JXL_FAILURE("non-32-bit float not supported");
-    }
-    for (size_t c = 0; c < color_channels; ++c) {
-      RunOnPool(
-          pool, 0, static_cast<uint32_t>(ysize), ThreadPool::SkipInit(),
-          [&](const int task, int /*thread*/) {
-            const int64_t y = task;
-            size_t i = stride * y + (c * bits_per_sample / jxl::kBitsPerByte);
-            const float* JXL_RESTRICT row_in = color->PlaneRow(c, y);
-            if (little_endian) {
-              for (size_t x = 0; x < xsize; ++x) {
-                StoreLEFloat(row_in[x], out + i);
-                i += bytes_per_pixel;
-              }
-            } else {
-              for (size_t x = 0; x < xsize; ++x) {
-                StoreBEFloat(row_in[x], out + i);
-                i += bytes_per_pixel;
-              }
-            }
-          },
-          "ConvertRGBFloat");
-    }
-  } else {
-    // Multiplier to convert from floating point 0-1 range to the integer
-    // range.
-    float mul = (1ull << bits_per_sample) - 1;
-    // TODO(deymo): Move the for(c) inside the StoreFloatRow() function so it is
-    // more write-cache friendly.
-    for (size_t c = 0; c < color_channels; ++c) {
-      RunOnPool(
-          pool, 0, static_cast<uint32_t>(ysize), ThreadPool::SkipInit(),
-          [&](const int task, int /*thread*/) {
-            const int64_t y = task;
-            size_t i = stride * y + (c * bits_per_sample / jxl::kBitsPerByte);
-            const float* JXL_RESTRICT row_in = color->PlaneRow(c, y);
-            // TODO(deymo): add bits_per_sample == 1 case here.
-            if (bits_per_sample <= 8) {
-              StoreFloatRow<Store8>(row_in, out + i, mul, xsize,
-                                    bytes_per_pixel);
-            } else if (bits_per_sample <= 16) {
-              if (little_endian) {
-                StoreFloatRow<StoreLE16>(row_in, out + i, mul, xsize,
-                                         bytes_per_pixel);
-              } else {
-                StoreFloatRow<StoreBE16>(row_in, out + i, mul, xsize,
-                                         bytes_per_pixel);
-              }
-            } else if (bits_per_sample <= 24) {
-              if (little_endian) {
-                StoreFloatRow<StoreLE24>(row_in, out + i, mul, xsize,
-                                         bytes_per_pixel);
-              } else {
-                StoreFloatRow<StoreBE24>(row_in, out + i, mul, xsize,
-                                         bytes_per_pixel);
-              }
-            } else {
-              if (little_endian) {
-                StoreFloatRow<StoreLE32>(row_in, out + i, mul, xsize,
-                                         bytes_per_pixel);
-              } else {
-                StoreFloatRow<StoreBE32>(row_in, out + i, mul, xsize,
-                                         bytes_per_pixel);
-              }
-            }
-          },
-          "ConvertRGBUint");
-    }
-  }
-
+  jxl::ImageF alpha_temp;
   if (want_alpha) {
-    jxl::ImageF alpha_temp;
     if (ib.HasAlpha()) {
       if (ib.metadata()->GetAlphaBits() == 0) {
         return JXL_FAILURE("invalid alpha bit depth");
       }
-    } else {
-      // TODO(sboukortt): have a different path altogether below instead of
-      // filling an image with ones just to read from it immediately afterwards.
+    } else if (!simd_rows) {
+      // PrepareRowForStore treats a null alpha row as opaque, but the scalar
+      // path needs an image of ones.
       alpha_temp = jxl::ImageF(xsize, ysize);
       FillImage(1.f, &alpha_temp);
       alpha = &alpha_temp;
     }
+    if (!float_out && bits_per_sample != 8 && bits_per_sample != 16) {
+      return JXL_FAILURE("32-bit and 1-bit not yet implemented");
+    }
+  }
 
-    if (float_out) {
-      if (bits_per_sample != 32) {
-        return JXL_FAILURE("non-32-bit float not supported");
+  // Multiplier to convert from floating point 0-1 range to the integer
+  // range.
+  const float mul = (1ull << bits_per_sample) - 1;
+
+  // 8-bit RGB and RGBA, with the channels of each pixel next to each other,
+  // are converted and interleaved in a single pass.
+  bool interleaved_u8 = simd_rows && !float_out && bits_per_sample == 8 &&
+                        color_channels == 3;
+  for (size_t c = 0; c < num_channels && interleaved_u8 && !out_callback;
+       ++c) {
+    interleaved_u8 = channels_out[c].data == channels_out[0].data + c &&
+                     channels_out[c].pixel_stride == num_channels &&
+                     channels_out[c].row_stride == channels_out[0].row_stride;
+  }
+
+  // When outputting to a callback, each thread converts its rows into its own
+  // scanline buffer before passing them on. With simd_rows, each thread also
+  // has a row for the converted values of one channel.
+  std::vector<CacheAlignedUniquePtr> callback_rows;
+  std::vector<CacheAlignedUniquePtr> prepared_rows;
+  const auto init_callback_rows = [&](size_t num_threads) {
+    callback_rows.clear();
+    prepared_rows.clear();
+    for (size_t i = 0; i < num_threads; ++i) {
+      if (out_callback) {
+        callback_rows.emplace_back(AllocateArray(bytes_per_pixel * xsize));
       }
-      RunOnPool(
-          pool, 0, static_cast<uint32_t>(ysize), ThreadPool::SkipInit(),
-          [&](const int task, int /*thread*/) {
-            const int64_t y = task;
-            size_t i = stride * y +
-                       (color_channels * bits_per_sample / jxl::kBitsPerByte);
-            const float* JXL_RESTRICT row_in = alpha->Row(y);
-            if (little_endian) {
-              for (size_t x = 0; x < xsize; ++x) {
-                StoreLEFloat(row_in[x], out + i);
-                i += bytes_per_pixel;
-              }
-            } else {
-              for (size_t x = 0; x < xsize; ++x) {
-                StoreBEFloat(row_in[x], out + i);
-                i += bytes_per_pixel;
-              }
-            }
-          },
-          "ConvertAlphaFloat");
-    } else {
-      if (bits_per_sample != 8 && bits_per_sample != 16) {
-        return JXL_FAILURE("32-bit and 1-bit not yet implemented");
+      if (simd_rows && !interleaved_u8) {
+        prepared_rows.emplace_back(AllocateArray(
+            sizeof(uint32_t) * (xsize + hwy::kMaxVectorSize / sizeof(float))));
       }
-
-      RunOnPool(
-          pool, 0, static_cast<uint32_t>(ysize), ThreadPool::SkipInit(),
-          [&](const int task, int /*thread*/) {
-            const int64_t y = task;
-            size_t i = stride * y +
-                       (color_channels * bits_per_sample / jxl::kBitsPerByte);
-            const float* JXL_RESTRICT row_in = alpha->Row(y);
-            if (bits_per_sample == 8) {
-              StoreFloatRow<Store8>(row_in, out + i, 255.f, xsize,
-                                    bytes_per_pixel);
-            } else if (bits_per_sample == 16) {
-              if (little_endian) {
-                StoreFloatRow<StoreLE16>(row_in, out + i, 65535.f, xsize,
-                                         bytes_per_pixel);
-              } else {
-                StoreFloatRow<StoreBE16>(row_in, out + i, 65535.f, xsize,
-                                         bytes_per_pixel);
-              }
-            }
-          },
-          "ConvertAlphaUint");
     }
-  }
+    return true;
+  };
+
+  // All channels of a row are written together, which is more write-cache
+  // friendly than converting one channel at a time over the whole image.
+  RunOnPool(
+      pool, 0, static_cast<uint32_t>(ysize), init_callback_rows,
+      [&](const int task, int thread) {
+        const int64_t y = task;
+        if (interleaved_u8) {
+          const float* JXL_RESTRICT rows_in[4] = {
+              color->PlaneRow(0, y), color->PlaneRow(1, y),
+              color->PlaneRow(2, y), alpha ? alpha->Row(y) : nullptr};
+          uint8_t* JXL_RESTRICT row_out =
+              out_callback
+                  ? callback_rows[thread].get()
+                  : channels_out[0].data + channels_out[0].row_stride * y;
+          HWY_DYNAMIC_DISPATCH(StoreInterleavedRowU8)
+          (rows_in, num_channels, xsize, fuse_srgb_tf, row_out);
+          if (out_callback) {
+            out_callback(out_opaque, 0, y, xsize, row_out);
+          }
+          return;
+        }
+        for (size_t c = 0; c < num_channels; ++c) {
+          const bool is_alpha = c >= color_channels;
+          const float* JXL_RESTRICT row_in =
+              !is_alpha ? color->PlaneRow(c, y)
+                        : (alpha ? alpha->Row(y) : nullptr);
+          uint8_t* JXL_RESTRICT row_c;
+          size_t pixel_stride;
+          if (out_callback) {
+            row_c = callback_rows[thread].get() + c * bytes_per_channel;
+            pixel_stride = bytes_per_pixel;
+          } else {
+            row_c = channels_out[c].data + channels_out[c].row_stride * y;
+            pixel_stride = channels_out[c].pixel_stride;
+          }
+          if (simd_rows) {
+            uint32_t* JXL_RESTRICT prepared =
+                reinterpret_cast<uint32_t*>(prepared_rows[thread].get());
+            HWY_DYNAMIC_DISPATCH(PrepareRowForStore)
+            (row_in, xsize, float_out, fuse_srgb_tf && !is_alpha, mul,
+             bytes_per_channel, !little_endian, prepared);
+            StorePreparedRow(prepared, row_c, xsize, pixel_stride,
+                             bytes_per_channel);
+          } else {
+            StoreUintRow(row_in, row_c, mul, xsize, pixel_stride,
+                         bits_per_sample, little_endian);
+          }
+        }
+        if (out_callback) {
+          out_callback(out_opaque, 0, y, xsize, callback_rows[thread].get());
+        }
+      },
+      "ConvertImage");
 
   return true;
 }
 
+}  // namespace
+
+Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
+                    bool float_out, bool apply_srgb_tf, size_t num_channels,
+                    JxlEndianness endianness, size_t stride,
+                    jxl::ThreadPool* pool, void* out_image, size_t out_size,
+                    jxl::Orientation undo_orientation) {
+  return ConvertImage(ib, bits_per_sample, float_out, apply_srgb_tf,
+                      num_channels, endianness, stride, pool, out_image,
+                      out_size, /*out_callback=*/nullptr,
+                      /*out_opaque=*/nullptr, undo_orientation);
+}
+
+Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
+                    bool float_out, bool apply_srgb_tf, size_t num_channels,
+                    JxlEndianness endianness, size_t stride,
+                    jxl::ThreadPool* pool, void* out_image, size_t out_size,
+                    JxlImageOutCallback out_callback, void* out_opaque,
+                    jxl::Orientation undo_orientation) {
+  // bytes_per_channel and bytes_per_pixel are only valid for
+  // bits_per_sample > 1.
+  const size_t bytes_per_channel = DivCeil(bits_per_sample, jxl::kBitsPerByte);
+  const size_t bytes_per_pixel = num_channels * bytes_per_channel;
+
+  if (out_callback == nullptr && stride < bytes_per_pixel * ib.xsize()) {
+    return JXL_FAILURE(
+        "stride is smaller than scanline width in bytes: %zu vs %zu", stride,
+        bytes_per_pixel * ib.xsize());
+  }
+
+  // The channels are interleaved in the rows of out_image.
+  ChannelOut channels_out[4];
+  uint8_t* out = reinterpret_cast<uint8_t*>(out_image);
+  for (size_t c = 0; c < num_channels && c < 4; ++c) {
+    channels_out[c] = {out + c * bytes_per_channel, bytes_per_pixel, stride};
+  }
+  return ConvertImageInternal(ib, bits_per_sample, float_out, apply_srgb_tf,
+                              num_channels, endianness, channels_out,
+                              out_callback, out_opaque, pool,
+                              undo_orientation);
+}
+
+Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
+                    bool float_out, bool apply_srgb_tf, size_t num_channels,
+                    JxlEndianness endianness, const ChannelOut* channels_out,
+                    jxl::ThreadPool* pool, jxl::Orientation undo_orientation) {
+  return ConvertImageInternal(ib, bits_per_sample, float_out, apply_srgb_tf,
+                              num_channels, endianness, channels_out,
+                              /*out_callback=*/nullptr, /*out_opaque=*/nullptr,
+                              pool, undo_orientation);
+}
+
 namespace {
 
 typedef uint32_t(LoadFuncType)(const uint8_t* p);
@@ -20,6 +20,7 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "jxl/decode.h"
 #include "jxl/types.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/padded_bytes.h"
@@ -62,6 +63,36 @@ Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
                     jxl::ThreadPool* thread_pool, void* out_image,
                     size_t out_size, jxl::Orientation undo_orientation);
 
+// Same as above, but if out_callback is not null, the pixels are passed to
+// out_callback one row at a time instead of being written to out_image, in
+// which case out_image, out_size and stride_out are ignored. out_callback may
+// be called concurrently from several threads of the thread_pool, and rows are
+// not passed in any particular order.
+Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
+                    bool float_out, bool apply_srgb_tf, size_t num_channels,
+                    JxlEndianness endianness, size_t stride_out,
+                    jxl::ThreadPool* thread_pool, void* out_image,
+                    size_t out_size, JxlImageOutCallback out_callback,
+                    void* out_opaque, jxl::Orientation undo_orientation);
+
+// Location in memory of one channel of an output image: the sample of the
+// top-left pixel, and the distances in bytes between the samples of two
+// horizontally and of two vertically adjacent pixels.
+struct ChannelOut {
+  uint8_t* data;
+  size_t pixel_stride;
+  size_t row_stride;
+};
+
+// Same as above, but writes each of the num_channels channels to the location
+// given by the corresponding entry of channels_out. This allows padded rows,
+// separate planes and any order of the channels in memory.
+Status ConvertImage(const jxl::ImageBundle& ib, size_t bits_per_sample,
+                    bool float_out, bool apply_srgb_tf, size_t num_channels,
+                    JxlEndianness endianness, const ChannelOut* channels_out,
+                    jxl::ThreadPool* thread_pool,
+                    jxl::Orientation undo_orientation);
+
 // Does the inverse conversion, from an interleaved pixel buffer to ib.
 Status ConvertImage(Span<const uint8_t> bytes, size_t xsize, size_t ysize,
                     const ColorEncoding& c_current, bool has_alpha,
@@ -14,12 +14,18 @@
 
 #include "lib/jxl/external_image.h"
 
+#include <stdio.h>
+#include <string.h>
+
 #include <array>
 #include <new>
+#include <utility>
+#include <vector>
 
 #include "gtest/gtest.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/os_specific.h"
 #include "lib/jxl/base/thread_pool_internal.h"
 #include "lib/jxl/color_encoding_internal.h"
 #include "lib/jxl/image_ops.h"
@@ -53,5 +59,167 @@ TEST(ExternalImageTest, InvalidSize) {
 }
 #endif
 
+// Returns an image with samples in [-0.1, 1.1], i.e. also out of range.
+ImageBundle MakeTestImage(ImageMetadata* im, size_t xsize, size_t ysize,
+                          bool has_alpha) {
+  if (has_alpha) im->SetAlphaBits(16);
+  ImageBundle ib(im);
+  Image3F color(xsize, ysize);
+  ImageF alpha(xsize, ysize);
+  for (size_t y = 0; y < ysize; ++y) {
+    for (size_t c = 0; c < 4; ++c) {
+      float* JXL_RESTRICT row = c < 3 ? color.PlaneRow(c, y) : alpha.Row(y);
+      for (size_t x = 0; x < xsize; ++x) {
+        row[x] = ((x * 7 + y * 13 + c * 29) % 97) / 80.0f - 0.1f;
+      }
+    }
+  }
+  ib.SetFromImage(std::move(color), ColorEncoding::SRGB());
+  if (has_alpha) {
+    ib.SetAlpha(std::move(alpha), /*alpha_is_premultiplied=*/false);
+  }
+  return ib;
+}
+
+// Straightforward conversion of one sample, for comparison.
+void StoreExpected(float v, size_t bits_per_sample, bool float_out,
+                   bool big_endian, uint8_t* out) {
+  uint32_t value;
+  if (float_out) {
+    memcpy(&value, &v, 4);
+  } else {
+    const float mul = (1u << bits_per_sample) - 1;
+    v = v < 0 ? 0 : (v > 1 ? mul : v * mul);
+    value = static_cast<uint32_t>(v + 0.5);
+  }
+  const size_t bytes = bits_per_sample / 8;
+  for (size_t i = 0; i < bytes; ++i) {
+    out[big_endian ? bytes - 1 - i : i] = (value >> (8 * i)) & 0xFF;
+  }
+}
+
+TEST(ExternalImageTest, AllFormats) {
+  constexpr size_t kXsize = 67;
+  constexpr size_t kYsize = 5;
+  ThreadPoolInternal pool(4);
+  for (bool has_alpha : {false, true}) {
+    ImageMetadata im;
+    const ImageBundle ib = MakeTestImage(&im, kXsize, kYsize, has_alpha);
+    for (size_t num_channels = 1; num_channels <= 4; ++num_channels) {
+      for (size_t bits_per_sample : {8, 16, 32}) {
+        for (JxlEndianness endianness : {JXL_LITTLE_ENDIAN, JXL_BIG_ENDIAN}) {
+          const bool float_out = bits_per_sample == 32;
+          const size_t bytes_per_channel = bits_per_sample / 8;
+          const size_t stride = kXsize * num_channels * bytes_per_channel;
+          std::vector<uint8_t> out(stride * kYsize);
+          ASSERT_TRUE(ConvertImage(ib, bits_per_sample, float_out,
+                                   /*apply_srgb_tf=*/false, num_channels,
+                                   endianness, stride, &pool, out.data(),
+                                   out.size(), Orientation::kIdentity));
+
+          const size_t color_channels = num_channels <= 2 ? 1 : 3;
+          uint8_t expected[4];
+          for (size_t y = 0; y < kYsize; ++y) {
+            for (size_t x = 0; x < kXsize; ++x) {
+              for (size_t c = 0; c < num_channels; ++c) {
+                float v = 1.0f;
+                if (c < color_channels) {
+                  v = ib.color().PlaneRow(c, y)[x];
+                } else if (has_alpha) {
+                  v = ib.alpha().Row(y)[x];
+                }
+                StoreExpected(v, bits_per_sample, float_out,
+                              endianness == JXL_BIG_ENDIAN, expected);
+                const uint8_t* actual =
+                    out.data() + y * stride +
+                    (x * num_channels + c) * bytes_per_channel;
+                ASSERT_EQ(0, memcmp(expected, actual, bytes_per_channel))
+                    << "channels " << num_channels << " bits "
+                    << bits_per_sample << " endianness " << endianness
+                    << " alpha " << has_alpha << " at " << x << "," << y
+                    << "," << c;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+// The sRGB transfer function is applied while converting; the result must be
+// the same as when applying it to the image beforehand.
+TEST(ExternalImageTest, FusedSRGBTransferFunction) {
+  constexpr size_t kXsize = 67;
+  constexpr size_t kYsize = 5;
+  ImageMetadata im;
+  const ImageBundle ib = MakeTestImage(&im, kXsize, kYsize, true);
+  ImageMetadata im_srgb;
+  ImageBundle ib_srgb = MakeTestImage(&im_srgb, kXsize, kYsize, true);
+  Image3F color = CopyImage(*ib_srgb.color());
+  LinearToSRGBInPlace(nullptr, &color, 3);
+  ib_srgb.SetFromImage(std::move(color), ColorEncoding::SRGB());
+
+  for (size_t bits_per_sample : {8, 16}) {
+    const size_t stride = kXsize * 4 * bits_per_sample / 8;
+    std::vector<uint8_t> fused(stride * kYsize);
+    std::vector<uint8_t> expected(stride * kYsize);
+    ASSERT_TRUE(ConvertImage(ib, bits_per_sample, /*float_out=*/false,
+                             /*apply_srgb_tf=*/true, 4, JXL_BIG_ENDIAN, stride,
+                             nullptr, fused.data(), fused.size(),
+                             Orientation::kIdentity));
+    ASSERT_TRUE(ConvertImage(ib_srgb, bits_per_sample, /*float_out=*/false,
+                             /*apply_srgb_tf=*/false, 4, JXL_BIG_ENDIAN,
+                             stride, nullptr, expected.data(), expected.size(),
+                             Orientation::kIdentity));
+    EXPECT_EQ(expected, fused);
+  }
+}
+
+TEST(ExternalImageTest, DISABLED_ConvertImageBenchmark) {
+  constexpr size_t kXsize = 2048;
+  constexpr size_t kYsize = 2048;
+  constexpr size_t kReps = 10;
+  ThreadPoolInternal pool(8);
+  ImageMetadata im;
+  const ImageBundle ib = MakeTestImage(&im, kXsize, kYsize, true);
+  const std::pair<JxlDataType, const char*> data_types[] = {
+      {JXL_TYPE_UINT8, "u8"},
+      {JXL_TYPE_UINT16, "u16"},
+      {JXL_TYPE_FLOAT, "f32"},
+  };
+  for (size_t num_channels = 1; num_channels <= 4; ++num_channels) {
+    for (const auto& data_type : data_types) {
+      for (JxlEndianness endianness : {JXL_LITTLE_ENDIAN, JXL_BIG_ENDIAN}) {
+        for (ThreadPool* p : {static_cast<ThreadPool*>(nullptr),
+                              static_cast<ThreadPool*>(&pool)}) {
+          const JxlPixelFormat format = {static_cast<uint32_t>(num_channels),
+                                         data_type.first, endianness, 0};
+          size_t bits_per_sample = 32;
+          if (format.data_type == JXL_TYPE_UINT8) bits_per_sample = 8;
+          if (format.data_type == JXL_TYPE_UINT16) bits_per_sample = 16;
+          const size_t stride =
+              kXsize * format.num_channels * bits_per_sample / 8;
+          std::vector<uint8_t> out(stride * kYsize);
+          const double t0 = Now();
+          for (size_t i = 0; i < kReps; ++i) {
+            ASSERT_TRUE(ConvertImage(
+                ib, bits_per_sample, format.data_type == JXL_TYPE_FLOAT,
+                /*apply_srgb_tf=*/false, format.num_channels,
+                format.endianness, stride, p, out.data(), out.size(),
+                Orientation::kIdentity));
+          }
+          const double elapsed = Now() - t0;
+          printf("%u x %-3s %s %-8s %8.2f MP/s\n", format.num_channels,
+                 data_type.second,
+                 endianness == JXL_LITTLE_ENDIAN ? "LE" : "BE",
+                 p ? "threads" : "1 thread",
+                 kXsize * kYsize * kReps * 1E-6 / elapsed);
+        }
+      }
+    }
+  }
+}
+
 }  // namespace
 }  // namespace jxl
@@ -97,6 +97,22 @@ struct FilterRows {
     }
   }
 
+  // Same as SetInput with RowMapMirror, for an input that only holds the rows
+  // [band_y0, band_y0 + in.ysize()) of an image of ysize rows.
+  void SetBandInput(const Image3F& in, size_t ysize, size_t band_y0,
+                    ssize_t y0, ssize_t x0) {
+    RowMapMirror row_map(ysize);
+    for (size_t c = 0; c < 3; c++) {
+      rows_in_[c] = in.ConstPlaneRow(c, 0);
+    }
+    for (int32_t i = -border_size_; i <= border_size_; i++) {
+      size_t y = row_map(y0 + i);
+      JXL_DASSERT(y >= band_y0 && y < band_y0 + in.ysize());
+      offsets_in_[i + kMaxBorderSize] =
+          static_cast<ssize_t>((y - band_y0) * in.PixelsPerRow()) + x0;
+    }
+  }
+
   template <typename RowMap>
   void SetOutput(Image3F* out, size_t y_offset, ssize_t y0, ssize_t x0) {
     size_t y = RowMap()(y0);
@@ -200,6 +216,24 @@ class FilterPipeline {
       };
     }
 
+    // Same as SetInputFixedOffset with RowMapMirror, for an input image that
+    // only holds a band of the rows of an image of image_ysize rows. The first
+    // row of the band is the row *band_y0 of the image, which may change
+    // between calls to ApplyFiltersRow.
+    template <ssize_t x_offset>
+    void SetInputBand(const Image3F* im_input, size_t image_ysize,
+                      const size_t* band_y0) {
+      input = im_input;
+      input_ysize = image_ysize;
+      input_band_y0 = band_y0;
+      set_input_rows = [](const FilterStep& self, FilterRows* rows, size_t y0,
+                          size_t /* rect_x0 */) {
+        rows->SetBandInput(*(self.input), self.input_ysize,
+                           *self.input_band_y0, y0,
+                           x_offset - kMaxFilterPadding);
+      };
+    }
+
     // Sets the input of the filter step as the temporary cyclic storage with
     // num_rows rows. The value rect.x0() during application will be mapped to
     // kMaxFilterPadding regardless of the rect being processed.
@@ -245,6 +279,9 @@ class FilterPipeline {
     // set_input_rows and set_output_rows functions.
     const Image3F* input;
     size_t input_y_offset = 0;
+    // Only used by SetInputBand.
+    size_t input_ysize = 0;
+    const size_t* input_band_y0 = nullptr;
     Image3F* output;
     size_t output_y_offset = 0;
 
@@ -167,4 +167,29 @@ uint32_t BuildHuffmanTable(HuffmanCode* root_table, int root_bits,
   return total_size;
 }
 
+uint32_t BuildHuffmanMultiTable(const HuffmanCode* root_table, int root_bits,
+                                HuffmanMultiCode* multi_table) {
+  const uint32_t table_size = 1u << root_bits;
+  uint32_t total_symbols = 0;
+  for (uint32_t key = 0; key < table_size; ++key) {
+    HuffmanMultiCode* code = &multi_table[key];
+    uint32_t remaining_key = key;
+    int remaining_bits = root_bits;
+    code->num_symbols = 0;
+    while (code->num_symbols < kHuffmanMaxMultiSymbols) {
+      /* Root entries are replicated over the bits above their code, so the
+         bits of the key that were already decoded do not matter. */
+      const HuffmanCode& entry = root_table[remaining_key];
+      if (entry.bits > remaining_bits) break;
+      code->value[code->num_symbols] = entry.value;
+      code->bits[code->num_symbols] = entry.bits;
+      ++code->num_symbols;
+      remaining_key >>= entry.bits;
+      remaining_bits -= entry.bits;
+    }
+    total_symbols += code->num_symbols;
+  }
+  return total_symbols;
+}
+
 }  // namespace jxl
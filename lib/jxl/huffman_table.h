@@ -25,6 +25,15 @@ struct HuffmanCode {
   uint16_t value; /* symbol value or table offset */
 };
 
+/* Maximum number of symbols decoded by a single multi-symbol lookup. */
+static constexpr size_t kHuffmanMaxMultiSymbols = 4;
+
+struct HuffmanMultiCode {
+  uint16_t value[kHuffmanMaxMultiSymbols]; /* symbols, in decoding order */
+  uint8_t bits[kHuffmanMaxMultiSymbols];   /* number of bits of each symbol */
+  uint8_t num_symbols; /* 0 if the first code is not in the root table */
+};
+
 /* Builds Huffman lookup table assuming code lengths are in symbol order. */
 /* Returns 0 in case of error (invalid tree or memory error), otherwise
    populated size of table. */
@@ -32,6 +41,12 @@ uint32_t BuildHuffmanTable(HuffmanCode* root_table, int root_bits,
                            const uint8_t* code_lengths,
                            size_t code_lengths_size, uint16_t* count);
 
+/* Fills the 1 << root_bits entries of multi_table with the symbols of
+   root_table that each key decodes to one after the other, as long as their
+   codes fit in the key. Returns the total number of symbols of all entries. */
+uint32_t BuildHuffmanMultiTable(const HuffmanCode* root_table, int root_bits,
+                                HuffmanMultiCode* multi_table);
+
 }  // namespace jxl
 
 #endif  // LIB_JXL_HUFFMAN_TABLE_H_
@@ -16,6 +16,8 @@
 
 #include "gtest/gtest.h"
 #include "lib/jxl/aux_out.h"
+#include "lib/jxl/image_test_utils.h"
+#include "lib/jxl/passes_state.h"
 
 namespace jxl {
 namespace {
@@ -41,5 +43,40 @@ TEST(ImageBundleTest, ExtraChannelName) {
   EXPECT_EQ("testK", metadata_out.Find(ExtraChannel::kBlack)->name);
 }
 
+TEST(ImageBundleTest, CompactReferenceFrame) {
+  ImageMetadata metadata;
+  metadata.SetUintSamples(8);
+  ImageBundle ib(&metadata);
+  Image3F color(37, 19);
+  for (size_t c = 0; c < 3; c++) {
+    for (size_t y = 0; y < color.ysize(); y++) {
+      float* JXL_RESTRICT row = color.PlaneRow(c, y);
+      for (size_t x = 0; x < color.xsize(); x++) {
+        row[x] = static_cast<float>((x * 7 + y * 3 + c) % 256) * (1.f / 255);
+      }
+    }
+  }
+  ib.SetFromImage(CopyImage(color), ColorEncoding::SRGB());
+
+  ReferenceFrame reference_frame;
+  ASSERT_TRUE(reference_frame.SetCompact(ib));
+  EXPECT_TRUE(reference_frame.IsCompact());
+  EXPECT_EQ(color.xsize(), reference_frame.xsize());
+  EXPECT_EQ(color.ysize(), reference_frame.ysize());
+  VerifyEqual(color, *reference_frame.Copy().color());
+  float buffer[5];
+  const float* row = reference_frame.ConstRow(1, 3, 7, 5, buffer);
+  for (size_t x = 0; x < 5; x++) {
+    EXPECT_EQ(color.PlaneRow(1, 7)[3 + x], row[x]);
+  }
+
+  // Samples that are not multiples of 1 / 255 are kept as floats.
+  color.PlaneRow(2, 18)[36] += 1e-3f;
+  ib.SetFromImage(std::move(color), ColorEncoding::SRGB());
+  reference_frame.Reset();
+  EXPECT_FALSE(reference_frame.SetCompact(ib));
+  EXPECT_FALSE(reference_frame.IsCompact());
+}
+
 }  // namespace
 }  // namespace jxl
@@ -812,6 +812,13 @@ SerializationStatus JXL_NOINLINE DoEncodeScan(const JPEGData& jpg,
       }
       --ss.restarts_to_go;
     }
+    if (!state->output_queue.empty() && ss.mcu_y + 1 < last_mcu_y) {
+      // Let the caller write out the filled chunks before encoding further, so
+      // that no more than about a chunk and an MCU row are buffered.
+      ++ss.mcu_y;
+      if (!bw->healthy) return SerializationStatus::ERROR;
+      return SerializationStatus::NEEDS_MORE_OUTPUT;
+    }
   }
   if (ss.mcu_y < MCU_rows) {
     if (!bw->healthy) return SerializationStatus::ERROR;
@@ -918,30 +925,31 @@ SerializationStatus SerializeSection(uint8_t marker, SerializationState* state,
 
 }  // namespace
 
-// TODO(veluca): add streaming support again.
-Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
-  SerializationState ss;
-
-  size_t written = 0;
-  const auto maybe_push_output = [&]() -> Status {
-    if (ss.stage != SerializationState::ERROR) {
-      while (!ss.output_queue.empty()) {
-        auto& chunk = ss.output_queue.front();
-        size_t num_written = out(chunk.next, chunk.len);
-        if (num_written == 0 && chunk.len > 0) {
-          return JXL_FAILURE("Failed to write output");
-        }
-        chunk.len -= num_written;
-        written += num_written;
-        if (chunk.len == 0) {
-          ss.output_queue.pop_front();
-        }
+Status WriteJpegIncrementally(const JPEGData& jpg, SerializationState* state,
+                              const JPEGOutput& out, bool* done) {
+  SerializationState& ss = *state;
+  *done = false;
+
+  // Returns false if `out` did not accept all the queued output.
+  const auto push_output = [&]() -> bool {
+    while (!ss.output_queue.empty()) {
+      auto& chunk = ss.output_queue.front();
+      size_t num_written = out(chunk.next, chunk.len);
+      if (num_written == 0 && chunk.len > 0) return false;
+      chunk.next += num_written;
+      chunk.len -= num_written;
+      if (chunk.len == 0) {
+        ss.output_queue.pop_front();
       }
     }
     return true;
   };
 
   while (true) {
+    if (ss.stage != SerializationState::ERROR && !push_output()) {
+      // Resumed by the next call with the same state.
+      return true;
+    }
     switch (ss.stage) {
       case SerializationState::INIT: {
         // Valid Brunsli requires, at least, 0xD9 marker.
@@ -960,7 +968,6 @@ Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
         }
 
         EncodeSOI(&ss);
-        JXL_RETURN_IF_ERROR(maybe_push_output());
         ss.stage = SerializationState::SERIALIZE_SECTION;
         break;
       }
@@ -977,8 +984,10 @@ Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
           ss.stage = SerializationState::ERROR;
           break;
         }
-        JXL_RETURN_IF_ERROR(maybe_push_output());
-        if (status == SerializationStatus::NEEDS_MORE_INPUT) {
+        if (status == SerializationStatus::NEEDS_MORE_OUTPUT) {
+          // The same section continues once its output is written.
+          break;
+        } else if (status == SerializationStatus::NEEDS_MORE_INPUT) {
           return JXL_FAILURE("Incomplete serialization data");
         } else if (status != SerializationStatus::DONE) {
           JXL_DASSERT(false);
@@ -991,6 +1000,7 @@ Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
 
       case SerializationState::DONE:
         JXL_ASSERT(ss.output_queue.empty());
+        *done = true;
         return true;
 
       case SerializationState::ERROR:
@@ -999,5 +1009,13 @@ Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
   }
 }
 
+Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out) {
+  SerializationState ss;
+  bool done;
+  JXL_RETURN_IF_ERROR(WriteJpegIncrementally(jpg, &ss, out, &done));
+  if (!done) return JXL_FAILURE("Failed to write output");
+  return true;
+}
+
 }  // namespace jpeg
 }  // namespace jxl
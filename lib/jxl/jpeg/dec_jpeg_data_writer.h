@@ -22,6 +22,7 @@
 
 #include <functional>
 
+#include "lib/jxl/jpeg/dec_jpeg_serialization_state.h"
 #include "lib/jxl/jpeg/jpeg_data.h"
 
 namespace jxl {
@@ -33,6 +34,13 @@ using JPEGOutput = std::function<size_t(const uint8_t* buf, size_t len)>;
 
 Status WriteJpeg(const JPEGData& jpg, const JPEGOutput& out);
 
+// Like WriteJpeg, but stops as soon as `out` accepts no more bytes, i.e.
+// returns 0 for a non-empty buffer, with *done set to false. Calling it again
+// with the same `state` continues where it stopped. Sets *done to true once
+// the whole JPEG was written.
+Status WriteJpegIncrementally(const JPEGData& jpg, SerializationState* state,
+                              const JPEGOutput& out, bool* done);
+
 }  // namespace jpeg
 }  // namespace jxl
 
@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <cinttypes>
 #include <limits>
 #include <numeric>
@@ -44,17 +45,27 @@
 namespace jxl {
 
 namespace {
-constexpr int32_t kWPPropRange = 512;
+// Property values are clamped to this range when looking up a tree that was
+// compiled to a table.
+constexpr int32_t kPropRangeFast = 512;
+// Index of the row (y) property.
+constexpr int32_t kRowProp = 2;
+// Trees that test the row are specialized for at most this many bands of
+// rows per channel.
+constexpr size_t kMaxRowBands = 64;
 // Plot tree (if enabled) and predictor usage map.
 constexpr bool kWantDebug = false;
 
 // Removes all nodes that use a static property (i.e. channel or group ID) from
 // the tree and collapses each node on even levels with its two children to
 // produce a flatter tree. Also computes whether the resulting tree requires
-// using the weighted predictor.
+// using the weighted predictor. If `row` is not negative, nodes that test the
+// row property are removed as well, assuming all pixels are on that row (or
+// on a row on the same side of every row split).
 FlatTree FilterTree(const Tree &global_tree,
                     std::array<pixel_type, kNumStaticProperties> &static_props,
-                    size_t *num_props, bool *use_wp, bool *wp_only) {
+                    size_t *num_props, bool *use_wp, bool *wp_only,
+                    int32_t row = -1) {
   *num_props = 0;
   bool has_wp = false;
   bool has_non_wp = false;
@@ -66,6 +77,12 @@ FlatTree FilterTree(const Tree &global_tree,
       has_non_wp = true;
     }
   };
+  const auto is_known = [&](int32_t p) {
+    return (p < kNumStaticProperties && p != -1) || (p == kRowProp && row >= 0);
+  };
+  const auto known_value = [&](int32_t p) {
+    return p == kRowProp ? row : static_props[p];
+  };
   FlatTree output;
   std::queue<size_t> nodes;
   nodes.push(0);
@@ -79,9 +96,8 @@ FlatTree FilterTree(const Tree &global_tree,
     size_t cur = nodes.front();
     nodes.pop();
     // Skip nodes that we can decide now, by jumping directly to their children.
-    while (global_tree[cur].property < kNumStaticProperties &&
-           global_tree[cur].property != -1) {
-      if (static_props[global_tree[cur].property] > global_tree[cur].splitval) {
+    while (is_known(global_tree[cur].property)) {
+      if (known_value(global_tree[cur].property) > global_tree[cur].splitval) {
         cur = global_tree[cur].lchild;
       } else {
         cur = global_tree[cur].rchild;
@@ -108,9 +124,8 @@ FlatTree FilterTree(const Tree &global_tree,
       size_t cur_child =
           i == 0 ? global_tree[cur].lchild : global_tree[cur].rchild;
       // Skip nodes that we can decide now.
-      while (global_tree[cur_child].property < kNumStaticProperties &&
-             global_tree[cur_child].property != -1) {
-        if (static_props[global_tree[cur_child].property] >
+      while (is_known(global_tree[cur_child].property)) {
+        if (known_value(global_tree[cur_child].property) >
             global_tree[cur_child].splitval) {
           cur_child = global_tree[cur_child].lchild;
         } else {
@@ -183,7 +198,7 @@ Status EncodeModularChannelMAANS(const Image &image, pixel_type chan,
   // Check if this tree is a WP-only tree with a small enough property value
   // range.
   // Initialized to avoid clang-tidy complaining.
-  uint16_t context_lookup[2 * kWPPropRange] = {};
+  uint16_t context_lookup[2 * kPropRangeFast] = {};
   // TODO(veluca): de-duplicate code in Decode.
   if (is_wp_only) {
     struct TreeRange {
@@ -193,12 +208,12 @@ Status EncodeModularChannelMAANS(const Image &image, pixel_type chan,
       size_t pos;
     };
     std::vector<TreeRange> ranges;
-    ranges.push_back(TreeRange{-kWPPropRange - 1, kWPPropRange - 1, 0});
+    ranges.push_back(TreeRange{-kPropRangeFast - 1, kPropRangeFast - 1, 0});
     while (!ranges.empty()) {
       TreeRange cur = ranges.back();
       ranges.pop_back();
-      if (cur.begin < -kWPPropRange - 1 || cur.begin >= kWPPropRange - 1 ||
-          cur.end > kWPPropRange - 1) {
+      if (cur.begin < -kPropRangeFast - 1 || cur.begin >= kPropRangeFast - 1 ||
+          cur.end > kPropRangeFast - 1) {
         // Tree is outside the allowed range, exit.
         is_wp_only = false;
         break;
@@ -213,7 +228,7 @@ Status EncodeModularChannelMAANS(const Image &image, pixel_type chan,
           break;
         }
         for (int i = cur.begin + 1; i < cur.end + 1; i++) {
-          context_lookup[i + kWPPropRange] = node.childID;
+          context_lookup[i + kPropRangeFast] = node.childID;
         }
         continue;
       }
@@ -260,9 +275,9 @@ Status EncodeModularChannelMAANS(const Image &image, pixel_type chan,
         int32_t guess = wp_state.Predict</*compute_properties=*/true>(
             x, y, channel.w, top, left, topright, topleft, toptop, &properties,
             offset);
-        uint32_t pos =
-            kWPPropRange +
-            std::min(std::max(-kWPPropRange, properties[0]), kWPPropRange - 1);
+        uint32_t pos = kPropRangeFast + std::min(std::max(-kPropRangeFast,
+                                                          properties[0]),
+                                                 kPropRangeFast - 1);
         uint32_t ctx_id = context_lookup[pos];
         int32_t residual = r[x] - guess;
         tokens->emplace_back(ctx_id, PackSigned(residual));
@@ -371,153 +386,242 @@ Status EncodeModularChannelMAANS(const Image &image, pixel_type chan,
   return true;
 }
 
-Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
-                                 const std::vector<uint8_t> &context_map,
-                                 const Tree &global_tree,
-                                 const weighted::Header &wp_header,
-                                 pixel_type chan, size_t group_id,
-                                 Image *image) {
-  Channel &channel = image->channel[chan];
-
-  std::array<pixel_type, kNumStaticProperties> static_props = {chan,
-                                                               (int)group_id};
-  // TODO(veluca): filter the tree according to static_props.
-
-  // zero pixel channel? could happen
-  if (channel.w == 0 || channel.h == 0) return true;
-
-  channel.resize(channel.w, channel.h);
-  bool tree_has_wp_prop_or_pred = false;
-  bool is_wp_only = false;
-  size_t num_props;
-  FlatTree tree = FilterTree(global_tree, static_props, &num_props,
-                             &tree_has_wp_prop_or_pred, &is_wp_only);
+namespace {
 
-  // From here on, tree lookup returns a *clustered* context ID.
-  // This avoids an extra memory lookup after tree traversal.
-  for (size_t i = 0; i < tree.size(); i++) {
-    if (tree[i].property0 == -1) {
-      tree[i].childID = context_map[tree[i].childID];
+// Returns the sorted split values of the nodes testing the row property that
+// are reachable in the tree once the static properties are known.
+std::vector<int32_t> RowSplits(
+    const Tree &global_tree,
+    const std::array<pixel_type, kNumStaticProperties> &static_props) {
+  std::vector<int32_t> splits;
+  std::vector<size_t> nodes(1, 0);
+  while (!nodes.empty()) {
+    const PropertyDecisionNode &node = global_tree[nodes.back()];
+    nodes.pop_back();
+    if (node.property == -1) continue;
+    if (node.property < kNumStaticProperties) {
+      nodes.push_back(static_props[node.property] > node.splitval
+                          ? node.lchild
+                          : node.rchild);
+      continue;
     }
+    if (node.property == kRowProp) splits.push_back(node.splitval);
+    nodes.push_back(node.lchild);
+    nodes.push_back(node.rchild);
   }
+  std::sort(splits.begin(), splits.end());
+  splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+  return splits;
+}
 
-  JXL_DEBUG_V(3, "Decoded MA tree with %zu nodes", tree.size());
-
-  // MAANS decode
-
-  // Check if this tree is a WP-only tree with a small enough property value
-  // range.
+// A tree whose decision nodes all test the same property, compiled to a table
+// indexed by the property value clamped to [-kPropRangeFast, kPropRangeFast).
+struct SinglePropertyLut {
+  int32_t property;
+  // Set if all the leaves use the same predictor.
+  bool uniform_predictor;
   // Those contexts are *clustered* context ids. This reduces stack usages and
   // avoids an extra memory lookup.
-  // Initialized to avoid clang-tidy complaining.
-  uint8_t context_lookup[2 * kWPPropRange] = {};
-  int32_t multipliers[2 * kWPPropRange] = {};
-  int8_t offsets[2 * kWPPropRange] = {};
-  if (is_wp_only) {
-    struct TreeRange {
-      // Begin *excluded*, end *included*. This works best with > vs <= decision
-      // nodes.
-      int begin, end;
-      size_t pos;
-    };
-    std::vector<TreeRange> ranges;
-    ranges.push_back(TreeRange{-kWPPropRange - 1, kWPPropRange - 1, 0});
-    while (!ranges.empty()) {
-      TreeRange cur = ranges.back();
-      ranges.pop_back();
-      if (cur.begin < -kWPPropRange - 1 || cur.begin >= kWPPropRange - 1 ||
-          cur.end > kWPPropRange - 1) {
-        // Tree is outside the allowed range, exit.
-        is_wp_only = false;
-        break;
-      }
-      auto &node = tree[cur.pos];
-      // Leaf.
-      if (node.property0 == -1) {
-        if (node.predictor_offset < std::numeric_limits<int8_t>::min() ||
-            node.predictor_offset > std::numeric_limits<int8_t>::max()) {
-          is_wp_only = false;
-          break;
-        }
-        for (int i = cur.begin + 1; i < cur.end + 1; i++) {
-          context_lookup[i + kWPPropRange] = node.childID;
-          multipliers[i + kWPPropRange] = node.multiplier;
-          offsets[i + kWPPropRange] = node.predictor_offset;
-        }
-        continue;
+  uint8_t context[2 * kPropRangeFast];
+  Predictor predictor[2 * kPropRangeFast];
+  int32_t multiplier[2 * kPropRangeFast];
+  int8_t offset[2 * kPropRangeFast];
+};
+
+// Returns false if the tree tests more than one property, or if its split
+// values or predictor offsets do not fit in the table.
+bool CompileSinglePropertyTree(const FlatTree &tree, SinglePropertyLut *lut) {
+  lut->property = -1;
+  lut->uniform_predictor = true;
+  struct TreeRange {
+    // Begin *excluded*, end *included*. This works best with > vs <= decision
+    // nodes.
+    int begin, end;
+    size_t pos;
+  };
+  std::vector<TreeRange> ranges;
+  ranges.push_back(TreeRange{-kPropRangeFast - 1, kPropRangeFast - 1, 0});
+  const FlatDecisionNode *first_leaf = nullptr;
+  const auto same_property = [lut](int32_t p) {
+    if (lut->property == -1) lut->property = p;
+    return lut->property == p;
+  };
+  while (!ranges.empty()) {
+    TreeRange cur = ranges.back();
+    ranges.pop_back();
+    if (cur.begin < -kPropRangeFast - 1 || cur.begin >= kPropRangeFast - 1 ||
+        cur.end > kPropRangeFast - 1) {
+      // Tree is outside the allowed range, exit.
+      return false;
+    }
+    const FlatDecisionNode &node = tree[cur.pos];
+    // Leaf.
+    if (node.property0 == -1) {
+      if (first_leaf == nullptr) first_leaf = &node;
+      if (node.predictor_offset < std::numeric_limits<int8_t>::min() ||
+          node.predictor_offset > std::numeric_limits<int8_t>::max()) {
+        return false;
       }
-      // > side of top node.
-      if (node.properties[0] >= kNumStaticProperties) {
-        ranges.push_back(TreeRange({node.splitvals[0], cur.end, node.childID}));
-        ranges.push_back(
-            TreeRange({node.splitval0, node.splitvals[0], node.childID + 1}));
-      } else {
-        ranges.push_back(TreeRange({node.splitval0, cur.end, node.childID}));
+      if (node.predictor != first_leaf->predictor) {
+        lut->uniform_predictor = false;
       }
-      // <= side
-      if (node.properties[1] >= kNumStaticProperties) {
-        ranges.push_back(
-            TreeRange({node.splitvals[1], node.splitval0, node.childID + 2}));
-        ranges.push_back(
-            TreeRange({cur.begin, node.splitvals[1], node.childID + 3}));
-      } else {
-        ranges.push_back(
-            TreeRange({cur.begin, node.splitval0, node.childID + 2}));
+      for (int i = cur.begin + 1; i < cur.end + 1; i++) {
+        lut->context[i + kPropRangeFast] = node.childID;
+        lut->predictor[i + kPropRangeFast] = node.predictor;
+        lut->multiplier[i + kPropRangeFast] = node.multiplier;
+        lut->offset[i + kPropRangeFast] = node.predictor_offset;
       }
+      continue;
+    }
+    if (!same_property(node.property0)) return false;
+    // > side of top node.
+    if (node.properties[0] >= kNumStaticProperties) {
+      if (!same_property(node.properties[0])) return false;
+      ranges.push_back(TreeRange({node.splitvals[0], cur.end, node.childID}));
+      ranges.push_back(
+          TreeRange({node.splitval0, node.splitvals[0], node.childID + 1}));
+    } else {
+      ranges.push_back(TreeRange({node.splitval0, cur.end, node.childID}));
+    }
+    // <= side
+    if (node.properties[1] >= kNumStaticProperties) {
+      if (!same_property(node.properties[1])) return false;
+      ranges.push_back(
+          TreeRange({node.splitvals[1], node.splitval0, node.childID + 2}));
+      ranges.push_back(
+          TreeRange({cur.begin, node.splitvals[1], node.childID + 3}));
+    } else {
+      ranges.push_back(
+          TreeRange({cur.begin, node.splitval0, node.childID + 2}));
     }
   }
+  return true;
+}
 
-  if (is_wp_only) {
-    JXL_DEBUG_V(8, "WP fast track.");
-    const intptr_t onerow = channel.plane.PixelsPerRow();
-    weighted::State wp_state(wp_header, channel.w, channel.h);
-    Properties properties(1);
-    for (size_t y = 0; y < channel.h; y++) {
-      pixel_type *JXL_RESTRICT r = channel.Row(y);
-      for (size_t x = 0; x < channel.w; x++) {
-        size_t offset = 0;
-        pixel_type_w left = (x ? r[x - 1] : y ? *(r + x - onerow) : 0);
-        pixel_type_w top = (y ? *(r + x - onerow) : left);
-        pixel_type_w topleft = (x && y ? *(r + x - 1 - onerow) : left);
-        pixel_type_w topright =
-            (x + 1 < channel.w && y ? *(r + x + 1 - onerow) : top);
-        pixel_type_w toptop = (y > 1 ? *(r + x - onerow - onerow) : top);
-        int32_t guess = wp_state.Predict</*compute_properties=*/true>(
-            x, y, channel.w, top, left, topright, topleft, toptop, &properties,
-            offset);
-        uint32_t pos =
-            kWPPropRange +
-            std::min(std::max(-kWPPropRange, properties[0]), kWPPropRange - 1);
-        uint32_t ctx_id = context_lookup[pos];
-        uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
-        r[x] = SaturatingAdd<pixel_type>(
-            UnpackSigned(v) * multipliers[pos] + offsets[pos], guess);
-        wp_state.UpdateErrors(r[x], x, y, channel.w);
-      }
+// Computes one of the properties that only depend on the position and the
+// causal neighbors of the pixel, with the same truncation to PropertyVal as
+// the full property computation.
+template <int32_t kProperty>
+JXL_INLINE PropertyVal NeighborProperty(size_t x, pixel_type_w left,
+                                         pixel_type_w top,
+                                         pixel_type_w topleft,
+                                         pixel_type_w topright,
+                                         pixel_type_w leftleft,
+                                         pixel_type_w toptop) {
+  switch (kProperty) {
+    case 3:
+      return x;
+    case 4:
+      return std::abs(top);
+    case 5:
+      return std::abs(left);
+    case 6:
+      return top;
+    case 7:
+      return left;
+    case 9:
+      return left + top - topleft;
+    case 10:
+      return left - topleft;
+    case 11:
+      return topleft - top;
+    case 12:
+      return top - topright;
+    case 13:
+      return top - toptop;
+    default:
+      return left - leftleft;
+  }
+}
+
+// Decodes rows [y0, y1) of a channel whose tree was compiled to a table on a
+// neighbor property and that does not use the weighted predictor.
+template <int32_t kProperty>
+void DecodeSinglePropertyRows(BitReader *br, ANSSymbolReader *reader,
+                              const SinglePropertyLut &lut, size_t y0,
+                              size_t y1, Channel *channel) {
+  const intptr_t onerow = channel->plane.PixelsPerRow();
+  const size_t w = channel->w;
+  const bool gradient = lut.uniform_predictor &&
+                        lut.predictor[kPropRangeFast] == Predictor::Gradient;
+  for (size_t y = y0; y < y1; y++) {
+    pixel_type *JXL_RESTRICT r = channel->Row(y);
+    for (size_t x = 0; x < w; x++) {
+      pixel_type_w left = (x ? r[x - 1] : y ? *(r + x - onerow) : 0);
+      pixel_type_w top = (y ? *(r + x - onerow) : left);
+      pixel_type_w topleft = (x && y ? *(r + x - 1 - onerow) : left);
+      pixel_type_w topright = (x + 1 < w && y ? *(r + x + 1 - onerow) : top);
+      pixel_type_w leftleft = (x > 1 ? r[x - 2] : left);
+      pixel_type_w toptop = (y > 1 ? *(r + x - onerow - onerow) : top);
+      PropertyVal v = NeighborProperty<kProperty>(x, left, top, topleft,
+                                                   topright, leftleft, toptop);
+      uint32_t pos =
+          kPropRangeFast +
+          std::min(std::max(-kPropRangeFast, v), kPropRangeFast - 1);
+      pixel_type_w guess =
+          gradient ? ClampedGradient(left, top, topleft)
+                   : PredictNoTreeNoWP(w, r + x, onerow, x, y,
+                                       lut.predictor[pos])
+                         .guess;
+      uint64_t val = reader->ReadHybridUintClustered(lut.context[pos], br);
+      r[x] = SaturatingAdd<pixel_type>(UnpackSigned(val) * lut.multiplier[pos],
+                                       guess + lut.offset[pos]);
     }
-  } else if (tree.size() == 1) {
+  }
+}
+
+// Decodes rows [y0, y1) of a channel with a tree that was filtered for those
+// rows. If the weighted predictor is used anywhere in the channel, `wp_state`
+// is not null and is updated for every pixel, even if this tree does not use
+// it.
+Status DecodeRows(
+    BitReader *br, ANSSymbolReader *reader, const FlatTree &tree,
+    size_t num_props, bool is_wp_only,
+    const std::array<pixel_type, kNumStaticProperties> &static_props,
+    pixel_type chan, size_t y0, size_t y1, Image *image,
+    weighted::State *wp_state) {
+  Channel &channel = image->channel[chan];
+  const intptr_t onerow = channel.plane.PixelsPerRow();
+
+  if (tree.size() == 1) {
     // special optimized case: no meta-adaptation, so no need
     // to compute properties.
     Predictor predictor = tree[0].predictor;
     int64_t offset = tree[0].predictor_offset;
     int32_t multiplier = tree[0].multiplier;
     size_t ctx_id = tree[0].childID;
-    if (predictor == Predictor::Zero) {
+    if (wp_state != nullptr) {
+      // special optimized case: no meta-adaptation, so no need to
+      // compute properties
+      JXL_DEBUG_V(8, "Somewhat fast track.");
+      for (size_t y = y0; y < y1; y++) {
+        pixel_type *JXL_RESTRICT r = channel.Row(y);
+        for (size_t x = 0; x < channel.w; x++) {
+          pixel_type_w g = PredictNoTreeWP(channel.w, r + x, onerow, x, y,
+                                           predictor, wp_state)
+                               .guess +
+                           offset;
+          uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
+          r[x] = SaturatingAdd<pixel_type>(UnpackSigned(v) * multiplier, g);
+          wp_state->UpdateErrors(r[x], x, y, channel.w);
+        }
+      }
+    } else if (predictor == Predictor::Zero) {
       uint32_t value;
-      if (reader->IsSingleValue(ctx_id, &value, channel.w * channel.h)) {
+      if (reader->IsSingleValue(ctx_id, &value, channel.w * (y1 - y0))) {
         // Special-case: histogram has a single symbol, with no extra bits, and
         // we use ANS mode.
         JXL_DEBUG_V(8, "Fastest track.");
         pixel_type v =
             SaturatingAdd<pixel_type>(UnpackSigned(value) * multiplier, offset);
-        for (size_t y = 0; y < channel.h; y++) {
+        for (size_t y = y0; y < y1; y++) {
           pixel_type *JXL_RESTRICT r = channel.Row(y);
           std::fill(r, r + channel.w, v);
         }
 
       } else {
         JXL_DEBUG_V(8, "Fast track.");
-        for (size_t y = 0; y < channel.h; y++) {
+        for (size_t y = y0; y < y1; y++) {
           pixel_type *JXL_RESTRICT r = channel.Row(y);
           for (size_t x = 0; x < channel.w; x++) {
             uint32_t v = reader->ReadHybridUintClustered(ctx_id, br);
@@ -526,12 +630,11 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
           }
         }
       }
-    } else if (predictor != Predictor::Weighted) {
+    } else {
       // special optimized case: no meta-adaptation, no wp, so no need to
       // compute properties
       JXL_DEBUG_V(8, "Quite fast track.");
-      const intptr_t onerow = channel.plane.PixelsPerRow();
-      for (size_t y = 0; y < channel.h; y++) {
+      for (size_t y = y0; y < y1; y++) {
         pixel_type *JXL_RESTRICT r = channel.Row(y);
         for (size_t x = 0; x < channel.w; x++) {
           PredictionResult pred =
@@ -542,34 +645,76 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
           r[x] = SaturatingAdd<pixel_type>(UnpackSigned(v) * multiplier, g);
         }
       }
-    } else {
-      // special optimized case: no meta-adaptation, so no need to
-      // compute properties
-      JXL_DEBUG_V(8, "Somewhat fast track.");
-      const intptr_t onerow = channel.plane.PixelsPerRow();
-      weighted::State wp_state(wp_header, channel.w, channel.h);
-      for (size_t y = 0; y < channel.h; y++) {
+    }
+    return true;
+  }
+
+  // Check if this tree only tests a single property with a small enough value
+  // range.
+  SinglePropertyLut lut;
+  if (CompileSinglePropertyTree(tree, &lut)) {
+    if (is_wp_only && lut.property == static_cast<int32_t>(kWPProp)) {
+      JXL_DEBUG_V(8, "WP fast track.");
+      Properties properties(1);
+      for (size_t y = y0; y < y1; y++) {
         pixel_type *JXL_RESTRICT r = channel.Row(y);
         for (size_t x = 0; x < channel.w; x++) {
-          pixel_type_w g = PredictNoTreeWP(channel.w, r + x, onerow, x, y,
-                                           predictor, &wp_state)
-                               .guess +
-                           offset;
+          size_t offset = 0;
+          pixel_type_w left = (x ? r[x - 1] : y ? *(r + x - onerow) : 0);
+          pixel_type_w top = (y ? *(r + x - onerow) : left);
+          pixel_type_w topleft = (x && y ? *(r + x - 1 - onerow) : left);
+          pixel_type_w topright =
+              (x + 1 < channel.w && y ? *(r + x + 1 - onerow) : top);
+          pixel_type_w toptop = (y > 1 ? *(r + x - onerow - onerow) : top);
+          int32_t guess = wp_state->Predict</*compute_properties=*/true>(
+              x, y, channel.w, top, left, topright, topleft, toptop,
+              &properties, offset);
+          uint32_t pos = kPropRangeFast + std::min(std::max(-kPropRangeFast,
+                                                            properties[0]),
+                                                   kPropRangeFast - 1);
+          uint32_t ctx_id = lut.context[pos];
           uint64_t v = reader->ReadHybridUintClustered(ctx_id, br);
-          r[x] = SaturatingAdd<pixel_type>(UnpackSigned(v) * multiplier, g);
-          wp_state.UpdateErrors(r[x], x, y, channel.w);
+          r[x] = SaturatingAdd<pixel_type>(
+              UnpackSigned(v) * lut.multiplier[pos] + lut.offset[pos], guess);
+          wp_state->UpdateErrors(r[x], x, y, channel.w);
         }
       }
+      return true;
+    }
+    if (wp_state == nullptr) {
+      JXL_DEBUG_V(8, "Single property track.");
+      switch (lut.property) {
+#define JXL_SINGLE_PROPERTY_CASE(P)                                 \
+  case P:                                                           \
+    DecodeSinglePropertyRows<P>(br, reader, lut, y0, y1, &channel); \
+    return true;
+        JXL_SINGLE_PROPERTY_CASE(3)
+        JXL_SINGLE_PROPERTY_CASE(4)
+        JXL_SINGLE_PROPERTY_CASE(5)
+        JXL_SINGLE_PROPERTY_CASE(6)
+        JXL_SINGLE_PROPERTY_CASE(7)
+        JXL_SINGLE_PROPERTY_CASE(9)
+        JXL_SINGLE_PROPERTY_CASE(10)
+        JXL_SINGLE_PROPERTY_CASE(11)
+        JXL_SINGLE_PROPERTY_CASE(12)
+        JXL_SINGLE_PROPERTY_CASE(13)
+        JXL_SINGLE_PROPERTY_CASE(14)
+#undef JXL_SINGLE_PROPERTY_CASE
+        default:
+          // Properties that depend on previous pixels or on other channels.
+          break;
+      }
     }
-  } else if (!tree_has_wp_prop_or_pred) {
+  }
+
+  MATreeLookup tree_lookup(tree);
+  Properties properties = Properties(num_props);
+  Channel references(properties.size() - kNumNonrefProperties, channel.w);
+  if (wp_state == nullptr) {
     // special optimized case: the weighted predictor and its properties are not
     // used, so no need to compute weights and properties.
     JXL_DEBUG_V(8, "Slow track.");
-    MATreeLookup tree_lookup(tree);
-    Properties properties = Properties(num_props);
-    const intptr_t onerow = channel.plane.PixelsPerRow();
-    Channel references(properties.size() - kNumNonrefProperties, channel.w);
-    for (size_t y = 0; y < channel.h; y++) {
+    for (size_t y = y0; y < y1; y++) {
       pixel_type *JXL_RESTRICT p = channel.Row(y);
       PrecomputeReferences(channel, y, *image, chan, &references);
       InitPropsRow(&properties, static_props, y);
@@ -584,29 +729,106 @@ Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
     }
   } else {
     JXL_DEBUG_V(8, "Slowest track.");
-    MATreeLookup tree_lookup(tree);
-    Properties properties = Properties(num_props);
-    const intptr_t onerow = channel.plane.PixelsPerRow();
-    Channel references(properties.size() - kNumNonrefProperties, channel.w);
-    weighted::State wp_state(wp_header, channel.w, channel.h);
-    for (size_t y = 0; y < channel.h; y++) {
+    for (size_t y = y0; y < y1; y++) {
       pixel_type *JXL_RESTRICT p = channel.Row(y);
       InitPropsRow(&properties, static_props, y);
       PrecomputeReferences(channel, y, *image, chan, &references);
       for (size_t x = 0; x < channel.w; x++) {
         PredictionResult res =
             PredictTreeWP(&properties, channel.w, p + x, onerow, x, y,
-                          tree_lookup, references, &wp_state);
+                          tree_lookup, references, wp_state);
         uint64_t v = reader->ReadHybridUintClustered(res.context, br);
         p[x] = SaturatingAdd<pixel_type>(UnpackSigned(v) * res.multiplier,
                                          res.guess);
-        wp_state.UpdateErrors(p[x], x, y, channel.w);
+        wp_state->UpdateErrors(p[x], x, y, channel.w);
       }
     }
   }
   return true;
 }
 
+}  // namespace
+
+Status DecodeModularChannelMAANS(BitReader *br, ANSSymbolReader *reader,
+                                 const std::vector<uint8_t> &context_map,
+                                 const Tree &global_tree,
+                                 const weighted::Header &wp_header,
+                                 pixel_type chan, size_t group_id,
+                                 Image *image) {
+  Channel &channel = image->channel[chan];
+
+  std::array<pixel_type, kNumStaticProperties> static_props = {chan,
+                                                               (int)group_id};
+
+  // zero pixel channel? could happen
+  if (channel.w == 0 || channel.h == 0) return true;
+
+  channel.resize(channel.w, channel.h);
+  bool tree_has_wp_prop_or_pred = false;
+  bool is_wp_only = false;
+  size_t num_props;
+  FlatTree tree = FilterTree(global_tree, static_props, &num_props,
+                             &tree_has_wp_prop_or_pred, &is_wp_only);
+
+  // From here on, tree lookup returns a *clustered* context ID.
+  // This avoids an extra memory lookup after tree traversal.
+  const auto cluster_contexts = [&context_map](FlatTree *flat_tree) {
+    for (size_t i = 0; i < flat_tree->size(); i++) {
+      if ((*flat_tree)[i].property0 == -1) {
+        (*flat_tree)[i].childID = context_map[(*flat_tree)[i].childID];
+      }
+    }
+  };
+  cluster_contexts(&tree);
+
+  JXL_DEBUG_V(3, "Decoded MA tree with %zu nodes", tree.size());
+
+  // MAANS decode
+
+  // The weighted predictor state has to be updated for every pixel of the
+  // channel as soon as any part of the tree uses it.
+  weighted::State wp_state(wp_header,
+                           tree_has_wp_prop_or_pred ? channel.w : 0,
+                           tree_has_wp_prop_or_pred ? channel.h : 0);
+  weighted::State *wp_state_ptr =
+      tree_has_wp_prop_or_pred ? &wp_state : nullptr;
+
+  // If the tree tests the row, split the channel in bands of rows that take
+  // the same side of every row split and specialize the tree for each of
+  // them. This usually leaves much smaller trees, often trees that can be
+  // compiled to a table or even a single leaf.
+  std::vector<size_t> band_starts(1, 0);
+  for (int32_t split : RowSplits(global_tree, static_props)) {
+    if (split >= 0 && static_cast<size_t>(split) + 1 < channel.h) {
+      band_starts.push_back(split + 1);
+    }
+  }
+  // Only worth it if filtering the tree is cheap compared to decoding.
+  if (band_starts.size() > kMaxRowBands ||
+      band_starts.size() * tree.size() > channel.w * channel.h) {
+    band_starts.resize(1);
+  }
+  if (band_starts.size() == 1) {
+    return DecodeRows(br, reader, tree, num_props, is_wp_only, static_props,
+                      chan, 0, channel.h, image, wp_state_ptr);
+  }
+  band_starts.push_back(channel.h);
+  for (size_t i = 0; i + 1 < band_starts.size(); i++) {
+    bool band_has_wp;
+    bool band_is_wp_only;
+    size_t band_num_props;
+    FlatTree band_tree =
+        FilterTree(global_tree, static_props, &band_num_props, &band_has_wp,
+                   &band_is_wp_only, band_starts[i]);
+    cluster_contexts(&band_tree);
+    JXL_RETURN_IF_ERROR(DecodeRows(br, reader, band_tree, band_num_props,
+                                   band_is_wp_only, static_props, chan,
+                                   band_starts[i], band_starts[i + 1], image,
+                                   wp_state_ptr));
+  }
+  return true;
+}
+
 void GatherTreeData(const Image &image, pixel_type chan, size_t group_id,
                     const weighted::Header &wp_header,
                     const ModularOptions &options, TreeSamples &tree_samples,
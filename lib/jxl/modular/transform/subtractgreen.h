@@ -15,9 +15,11 @@
 #ifndef LIB_JXL_MODULAR_TRANSFORM_SUBTRACTGREEN_H_
 #define LIB_JXL_MODULAR_TRANSFORM_SUBTRACTGREEN_H_
 
+#include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/base/status.h"
 #include "lib/jxl/common.h"
 #include "lib/jxl/modular/modular_image.h"
+#include "lib/jxl/modular/transform/transform.h"
 
 namespace jxl {
 
@@ -58,7 +60,29 @@ void InvSubtractGreenRow(const pixel_type* in0, const pixel_type* in1,
   }
 }
 
-Status InvSubtractGreen(Image& input, size_t begin_c, size_t rct_type) {
+void InvRCTRow(uint32_t rct_type, const pixel_type* in0, const pixel_type* in1,
+               const pixel_type* in2, pixel_type* const out[3], size_t w) {
+  // Permutation: 0=RGB, 1=GBR, 2=BRG, 3=RBG, 4=GRB, 5=BGR
+  int permutation = rct_type / 7;
+  // 0-5 values have the low bit corresponding to Third and the high bits
+  // corresponding to Second. 6 corresponds to YCoCg.
+  //
+  // Second: 0=nop, 1=SubtractFirst, 2=SubtractAvgFirstThird
+  //
+  // Third: 0=nop, 1=SubtractFirst
+  int custom = rct_type % 7;
+  constexpr decltype(&InvSubtractGreenRow<0>) inv_subtract_green_row[] = {
+      InvSubtractGreenRow<0>, InvSubtractGreenRow<1>, InvSubtractGreenRow<2>,
+      InvSubtractGreenRow<3>, InvSubtractGreenRow<4>, InvSubtractGreenRow<5>,
+      InvSubtractGreenRow<6>};
+  inv_subtract_green_row[custom](
+      in0, in1, in2, out[permutation % 3],
+      out[(permutation + 1 + permutation / 3) % 3],
+      out[(permutation + 2 - permutation / 3) % 3], w);
+}
+
+Status InvSubtractGreen(Image& input, size_t begin_c, size_t rct_type,
+                        ThreadPool* pool) {
   size_t m = begin_c;
   if (input.nb_channels + input.nb_meta_channels < begin_c + 3) {
     return JXL_FAILURE(
@@ -82,12 +106,6 @@ Status InvSubtractGreen(Image& input, size_t begin_c, size_t rct_type) {
   // Permutation: 0=RGB, 1=GBR, 2=BRG, 3=RBG, 4=GRB, 5=BGR
   int permutation = rct_type / 7;
   JXL_CHECK(permutation < 6);
-  // 0-5 values have the low bit corresponding to Third and the high bits
-  // corresponding to Second. 6 corresponds to YCoCg.
-  //
-  // Second: 0=nop, 1=SubtractFirst, 2=SubtractAvgFirstThird
-  //
-  // Third: 0=nop, 1=SubtractFirst
   int custom = rct_type % 7;
   // Special case: permute-only. Swap channels around.
   if (custom == 0) {
@@ -101,21 +119,16 @@ Status InvSubtractGreen(Image& input, size_t begin_c, size_t rct_type) {
         std::move(ch2);
     return true;
   }
-  constexpr decltype(&InvSubtractGreenRow<0>) inv_subtract_green_row[] = {
-      InvSubtractGreenRow<0>, InvSubtractGreenRow<1>, InvSubtractGreenRow<2>,
-      InvSubtractGreenRow<3>, InvSubtractGreenRow<4>, InvSubtractGreenRow<5>,
-      InvSubtractGreenRow<6>};
-  for (size_t y = 0; y < h; y++) {
-    const pixel_type* in0 = input.channel[m].Row(y);
-    const pixel_type* in1 = input.channel[m + 1].Row(y);
-    const pixel_type* in2 = input.channel[m + 2].Row(y);
-    pixel_type* out0 = input.channel[m + (permutation % 3)].Row(y);
-    pixel_type* out1 =
-        input.channel[m + ((permutation + 1 + permutation / 3) % 3)].Row(y);
-    pixel_type* out2 =
-        input.channel[m + ((permutation + 2 - permutation / 3) % 3)].Row(y);
-    inv_subtract_green_row[custom](in0, in1, in2, out0, out1, out2, w);
-  }
+  RunOnPool(
+      pool, 0, h, ThreadPool::SkipInit(),
+      [&](const int task, const int thread) {
+        const size_t y = task;
+        pixel_type* const rows[3] = {input.channel[m].Row(y),
+                                     input.channel[m + 1].Row(y),
+                                     input.channel[m + 2].Row(y)};
+        InvRCTRow(rct_type, rows[0], rows[1], rows[2], rows, w);
+      },
+      "InvRCT");
   return true;
 }
 
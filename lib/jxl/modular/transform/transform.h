@@ -157,6 +157,12 @@ class Transform : public Fields {
   Status MetaApply(Image &input);
 };
 
+// Undoes an RCT of type `rct_type` on one row of the three channels it was
+// applied to. out[i] receives the i-th channel after the inverse transform and
+// may alias any of the inputs.
+void InvRCTRow(uint32_t rct_type, const pixel_type *in0, const pixel_type *in1,
+               const pixel_type *in2, pixel_type *const out[3], size_t w);
+
 }  // namespace jxl
 
 #endif  // LIB_JXL_MODULAR_TRANSFORM_TRANSFORM_H_
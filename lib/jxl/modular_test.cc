@@ -15,6 +15,7 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <algorithm>
 #include <array>
 #include <random>
 #include <string>
@@ -26,6 +27,7 @@
 #include "lib/jxl/aux_out.h"
 #include "lib/jxl/base/compiler_specific.h"
 #include "lib/jxl/base/data_parallel.h"
+#include "lib/jxl/base/os_specific.h"
 #include "lib/jxl/base/override.h"
 #include "lib/jxl/base/padded_bytes.h"
 #include "lib/jxl/base/thread_pool_internal.h"
@@ -84,6 +86,29 @@ TEST(ModularTest, JXL_TSAN_SLOW_TEST(RoundtripLosslessGroups1024)) {
   TestLosslessGroups(3);
 }
 
+TEST(ModularTest, RoundtripLosslessRCTs) {
+  ThreadPoolInternal pool(4);
+  const PaddedBytes orig =
+      ReadTestData("imagecompression.info/flower_foveon.png");
+  CodecInOut io;
+  ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io, &pool));
+  io.ShrinkTo(io.xsize() / 8, io.ysize() / 8);
+  // Identity, YCoCg, a permutation only, and permutations with a transform.
+  for (int rct_type : {0, 6, 7, 13, 23, 41}) {
+    CompressParams cparams;
+    cparams.modular_mode = true;
+    cparams.color_transform = jxl::ColorTransform::kNone;
+    cparams.colorspace = rct_type + 2;
+    DecompressParams dparams;
+    CodecInOut io_out;
+    Roundtrip(&io, cparams, dparams, &pool, &io_out);
+    EXPECT_LE(ButteraugliDistance(io, io_out, cparams.ba_params,
+                                  /*distmap=*/nullptr, &pool),
+              0.0)
+        << "rct_type = " << rct_type;
+  }
+}
+
 TEST(ModularTest, RoundtripLossy) {
   ThreadPool* pool = nullptr;
   const PaddedBytes orig =
@@ -175,5 +200,101 @@ TEST(ModularTest, RoundtripExtraProperties) {
   }
 }
 
+void TestTreeRoundtrip(const std::vector<uint32_t>& properties,
+                       Predictor predictor) {
+  constexpr size_t kSize = 200;
+  Image image(kSize, kSize, /*maxval=*/255, 3);
+  ModularOptions options;
+  options.splitting_heuristics_properties = properties;
+  options.predictor = predictor;
+  options.nb_repeats = 1;
+  std::mt19937 rng(0);
+  std::uniform_int_distribution<> dist(0, 8);
+  for (size_t c = 0; c < image.channel.size(); c++) {
+    for (size_t y = 0; y < kSize; y++) {
+      pixel_type* JXL_RESTRICT row = image.channel[c].plane.Row(y);
+      for (size_t x = 0; x < kSize; x++) {
+        // Smooth noisy content on top, flat areas with sharp edges below, so
+        // that trees split on the row.
+        row[x] = y < kSize / 2 ? (x + y + c * 17) / 2 + dist(rng)
+                               : ((x / 16 + y / 16) % 3) * 80 + c;
+      }
+    }
+  }
+  BitWriter writer;
+  ASSERT_TRUE(ModularGenericCompress(image, options, &writer));
+  writer.ZeroPadToByte();
+  Image decoded(kSize, kSize, /*maxval=*/255, image.channel.size());
+  for (size_t i = 0; i < image.channel.size(); i++) {
+    const Channel& ch = image.channel[i];
+    decoded.channel[i] = Channel(ch.w, ch.h, ch.hshift, ch.vshift);
+  }
+  Status status = true;
+  {
+    BitReader reader(writer.GetSpan());
+    BitReaderScopedCloser closer(&reader, &status);
+    ASSERT_TRUE(ModularGenericDecompress(&reader, decoded, /*header=*/nullptr,
+                                         /*group_id=*/0, &options));
+  }
+  ASSERT_TRUE(status);
+  for (size_t c = 0; c < image.channel.size(); c++) {
+    VerifyEqual(image.channel[c].plane, decoded.channel[c].plane);
+  }
+}
+
+// Trees on a single neighbor property are decoded from a table.
+TEST(ModularTest, RoundtripSinglePropertyTree) {
+  TestTreeRoundtrip({9}, Predictor::Gradient);
+  TestTreeRoundtrip({6}, Predictor::Select);
+  TestTreeRoundtrip({12}, Predictor::Best);
+  TestTreeRoundtrip({15}, Predictor::Weighted);
+}
+
+// Trees that test the row are specialized for bands of rows.
+TEST(ModularTest, RoundtripRowSplitTree) {
+  TestTreeRoundtrip({2, 9}, Predictor::Gradient);
+  TestTreeRoundtrip({2, 15}, Predictor::Weighted);
+  TestTreeRoundtrip({2, 3, 6, 7}, Predictor::Best);
+  TestTreeRoundtrip({0, 1, 2, 15, 9, 10, 11, 12, 13}, Predictor::Variable);
+}
+
+TEST(ModularTest, DISABLED_LosslessDecodeBenchmark) {
+  // Photos and synthetic, screenshot-like content.
+  const char* kFiles[] = {
+      "imagecompression.info/flower_foveon.png",
+      "wesaturate/500px/u76c0g_bliznaca_srgb8.png",
+      "jxl/grayscale_patches.png",
+      "jxl/splines.png",
+  };
+  const SpeedTier kSpeedTiers[] = {SpeedTier::kFalcon, SpeedTier::kSquirrel,
+                                   SpeedTier::kKitten};
+  constexpr size_t kReps = 5;
+  for (const char* file : kFiles) {
+    const PaddedBytes orig = ReadTestData(file);
+    CodecInOut io;
+    ASSERT_TRUE(SetFromBytes(Span<const uint8_t>(orig), &io));
+    for (SpeedTier speed_tier : kSpeedTiers) {
+      CompressParams cparams;
+      cparams.modular_mode = true;
+      cparams.color_transform = ColorTransform::kNone;
+      cparams.speed_tier = speed_tier;
+      PaddedBytes compressed;
+      PassesEncoderState enc_state;
+      ASSERT_TRUE(EncodeFile(cparams, &io, &enc_state, &compressed));
+      DecompressParams dparams;
+      double best = 1e9;
+      for (size_t i = 0; i < kReps; i++) {
+        CodecInOut io_out;
+        const double t0 = Now();
+        ASSERT_TRUE(DecodeFile(dparams, compressed, &io_out));
+        best = std::min(best, Now() - t0);
+      }
+      printf("%-45s %-8s %8zu bytes %7.2f MP/s\n", file,
+             SpeedTierName(speed_tier), compressed.size(),
+             io.xsize() * io.ysize() * 1e-6 / best);
+    }
+  }
+}
+
 }  // namespace
 }  // namespace jxl
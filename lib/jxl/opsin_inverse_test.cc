@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <vector>
+
 #include "gtest/gtest.h"
 #include "lib/jxl/base/data_parallel.h"
 #include "lib/jxl/codec_in_out.h"
@@ -61,5 +64,59 @@ TEST(OpsinInverseTest, YcbCrInverts) {
   VerifyRelativeError(rgb, rgb2, 4E-5, 4E-7);
 }
 
+TEST(OpsinInverseTest, UpsampleHV2MatchesH2ThenV2) {
+  constexpr size_t kPadding = 8;
+  for (size_t ysize : {1, 2, 77, 300}) {
+    ImageF plane(123 + 2 * kPadding, ysize);
+    RandomFillImage(&plane, 1.0f);
+    plane.InitializePaddingForUnalignedAccesses();
+    ImageF h2 = UpsampleH2(plane, kPadding, /*pool=*/nullptr);
+    h2.InitializePaddingForUnalignedAccesses();
+    ImageF expected = UpsampleV2(h2, /*pool=*/nullptr);
+    ImageF actual = UpsampleHV2(plane, kPadding, /*pool=*/nullptr);
+    ASSERT_TRUE(SameSize(expected, actual));
+    for (size_t y = 0; y < actual.ysize(); y++) {
+      for (size_t x = kPadding; x < actual.xsize() - kPadding; x++) {
+        ASSERT_EQ(expected.Row(y)[x], actual.Row(y)[x])
+            << "x: " << x << " y: " << y << " ysize: " << ysize;
+      }
+    }
+  }
+}
+
+TEST(OpsinInverseTest, UpsampleRowMatchesUpsampleH2V2) {
+  constexpr size_t kPadding = 8;
+  for (size_t ysize : {1, 2, 77}) {
+    for (size_t hshift = 0; hshift < 2; hshift++) {
+      for (size_t vshift = 0; vshift < 2; vshift++) {
+        ImageF plane(123 + 2 * kPadding, ysize);
+        RandomFillImage(&plane, 1.0f);
+        plane.InitializePaddingForUnalignedAccesses();
+        ImageF expected = CopyImage(plane);
+        if (hshift != 0) {
+          expected = UpsampleH2(expected, kPadding, /*pool=*/nullptr);
+          expected.InitializePaddingForUnalignedAccesses();
+        }
+        if (vshift != 0) expected = UpsampleV2(expected, /*pool=*/nullptr);
+        const size_t xsize = expected.xsize() - 2 * kPadding;
+        std::vector<float> row(xsize);
+        for (size_t y = 0; y < expected.ysize(); y++) {
+          // Rows are computed in parts, as for the rects of a frame.
+          for (size_t x0 = 0; x0 < xsize; x0 += 64) {
+            const size_t num = std::min<size_t>(64, xsize - x0);
+            UpsampleRow(plane, kPadding, 123, ysize, hshift, vshift, x0, y,
+                        num, row.data() + x0);
+          }
+          for (size_t x = 0; x < xsize; x++) {
+            ASSERT_NEAR(expected.Row(y)[x + kPadding], row[x], 1e-6f)
+                << "x: " << x << " y: " << y << " ysize: " << ysize
+                << " hshift: " << hshift << " vshift: " << vshift;
+          }
+        }
+      }
+    }
+  }
+}
+
 }  // namespace
 }  // namespace jxl
@@ -14,11 +14,109 @@
 
 #include "lib/jxl/passes_state.h"
 
+#include <cmath>
+#include <utility>
+
 #include "lib/jxl/chroma_from_luma.h"
 #include "lib/jxl/common.h"
 
 namespace jxl {
 
+namespace {
+
+// Stores the samples of `in` as the integers that they are multiples of
+// 1 / maxval of, computing the multiples the way modular decoding does, or
+// returns false if some sample is not such a multiple in the range.
+bool CompactPlane(const ImageF& in, const BitDepth& bit_depth, ImageU* out,
+                  float* scale) {
+  if (bit_depth.floating_point_sample || bit_depth.bits_per_sample > 16) {
+    return false;
+  }
+  const float maxval = (1u << bit_depth.bits_per_sample) - 1;
+  const float mul = 1.0f / maxval;
+  const auto to_int = [maxval, mul](float v, uint16_t* JXL_RESTRICT i) {
+    const float rounded = std::round(v * maxval);
+    if (!(rounded >= 0.0f && rounded <= maxval)) return false;
+    *i = static_cast<uint16_t>(rounded);
+    return *i * mul == v;
+  };
+  // Lossy frames are usually rejected by their first sample; avoid allocating
+  // the plane for them.
+  uint16_t unused;
+  if (!to_int(in.ConstRow(0)[0], &unused)) return false;
+  ImageU plane(in.xsize(), in.ysize());
+  for (size_t y = 0; y < in.ysize(); y++) {
+    const float* JXL_RESTRICT row_in = in.ConstRow(y);
+    uint16_t* JXL_RESTRICT row_out = plane.Row(y);
+    for (size_t x = 0; x < in.xsize(); x++) {
+      if (!to_int(row_in[x], &row_out[x])) return false;
+    }
+  }
+  *out = std::move(plane);
+  *scale = mul;
+  return true;
+}
+
+ImageF ExpandPlane(const ImageU& in, float scale) {
+  ImageF out(in.xsize(), in.ysize());
+  for (size_t y = 0; y < in.ysize(); y++) {
+    const uint16_t* JXL_RESTRICT row_in = in.ConstRow(y);
+    float* JXL_RESTRICT row_out = out.Row(y);
+    for (size_t x = 0; x < in.xsize(); x++) {
+      row_out[x] = row_in[x] * scale;
+    }
+  }
+  return out;
+}
+
+}  // namespace
+
+bool ReferenceFrame::SetCompact(const ImageBundle& ib) {
+  if (ib.IsJPEG() || !ib.HasColor()) return false;
+  const ImageMetadata* metadata = ib.metadata();
+  const size_t num_ec = ib.extra_channels().size();
+  std::vector<ImageU> planes(3 + num_ec);
+  std::vector<float> scales(3 + num_ec);
+  for (size_t c = 0; c < 3; c++) {
+    if (!CompactPlane(ib.color().Plane(c), metadata->bit_depth, &planes[c],
+                      &scales[c])) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < num_ec; i++) {
+    if (!CompactPlane(ib.extra_channels()[i],
+                      metadata->extra_channel_info[i].bit_depth,
+                      &planes[3 + i], &scales[3 + i])) {
+      return false;
+    }
+  }
+  storage = ImageBundle(metadata);
+  storage.OverrideProfile(ib.c_current());
+  storage.origin = ib.origin;
+  frame = &storage;
+  compact = std::move(planes);
+  compact_scale = std::move(scales);
+  return true;
+}
+
+ImageBundle ReferenceFrame::Copy() const {
+  if (!IsCompact()) return frame->Copy();
+  ImageBundle copy(storage.metadata());
+  Image3F color(ExpandPlane(compact[0], compact_scale[0]),
+                ExpandPlane(compact[1], compact_scale[1]),
+                ExpandPlane(compact[2], compact_scale[2]));
+  copy.SetFromImage(std::move(color), storage.c_current());
+  if (compact.size() > 3) {
+    std::vector<ImageF> extra_channels;
+    for (size_t i = 3; i < compact.size(); i++) {
+      extra_channels.push_back(ExpandPlane(compact[i], compact_scale[i]));
+    }
+    copy.SetExtraChannels(std::move(extra_channels));
+  }
+  copy.origin = storage.origin;
+  return copy;
+}
+
 Status InitializePassesSharedState(const FrameHeader& frame_header,
                                    PassesSharedState* JXL_RESTRICT shared,
                                    bool encoder) {
@@ -30,12 +128,21 @@ Status InitializePassesSharedState(const FrameHeader& frame_header,
 
   const FrameDimensions& frame_dim = shared->frame_dim;
 
-  shared->ac_strategy =
-      AcStrategyImage(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
-  shared->raw_quant_field =
-      ImageI(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
-  shared->epf_sharpness =
-      ImageB(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+  // The per-block images are kept if they already have the right size, as is
+  // the case for the frames of an animation, or when the decoder reuses its
+  // state for a sequence of images of the same size.
+  if (shared->ac_strategy.xsize() != frame_dim.xsize_blocks ||
+      shared->ac_strategy.ysize() != frame_dim.ysize_blocks) {
+    shared->ac_strategy =
+        AcStrategyImage(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+    shared->raw_quant_field =
+        ImageI(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+    shared->epf_sharpness =
+        ImageB(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+    shared->quant_dc = ImageB(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+    shared->dc_storage =
+        Image3F(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+  }
   shared->cmap = ColorCorrelationMap(frame_dim.xsize, frame_dim.ysize);
 
   shared->opsin_params =
@@ -49,10 +156,8 @@ Status InitializePassesSharedState(const FrameHeader& frame_header,
                                 kCoeffOrderSize);
   }
 
-  shared->quant_dc = ImageB(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
   if (!(frame_header.flags & FrameHeader::kUseDcFrame) || encoder) {
-    shared->dc_storage =
-        Image3F(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
+    shared->dc = &shared->dc_storage;
   } else {
     if (frame_header.dc_level == 4) {
       return JXL_FAILURE("Invalid DC level for kUseDcFrame: %u",
@@ -68,8 +173,6 @@ Status InitializePassesSharedState(const FrameHeader& frame_header,
     ZeroFillImage(&shared->quant_dc);
   }
 
-  shared->dc_storage = Image3F(frame_dim.xsize_blocks, frame_dim.ysize_blocks);
-
   return true;
 }
 
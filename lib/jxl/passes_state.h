@@ -15,6 +15,11 @@
 #ifndef LIB_JXL_PASSES_STATE_H_
 #define LIB_JXL_PASSES_STATE_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
 #include "lib/jxl/ac_context.h"
 #include "lib/jxl/ac_strategy.h"
 #include "lib/jxl/chroma_from_luma.h"
@@ -35,6 +40,62 @@
 
 namespace jxl {
 
+// A frame saved for later frames to reference, in patches and blending.
+struct ReferenceFrame {
+  ImageBundle storage;
+  // Can either point to `storage`, if this is a frame that is not stored in
+  // the CodecInOut, or can point to an existing ImageBundle.
+  // TODO(veluca): pointing to ImageBundles in CodecInOut is not possible for
+  // now, as they are stored in a vector and thus may be moved. Fix this.
+  ImageBundle* JXL_RESTRICT frame = &storage;
+  // ImageBundle doesn't yet have a simple way to state it is in XYB.
+  bool ib_is_in_xyb = true;
+  // If not empty, the samples of the frame are kept here instead of in
+  // `storage`, which then only holds its metadata. Sample i of plane c stands
+  // for i * compact_scale[c]; the color planes come first, then the extra
+  // channels.
+  std::vector<ImageU> compact;
+  std::vector<float> compact_scale;
+
+  bool IsCompact() const { return !compact.empty(); }
+  size_t xsize() const {
+    return IsCompact() ? compact[0].xsize() : frame->xsize();
+  }
+  size_t ysize() const {
+    return IsCompact() ? compact[0].ysize() : frame->ysize();
+  }
+
+  // Saves `ib` in compact form if all of its samples are integers divided by
+  // the maximum value of the image bit depth, as those of lossless frames are,
+  // at half the memory of floats. Returns false, leaving the frame as is,
+  // otherwise.
+  bool SetCompact(const ImageBundle& ib);
+
+  // Returns a copy of the frame, expanded to floats if it is compact.
+  ImageBundle Copy() const;
+
+  // Returns `xsize` samples of color plane `c` starting at `x0` in row `y`,
+  // expanded into `buffer` if the frame is compact.
+  const float* ConstRow(size_t c, size_t x0, size_t y, size_t xsize,
+                        float* JXL_RESTRICT buffer) const {
+    if (!IsCompact()) return frame->color()->ConstPlaneRow(c, y) + x0;
+    const uint16_t* JXL_RESTRICT row = compact[c].ConstRow(y) + x0;
+    const float scale = compact_scale[c];
+    for (size_t x = 0; x < xsize; x++) {
+      buffer[x] = row[x] * scale;
+    }
+    return buffer;
+  }
+
+  void Reset() {
+    storage = ImageBundle();
+    frame = &storage;
+    ib_is_in_xyb = true;
+    compact.clear();
+    compact_scale.clear();
+  }
+};
+
 struct ImageFeatures {
   NoiseParams noise_params;
   PatchDictionary patches;
@@ -81,16 +142,7 @@ struct PassesSharedState {
 
   Image3F dc_frames[4];
 
-  struct {
-    ImageBundle storage;
-    // Can either point to `storage`, if this is a frame that is not stored in
-    // the CodecInOut, or can point to an existing ImageBundle.
-    // TODO(veluca): pointing to ImageBundles in CodecInOut is not possible for
-    // now, as they are stored in a vector and thus may be moved. Fix this.
-    ImageBundle* JXL_RESTRICT frame = &storage;
-    // ImageBundle doesn't yet have a simple way to state it is in XYB.
-    bool ib_is_in_xyb = true;
-  } reference_frames[4] = {};
+  ReferenceFrame reference_frames[4] = {};
 
   // Number of pre-clustered set of histograms (with the same ctx map), per
   // pass. Encoded as num_histograms_ - 1.
@@ -151,10 +151,10 @@ Status PatchDictionary::Decode(BitReader* br, size_t xsize, size_t ysize) {
     PatchReferencePosition ref_pos;
     ref_pos.ref = read_num(kReferenceFrameContext);
     if (ref_pos.ref >= kMaxNumReferenceFrames ||
-        shared_->reference_frames[ref_pos.ref].frame->xsize() == 0) {
+        shared_->reference_frames[ref_pos.ref].xsize() == 0) {
       return JXL_FAILURE("Invalid reference frame ID");
     }
-    const ImageBundle& ib = *shared_->reference_frames[ref_pos.ref].frame;
+    const ReferenceFrame& ib = shared_->reference_frames[ref_pos.ref];
     ref_pos.x0 = read_num(kPatchReferencePositionContext);
     ref_pos.y0 = read_num(kPatchReferencePositionContext);
     ref_pos.xsize = read_num(kPatchSizeContext) + 1;
@@ -268,6 +268,8 @@ void PatchDictionary::Apply(Image3F* opsin, const Rect& opsin_rect,
                             const Rect& image_rect) const {
   JXL_CHECK(SameSize(opsin_rect, image_rect));
   size_t num = 0;
+  // Patch rows expanded from compact reference frames.
+  std::vector<float> ref_buffer;
   for (size_t y = image_rect.y0(); y < image_rect.y0() + image_rect.ysize();
        y++) {
     if (y + 1 >= patch_starts_.size()) continue;
@@ -289,17 +291,14 @@ void PatchDictionary::Apply(Image3F* opsin, const Rect& opsin_rect,
       if (bx >= image_rect.x0() + image_rect.xsize()) continue;
       if (bx + xsize < image_rect.x0()) continue;
       // TODO(veluca): check that the reference frame is in XYB.
-      const float* JXL_RESTRICT ref_rows[3] = {
-          shared_->reference_frames[ref].frame->color()->ConstPlaneRow(
-              0, pos.ref_pos.y0 + iy) +
-              pos.ref_pos.x0,
-          shared_->reference_frames[ref].frame->color()->ConstPlaneRow(
-              1, pos.ref_pos.y0 + iy) +
-              pos.ref_pos.x0,
-          shared_->reference_frames[ref].frame->color()->ConstPlaneRow(
-              2, pos.ref_pos.y0 + iy) +
-              pos.ref_pos.x0,
-      };
+      const ReferenceFrame& ref_frame = shared_->reference_frames[ref];
+      ref_buffer.resize(3 * xsize);
+      const float* JXL_RESTRICT ref_rows[3];
+      for (size_t c = 0; c < 3; c++) {
+        ref_rows[c] =
+            ref_frame.ConstRow(c, pos.ref_pos.x0, pos.ref_pos.y0 + iy, xsize,
+                               ref_buffer.data() + c * xsize);
+      }
       // TODO(veluca): use the same code as in dec_reconstruct.cc.
       for (size_t ix = 0; ix < xsize; ix++) {
         // TODO(veluca): hoist branches and checks.
@@ -999,6 +998,7 @@ void FindBestPatchDictionary(const Image3F& opsin,
     state->shared.reference_frames[0] =
         std::move(dec_state.shared_storage.reference_frames[0]);
   } else {
+    state->shared.reference_frames[0].Reset();
     state->shared.reference_frames[0].storage = std::move(ib);
   }
   state->shared.reference_frames[0].frame =
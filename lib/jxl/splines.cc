@@ -15,6 +15,7 @@
 #include "lib/jxl/splines.h"
 
 #include <algorithm>
+#include <limits>
 
 #include "lib/jxl/ans_params.h"
 #include "lib/jxl/base/status.h"
@@ -63,113 +64,102 @@ float ContinuousIDCT(const float dct[32], float t) {
   return GetLane(SumOfLanes(result));
 }
 
-// Splats a single Gaussian on the image.
-void DrawGaussian(Image3F* const opsin, const Rect& opsin_rect,
-                  const Rect& image_rect, const Spline::Point& center,
-                  const float intensity, const float color[3],
-                  const float sigma, std::vector<int32_t>& xs,
-                  std::vector<int32_t>& ys,
-                  std::vector<float>& local_intensity_storage) {
-  constexpr float kDistanceMultiplier = 4.605170185988091f;  // -2 * log(0.1)
-  // Distance beyond which exp(-d^2 / (2 * sigma^2)) drops below 0.1.
-  const float maximum_distance = sigma * sigma * kDistanceMultiplier;
-  const auto xbegin_s =
-      std::max<ssize_t>(image_rect.x0(), center.x - maximum_distance + .5f);
-  const auto xend_s =
-      std::min<ssize_t>(center.x + maximum_distance + .5f,
-                        image_rect.x0() + image_rect.xsize() - 1);
-  const auto ybegin_s =
-      std::max<ssize_t>(image_rect.y0(), center.y - maximum_distance + .5f);
-  const auto yend_s =
-      std::min<ssize_t>(center.y + maximum_distance + .5f,
-                        image_rect.y0() + image_rect.ysize() - 1);
-  if ((xend_s) <= 0 || (xend_s < xbegin_s)) return;
-  const size_t xbegin = xbegin_s;
-  const size_t xend = xend_s;
-  if ((yend_s <= 0) || (yend_s < ybegin_s)) return;
-  const size_t ybegin = ybegin_s;
-  const size_t yend = yend_s;
-  const size_t opsin_stride = opsin->PixelsPerRow();
-  float* JXL_RESTRICT rows[3] = {
-      opsin_rect.PlaneRow(opsin, 0, ybegin - image_rect.y0()),
-      opsin_rect.PlaneRow(opsin, 1, ybegin - image_rect.y0()),
-      opsin_rect.PlaneRow(opsin, 2, ybegin - image_rect.y0()),
-  };
-  const size_t nx = xend + 1 - xbegin;
-  const size_t ny = yend + 1 - ybegin;
-  HWY_FULL(float) df;
-  if (xs.size() < nx * ny) {
-    size_t sz = DivCeil(nx * ny, Lanes(df)) * Lanes(df);
-    xs.resize(sz);
-    ys.resize(sz);
-    local_intensity_storage.resize(sz);
-  }
-  for (size_t y = ybegin; y <= yend; ++y) {
-    for (size_t x = xbegin; x <= xend; ++x) {
-      xs[(y - ybegin) * nx + (x - xbegin)] = x;
-      ys[(y - ybegin) * nx + (x - xbegin)] = y;
-    }
-  }
-  Rebind<int32_t, decltype(df)> di;
-  const auto inv_sigma = Set(df, 1.0f / sigma);
-  const auto half = Set(df, 0.5f);
-  const auto one_over_2s2 = Set(df, 0.353553391f);
-  const auto sigma_over_4_times_intensity = Set(df, .25f * sigma * intensity);
-  for (size_t i = 0; i < nx * ny; i += Lanes(df)) {
-    const auto x = ConvertTo(df, LoadU(di, &xs[i]));
-    const auto y = ConvertTo(df, LoadU(di, &ys[i]));
-    const auto dx = x - Set(df, center.x);
-    const auto dy = y - Set(df, center.y);
-    const auto sqd = MulAdd(dx, dx, dy * dy);
-    const auto distance = Sqrt(sqd);
-    const auto one_dimensional_factor =
-        FastErff(df, MulAdd(distance, half, one_over_2s2) * inv_sigma) -
-        FastErff(df, MulSub(distance, half, one_over_2s2) * inv_sigma);
-    const auto local_intensity = sigma_over_4_times_intensity *
-                                 one_dimensional_factor *
-                                 one_dimensional_factor;
-    StoreU(local_intensity, df, &local_intensity_storage[i]);
-  }
-  ssize_t off = -static_cast<ssize_t>(image_rect.x0());
-  for (size_t y = ybegin; y <= yend; ++y) {
-    HWY_CAPPED(float, 1) df;
-    for (size_t x = xbegin; x <= xend; ++x) {
-      const auto local_intensity = Load(
-          df, local_intensity_storage.data() + (y - ybegin) * nx + x - xbegin);
-      for (size_t c = 0; c < 3; ++c) {
-        const auto cm = Set(df, color[c]);
-        const auto in = LoadU(df, rows[c] + x + off);
-        StoreU(MulAdd(cm, local_intensity, in), df, rows[c] + x + off);
-      }
-    }
-    off += opsin_stride;
-  }
-}
-
-void DrawFromPoints(
-    Image3F* const opsin, const Rect& opsin_rect, const Rect& image_rect,
-    const Spline& spline, bool add,
+// Computes the Gaussians that are splatted at `points_to_draw` to draw the
+// spline on an image of the given size, and appends those that touch the image
+// to `segments`.
+void ComputeSegments(
+    const Spline& spline,
     const std::vector<std::pair<Spline::Point, float>>& points_to_draw,
-    float arc_length) {
-  float inv_arc_length = 1.0f / arc_length;
+    float arc_length, size_t image_xsize, size_t image_ysize,
+    std::vector<SplineSegment>* segments) {
+  constexpr float kDistanceMultiplier = 4.605170185988091f;  // -2 * log(0.1)
+  const float inv_arc_length = 1.0f / arc_length;
   int k = 0;
-  std::vector<int32_t> xs, ys;
-  std::vector<float> local_intensity_storage;
   for (const auto& point_to_draw : points_to_draw) {
-    const Spline::Point& point = point_to_draw.first;
-    const float multiplier = add ? point_to_draw.second : -point_to_draw.second;
+    const Spline::Point& center = point_to_draw.first;
+    const float intensity = point_to_draw.second;
     const float progress_along_arc =
         std::min(1.f, (k * kDesiredRenderingDistance) * inv_arc_length);
     ++k;
-    float color[3];
+    SplineSegment segment;
     for (size_t c = 0; c < 3; ++c) {
-      color[c] =
+      segment.color[c] =
           ContinuousIDCT(spline.color_dct[c], (32 - 1) * progress_along_arc);
     }
     const float sigma =
         ContinuousIDCT(spline.sigma_dct, (32 - 1) * progress_along_arc);
-    DrawGaussian(opsin, opsin_rect, image_rect, point, multiplier, color, sigma,
-                 xs, ys, local_intensity_storage);
+    // Distance beyond which exp(-d^2 / (2 * sigma^2)) drops below 0.1.
+    const float maximum_distance = sigma * sigma * kDistanceMultiplier;
+    const auto xbegin_s =
+        std::max<ssize_t>(0, center.x - maximum_distance + .5f);
+    const auto xend_s = std::min<ssize_t>(center.x + maximum_distance + .5f,
+                                          image_xsize - 1);
+    const auto ybegin_s =
+        std::max<ssize_t>(0, center.y - maximum_distance + .5f);
+    const auto yend_s = std::min<ssize_t>(center.y + maximum_distance + .5f,
+                                          image_ysize - 1);
+    if ((xend_s) <= 0 || (xend_s < xbegin_s)) continue;
+    if ((yend_s <= 0) || (yend_s < ybegin_s)) continue;
+    segment.center = center;
+    segment.inv_sigma = 1.0f / sigma;
+    segment.sigma_over_4_times_intensity = .25f * sigma * intensity;
+    segment.xbegin = xbegin_s;
+    segment.xend = xend_s;
+    segment.ybegin = ybegin_s;
+    segment.yend = yend_s;
+    segments->push_back(segment);
+  }
+}
+
+// Splats the given Gaussians on the pixels [x0, x1) of row y of the image,
+// which are stored at `rows`, or subtracts them if `add` is false. Gaussians
+// that do not touch row y are skipped.
+void DrawSegments(float* JXL_RESTRICT row_x, float* JXL_RESTRICT row_y,
+                  float* JXL_RESTRICT row_b, const size_t y, const size_t x0,
+                  const size_t x1, const bool add,
+                  const SplineSegment* JXL_RESTRICT segments,
+                  const uint32_t* JXL_RESTRICT segment_indices,
+                  const size_t num_segments) {
+  float* JXL_RESTRICT rows[3] = {row_x, row_y, row_b};
+  const HWY_FULL(float) df;
+  const HWY_CAPPED(float, 1) d1;
+  const size_t N = Lanes(df);
+  const auto half = Set(df, 0.5f);
+  const auto one_over_2s2 = Set(df, 0.353553391f);
+  HWY_ALIGN float local_intensity_storage[MaxLanes(df)];
+  for (size_t i = 0; i < num_segments; ++i) {
+    const SplineSegment& segment = segments[segment_indices[i]];
+    if (y < segment.ybegin || y > segment.yend) continue;
+    const size_t xbegin = std::max(x0, segment.xbegin);
+    const size_t xend = std::min(x1 - 1, segment.xend);
+    if (xend < xbegin) continue;
+    const auto inv_sigma = Set(df, segment.inv_sigma);
+    const auto sigma_over_4_times_intensity =
+        Set(df, add ? segment.sigma_over_4_times_intensity
+                    : -segment.sigma_over_4_times_intensity);
+    const auto dy = Set(df, static_cast<float>(y)) - Set(df, segment.center.y);
+    for (size_t x = xbegin; x <= xend; x += N) {
+      const auto dx = Iota(df, x) - Set(df, segment.center.x);
+      const auto sqd = MulAdd(dx, dx, dy * dy);
+      const auto distance = Sqrt(sqd);
+      const auto one_dimensional_factor =
+          FastErff(df, MulAdd(distance, half, one_over_2s2) * inv_sigma) -
+          FastErff(df, MulSub(distance, half, one_over_2s2) * inv_sigma);
+      const auto local_intensity = sigma_over_4_times_intensity *
+                                   one_dimensional_factor *
+                                   one_dimensional_factor;
+      Store(local_intensity, df, local_intensity_storage);
+      const size_t num_pixels = std::min(N, xend + 1 - x);
+      for (size_t ix = 0; ix < num_pixels; ++ix) {
+        const auto pixel_intensity = Load(d1, local_intensity_storage + ix);
+        for (size_t c = 0; c < 3; ++c) {
+          float* JXL_RESTRICT pixel = rows[c] + (x + ix - x0);
+          const auto cm = Set(d1, segment.color[c]);
+          const auto in = LoadU(d1, pixel);
+          StoreU(MulAdd(cm, pixel_intensity, in), d1, pixel);
+        }
+      }
+    }
   }
 }
 }  // namespace
@@ -180,7 +170,8 @@ HWY_AFTER_NAMESPACE();
 
 #if HWY_ONCE
 namespace jxl {
-HWY_EXPORT(DrawFromPoints);
+HWY_EXPORT(ComputeSegments);
+HWY_EXPORT(DrawSegments);
 
 namespace {
 
@@ -189,6 +180,14 @@ namespace {
 constexpr size_t kMaxNumControlPoints = 1u << 20u;
 constexpr size_t kMaxNumControlPointsPerPixelRatio = 2;
 
+// The Gaussians are indexed by bands of this many rows of the image.
+constexpr size_t kSplineBandRows = 8;
+// Maximum number of (Gaussian, band) pairs of the draw cache per pixel of the
+// image, and for any image, which limits the memory and the drawing work that
+// the splines of a frame can cause.
+constexpr uint64_t kMaxSegmentIndicesPerPixel = 2;
+constexpr uint64_t kMinMaxSegmentIndices = uint64_t{1} << 20;
+
 // X, Y, B, sigma.
 float ColorQuantizationWeight(const int32_t adjustment, const int channel,
                               const int i) {
@@ -508,6 +507,7 @@ void Splines::Encode(BitWriter* writer, const size_t layer,
 }
 
 Status Splines::Decode(jxl::BitReader* br, size_t num_pixels) {
+  ClearDrawCache();
   std::vector<uint8_t> context_map;
   ANSCode code;
   JXL_RETURN_IF_ERROR(
@@ -545,21 +545,10 @@ Status Splines::Decode(jxl::BitReader* br, size_t num_pixels) {
   return true;
 }
 
-Status Splines::AddTo(Image3F* const opsin, const Rect& opsin_rect,
-                      const Rect& image_rect,
-                      const ColorCorrelationMap& cmap) const {
-  return Apply</*add=*/true>(opsin, opsin_rect, image_rect, cmap);
-}
-
-Status Splines::SubtractFrom(Image3F* const opsin,
-                             const ColorCorrelationMap& cmap) const {
-  return Apply</*add=*/false>(opsin, Rect(*opsin), Rect(*opsin), cmap);
-}
-
-template <bool add>
-Status Splines::Apply(Image3F* const opsin, const Rect& opsin_rect,
-                      const Rect& image_rect,
-                      const ColorCorrelationMap& cmap) const {
+Status Splines::InitializeDrawCache(const size_t image_xsize,
+                                    const size_t image_ysize,
+                                    const ColorCorrelationMap& cmap) {
+  ClearDrawCache();
   for (size_t i = 0; i < splines_.size(); ++i) {
     const Spline spline =
         splines_[i].Dequantize(starting_points_[i], quantization_adjustment_,
@@ -567,6 +556,7 @@ Status Splines::Apply(Image3F* const opsin, const Rect& opsin_rect,
     if (std::adjacent_find(spline.control_points.begin(),
                            spline.control_points.end()) !=
         spline.control_points.end()) {
+      ClearDrawCache();
       return JXL_FAILURE("identical successive control points in spline %zu",
                          i);
     }
@@ -583,12 +573,77 @@ Status Splines::Apply(Image3F* const opsin, const Rect& opsin_rect,
       // This spline wouldn't have any effect.
       continue;
     }
-    HWY_DYNAMIC_DISPATCH(DrawFromPoints)
-    (opsin, opsin_rect, image_rect, spline, add, points_to_draw, arc_length);
+    HWY_DYNAMIC_DISPATCH(ComputeSegments)
+    (spline, points_to_draw, arc_length, image_xsize, image_ysize, &segments_);
+  }
+
+  // Counting sort of the segments by band of rows, which keeps the order in
+  // which they are drawn within each band.
+  const size_t num_bands = DivCeil(image_ysize, kSplineBandRows);
+  // The indices and band starts are 32-bit.
+  const uint64_t max_segment_indices = std::min<uint64_t>(
+      std::max(kMaxSegmentIndicesPerPixel * image_xsize * image_ysize,
+               kMinMaxSegmentIndices),
+      std::numeric_limits<uint32_t>::max());
+  uint64_t num_segment_indices = 0;
+  segment_band_start_.assign(num_bands + 1, 0);
+  for (const SplineSegment& segment : segments_) {
+    const size_t band_begin = segment.ybegin / kSplineBandRows;
+    const size_t band_end = segment.yend / kSplineBandRows;
+    num_segment_indices += band_end + 1 - band_begin;
+    for (size_t band = band_begin; band <= band_end; ++band) {
+      ++segment_band_start_[band + 1];
+    }
+  }
+  if (num_segment_indices > max_segment_indices) {
+    ClearDrawCache();
+    return JXL_FAILURE("Too many spline segments for the image size");
+  }
+  for (size_t band = 0; band < num_bands; ++band) {
+    segment_band_start_[band + 1] += segment_band_start_[band];
+  }
+  segment_indices_.resize(num_segment_indices);
+  std::vector<uint32_t> segment_band_pos(segment_band_start_.begin(),
+                                         segment_band_start_.end() - 1);
+  for (size_t i = 0; i < segments_.size(); ++i) {
+    const size_t band_begin = segments_[i].ybegin / kSplineBandRows;
+    const size_t band_end = segments_[i].yend / kSplineBandRows;
+    for (size_t band = band_begin; band <= band_end; ++band) {
+      segment_indices_[segment_band_pos[band]++] = i;
+    }
   }
   return true;
 }
 
+void Splines::AddTo(Image3F* const opsin, const Rect& opsin_rect,
+                    const Rect& image_rect) const {
+  Apply</*add=*/true>(opsin, opsin_rect, image_rect);
+}
+
+void Splines::SubtractFrom(Image3F* const opsin) const {
+  Apply</*add=*/false>(opsin, Rect(*opsin), Rect(*opsin));
+}
+
+template <bool add>
+void Splines::Apply(Image3F* const opsin, const Rect& opsin_rect,
+                    const Rect& image_rect) const {
+  if (segments_.empty()) return;
+  for (size_t iy = 0; iy < image_rect.ysize(); ++iy) {
+    const size_t y = image_rect.y0() + iy;
+    const size_t band = y / kSplineBandRows;
+    // Rows outside of the image passed to InitializeDrawCache.
+    if (band + 1 >= segment_band_start_.size()) break;
+    const size_t begin = segment_band_start_[band];
+    const size_t end = segment_band_start_[band + 1];
+    if (begin == end) continue;
+    HWY_DYNAMIC_DISPATCH(DrawSegments)
+    (opsin_rect.PlaneRow(opsin, 0, iy), opsin_rect.PlaneRow(opsin, 1, iy),
+     opsin_rect.PlaneRow(opsin, 2, iy), y, image_rect.x0(),
+     image_rect.x0() + image_rect.xsize(), add, segments_.data(),
+     segment_indices_.data() + begin, end - begin);
+  }
+}
+
 Splines FindSplines(const Image3F& opsin) {
   // TODO: implement spline detection.
   return {};
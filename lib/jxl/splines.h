@@ -54,6 +54,17 @@ struct Spline {
   float sigma_dct[32];
 };
 
+// One of the Gaussians that are splatted along a spline to draw it.
+struct SplineSegment {
+  Spline::Point center;
+  float inv_sigma;
+  float sigma_over_4_times_intensity;
+  float color[3];
+  // Pixels of the image that the Gaussian is drawn on, both ends included.
+  size_t xbegin, xend;
+  size_t ybegin, yend;
+};
+
 class QuantizedSpline {
  public:
   QuantizedSpline() = default;
@@ -95,9 +106,17 @@ class Splines {
               const HistogramParams& histogram_params, AuxOut* aux_out) const;
   Status Decode(BitReader* br, size_t num_pixels);
 
-  Status AddTo(Image3F* opsin, const Rect& opsin_rect, const Rect& image_rect,
-               const ColorCorrelationMap& cmap) const;
-  Status SubtractFrom(Image3F* opsin, const ColorCorrelationMap& cmap) const;
+  // Computes the Gaussians that draw the splines on an image of the given
+  // size, and indexes them by the bands of rows of the image that they touch,
+  // so that drawing a rect only visits the Gaussians that overlap its bands.
+  // Fails if the index would be too large for the image. Must be called before
+  // AddTo or SubtractFrom, once the splines and `cmap` are known.
+  Status InitializeDrawCache(size_t image_xsize, size_t image_ysize,
+                             const ColorCorrelationMap& cmap);
+
+  void AddTo(Image3F* opsin, const Rect& opsin_rect,
+             const Rect& image_rect) const;
+  void SubtractFrom(Image3F* opsin) const;
 
   const std::vector<QuantizedSpline>& TestOnlyQuantizedSplines() const {
     return splines_;
@@ -108,8 +127,14 @@ class Splines {
 
  private:
   template <bool>
-  Status Apply(Image3F* opsin, const Rect& opsin_rect, const Rect& image_rect,
-               const ColorCorrelationMap& cmap) const;
+  void Apply(Image3F* opsin, const Rect& opsin_rect,
+             const Rect& image_rect) const;
+
+  void ClearDrawCache() {
+    segments_.clear();
+    segment_indices_.clear();
+    segment_band_start_.clear();
+  }
 
   // If positive, quantization weights are multiplied by 1 + this/8, which
   // increases precision. If negative, they are divided by 1 - this/8. If 0,
@@ -117,6 +142,14 @@ class Splines {
   int32_t quantization_adjustment_ = 0;
   std::vector<QuantizedSpline> splines_;
   std::vector<Spline::Point> starting_points_;
+
+  // Draw cache, see InitializeDrawCache. The segments that touch band b of 8
+  // rows of the image, in the order in which they are drawn, are those whose
+  // indices are segment_indices_[segment_band_start_[b]] to
+  // segment_indices_[segment_band_start_[b + 1] - 1].
+  std::vector<SplineSegment> segments_;
+  std::vector<uint32_t> segment_indices_;
+  std::vector<uint32_t> segment_band_start_;
 };
 
 Splines FindSplines(const Image3F& opsin);
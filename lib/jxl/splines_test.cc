@@ -14,10 +14,18 @@
 
 #include "lib/jxl/splines.h"
 
+#include <stdio.h>
+#include <string.h>
+
+#include <cmath>
+#include <random>
+
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "lib/extras/codec.h"
+#include "lib/jxl/base/os_specific.h"
 #include "lib/jxl/enc_butteraugli_comparator.h"
+#include "lib/jxl/filters.h"
 #include "lib/jxl/image_test_utils.h"
 #include "lib/jxl/testdata.h"
 
@@ -274,7 +282,33 @@ TEST(SplinesTest, DuplicatePoints) {
 
   Image3F image(320, 320);
   ZeroFillImage(&image);
-  EXPECT_FALSE(splines.AddTo(&image, Rect(image), Rect(image), *cmap));
+  EXPECT_FALSE(
+      splines.InitializeDrawCache(image.xsize(), image.ysize(), *cmap));
+}
+
+#ifdef JXL_CRASH_ON_ERROR
+TEST(SplinesTest, DISABLED_TooManySegments) {
+#else
+TEST(SplinesTest, TooManySegments) {
+#endif
+  // A wide spline that goes back and forth across a small image, so that
+  // each of its many Gaussians covers all the rows of the image.
+  std::vector<Spline::Point> control_points;
+  for (size_t i = 0; i < 5000; ++i) {
+    control_points.push_back(i % 2 == 0 ? Spline::Point{1.f, 1.f}
+                                        : Spline::Point{60.f, 60.f});
+  }
+  Spline spline{control_points,
+                /*color_dct=*/
+                {{1.f, 0.2f, 0.1f}, {35.7f, 10.3f}, {35.7f, 7.8f}},
+                /*sigma_dct=*/{40.f, 0.f, 0.f, 0.f}};
+  std::vector<QuantizedSpline> quantized_splines;
+  quantized_splines.emplace_back(spline, kQuantizationAdjustment, kYToX,
+                                 kYToB);
+  std::vector<Spline::Point> starting_points{spline.control_points.front()};
+  Splines splines(kQuantizationAdjustment, std::move(quantized_splines),
+                  std::move(starting_points));
+  EXPECT_FALSE(splines.InitializeDrawCache(64, 64, *cmap));
 }
 
 TEST(SplinesTest, Drawing) {
@@ -303,7 +337,8 @@ TEST(SplinesTest, Drawing) {
 
   Image3F image(320, 320);
   ZeroFillImage(&image);
-  ASSERT_TRUE(splines.AddTo(&image, Rect(image), Rect(image), *cmap));
+  ASSERT_TRUE(splines.InitializeDrawCache(image.xsize(), image.ysize(), *cmap));
+  splines.AddTo(&image, Rect(image), Rect(image));
 
   OpsinParams opsin_params{};
   opsin_params.Init(kDefaultIntensityTarget);
@@ -317,4 +352,101 @@ TEST(SplinesTest, Drawing) {
                       1e-2f, 1e-1f);
 }
 
+// Splines with random control points, not too close to each other.
+Splines RandomSplines(size_t num_splines, size_t xsize, size_t ysize,
+                      std::mt19937* rng) {
+  std::uniform_int_distribution<int> dist_x(0, xsize - 1);
+  std::uniform_int_distribution<int> dist_y(0, ysize - 1);
+  std::uniform_int_distribution<int> dist_num_points(2, 6);
+  std::vector<QuantizedSpline> quantized_splines;
+  std::vector<Spline::Point> starting_points;
+  for (size_t i = 0; i < num_splines; ++i) {
+    std::vector<Spline::Point> control_points;
+    const int num_points = dist_num_points(*rng);
+    while (control_points.size() < static_cast<size_t>(num_points)) {
+      const Spline::Point point(dist_x(*rng), dist_y(*rng));
+      if (!control_points.empty() &&
+          std::hypot(point.x - control_points.back().x,
+                     point.y - control_points.back().y) < 4) {
+        continue;
+      }
+      control_points.push_back(point);
+    }
+    const Spline spline{
+        control_points,
+        /*color_dct=*/
+        {{0.03125f, 0.00625f, 0.003125f}, {1.f, 0.321875f}, {1.f, 0.24375f}},
+        /*sigma_dct=*/{0.3125f, 0.f, 0.f, 0.0625f}};
+    quantized_splines.emplace_back(spline, kQuantizationAdjustment, kYToX,
+                                   kYToB);
+    starting_points.push_back(spline.control_points.front());
+  }
+  return Splines(kQuantizationAdjustment, std::move(quantized_splines),
+                 std::move(starting_points));
+}
+
+// Draws the splines one row of at most tile_dim pixels at a time, through a
+// separate image for the row, as the decoder does.
+void DrawInTiles(const Splines& splines, size_t tile_dim, Image3F* image) {
+  Image3F tile(tile_dim, 1);
+  for (size_t y = 0; y < image->ysize(); ++y) {
+    for (size_t x = 0; x < image->xsize(); x += tile_dim) {
+      const Rect image_rect(x, y, tile_dim, 1, image->xsize(), image->ysize());
+      const Rect tile_rect(0, 0, image_rect.xsize(), 1);
+      for (size_t c = 0; c < 3; ++c) {
+        memcpy(tile_rect.PlaneRow(&tile, c, 0),
+               image_rect.ConstPlaneRow(*image, c, 0),
+               image_rect.xsize() * sizeof(float));
+      }
+      splines.AddTo(&tile, tile_rect, image_rect);
+      for (size_t c = 0; c < 3; ++c) {
+        memcpy(image_rect.PlaneRow(image, c, 0),
+               tile_rect.ConstPlaneRow(tile, c, 0),
+               image_rect.xsize() * sizeof(float));
+      }
+    }
+  }
+}
+
+TEST(SplinesTest, DrawingInTiles) {
+  std::mt19937 rng(1234);
+  const size_t kXSize = 500;
+  const size_t kYSize = 300;
+  Splines splines = RandomSplines(50, kXSize, kYSize, &rng);
+  ASSERT_TRUE(splines.InitializeDrawCache(kXSize, kYSize, *cmap));
+
+  Image3F expected(kXSize, kYSize);
+  ZeroFillImage(&expected);
+  splines.AddTo(&expected, Rect(expected), Rect(expected));
+
+  Image3F actual(kXSize, kYSize);
+  ZeroFillImage(&actual);
+  DrawInTiles(splines, 256, &actual);
+  VerifyEqual(expected, actual);
+
+  // Subtracting the splines again gives back an image that is almost zero.
+  splines.SubtractFrom(&actual);
+  Image3F zero(kXSize, kYSize);
+  ZeroFillImage(&zero);
+  VerifyRelativeError(zero, actual, 1e-5f, 1e-5f);
+}
+
+TEST(SplinesTest, DISABLED_DrawingBenchmark) {
+  std::mt19937 rng(1234);
+  const size_t kXSize = 2048;
+  const size_t kYSize = 2048;
+  for (size_t num_splines : {10, 100, 1000}) {
+    Splines splines = RandomSplines(num_splines, kXSize, kYSize, &rng);
+    Image3F image(kXSize, kYSize);
+    ZeroFillImage(&image);
+    const double t0 = Now();
+    ASSERT_TRUE(splines.InitializeDrawCache(kXSize, kYSize, *cmap));
+    const double t1 = Now();
+    DrawInTiles(splines, kApplyImageFeaturesTileDim, &image);
+    const double t2 = Now();
+    printf("%4zu splines: init %7.2f ms, drawing %7.2f MP/s\n", num_splines,
+           (t1 - t0) * 1E3, kXSize * kYSize * 1E-6 / (t2 - t1));
+  }
+}
+
 }  // namespace jxl
@@ -77,7 +77,69 @@ class Xorshift128Plus {
 #endif
   }
 
+  // Advances the state as if Fill had been called num_fills times. The
+  // generator is linear over GF(2), so the state after n steps is P(T) applied
+  // to the current state, where T is the transition matrix and P is x^n modulo
+  // the characteristic polynomial of T. Takes about 128 calls to Fill for any
+  // large num_fills.
+  HWY_MAYBE_UNUSED void Skip(uint64_t num_fills) {
+    HWY_ALIGN uint64_t batch[N];
+    if (num_fills < 128) {
+      for (uint64_t i = 0; i < num_fills; ++i) Fill(batch);
+      return;
+    }
+    // x^num_fills mod the characteristic polynomial, by square-and-multiply.
+    uint64_t poly[2] = {1, 0};
+    for (int bit = 63; bit >= 0; --bit) {
+      const uint64_t square[2] = {poly[0], poly[1]};
+      MulMod(square, poly);
+      if ((num_fills >> bit) & 1) MulX(poly);
+    }
+    HWY_ALIGN uint64_t s0[N] = {0};
+    HWY_ALIGN uint64_t s1[N] = {0};
+    for (size_t bit = 0; bit < 128; ++bit) {
+      if ((poly[bit / 64] >> (bit % 64)) & 1) {
+        for (size_t i = 0; i < N; ++i) {
+          s0[i] ^= s0_[i];
+          s1[i] ^= s1_[i];
+        }
+      }
+      Fill(batch);
+    }
+    for (size_t i = 0; i < N; ++i) {
+      s0_[i] = s0[i];
+      s1_[i] = s1[i];
+    }
+  }
+
  private:
+  // Multiplies the polynomial (over GF(2), of degree < 128) by x, modulo the
+  // characteristic polynomial of the state transition, which is x^128 plus the
+  // polynomial whose coefficients are the bits of the constants below.
+  static void MulX(uint64_t* HWY_RESTRICT poly) {
+    const uint64_t carry = poly[1] >> 63;
+    poly[1] = (poly[1] << 1) | (poly[0] >> 63);
+    poly[0] <<= 1;
+    if (carry) {
+      poly[0] ^= 0x024F06FAE9E61DAFull;
+      poly[1] ^= 0x2844C5D42CAF7DB0ull;
+    }
+  }
+
+  // Sets *poly to a * poly modulo the characteristic polynomial.
+  static void MulMod(const uint64_t* HWY_RESTRICT a, uint64_t* poly) {
+    uint64_t product[2] = {0, 0};
+    for (int bit = 127; bit >= 0; --bit) {
+      MulX(product);
+      if ((a[bit / 64] >> (bit % 64)) & 1) {
+        product[0] ^= poly[0];
+        product[1] ^= poly[1];
+      }
+    }
+    poly[0] = product[0];
+    poly[1] = product[1];
+  }
+
   static uint64_t SplitMix64(uint64_t z) {
     z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
     z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
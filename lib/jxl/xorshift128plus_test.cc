@@ -269,6 +269,26 @@ void TestGolden() {
   }
 }
 
+// Skip(n) is equivalent to n calls to Fill.
+void TestSkip() {
+  HWY_ALIGN uint64_t expected[Xorshift128Plus::N];
+  HWY_ALIGN uint64_t actual[Xorshift128Plus::N];
+  for (uint64_t num_fills : {0, 1, 127, 128, 129, 1000, 4353, 65536}) {
+    HWY_ALIGN Xorshift128Plus filled(num_fills);
+    HWY_ALIGN Xorshift128Plus skipped(num_fills);
+    for (uint64_t i = 0; i < num_fills; ++i) filled.Fill(expected);
+    skipped.Skip(num_fills);
+    for (size_t vector = 0; vector < 4; ++vector) {
+      filled.Fill(expected);
+      skipped.Fill(actual);
+      for (size_t i = 0; i < Xorshift128Plus::N; ++i) {
+        ASSERT_EQ(expected[i], actual[i])
+            << "Where num_fills=" << num_fills << " i=" << i;
+      }
+    }
+  }
+}
+
 // Output changes when given different seeds
 void TestSeedChanges() {
   HWY_ALIGN uint64_t lanes[Xorshift128Plus::N];
@@ -374,6 +394,7 @@ HWY_TARGET_INSTANTIATE_TEST_SUITE_P(Xorshift128Test);
 
 HWY_EXPORT_AND_TEST_P(Xorshift128Test, TestNotZero);
 HWY_EXPORT_AND_TEST_P(Xorshift128Test, TestGolden);
+HWY_EXPORT_AND_TEST_P(Xorshift128Test, TestSkip);
 HWY_EXPORT_AND_TEST_P(Xorshift128Test, TestSeedChanges);
 HWY_EXPORT_AND_TEST_P(Xorshift128Test, TestFloat);
 
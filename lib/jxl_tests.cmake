@@ -30,6 +30,7 @@ set(TEST_FILES
   jxl/convolve_test.cc
   jxl/data_parallel_test.cc
   jxl/dct_test.cc
+  jxl/dec_noise_test.cc
   jxl/decode_test.cc
   jxl/descriptive_statistics_test.cc
   jxl/encode_test.cc